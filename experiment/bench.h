@@ -0,0 +1,48 @@
+#ifndef Z_EXPERIMENT_BENCH_H__
+#define Z_EXPERIMENT_BENCH_H__
+
+/**
+ * @brief Tiny helpers shared by the benchmarks in experiment/.
+ */
+
+#include "tm.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <x86intrin.h>
+
+namespace z {
+namespace bench {
+;
+
+inline uint64_t cycles() {
+    return __rdtsc();
+}
+
+inline uint64_t now_ns() {
+    ztime_t t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return uint64_t(t.tv_sec) * 1000000000ull + uint64_t(t.tv_nsec);
+}
+
+/// keep the optimizer from dropping a computed value
+template <typename T>
+inline void keep(const T &v) {
+    asm volatile("" : : "r,m"(v) : "memory");
+}
+
+/// xorshift64*, deterministic keys for every run
+struct Rand {
+    uint64_t s;
+    explicit Rand(uint64_t seed = 0x9E3779B97F4A7C15ull) : s(seed | 1) {}
+    uint64_t next() {
+        s ^= s >> 12;
+        s ^= s << 25;
+        s ^= s >> 27;
+        return s * 2685821657736338717ull;
+    }
+};
+
+} // namespace bench
+} // namespace z
+
+#endif
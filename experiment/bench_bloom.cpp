@@ -0,0 +1,89 @@
+/**
+ * @brief BloomFilter against BlockedBloomFilter. Bits per key and the
+ *        measured false positive rate for a range of targets, then ns per
+ *        add, per query of a present key and of an absent key with a filter
+ *        far larger than the cache (8-byte keys, hashing included).
+ *
+ * usage: bench_bloom [keys] [queries]
+ */
+
+#include "experiment/bench.h"
+#include "algo_bloom.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace z;
+using namespace z::bench;
+
+template <typename Filter>
+static void rate_run(const char *name, double target, uint64_t n, uint64_t probes) {
+    Filter f;
+    f.init(n, target);
+    for (uint64_t i = 0; i < n; ++i) {
+        f.add(&i, sizeof(i) );
+    }
+    uint64_t hits = 0;
+    for (uint64_t i = n; i < n + probes; ++i) {
+        hits += f.contains(&i, sizeof(i) ) ? 1 : 0;
+    }
+    printf("%-10s %10.4f%% %10.2f %10u %10.4f%%\n", name, target * 100, double(f.bits() ) / n,
+        f.k(), double(hits) / probes * 100);
+}
+
+template <typename Filter>
+static void speed_run(const char *name, const std::vector<uint64_t> &keys, const std::vector<uint64_t> &absent) {
+    Filter f;
+    f.init(keys.size(), 0.01);
+
+    uint64_t begin = now_ns();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        f.add(&keys[i], sizeof(keys[i]) );
+    }
+    double add_ns = double(now_ns() - begin) / keys.size();
+
+    uint64_t hits = 0;
+    begin = now_ns();
+    for (size_t i = 0; i < absent.size(); ++i) {
+        hits += f.contains(&keys[i], sizeof(keys[i]) ) ? 1 : 0;
+    }
+    double hit_ns = double(now_ns() - begin) / absent.size();
+
+    begin = now_ns();
+    for (size_t i = 0; i < absent.size(); ++i) {
+        hits += f.contains(&absent[i], sizeof(absent[i]) ) ? 1 : 0;
+    }
+    double miss_ns = double(now_ns() - begin) / absent.size();
+    keep(hits);
+
+    printf("%-10s %10.1f %10.1f %10.1f %10.1f\n", name, f.bits() / 8.0 / 1048576.0, add_ns, hit_ns, miss_ns);
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t n = (argc > 1) ? atoll(argv[1]) : 10000000;
+    uint64_t queries = (argc > 2) ? atoll(argv[2]) : 5000000;
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("%u online cpus\n", uint32_t(sysconf(_SC_NPROCESSORS_ONLN) ) );
+    printf("\n1M keys, 2M absent probes\n%-10s %11s %10s %10s %11s\n", "", "target", "bits/key", "k", "measured");
+    const double targets[] = {0.1, 0.01, 0.001, 0.0001};
+    for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]); ++t) {
+        rate_run<BloomFilter>("standard", targets[t], 1000000, 2000000);
+        rate_run<BlockedBloomFilter>("blocked", targets[t], 1000000, 2000000);
+    }
+
+    Rand r;
+    std::vector<uint64_t> keys(n);
+    for (uint64_t i = 0; i < n; ++i) {
+        keys[i] = r.next();
+    }
+    std::vector<uint64_t> absent(queries < n ? queries : n);
+    for (size_t i = 0; i < absent.size(); ++i) {
+        absent[i] = r.next();
+    }
+    printf("\n%lu keys at 1%%, ns per op\n%-10s %10s %10s %10s %10s\n", n, "", "MB", "add", "present", "absent");
+    speed_run<BloomFilter>("standard", keys, absent);
+    speed_run<BlockedBloomFilter>("blocked", keys, absent);
+
+    return 0;
+}
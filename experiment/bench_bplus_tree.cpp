@@ -0,0 +1,171 @@
+/**
+ * @brief BPlusTree against std::map with n random 64-bit keys: ns per
+ *        insert (random order, and the bulk load of sorted keys), per
+ *        random point lookup, per key of 100 key range scans and of a full
+ *        scan, plus the heap in use, for node sizes of 256B to 4KB.
+ *
+ * usage: bench_bplus_tree [keys] [lookups]
+ */
+
+#include "experiment/bench.h"
+#include "algo_ds.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <malloc.h>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+using namespace z;
+using namespace z::bench;
+
+/// the heap in use, freed memory kept by malloc would hide in the RSS
+static double heap_mb() {
+    return double(mallinfo2().uordblks) / 1048576.0;
+}
+
+struct Result {
+    double  insert;
+    double  bulk;
+    double  lookup;
+    double  range;
+    double  scan;
+    double  mb;
+};
+
+static void print(const char *name, const Result &r) {
+    printf("%-16s %10.1f %10.1f %10.1f %10.2f %10.2f %10.1f\n", name,
+        r.insert, r.bulk, r.lookup, r.range, r.scan, r.mb);
+}
+
+template <typename Tree>
+static Result tree_run(const std::vector<uint64_t> &keys, const std::vector<uint64_t> &sorted,
+    const std::vector<uint64_t> &probes) {
+    Result r;
+    double heap0 = heap_mb();
+    Tree *t = new Tree;
+    uint64_t begin = now_ns();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        t->insert(keys[i], i);
+    }
+    r.insert = double(now_ns() - begin) / keys.size();
+    r.mb = heap_mb() - heap0;
+
+    uint64_t v = 0;
+    begin = now_ns();
+    for (size_t i = 0; i < probes.size(); ++i) {
+        t->find(probes[i], &v);
+        keep(v);
+    }
+    r.lookup = double(now_ns() - begin) / probes.size();
+
+    uint64_t visited = 0;
+    begin = now_ns();
+    for (size_t i = 0; i < probes.size() / 10; ++i) {
+        typename Tree::Iterator it = t->lower_bound(probes[i]);
+        for (uint32_t k = 0; k < 100 && it.valid(); ++k, it.next() ) {
+            v += it.value();
+            ++visited;
+        }
+    }
+    keep(v);
+    r.range = double(now_ns() - begin) / visited;
+
+    begin = now_ns();
+    for (typename Tree::Iterator it = t->begin(); it.valid(); it.next() ) {
+        v += it.value();
+    }
+    keep(v);
+    r.scan = double(now_ns() - begin) / keys.size();
+
+    std::vector<uint64_t> values(sorted.size() );
+    begin = now_ns();
+    t->bulk_load(&sorted[0], &values[0], uint32_t(sorted.size() ) );
+    r.bulk = double(now_ns() - begin) / sorted.size();
+    delete t;
+    return r;
+}
+
+static Result map_run(const std::vector<uint64_t> &keys, const std::vector<uint64_t> &sorted,
+    const std::vector<uint64_t> &probes) {
+    Result r;
+    double heap0 = heap_mb();
+    std::map<uint64_t, uint64_t> *m = new std::map<uint64_t, uint64_t>;
+    uint64_t begin = now_ns();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        m->insert(std::make_pair(keys[i], uint64_t(i) ) );
+    }
+    r.insert = double(now_ns() - begin) / keys.size();
+    r.mb = heap_mb() - heap0;
+
+    uint64_t v = 0;
+    begin = now_ns();
+    for (size_t i = 0; i < probes.size(); ++i) {
+        std::map<uint64_t, uint64_t>::iterator it = m->find(probes[i]);
+        keep(it == m->end() ? 0 : it->second);
+    }
+    r.lookup = double(now_ns() - begin) / probes.size();
+
+    uint64_t visited = 0;
+    begin = now_ns();
+    for (size_t i = 0; i < probes.size() / 10; ++i) {
+        std::map<uint64_t, uint64_t>::iterator it = m->lower_bound(probes[i]);
+        for (uint32_t k = 0; k < 100 && it != m->end(); ++k, ++it) {
+            v += it->second;
+            ++visited;
+        }
+    }
+    keep(v);
+    r.range = double(now_ns() - begin) / visited;
+
+    begin = now_ns();
+    for (std::map<uint64_t, uint64_t>::iterator it = m->begin(); it != m->end(); ++it) {
+        v += it->second;
+    }
+    keep(v);
+    r.scan = double(now_ns() - begin) / keys.size();
+
+    // the map's bulk load: inserts with the end as the hint
+    delete m;
+    m = new std::map<uint64_t, uint64_t>;
+    begin = now_ns();
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        m->insert(m->end(), std::make_pair(sorted[i], uint64_t(0) ) );
+    }
+    r.bulk = double(now_ns() - begin) / sorted.size();
+    delete m;
+    return r;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t n = (argc > 1) ? atoi(argv[1]) : 10000000;
+    uint32_t lookups = (argc > 2) ? atoi(argv[2]) : 2000000;
+
+    Rand r;
+    std::vector<uint64_t> keys(n);
+    for (uint32_t i = 0; i < n; ++i) {
+        keys[i] = r.next();
+    }
+    std::vector<uint64_t> sorted(keys);
+    std::sort(sorted.begin(), sorted.end() );
+    sorted.erase(std::unique(sorted.begin(), sorted.end() ), sorted.end() );
+    std::vector<uint64_t> probes(lookups);
+    for (uint32_t i = 0; i < lookups; ++i) {
+        // half hits, half misses
+        probes[i] = (i & 1) ? r.next() : keys[r.next() % n];
+    }
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("%u online cpus, %u keys, %u lookups, ns per op, heap in MB\n",
+        uint32_t(sysconf(_SC_NPROCESSORS_ONLN) ), n, lookups);
+    printf("%-16s %10s %10s %10s %10s %10s %10s\n", "", "insert", "sorted", "lookup",
+        "range/key", "scan/key", "MB");
+    print("std::map", map_run(keys, sorted, probes) );
+    print("bptree 256B", tree_run<BPlusTree<uint64_t, uint64_t, 256> >(keys, sorted, probes) );
+    print("bptree 512B", tree_run<BPlusTree<uint64_t, uint64_t, 512> >(keys, sorted, probes) );
+    print("bptree 1024B", tree_run<BPlusTree<uint64_t, uint64_t, 1024> >(keys, sorted, probes) );
+    print("bptree 2048B", tree_run<BPlusTree<uint64_t, uint64_t, 2048> >(keys, sorted, probes) );
+    print("bptree 4096B", tree_run<BPlusTree<uint64_t, uint64_t, 4096> >(keys, sorted, probes) );
+
+    return 0;
+}
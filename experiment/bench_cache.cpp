@@ -0,0 +1,162 @@
+/**
+ * @brief ZCache against a mutex + std::list + std::unordered_map LRU: ns per
+ *        hit with one thread, then total Mops/s and hit ratio with 1..N
+ *        threads on a skewed key stream (get, put on a miss).
+ *
+ * usage: bench_cache [max_threads] [ops_per_thread] [keys]
+ */
+
+#include "experiment/bench.h"
+#include "algo_cache.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+using namespace z;
+using namespace z::bench;
+
+/// the usual LRU: a hit splices the entry to the front of the list
+class ListLRU {
+public:
+    ListLRU(uint64_t capacity_bytes, uint32_t) : _capacity(capacity_bytes / 16) {}
+
+    bool get(uint64_t key, uint64_t *value) {
+        _lock.lock();
+        std::unordered_map<uint64_t, Iter>::iterator it = _index.find(key);
+        if (it == _index.end() ) {
+            _lock.unlock();
+            return false;
+        }
+        _list.splice(_list.begin(), _list, it->second);
+        *value = it->second->second;
+        _lock.unlock();
+        return true;
+    }
+
+    void put(uint64_t key, uint64_t value) {
+        _lock.lock();
+        std::unordered_map<uint64_t, Iter>::iterator it = _index.find(key);
+        if (it != _index.end() ) {
+            it->second->second = value;
+            _list.splice(_list.begin(), _list, it->second);
+        } else {
+            if (_index.size() >= _capacity) {
+                _index.erase(_list.back().first);
+                _list.pop_back();
+            }
+            _list.push_front(std::make_pair(key, value) );
+            _index[key] = _list.begin();
+        }
+        _lock.unlock();
+    }
+private:
+    typedef std::list<std::pair<uint64_t, uint64_t> >::iterator Iter;
+    uint64_t    _capacity;
+    std::list<std::pair<uint64_t, uint64_t> >   _list;
+    std::unordered_map<uint64_t, Iter>          _index;
+    ZMutexLock  _lock;
+};
+
+typedef ZCache<uint64_t, uint64_t> Cache;
+typedef ZCache<uint64_t, uint64_t, ZMutexLock> MutexCache;
+
+/// a skewed stream: the square of a uniform variable favours low keys
+static uint64_t skewed(Rand *r, uint64_t keys) {
+    uint64_t u = r->next() % 65536;
+    return (u * u * keys) >> 32;
+}
+
+template <typename C>
+static double hit_ns(uint64_t keys) {
+    C c(keys * 16 * 2, 16);
+    for (uint64_t k = 0; k < keys; ++k) {
+        c.put(k, k);
+    }
+    std::vector<uint64_t> order(1 << 16);
+    Rand r;
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = r.next() % keys;
+    }
+    uint64_t v = 0;
+    uint64_t begin = now_ns();
+    const uint32_t ROUNDS = 32;
+    for (uint32_t n = 0; n < ROUNDS; ++n) {
+        for (size_t i = 0; i < order.size(); ++i) {
+            c.get(order[i], &v);
+            keep(v);
+        }
+    }
+    return double(now_ns() - begin) / (ROUNDS * order.size() );
+}
+
+struct Args {
+    void        *cache;
+    uint32_t    ops;
+    uint64_t    keys;
+    uint32_t    seed;
+    uint64_t    hits;
+};
+
+template <typename C>
+static void *worker(void *arg) {
+    Args *a = (Args*)(arg);
+    C *c = (C*)(a->cache);
+    Rand r(a->seed);
+    uint64_t v = 0;
+    for (uint32_t i = 0; i < a->ops; ++i) {
+        uint64_t k = skewed(&r, a->keys);
+        if (c->get(k, &v) ) {
+            ++a->hits;
+        } else {
+            c->put(k, k);
+        }
+    }
+    return nullptr;
+}
+
+template <typename C>
+static double threads_run(uint32_t threads, uint32_t ops, uint64_t keys, double *hit_ratio) {
+    // room for a tenth of the keys
+    C c(keys / 10 * 16, 64);
+    std::vector<pthread_t> ids(threads);
+    std::vector<Args> args(threads);
+    uint64_t begin = now_ns();
+    for (uint32_t i = 0; i < threads; ++i) {
+        Args a = {&c, ops, keys, i + 1, 0};
+        args[i] = a;
+        pthread_create(&ids[i], nullptr, worker<C>, &args[i]);
+    }
+    uint64_t hits = 0;
+    for (uint32_t i = 0; i < threads; ++i) {
+        pthread_join(ids[i], nullptr);
+        hits += args[i].hits;
+    }
+    *hit_ratio = double(hits) / (double(threads) * ops);
+    return double(threads) * ops / double(now_ns() - begin) * 1000.0;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t max_threads = (argc > 1) ? atoi(argv[1]) : 8;
+    uint32_t ops = (argc > 2) ? atoi(argv[2]) : 1000000;
+    uint64_t keys = (argc > 3) ? atoll(argv[3]) : 1000000;
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("%u online cpus, %lu keys\n", uint32_t(sysconf(_SC_NPROCESSORS_ONLN) ), keys);
+    printf("ns per hit, 100K resident keys: zcache %.1f, list lru %.1f\n",
+        hit_ns<Cache>(100000), hit_ns<ListLRU>(100000) );
+
+    printf("\n%-8s %12s %12s %8s %12s %8s   (Mops/s, hit ratio; 10%% of the keys fit)\n",
+        "threads", "zcache", "zcache mtx", "hits", "list lru", "hits");
+    for (uint32_t t = 1; t <= max_threads; t *= 2) {
+        double zh = 0;
+        double lh = 0;
+        double z = threads_run<Cache>(t, ops, keys, &zh);
+        double m = threads_run<MutexCache>(t, ops, keys, &zh);
+        double l = threads_run<ListLRU>(t, ops, keys, &lh);
+        printf("%-8u %12.2f %12.2f %8.3f %12.2f %8.3f\n", t, z, m, zh, l, lh);
+    }
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+/**
+ * @brief ConcurrentHashTable64 against HashTable64 behind one ZSpinLock:
+ *        total Mops/s on 1..64 threads with 90/10 and 50/50 read/write.
+ *
+ * usage: bench_concurrent_hashtable [max_threads] [ops_per_thread]
+ */
+
+#include "experiment/bench.h"
+#include "algo_ds.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <vector>
+
+using namespace z;
+using namespace z::bench;
+
+enum {
+    KEY_SPACE   = 1 << 20,
+};
+
+typedef ConcurrentHashTable64<uint64_t>     Sharded;
+typedef HashTable64<uint64_t, ZSpinLock>    Locked;
+
+struct Args {
+    void        *table;
+    uint32_t    id;
+    uint32_t    write_pct;
+    uint32_t    ops;
+};
+
+template <typename Table>
+static void *worker(void *arg) {
+    Args *a = (Args*)(arg);
+    Table *t = (Table*)(a->table);
+    Rand r(a->id + 1);
+    uint64_t v = 0;
+    for (uint32_t i = 0; i < a->ops; ++i) {
+        uint64_t x = r.next();
+        uint64_t key = x % KEY_SPACE;
+        if ( (x >> 40) % 100 < a->write_pct) {
+            if (x & (1ull << 32) ) {
+                t->update(key, i);
+            } else {
+                t->erase(key);
+            }
+        } else {
+            t->find(key, &v);
+            keep(v);
+        }
+    }
+    return nullptr;
+}
+
+template <typename Table>
+static double run(uint32_t threads, uint32_t write_pct, uint32_t ops) {
+    Table t(KEY_SPACE);
+    for (uint64_t k = 0; k < KEY_SPACE; k += 2) {
+        t.update(k, k);
+    }
+
+    std::vector<pthread_t> ids(threads);
+    std::vector<Args> args(threads);
+    uint64_t begin = now_ns();
+    for (uint32_t i = 0; i < threads; ++i) {
+        args[i].table = &t;
+        args[i].id = i;
+        args[i].write_pct = write_pct;
+        args[i].ops = ops;
+        pthread_create(&ids[i], nullptr, worker<Table>, &args[i]);
+    }
+    for (uint32_t i = 0; i < threads; ++i) {
+        pthread_join(ids[i], nullptr);
+    }
+    double ns = double(now_ns() - begin);
+    return double(threads) * ops / ns * 1000.0;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t max_threads = (argc > 1) ? atoi(argv[1]) : 64;
+    uint32_t ops = (argc > 2) ? atoi(argv[2]) : 200000;
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("%u online cpus, %u ops per thread, Mops/s in total\n",
+        uint32_t(sysconf(_SC_NPROCESSORS_ONLN) ), ops);
+    printf("%-8s %12s %12s %12s %12s\n", "threads", "sharded 90/10", "locked 90/10",
+        "sharded 50/50", "locked 50/50");
+    for (uint32_t n = 1; n <= max_threads; n *= 2) {
+        printf("%-8u %12.2f %12.2f %12.2f %12.2f\n", n,
+            run<Sharded>(n, 10, ops), run<Locked>(n, 10, ops),
+            run<Sharded>(n, 50, ops), run<Locked>(n, 50, ops) );
+    }
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+/**
+ * @brief crc32c() throughput: SSE4.2 interleaved kernel vs slicing-by-8.
+ *
+ * usage: bench_crc [max_bytes]
+ */
+
+#include "experiment/bench.h"
+#include "algo_crc.h"
+#include <stdlib.h>
+#include <vector>
+
+using namespace z;
+using namespace z::bench;
+
+typedef uint32_t (*crc_func_t)(const void *data, size_t size, uint32_t crc);
+
+static double gbps(crc_func_t f, const char *buf, size_t size) {
+    uint32_t rounds = 1;
+    for (;;) {
+        uint64_t begin = now_ns();
+        uint32_t crc = 0;
+        for (uint32_t i = 0; i < rounds; ++i) {
+            crc = f(buf, size, crc);
+        }
+        uint64_t ns = now_ns() - begin;
+        keep(crc);
+        if (ns > 20 * 1000 * 1000) {
+            return double(size) * rounds / ns;
+        }
+        rounds *= 2;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_size = (argc > 1) ? atol(argv[1]) : 4 * 1024 * 1024;
+    std::vector<char> buf(max_size);
+    Rand r;
+    for (size_t i = 0; i < buf.size(); ++i) {
+        buf[i] = char(r.next() );
+    }
+
+    printf("hw available: %d\n", int(crc32c_hw_available() ) );
+    printf("%-10s %12s %12s\n", "bytes", "hw(GB/s)", "sw(GB/s)");
+    for (size_t size = 64; size <= max_size; size *= 4) {
+        double hw = crc32c_hw_available() ? gbps(crc32c_hw, &buf[0], size) : 0;
+        printf("%-10lu %12.2f %12.2f\n", size, hw, gbps(crc32c_sw, &buf[0], size) );
+    }
+
+    return 0;
+}
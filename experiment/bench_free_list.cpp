@@ -0,0 +1,89 @@
+/**
+ * @brief StaticLinkedList allocate()/release(): total Mops/s with 1..N threads,
+ *        each taking a burst of items and giving them back. ZSpinLock against
+ *        the lock-free stack, without and with per-thread magazines.
+ *
+ * usage: bench_free_list [max_threads] [ops_per_thread] [burst]
+ */
+
+#include "experiment/bench.h"
+#include "algo_ds.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <vector>
+
+using namespace z;
+using namespace z::bench;
+
+typedef StaticLinkedList<uint64_t, ZSpinLock>   Locked;
+typedef StaticLinkedList<uint64_t, ZLockFree>   LockFree;
+
+enum {
+    MAX_BURST   = 256,
+    MAGAZINE    = 32,
+};
+
+struct Args {
+    void        *list;
+    uint32_t    ops;
+    uint32_t    burst;
+};
+
+template <typename List>
+static void *worker(void *arg) {
+    Args *a = (Args*)(arg);
+    List *l = (List*)(a->list);
+    uint64_t *held[MAX_BURST];
+    for (uint32_t done = 0; done < a->ops; done += a->burst) {
+        uint32_t n = 0;
+        for (; n < a->burst; ++n) {
+            held[n] = l->allocate();
+            if (!held[n]) {
+                break;
+            }
+            *held[n] = done;
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            l->release(held[i]);
+        }
+    }
+    return nullptr;
+}
+
+template <typename List>
+static double run(List *l, uint32_t threads, uint32_t ops, uint32_t burst) {
+    Args args = {l, ops, burst};
+    std::vector<pthread_t> ids(threads);
+    uint64_t begin = now_ns();
+    for (uint32_t i = 0; i < threads; ++i) {
+        pthread_create(&ids[i], nullptr, worker<List>, &args);
+    }
+    for (uint32_t i = 0; i < threads; ++i) {
+        pthread_join(ids[i], nullptr);
+    }
+    // an allocate and a release per op
+    return 2.0 * threads * ops / double(now_ns() - begin) * 1000.0;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t max_threads = (argc > 1) ? atoi(argv[1]) : 16;
+    uint32_t ops = (argc > 2) ? atoi(argv[2]) : 2000000;
+    uint32_t burst = (argc > 3) ? atoi(argv[3]) : 8;
+    burst = (burst > MAX_BURST) ? uint32_t(MAX_BURST) : (burst ? burst : 1);
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("%u online cpus, %u ops per thread, burst %u, Mops/s in total\n",
+        uint32_t(sysconf(_SC_NPROCESSORS_ONLN) ), ops, burst);
+    printf("%-8s %10s %10s %10s\n", "threads", "spinlock", "lockfree", "magazine");
+    for (uint32_t n = 1; n <= max_threads; n *= 2) {
+        uint32_t items = n * burst * 2;
+        Locked locked(items);
+        LockFree lock_free(items);
+        LockFree magazine(items, MAGAZINE);
+        printf("%-8u %10.2f %10.2f %10.2f\n", n, run(&locked, n, ops, burst),
+            run(&lock_free, n, ops, burst), run(&magazine, n, ops, burst) );
+    }
+
+    return 0;
+}
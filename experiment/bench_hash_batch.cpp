@@ -0,0 +1,88 @@
+/**
+ * @brief hash_bytes64_batch() and hash_int64_batch() against hashing the
+ *        same keys one at a time.
+ *
+ * usage: bench_hash_batch [keys_per_round]
+ */
+
+#include "experiment/bench.h"
+#include "algo_hash.h"
+#include <stdlib.h>
+#include <vector>
+
+using namespace z;
+using namespace z::bench;
+
+enum {
+    ROUNDS = 200,
+};
+
+__attribute__((noinline))
+static void per_key(const void *const keys[], const uint32_t lens[], uint64_t out[], uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i) {
+        out[i] = hash_bytes64(keys[i], lens[i]);
+    }
+}
+
+__attribute__((noinline))
+static void per_key_int(const uint64_t keys[], uint64_t out[], uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i) {
+        out[i] = hash_int64(keys[i]);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t n = (argc > 1) ? atoi(argv[1]) : 64 * 1024;
+    Rand r;
+
+    std::vector<char> pool(n * 64 + 64);
+    for (size_t i = 0; i < pool.size(); ++i) {
+        pool[i] = char(r.next() );
+    }
+    std::vector<const void*> keys(n);
+    std::vector<uint32_t> lens(n);
+    std::vector<uint64_t> ikeys(n);
+    std::vector<uint64_t> out(n);
+    for (uint32_t i = 0; i < n; ++i) {
+        // scattered keys, like a batch of lookups
+        keys[i] = &pool[(r.next() % n) * 64];
+        ikeys[i] = r.next();
+    }
+
+    printf("%-10s %16s %16s\n", "key bytes", "per-key(cyc)", "batch(cyc)");
+    const uint32_t sizes[] = {8, 16, 32, 64};
+    for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        for (uint32_t i = 0; i < n; ++i) {
+            lens[i] = sizes[s];
+        }
+
+        uint64_t c0 = cycles();
+        for (uint32_t k = 0; k < ROUNDS; ++k) {
+            per_key(&keys[0], &lens[0], &out[0], n);
+        }
+        uint64_t c1 = cycles();
+        for (uint32_t k = 0; k < ROUNDS; ++k) {
+            hash_bytes64_batch(&keys[0], &lens[0], &out[0], n);
+        }
+        uint64_t c2 = cycles();
+        keep(out[n / 2]);
+
+        printf("%-10u %16.2f %16.2f\n", sizes[s],
+            double(c1 - c0) / ROUNDS / n, double(c2 - c1) / ROUNDS / n);
+    }
+
+    uint64_t c0 = cycles();
+    for (uint32_t k = 0; k < ROUNDS; ++k) {
+        per_key_int(&ikeys[0], &out[0], n);
+    }
+    uint64_t c1 = cycles();
+    for (uint32_t k = 0; k < ROUNDS; ++k) {
+        hash_int64_batch(&ikeys[0], &out[0], n);
+    }
+    uint64_t c2 = cycles();
+    keep(out[n / 2]);
+    printf("%-10s %16.2f %16.2f\n", "uint64",
+        double(c1 - c0) / ROUNDS / n, double(c2 - c1) / ROUNDS / n);
+
+    return 0;
+}
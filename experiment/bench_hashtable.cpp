@@ -0,0 +1,121 @@
+/**
+ * @brief HashTable64 against std::unordered_map: ns per insert, hit, miss
+ *        and erase as the table grows out of the caches.
+ *
+ * usage: bench_hashtable [max_entries]    (default 10M, 100M needs ~8GB)
+ */
+
+#include "experiment/bench.h"
+#include "algo_ds.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+using namespace z;
+using namespace z::bench;
+
+struct Result {
+    double insert;
+    double hit;
+    double miss;
+    double erase;
+};
+
+static double per_op(uint64_t begin, size_t n) {
+    return double(now_ns() - begin) / double(n);
+}
+
+static Result run_z(const std::vector<uint64_t> &keys, const std::vector<uint64_t> &hits,
+                    const std::vector<uint64_t> &misses) {
+    Result r;
+    HashTable64<uint64_t> t;
+    uint64_t v = 0;
+
+    uint64_t begin = now_ns();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        t.insert(keys[i], i);
+    }
+    r.insert = per_op(begin, keys.size() );
+
+    begin = now_ns();
+    for (size_t i = 0; i < hits.size(); ++i) {
+        t.find(hits[i], &v);
+        keep(v);
+    }
+    r.hit = per_op(begin, hits.size() );
+
+    begin = now_ns();
+    for (size_t i = 0; i < misses.size(); ++i) {
+        keep(t.find(misses[i]) );
+    }
+    r.miss = per_op(begin, misses.size() );
+
+    begin = now_ns();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        t.erase(keys[i]);
+    }
+    r.erase = per_op(begin, keys.size() );
+    return r;
+}
+
+static Result run_std(const std::vector<uint64_t> &keys, const std::vector<uint64_t> &hits,
+                      const std::vector<uint64_t> &misses) {
+    Result r;
+    std::unordered_map<uint64_t, uint64_t> t;
+
+    uint64_t begin = now_ns();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        t.emplace(keys[i], i);
+    }
+    r.insert = per_op(begin, keys.size() );
+
+    begin = now_ns();
+    for (size_t i = 0; i < hits.size(); ++i) {
+        keep(t.find(hits[i])->second);
+    }
+    r.hit = per_op(begin, hits.size() );
+
+    begin = now_ns();
+    for (size_t i = 0; i < misses.size(); ++i) {
+        keep(t.find(misses[i]) == t.end() );
+    }
+    r.miss = per_op(begin, misses.size() );
+
+    begin = now_ns();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        t.erase(keys[i]);
+    }
+    r.erase = per_op(begin, keys.size() );
+    return r;
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_n = (argc > 1) ? strtoull(argv[1], nullptr, 10) : 10 * 1000 * 1000;
+
+    printf("%-10s %-6s %8s %8s %8s %8s   (ns/op)\n", "entries", "table", "insert", "hit", "miss", "erase");
+    for (size_t n = 1000; n <= max_n; n *= 10) {
+        std::vector<uint64_t> keys(n);
+        std::vector<uint64_t> misses(n);
+        Rand rnd(n);
+        for (size_t i = 0; i < n; ++i) {
+            keys[i] = rnd.next() | 1;
+            misses[i] = rnd.next() & ~1ull;
+        }
+
+        // look up in an order unrelated to insertion, node allocators
+        // otherwise hand std a sequential walk through memory
+        std::vector<uint64_t> hits(keys);
+        for (size_t i = n - 1; i > 0; --i) {
+            std::swap(hits[i], hits[rnd.next() % (i + 1)]);
+        }
+
+        Result a = run_z(keys, hits, misses);
+        Result b = run_std(keys, hits, misses);
+        printf("%-10zu %-6s %8.1f %8.1f %8.1f %8.1f\n", n, "z", a.insert, a.hit, a.miss, a.erase);
+        printf("%-10s %-6s %8.1f %8.1f %8.1f %8.1f\n", "", "std", b.insert, b.hit, b.miss, b.erase);
+    }
+
+    return 0;
+}
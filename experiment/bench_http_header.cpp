@@ -0,0 +1,121 @@
+/**
+ * @brief HTTP response header classification: strcmp chain vs hash dispatch.
+ *
+ * Both classifiers are copies of http_check_response_header() in
+ * src/net_http.cpp, before and after it switched to hash_str_ci().
+ */
+
+#include "experiment/bench.h"
+#include "algo_hash.h"
+#include <string.h>
+#include <strings.h>
+
+using namespace z;
+using namespace z::bench;
+
+enum {
+    HDR_HTTP1_0 = 0,
+    HDR_HTTP1_1,
+    HDR_CONTENT_LENGTH,
+    HDR_LOCATION,
+    HDR_NO_INTEREST,
+
+    HEADER_MAX_LEN = 64,
+    ROUNDS = 1000 * 1000,
+    RUNS = 7,
+};
+
+__attribute__((noinline))
+static int classify_strcmp(const char *line, const char **end) {
+    char header[HEADER_MAX_LEN + 1] = {0};
+    size_t header_len = 0;
+    for (header_len = 0; header_len < HEADER_MAX_LEN && line[header_len]; ++header_len) {
+        if (' ' == line[header_len]) {
+            break;
+        }
+        header[header_len] = line[header_len];
+        if (header[header_len] >= 'a' && header[header_len] <= 'z') {
+            header[header_len] += ('A' - 'a');
+        }
+    }
+    header[header_len] = '\0';
+    *end = line[header_len] ? &line[header_len + 1] : &line[header_len];
+
+    if (!strcmp("HTTP/1.0", header)) {
+        return HDR_HTTP1_0;
+    } else if (!strcmp("HTTP/1.1", header)) {
+        return HDR_HTTP1_1;
+    } else if (!strcmp("CONTENT-LENGTH:", header)) {
+        return HDR_CONTENT_LENGTH;
+    } else if (!strcmp("LOCATION:", header)) {
+        return HDR_LOCATION;
+    }
+    return HDR_NO_INTEREST;
+}
+
+__attribute__((noinline))
+static int classify_hash(const char *line, const char **end) {
+    size_t header_len = 0;
+    while (header_len < HEADER_MAX_LEN && line[header_len] && ' ' != line[header_len]) {
+        ++header_len;
+    }
+    *end = line[header_len] ? &line[header_len + 1] : &line[header_len];
+
+    int header = HDR_NO_INTEREST;
+    const char *expected = NULL;
+    switch (hash_str_ci(line, header_len) ) {
+    case "HTTP/1.0"_zh:         header = HDR_HTTP1_0;          expected = "HTTP/1.0";        break;
+    case "HTTP/1.1"_zh:         header = HDR_HTTP1_1;          expected = "HTTP/1.1";        break;
+    case "CONTENT-LENGTH:"_zh:  header = HDR_CONTENT_LENGTH;   expected = "CONTENT-LENGTH:"; break;
+    case "LOCATION:"_zh:        header = HDR_LOCATION;         expected = "LOCATION:";       break;
+    default:                    return HDR_NO_INTEREST;
+    }
+    if (strlen(expected) != header_len || strncasecmp(expected, line, header_len) ) {
+        return HDR_NO_INTEREST;
+    }
+    return header;
+}
+
+typedef int (*classify_t)(const char *line, const char **end);
+
+/// the best of a few runs, the box may be noisy
+static double ns_per_line(classify_t f, const char *const lines[], uint32_t n, int *checksum) {
+    double best = 1e9;
+    for (uint32_t run = 0; run < RUNS; ++run) {
+        uint64_t begin = now_ns();
+        int sum = 0;
+        for (uint32_t r = 0; r < ROUNDS; ++r) {
+            const char *end = NULL;
+            sum += f(lines[r % n], &end);
+        }
+        *checksum = sum;
+        double ns = double(now_ns() - begin) / ROUNDS;
+        best = (ns < best) ? ns : best;
+    }
+    return best;
+}
+
+int main() {
+    // a typical response head
+    const char *lines[] = {
+        "HTTP/1.1 200 OK",
+        "Server: nginx/1.18.0",
+        "Date: Sat, 17 Oct 2026 10:00:00 GMT",
+        "Content-Type: text/html; charset=utf-8",
+        "Content-Length: 1024",
+        "Connection: keep-alive",
+        "Cache-Control: no-cache",
+        "Location: http://example.com/",
+    };
+    const uint32_t n = sizeof(lines) / sizeof(lines[0]);
+
+    int sum_strcmp = 0;
+    int sum_hash = 0;
+    double t_strcmp = ns_per_line(classify_strcmp, lines, n, &sum_strcmp);
+    double t_hash = ns_per_line(classify_hash, lines, n, &sum_hash);
+    printf("strcmp chain: %6.2f ns/line\n", t_strcmp);
+    printf("hash switch:  %6.2f ns/line\n", t_hash);
+    printf("same result:  %s\n", (sum_strcmp == sum_hash) ? "yes" : "NO");
+
+    return 0;
+}
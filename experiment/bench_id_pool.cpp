@@ -0,0 +1,145 @@
+/**
+ * @brief IDPool: the bitmap against the former free list of next-pointers.
+ *        Memory, ns per op allocating every id, ns per op releasing and
+ *        re-allocating random ids, then Mops/s churning from 1..N threads.
+ *
+ * usage: bench_id_pool [ids] [max_threads]
+ */
+
+#include "experiment/bench.h"
+#include "algo_ds.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <vector>
+
+using namespace z;
+using namespace z::bench;
+
+/// the free list IDPool used to be: a next-pointer per id, under a lock
+class ListIDPool {
+public:
+    ListIDPool(uint32_t max_id) : _size(max_id + 1), _pool(new uint32_t[max_id + 1]) {
+        for (uint32_t i = 0; i < _size; ++i) {
+            _pool[i] = i + 1;
+        }
+        _pool[_size - 1] = 0;
+    }
+    ~ListIDPool() {delete [] _pool; }
+
+    uint32_t allocate() {
+        _lock.lock();
+        uint32_t offset = _pool[0];
+        if (0 == offset) {
+            _lock.unlock();
+            return uint32_t(-1);
+        }
+        _pool[0] = _pool[offset];
+        _pool[offset] = uint32_t(-1);
+        _lock.unlock();
+        return offset - 1;
+    }
+    void release(uint32_t id) {
+        _lock.lock();
+        _pool[id + 1] = _pool[0];
+        _pool[0] = id + 1;
+        _lock.unlock();
+    }
+    static size_t bytes(uint32_t n) {return size_t(n + 1) * 4; }
+private:
+    uint32_t    _size;
+    uint32_t    *_pool;
+    ZSpinLock   _lock;
+};
+
+template <typename Pool>
+static void fill_and_churn(uint32_t n, double *fill_ns, double *churn_ns) {
+    Pool pool(n);
+    uint64_t begin = now_ns();
+    for (uint32_t i = 0; i < n; ++i) {
+        keep(pool.allocate() );
+    }
+    *fill_ns = double(now_ns() - begin) / n;
+
+    // release distinct random ids, take them back
+    Rand r;
+    const uint32_t BATCH = 1024;
+    std::vector<uint32_t> ids(BATCH);
+    uint32_t rounds = 1000;
+    begin = now_ns();
+    for (uint32_t k = 0; k < rounds; ++k) {
+        uint64_t base = r.next();
+        for (uint32_t i = 0; i < BATCH; ++i) {
+            ids[i] = uint32_t((base + uint64_t(i) * 7919) % n);
+            pool.release(ids[i]);
+        }
+        for (uint32_t i = 0; i < BATCH; ++i) {
+            keep(pool.allocate() );
+        }
+    }
+    *churn_ns = double(now_ns() - begin) / (2.0 * rounds * BATCH);
+}
+
+struct Args {
+    void        *pool;
+    uint32_t    ops;
+};
+
+template <typename Pool>
+static void *worker(void *arg) {
+    Args *a = (Args*)(arg);
+    Pool *pool = (Pool*)(a->pool);
+    uint32_t held[16];
+    for (uint32_t done = 0; done < a->ops; done += 16) {
+        for (uint32_t i = 0; i < 16; ++i) {
+            held[i] = pool->allocate();
+        }
+        for (uint32_t i = 0; i < 16; ++i) {
+            pool->release(held[i]);
+        }
+    }
+    return nullptr;
+}
+
+template <typename Pool>
+static double threads_run(uint32_t threads, uint32_t n) {
+    Pool pool(n);
+    Args args = {&pool, 1000000};
+    std::vector<pthread_t> ids(threads);
+    uint64_t begin = now_ns();
+    for (uint32_t i = 0; i < threads; ++i) {
+        pthread_create(&ids[i], nullptr, worker<Pool>, &args);
+    }
+    for (uint32_t i = 0; i < threads; ++i) {
+        pthread_join(ids[i], nullptr);
+    }
+    return 2.0 * threads * args.ops / double(now_ns() - begin) * 1000.0;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t n = (argc > 1) ? atoi(argv[1]) : 10000000;
+    uint32_t max_threads = (argc > 2) ? atoi(argv[2]) : 8;
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("%u online cpus, %u ids\n", uint32_t(sysconf(_SC_NPROCESSORS_ONLN) ), n);
+    printf("memory: list %.2f MB, bitmap %.2f MB\n", ListIDPool::bytes(n) / 1048576.0,
+        (n / 8.0) * 64 / 63 / 1048576.0);
+
+    double fill = 0;
+    double churn = 0;
+    printf("%-22s %12s %12s\n", "ns per op", "fill", "random churn");
+    fill_and_churn<ListIDPool>(n, &fill, &churn);
+    printf("%-22s %12.2f %12.2f\n", "list+spinlock", fill, churn);
+    fill_and_churn<IDPool<ZSpinLock> >(n, &fill, &churn);
+    printf("%-22s %12.2f %12.2f\n", "bitmap+spinlock", fill, churn);
+    fill_and_churn<IDPool<ZLockFree> >(n, &fill, &churn);
+    printf("%-22s %12.2f %12.2f\n", "bitmap lock-free", fill, churn);
+
+    printf("\n%-8s %14s %14s %14s   (Mops/s, 64K ids)\n", "threads", "list+spin", "bitmap+spin", "lock-free");
+    for (uint32_t t = 1; t <= max_threads; t *= 2) {
+        printf("%-8u %14.2f %14.2f %14.2f\n", t, threads_run<ListIDPool>(t, 65536),
+            threads_run<IDPool<ZSpinLock> >(t, 65536), threads_run<IDPool<ZLockFree> >(t, 65536) );
+    }
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+/**
+ * @brief Throughput of ZSpinLock, ZMutexLock and ZAdaptiveLock under
+ *        contention, across critical section lengths and thread counts.
+ *
+ * Every thread loops: lock, a critical section of cs units of work, unlock,
+ * then as many units outside the lock, for a fixed time. A unit is a few
+ * dependent multiplies, about 1ns. Reported: lock acquisitions per second
+ * over all the threads, and their ns each.
+ *
+ * usage: bench_lock [ms_per_run] [max_threads]
+ */
+
+#include "experiment/bench.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <atomic>
+#include <vector>
+
+using namespace z;
+using namespace z::bench;
+
+static uint64_t work(uint64_t v, uint32_t units) {
+    for (uint32_t i = 0; i < units; ++i) {
+        v = v * 6364136223846793005ull + 1442695040888963407ull;
+    }
+    return v;
+}
+
+template <typename LOCK>
+struct Shared {
+    LOCK                lock;
+    char                pad[DEF_SIZE_CACHE_LINE];
+    uint64_t            count;
+    uint64_t            state;
+    uint32_t            cs;
+    std::atomic<bool>   start;
+    std::atomic<bool>   stop;
+};
+
+template <typename LOCK>
+static void* thread_main(void *arg) {
+    Shared<LOCK> *s = (Shared<LOCK>*)(arg);
+    uint64_t local = uint64_t(pthread_self() );
+    while (!s->start.load(std::memory_order_acquire) ) {
+    }
+    while (!s->stop.load(std::memory_order_relaxed) ) {
+        s->lock.lock();
+        s->state = work(s->state, s->cs);
+        ++s->count;
+        s->lock.unlock();
+        local = work(local, s->cs);
+    }
+    keep(local);
+    return nullptr;
+}
+
+template <typename LOCK>
+static double run(uint32_t threads, uint32_t cs, uint32_t ms) {
+    Shared<LOCK> s;
+    s.count = 0;
+    s.state = 1;
+    s.cs = cs;
+    s.start.store(false);
+    s.stop.store(false);
+
+    std::vector<pthread_t> ids(threads);
+    for (uint32_t i = 0; i < threads; ++i) {
+        pthread_create(&ids[i], nullptr, &thread_main<LOCK>, &s);
+    }
+    uint64_t begin = now_ns();
+    s.start.store(true, std::memory_order_release);
+    zsleep_ms(ms);
+    s.stop.store(true);
+    for (uint32_t i = 0; i < threads; ++i) {
+        pthread_join(ids[i], nullptr);
+    }
+    uint64_t ns = now_ns() - begin;
+    keep(s.state);
+    return s.count / (ns / 1e9);
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t ms = (argc > 1) ? atoi(argv[1]) : 200;
+    uint32_t max_threads = (argc > 2) ? atoi(argv[2]) : 64;
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("%u online cpus\n", uint32_t(sysconf(_SC_NPROCESSORS_ONLN) ) );
+
+    const uint32_t sections[] = {0, 50, 500, 5000};
+    for (size_t c = 0; c < sizeof(sections) / sizeof(sections[0]); ++c) {
+        printf("\ncritical section of %u units, Mlocks/s (ns per lock)\n%8s %18s %18s %18s\n",
+            sections[c], "threads", "spin", "mutex", "adaptive");
+        for (uint32_t threads = 1; threads <= max_threads; threads *= 2) {
+            double spin = run<ZSpinLock>(threads, sections[c], ms);
+            double mutex = run<ZMutexLock>(threads, sections[c], ms);
+            double adaptive = run<ZAdaptiveLock>(threads, sections[c], ms);
+            printf("%8u %9.2f (%6.0f) %9.2f (%6.0f) %9.2f (%6.0f)\n", threads,
+                spin / 1e6, 1e9 / spin, mutex / 1e6, 1e9 / mutex, adaptive / 1e6, 1e9 / adaptive);
+        }
+    }
+    return 0;
+}
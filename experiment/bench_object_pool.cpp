@@ -0,0 +1,104 @@
+/**
+ * @brief ObjectPool against StaticLinkedList for a task pool of link_max
+ *        RPCTask sized objects: construction time and RSS when idle, RSS
+ *        with 10% in use and after releasing them, and ns per allocate +
+ *        release pair.
+ *
+ * usage: bench_object_pool [link_max]
+ */
+
+#include "experiment/bench.h"
+#include "algo_ds.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <vector>
+
+using namespace z;
+using namespace z::bench;
+
+/// the size and layout of an RPCTask
+struct Task {
+    int         fd;
+    uint32_t    flags;
+    uint32_t    events;
+    void        *service;
+    char        buf[8];
+    uint64_t    dn;
+    void        *dptr;
+};
+
+static double rss_mb() {
+    long pages = 0;
+    long resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (2 != fscanf(f, "%ld %ld", &pages, &resident) ) {
+            resident = 0;
+        }
+        fclose(f);
+    }
+    return double(resident) * sysconf(_SC_PAGESIZE) / 1048576.0;
+}
+
+template <typename Pool>
+static void run(const char *name, Pool *(*make)(uint32_t), uint32_t n) {
+    double rss0 = rss_mb();
+    uint64_t begin = now_ns();
+    Pool *pool = make(n);
+    double init_ms = double(now_ns() - begin) / 1e6;
+    double idle = rss_mb() - rss0;
+
+    std::vector<Task*> tasks(n / 10);
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        tasks[i] = pool->allocate();
+    }
+    double used = rss_mb() - rss0;
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        pool->release(tasks[i]);
+    }
+    double released = rss_mb() - rss0;
+
+    const uint32_t ROUNDS = 2000;
+    const uint32_t BURST = 64;
+    begin = now_ns();
+    for (uint32_t r = 0; r < ROUNDS; ++r) {
+        for (uint32_t i = 0; i < BURST; ++i) {
+            tasks[i] = pool->allocate();
+            tasks[i]->dn = i;
+        }
+        for (uint32_t i = 0; i < BURST; ++i) {
+            pool->release(tasks[i]);
+        }
+    }
+    double ns = double(now_ns() - begin) / (ROUNDS * BURST);
+
+    printf("%-22s %10.2f %10.2f %10.2f %10.2f %10.2f\n", name, init_ms, idle, used, released, ns);
+    delete pool;
+}
+
+static StaticLinkedList<Task, ZSpinLock> *make_list(uint32_t n) {
+    return new StaticLinkedList<Task, ZSpinLock>(n);
+}
+
+static ObjectPool<Task, ZSpinLock> *make_pool(uint32_t n) {
+    return new ObjectPool<Task, ZSpinLock>(n);
+}
+
+static ObjectPool<Task, ZSpinLock> *make_huge_pool(uint32_t n) {
+    return new ObjectPool<Task, ZSpinLock>(n, OBJECT_POOL_HUGEPAGE);
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t n = (argc > 1) ? atoi(argv[1]) : 1024000;
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("%u online cpus, link_max %u, %u byte tasks, RSS in MB\n",
+        uint32_t(sysconf(_SC_NPROCESSORS_ONLN) ), n, uint32_t(sizeof(Task) ) );
+    printf("%-22s %10s %10s %10s %10s %10s\n", "", "init(ms)", "idle", "10% used", "released", "ns/op");
+    run("StaticLinkedList", make_list, n);
+    run("ObjectPool", make_pool, n);
+    run("ObjectPool hugepage", make_huge_pool, n);
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+/**
+ * @brief MPMCQueue against FixedLengthQueue<.., ZSpinLock>: total Mitems/s
+ *        with 1..32 producers and as many consumers on a 1024 slot queue.
+ *
+ * usage: bench_queue [max_threads] [items_per_producer]
+ */
+
+#include "experiment/bench.h"
+#include "algo_ds.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <vector>
+
+using namespace z;
+using namespace z::bench;
+
+typedef MPMCQueue<uint64_t>                     Ring;
+typedef FixedLengthQueue<uint64_t, ZSpinLock>   Locked;
+
+struct Args {
+    void        *queue;
+    uint32_t    items;
+};
+
+template <typename Queue>
+static void *producer(void *arg) {
+    Args *a = (Args*)(arg);
+    Queue *q = (Queue*)(a->queue);
+    for (uint32_t i = 0; i < a->items; ++i) {
+        while (!q->enqueue(i) ) {
+            sched_yield();
+        }
+    }
+    return nullptr;
+}
+
+template <typename Queue>
+static void *consumer(void *arg) {
+    Args *a = (Args*)(arg);
+    Queue *q = (Queue*)(a->queue);
+    uint64_t v = 0;
+    for (uint32_t n = 0; n < a->items; ) {
+        if (q->dequeue(&v) ) {
+            keep(v);
+            ++n;
+        } else {
+            sched_yield();
+        }
+    }
+    return nullptr;
+}
+
+template <typename Queue>
+static double run(uint32_t threads, uint32_t items) {
+    Queue q(1024);
+    Args args = {&q, items};
+    std::vector<pthread_t> ids(2 * threads);
+    uint64_t begin = now_ns();
+    for (uint32_t i = 0; i < threads; ++i) {
+        pthread_create(&ids[2 * i], nullptr, producer<Queue>, &args);
+        pthread_create(&ids[2 * i + 1], nullptr, consumer<Queue>, &args);
+    }
+    for (uint32_t i = 0; i < 2 * threads; ++i) {
+        pthread_join(ids[i], nullptr);
+    }
+    return double(threads) * items / double(now_ns() - begin) * 1000.0;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t max_threads = (argc > 1) ? atoi(argv[1]) : 32;
+    uint32_t items = (argc > 2) ? atoi(argv[2]) : 200000;
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("%u online cpus, %u items per producer, Mitems/s in total\n",
+        uint32_t(sysconf(_SC_NPROCESSORS_ONLN) ), items);
+    printf("%-12s %10s %10s\n", "prod/cons", "mpmc", "spinlock");
+    for (uint32_t n = 1; n <= max_threads; n *= 2) {
+        printf("%-12u %10.2f %10.2f\n", n, run<Ring>(n, items), run<Locked>(n, items) );
+    }
+
+    return 0;
+}
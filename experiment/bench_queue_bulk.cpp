@@ -0,0 +1,125 @@
+/**
+ * @brief enqueue_bulk()/dequeue_bulk(): ns per item through one producer and
+ *        one consumer, with batch sizes 1/8/32/128 on a 1024 slot queue.
+ *        A batch of 1 uses enqueue()/dequeue(). The fd queue consumer blocks
+ *        in poll() when the queue is drained, like a pool thread does.
+ *
+ * usage: bench_queue_bulk [items]
+ */
+
+#include "experiment/bench.h"
+#include "algo_ds.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+
+using namespace z;
+using namespace z::bench;
+
+typedef FixedLengthQueue<uint64_t, ZSpinLock>   Locked;
+typedef MPMCQueue<uint64_t>                     Ring;
+typedef SPSCQueue<uint64_t>                     Spsc;
+typedef FixedLengthQueueWithFd<uint64_t, ZNoLock, 1024, MPMCQueue<uint64_t> >  FdRing;
+
+enum {
+    MAX_BATCH   = 128,
+};
+
+struct Args {
+    void        *queue;
+    uint32_t    items;
+    uint32_t    batch;
+};
+
+template <typename Queue>
+static uint32_t put(Queue *q, const uint64_t *items, uint32_t n) {
+    return (1 == n) ? uint32_t(q->enqueue(items[0]) ) : q->enqueue_bulk(items, n);
+}
+
+template <typename Queue>
+static uint32_t get(Queue *q, uint64_t *items, uint32_t n) {
+    return (1 == n) ? uint32_t(q->dequeue(items) ) : q->dequeue_bulk(items, n);
+}
+
+template <typename Queue>
+static void idle(Queue *) {
+    sched_yield();
+}
+
+static void idle(FdRing *q) {
+    pollfd pfd = {q->dequeue_fd(), POLLIN, 0};
+    poll(&pfd, 1, 10);
+}
+
+template <typename Queue>
+static void *producer(void *arg) {
+    Args *a = (Args*)(arg);
+    Queue *q = (Queue*)(a->queue);
+    uint64_t items[MAX_BATCH];
+    for (uint32_t i = 0; i < a->items; ) {
+        uint32_t n = (a->items - i < a->batch) ? a->items - i : a->batch;
+        for (uint32_t k = 0; k < n; ++k) {
+            items[k] = i + k;
+        }
+        uint32_t done = 0;
+        while (done < n) {
+            uint32_t added = put(q, items + done, n - done);
+            done += added;
+            if (0 == added) {
+                sched_yield();
+            }
+        }
+        i += n;
+    }
+    return nullptr;
+}
+
+template <typename Queue>
+static void *consumer(void *arg) {
+    Args *a = (Args*)(arg);
+    Queue *q = (Queue*)(a->queue);
+    uint64_t items[MAX_BATCH];
+    for (uint32_t n = 0; n < a->items; ) {
+        uint32_t got = get(q, items, a->batch);
+        for (uint32_t k = 0; k < got; ++k) {
+            keep(items[k]);
+        }
+        n += got;
+        if (0 == got) {
+            idle(q);
+        }
+    }
+    return nullptr;
+}
+
+template <typename Queue>
+static double run(uint32_t batch, uint32_t items) {
+    Queue q(1024);
+    Args args = {&q, items, batch};
+    pthread_t ids[2];
+    uint64_t begin = now_ns();
+    pthread_create(&ids[0], nullptr, producer<Queue>, &args);
+    pthread_create(&ids[1], nullptr, consumer<Queue>, &args);
+    pthread_join(ids[0], nullptr);
+    pthread_join(ids[1], nullptr);
+    return double(now_ns() - begin) / items;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t items = (argc > 1) ? atoi(argv[1]) : 2000000;
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("%u online cpus, %u items, ns per item\n",
+        uint32_t(sysconf(_SC_NPROCESSORS_ONLN) ), items);
+    printf("%-8s %10s %10s %10s %10s\n", "batch", "spinlock", "mpmc", "spsc", "mpmc+fd");
+    const uint32_t batches[] = {1, 8, 32, 128};
+    for (uint32_t i = 0; i < sizeof(batches) / sizeof(batches[0]); ++i) {
+        uint32_t b = batches[i];
+        printf("%-8u %10.2f %10.2f %10.2f %10.2f\n", b, run<Locked>(b, items),
+            run<Ring>(b, items), run<Spsc>(b, items), run<FdRing>(b, items) );
+    }
+
+    return 0;
+}
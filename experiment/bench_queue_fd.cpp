@@ -0,0 +1,156 @@
+/**
+ * @brief FixedLengthQueueWithFd: syscalls per item and throughput of the
+ *        eventfd queue (signal on empty -> non-empty, or EFD_SEMAPHORE)
+ *        against the former byte-per-item pipe, one producer and one
+ *        consumer sleeping in epoll_wait.
+ *
+ * read() and write() are interposed to count the calls made outside libc.
+ *
+ * usage: bench_queue_fd [items] [burst]
+ */
+
+#include "experiment/bench.h"
+#include "algo_ds.h"
+#include "thread.h"
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+
+using namespace z;
+using namespace z::bench;
+
+static uint64_t g_syscalls = 0;
+
+typedef ssize_t (*read_func_t)(int, void*, size_t);
+typedef ssize_t (*write_func_t)(int, const void*, size_t);
+
+extern "C" ssize_t read(int fd, void *buf, size_t n) {
+    static read_func_t real = (read_func_t)(dlsym(RTLD_NEXT, "read") );
+    __sync_fetch_and_add(&g_syscalls, 1);
+    return real(fd, buf, n);
+}
+
+extern "C" ssize_t write(int fd, const void *buf, size_t n) {
+    static write_func_t real = (write_func_t)(dlsym(RTLD_NEXT, "write") );
+    __sync_fetch_and_add(&g_syscalls, 1);
+    return real(fd, buf, n);
+}
+
+typedef MPMCQueue<uint64_t> Inner;
+
+/// the previous FixedLengthQueueWithFd: one pipe byte per item each way
+class PipeQueue {
+public:
+    PipeQueue(uint32_t n) : _queue(n) {
+        int ret = ::pipe2(_fds, O_CLOEXEC | O_NONBLOCK);
+        ZASSERT(0 == ret);
+        Z_USE_VAR(ret);
+    }
+    ~PipeQueue() {
+        ::close(_fds[0]);
+        ::close(_fds[1]);
+    }
+    bool enqueue(uint64_t v) {
+        Z_RET_IF(!_queue.enqueue(v), false);
+        while (::write(_fds[1], "\1", 1) != 1) {
+            usleep(1000);
+        }
+        return true;
+    }
+    bool dequeue(uint64_t *v) {
+        char c;
+        Z_RET_IF(::read(_fds[0], &c, 1) != 1, false);
+        while (!_queue.dequeue(v) ) {
+            sched_yield();
+        }
+        return true;
+    }
+    int dequeue_fd() const {return _fds[0]; }
+private:
+    int     _fds[2];
+    Inner   _queue;
+};
+
+typedef FixedLengthQueueWithFd<uint64_t, ZNoLock, 1024, Inner> FdQueue;
+
+struct EventfdQueue : public FdQueue {
+    EventfdQueue(uint32_t n) : FdQueue(n) {}
+};
+
+struct SemaphoreQueue : public FdQueue {
+    SemaphoreQueue(uint32_t n) : FdQueue(n, EFD_SEMAPHORE) {}
+};
+
+struct Args {
+    void        *queue;
+    uint32_t    items;
+    uint32_t    burst;
+};
+
+template <typename Queue>
+static void *producer(void *arg) {
+    Args *a = (Args*)(arg);
+    Queue *q = (Queue*)(a->queue);
+    for (uint32_t i = 0; i < a->items; ++i) {
+        while (!q->enqueue(i) ) {
+            sched_yield();
+        }
+        if (i % a->burst == a->burst - 1) {
+            sched_yield();
+        }
+    }
+    return nullptr;
+}
+
+template <typename Queue>
+static void run(const char *name, uint32_t items, uint32_t burst) {
+    Queue q(1024);
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    epoll_ctl(ep, EPOLL_CTL_ADD, q.dequeue_fd(), &ev);
+
+    Args args = {&q, items, burst};
+    pthread_t id;
+    uint64_t calls = __sync_fetch_and_add(&g_syscalls, 0);
+    uint64_t waits = 0;
+    uint64_t begin = now_ns();
+    pthread_create(&id, nullptr, producer<Queue>, &args);
+    uint64_t v = 0;
+    for (uint32_t n = 0; n < items; ) {
+        epoll_wait(ep, &ev, 1, 100);
+        ++waits;
+        while (q.dequeue(&v) ) {
+            ++n;
+        }
+    }
+    double ns = double(now_ns() - begin);
+    pthread_join(id, nullptr);
+    calls = __sync_fetch_and_add(&g_syscalls, 0) - calls + waits;
+    ::close(ep);
+
+    printf("%-12s %6u %14.3f %14.3f %10.2f\n", name, burst,
+        double(calls) / items, double(waits) / items, items / ns * 1000.0);
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t items = (argc > 1) ? atoi(argv[1]) : 1000000;
+    uint32_t burst = (argc > 2) ? atoi(argv[2]) : 0;
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("%u online cpus, %u items\n", uint32_t(sysconf(_SC_NPROCESSORS_ONLN) ), items);
+    printf("%-12s %6s %14s %14s %10s\n", "queue", "burst", "syscalls/item", "wakeups/item", "Mitems/s");
+    for (uint32_t b = 1; b <= 64; b *= 8) {
+        if (burst && b != burst) {
+            continue;
+        }
+        run<PipeQueue>("pipe", items, b);
+        run<EventfdQueue>("eventfd", items, b);
+        run<SemaphoreQueue>("semaphore", items, b);
+    }
+
+    return 0;
+}
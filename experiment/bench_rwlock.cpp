@@ -0,0 +1,193 @@
+/**
+ * @brief Reader scaling of read-mostly data: a 32 byte entry read under
+ *        ZMutexLock, ZSpinLock, ZAdaptiveLock, pthread_rwlock_t and
+ *        ZRWLock, and copied out of a ZSeqSnapshot.
+ *
+ * Every reader thread loops for a fixed time: take the read side (the whole
+ * lock for the exclusive ones, through ZSharedLock), copy the entry,
+ * release. A second table adds a writer thread replacing the entry every
+ * write_us. Reported: reads per second over all the readers, and the ns of
+ * one read as seen by one reader, which stays flat while readers scale.
+ *
+ * usage: bench_rwlock [ms_per_run] [max_threads] [write_us]
+ */
+
+#include "experiment/bench.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <atomic>
+#include <vector>
+
+using namespace z;
+using namespace z::bench;
+
+struct Route {
+    uint64_t    addr;
+    uint64_t    mask;
+    uint64_t    next_hop;
+    uint64_t    metric;
+};
+
+/// pthread_rwlock_t, as a LOCK with a read side
+class PthreadRWLock {
+public:
+    PthreadRWLock() {pthread_rwlock_init(&_lock, nullptr); }
+    ~PthreadRWLock() {pthread_rwlock_destroy(&_lock); }
+
+    void read_lock() {pthread_rwlock_rdlock(&_lock); }
+    void read_unlock() {pthread_rwlock_unlock(&_lock); }
+    void lock() {pthread_rwlock_wrlock(&_lock); }
+    void unlock() {pthread_rwlock_unlock(&_lock); }
+private:
+    pthread_rwlock_t    _lock;
+};
+
+template <typename LOCK>
+struct Locked {
+    Route read() {
+        ZSharedLock<LOCK>::lock(&lock);
+        Route v = route;
+        ZSharedLock<LOCK>::unlock(&lock);
+        return v;
+    }
+    void write(const Route &v) {
+        lock.lock();
+        route = v;
+        lock.unlock();
+    }
+
+    LOCK    lock;
+    Route   route;
+};
+
+struct Seq {
+    Route read() {return snapshot.load(); }
+    void write(const Route &v) {snapshot.store(v); }
+
+    ZSeqSnapshot<Route>     snapshot;
+};
+
+template <typename DATA>
+struct Shared {
+    DATA                data;
+    char                pad[DEF_SIZE_CACHE_LINE];
+    std::atomic<bool>   start;
+    std::atomic<bool>   stop;
+    uint32_t            write_us;
+};
+
+/// padded rather than aligned: std::vector does not align past max_align_t
+template <typename DATA>
+struct Reader {
+    Shared<DATA>    *s;
+    uint64_t        reads;
+    char            pad[DEF_SIZE_CACHE_LINE];
+};
+
+template <typename DATA>
+static void* reader_main(void *arg) {
+    Reader<DATA> *r = (Reader<DATA>*)(arg);
+    Shared<DATA> *s = r->s;
+    uint64_t reads = 0;
+    uint64_t sum = 0;
+    while (!s->start.load(std::memory_order_acquire) ) {
+    }
+    while (!s->stop.load(std::memory_order_relaxed) ) {
+        Route v = s->data.read();
+        sum += v.next_hop + v.metric;
+        ++reads;
+    }
+    keep(sum);
+    r->reads = reads;
+    return nullptr;
+}
+
+template <typename DATA>
+static void* writer_main(void *arg) {
+    Shared<DATA> *s = (Shared<DATA>*)(arg);
+    Route v = {0, 0, 0, 0};
+    while (!s->stop.load(std::memory_order_relaxed) ) {
+        ++v.next_hop;
+        ++v.metric;
+        s->data.write(v);
+        zsleep_us(s->write_us);
+    }
+    return nullptr;
+}
+
+template <typename DATA>
+static double run(uint32_t threads, uint32_t ms, uint32_t write_us) {
+    Shared<DATA> s;
+    s.start.store(false);
+    s.stop.store(false);
+    s.write_us = write_us;
+
+    std::vector<Reader<DATA> > readers(threads);
+    std::vector<pthread_t> ids(threads);
+    for (uint32_t i = 0; i < threads; ++i) {
+        readers[i].s = &s;
+        pthread_create(&ids[i], nullptr, &reader_main<DATA>, &readers[i]);
+    }
+    pthread_t writer;
+    if (write_us) {
+        pthread_create(&writer, nullptr, &writer_main<DATA>, &s);
+    }
+    uint64_t begin = now_ns();
+    s.start.store(true, std::memory_order_release);
+    zsleep_ms(ms);
+    s.stop.store(true);
+    for (uint32_t i = 0; i < threads; ++i) {
+        pthread_join(ids[i], nullptr);
+    }
+    if (write_us) {
+        pthread_join(writer, nullptr);
+    }
+    uint64_t ns = now_ns() - begin;
+
+    uint64_t reads = 0;
+    for (uint32_t i = 0; i < threads; ++i) {
+        reads += readers[i].reads;
+    }
+    return reads / (ns / 1e9);
+}
+
+static void report(uint32_t threads, uint32_t ms, uint32_t write_us) {
+    double r[] = {
+        run<Locked<ZMutexLock> >(threads, ms, write_us),
+        run<Locked<ZSpinLock> >(threads, ms, write_us),
+        run<Locked<ZAdaptiveLock> >(threads, ms, write_us),
+        run<Locked<PthreadRWLock> >(threads, ms, write_us),
+        run<Locked<ZRWLock> >(threads, ms, write_us),
+        run<Seq>(threads, ms, write_us),
+    };
+    printf("%8u", threads);
+    for (size_t i = 0; i < sizeof(r) / sizeof(r[0]); ++i) {
+        printf(" %8.2f (%5.0f)", r[i] / 1e6, 1e9 * threads / r[i]);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t ms = (argc > 1) ? atoi(argv[1]) : 200;
+    uint32_t max_threads = (argc > 2) ? atoi(argv[2]) : 64;
+    uint32_t write_us = (argc > 3) ? atoi(argv[3]) : 100;
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("%u online cpus\n", uint32_t(sysconf(_SC_NPROCESSORS_ONLN) ) );
+
+    const char *header = "%8s %16s %16s %16s %16s %16s %16s\n";
+    printf("\nreaders only, Mreads/s (ns per read per reader)\n");
+    printf(header, "readers", "mutex", "spin", "adaptive", "pthread_rwlock", "ZRWLock", "ZSeqSnapshot");
+    for (uint32_t threads = 1; threads <= max_threads; threads *= 2) {
+        report(threads, ms, 0);
+    }
+
+    printf("\na writer every %u us, Mreads/s (ns per read per reader)\n", write_us);
+    printf(header, "readers", "mutex", "spin", "adaptive", "pthread_rwlock", "ZRWLock", "ZSeqSnapshot");
+    for (uint32_t threads = 1; threads <= max_threads; threads *= 2) {
+        report(threads, ms, write_us);
+    }
+    return 0;
+}
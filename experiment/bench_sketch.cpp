@@ -0,0 +1,113 @@
+/**
+ * @brief ns per update of HyperLogLog (sparse and dense), CountMinSketch and
+ *        HeavyHitters over URI-like string keys with a skewed distribution,
+ *        hashing included; then the HyperLogLog estimate error and merge cost.
+ *
+ * usage: bench_sketch [updates]
+ */
+
+#include "experiment/bench.h"
+#include "algo_sketch.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <string>
+#include <vector>
+
+using namespace z;
+using namespace z::bench;
+
+int main(int argc, char *argv[]) {
+    uint64_t n = (argc > 1) ? atoll(argv[1]) : 10000000;
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("%u online cpus\n", uint32_t(sysconf(_SC_NPROCESSORS_ONLN) ) );
+
+    // a key of rank r is drawn about 1 / r of the time, out of ~1M keys
+    Rand r;
+    std::vector<std::string> keys(1 << 16);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        uint64_t bits = r.next() % 20;
+        char buf[64];
+        int len = snprintf(buf, sizeof(buf), "/api/v1/object/%lu", r.next() & ( (uint64_t(1) << bits) - 1) );
+        keys[i].assign(buf, len);
+    }
+
+    printf("\n%lu updates, ns per update\n", n);
+    {
+        // sparse until 4096 registers are touched: fresh sketches of 2000 keys
+        uint64_t rounds = n / 2000;
+        uint64_t sparse_bytes = 0;
+        uint64_t begin = now_ns();
+        for (uint64_t round = 0; round < rounds; ++round) {
+            HyperLogLog s;
+            for (uint64_t i = 0; i < 2000; ++i) {
+                const std::string &k = keys[(round * 2000 + i) & 0xFFFF];
+                s.add(k.data(), k.size() );
+            }
+            sparse_bytes = s.bytes();
+        }
+        printf("%-24s %8.1f  (%lu bytes)\n", "hll sparse", double(now_ns() - begin) / (rounds * 2000), sparse_bytes);
+
+        HyperLogLog h;
+        begin = now_ns();
+        for (uint64_t i = 0; i < n; ++i) {
+            const std::string &k = keys[i & 0xFFFF];
+            h.add(k.data(), k.size() );
+        }
+        printf("%-24s %8.1f  (%lu bytes)\n", "hll dense", double(now_ns() - begin) / n, h.bytes() );
+    }
+    {
+        CountMinSketch cms(0.0001, 0.01);
+        uint64_t begin = now_ns();
+        for (uint64_t i = 0; i < n; ++i) {
+            const std::string &k = keys[i & 0xFFFF];
+            cms.add(k.data(), k.size() );
+        }
+        printf("%-24s %8.1f  (%u x %u)\n", "count-min", double(now_ns() - begin) / n, cms.depth(), cms.width() );
+    }
+    const uint32_t tops[] = {10, 100, 1000};
+    for (size_t t = 0; t < sizeof(tops) / sizeof(tops[0]); ++t) {
+        HeavyHitters hh(tops[t]);
+        uint64_t begin = now_ns();
+        for (uint64_t i = 0; i < n; ++i) {
+            const std::string &k = keys[i & 0xFFFF];
+            hh.add(k.data(), k.size() );
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "heavy hitters top %u", tops[t]);
+        printf("%-24s %8.1f\n", name, double(now_ns() - begin) / n);
+    }
+
+    printf("\nhll error at precision 14, 1.04 / sqrt(m) = %.2f%%\n%12s %12s %9s\n",
+        104 / ::sqrt(16384.0), "distinct", "estimate", "error");
+    {
+        HyperLogLog h;
+        uint64_t added = 0;
+        for (uint64_t c = 10; c <= 100000000; c *= 10) {
+            for (; added < c; ++added) {
+                h.add(&added, sizeof(added) );
+            }
+            printf("%12lu %12.0f %8.2f%%\n", c, h.estimate(), (h.estimate() - c) / c * 100);
+        }
+    }
+
+    {
+        HyperLogLog a;
+        HyperLogLog b;
+        for (uint64_t i = 0; i < 1000000; ++i) {
+            a.add(&i, sizeof(i) );
+            uint64_t j = i + 500000;
+            b.add(&j, sizeof(j) );
+        }
+        const uint32_t rounds = 100000;
+        uint64_t begin = now_ns();
+        for (uint32_t i = 0; i < rounds; ++i) {
+            a.merge(b);
+        }
+        printf("\ndense merge of %lu registers %.1f ns, union estimate %.0f of 1500000\n",
+            a.bytes(), double(now_ns() - begin) / rounds, a.estimate() );
+    }
+
+    return 0;
+}
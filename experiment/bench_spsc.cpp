@@ -0,0 +1,131 @@
+/**
+ * @brief One producer, one consumer: throughput and handoff latency of
+ *        SPSCQueue (published per item or per batch), MPMCQueue and
+ *        FixedLengthQueue<.., ZSpinLock>.
+ *
+ * The latency run paces the producer at one item per `gap' ns and stamps
+ * every item; the consumer records now - stamp.
+ *
+ * usage: bench_spsc [items] [gap_ns]
+ */
+
+#include "experiment/bench.h"
+#include "algo_ds.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <vector>
+
+using namespace z;
+using namespace z::bench;
+
+enum {
+    QUEUE_SIZE  = 1024,
+    BATCH       = 16,
+};
+
+struct Args {
+    void        *queue;
+    uint32_t    items;
+    uint32_t    gap_ns;
+};
+
+/// the producer of SPSCQueue can stage items, the other queues cannot
+template <typename Queue>
+static bool push(Queue *q, uint64_t v, uint32_t) {
+    return q->enqueue(v);
+}
+
+struct BatchedSPSC : public SPSCQueue<uint64_t> {
+    BatchedSPSC(uint32_t n) : SPSCQueue<uint64_t>(n) {}
+};
+
+static bool push(BatchedSPSC *q, uint64_t v, uint32_t i) {
+    if (!q->enqueue_deferred(v) ) {
+        q->publish();
+        return false;
+    }
+    if (i % BATCH == BATCH - 1) {
+        q->publish();
+    }
+    return true;
+}
+
+template <typename Queue>
+static void *producer(void *arg) {
+    Args *a = (Args*)(arg);
+    Queue *q = (Queue*)(a->queue);
+    for (uint32_t i = 0; i < a->items; ++i) {
+        uint64_t stamp = now_ns();
+        if (a->gap_ns) {
+            while (now_ns() - stamp < a->gap_ns) {
+            }
+            stamp = now_ns();
+        }
+        while (!push(q, stamp, i) ) {
+            sched_yield();
+        }
+    }
+    push(q, 0, BATCH - 1);
+    return nullptr;
+}
+
+struct Result {
+    double      mops;
+    uint64_t    p50;
+    uint64_t    p99;
+};
+
+template <typename Queue>
+static Result run(uint32_t items, uint32_t gap_ns) {
+    Queue q(QUEUE_SIZE);
+    Args args = {&q, items, gap_ns};
+    std::vector<uint64_t> lat;
+    lat.reserve(items);
+
+    pthread_t id;
+    uint64_t begin = now_ns();
+    pthread_create(&id, nullptr, producer<Queue>, &args);
+    uint64_t v = 0;
+    for (uint32_t n = 0; n < items; ) {
+        if (q.dequeue(&v) ) {
+            lat.push_back(now_ns() - v);
+            ++n;
+        } else {
+            sched_yield();
+        }
+    }
+    Result r;
+    r.mops = double(items) / double(now_ns() - begin) * 1000.0;
+    pthread_join(id, nullptr);
+
+    std::sort(lat.begin(), lat.end() );
+    r.p50 = lat[lat.size() / 2];
+    r.p99 = lat[lat.size() * 99 / 100];
+    return r;
+}
+
+template <typename Queue>
+static void report(const char *name, uint32_t items, uint32_t gap_ns) {
+    Result t = run<Queue>(items, 0);
+    Result l = run<Queue>(items / 10, gap_ns);
+    printf("%-18s %10.2f %12lu %12lu %12lu\n", name, t.mops, l.p50, l.p99, t.p99);
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t items = (argc > 1) ? atoi(argv[1]) : 2000000;
+    uint32_t gap_ns = (argc > 2) ? atoi(argv[2]) : 1000;
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("%u online cpus, %u items, paced latency at one item per %u ns\n",
+        uint32_t(sysconf(_SC_NPROCESSORS_ONLN) ), items, gap_ns);
+    printf("%-18s %10s %12s %12s %12s\n", "queue", "Mitems/s", "paced p50", "paced p99", "flood p99");
+    report<SPSCQueue<uint64_t> >("spsc", items, gap_ns);
+    report<BatchedSPSC>("spsc batch 16", items, gap_ns);
+    report<MPMCQueue<uint64_t> >("mpmc", items, gap_ns);
+    report<FixedLengthQueue<uint64_t, ZSpinLock> >("spinlock list", items, gap_ns);
+
+    return 0;
+}
@@ -0,0 +1,204 @@
+/**
+ * @brief Submit and execute cost of empty tasks on ZThreadPool: a heap
+ *        allocated ZThreadTask subclass, as before, against a callable in
+ *        a pooled slot through commit(F&&).
+ *
+ * round trip: one task at a time, submitted then waited for; ZThreadTask
+ * waits on its mutex and condition, the callable on a ZTaskEvent.
+ *
+ * batch: n tasks submitted, then all joined; the ZThreadTasks one by one
+ * with wait() then delete, the callables through a ZTaskGroup. submit is
+ * the time until the last commit returned, total until all are joined.
+ *
+ * fan-out: the batch committed by a task running on a WORK_STEALING
+ * worker, into its own deque, and joined through a ZTaskGroup there.
+ *
+ * capture: the batch of callables with captures just inside and just past
+ * the inline buffer, which costs a heap allocation per task.
+ *
+ * usage: bench_task_commit [batch] [round_trips] [max_threads]
+ */
+
+#include "experiment/bench.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace z;
+using namespace z::bench;
+
+class EmptyTask : public ZThreadTask {
+public:
+    virtual int exec(void*) {return 0; }
+};
+
+/// an empty callable capturing BYTES bytes
+template <uint32_t BYTES>
+struct Capture {
+    void operator() () const {keep(data[0]); }
+
+    char    data[BYTES];
+};
+
+static const char* mode_name(ZThreadPool::ScheduleMode mode) {
+    return (mode == ZThreadPool::SHARED_QUEUE) ? "shared queue" : "work stealing";
+}
+
+static void run_round_trip(ZThreadPool::ScheduleMode mode, uint32_t n) {
+    ZThreadPool pool(64);
+    pool.start(1, mode);
+
+    uint64_t begin = now_ns();
+    for (uint32_t i = 0; i < n; ++i) {
+        EmptyTask *task = new EmptyTask;
+        pool.commit(task);
+        task->wait();
+        delete task;
+    }
+    uint64_t task_ns = now_ns() - begin;
+
+    begin = now_ns();
+    for (uint32_t i = 0; i < n; ++i) {
+        ZTaskEvent done;
+        pool.commit([] () {}, &done);
+        done.wait();
+    }
+    uint64_t call_ns = now_ns() - begin;
+    pool.stop();
+
+    printf("%-14s %14.0f %14.0f\n", mode_name(mode), double(task_ns) / n, double(call_ns) / n);
+}
+
+static void report(const char *name, ZThreadPool::ScheduleMode mode, uint32_t threads,
+        uint32_t n, uint64_t submit_ns, uint64_t total_ns) {
+    printf("%-14s %-14s %8u %12.1f %12.1f\n", name, mode_name(mode), threads,
+        double(submit_ns) / n, double(total_ns) / n);
+}
+
+static void run_batch_task(ZThreadPool::ScheduleMode mode, uint32_t threads, uint32_t n) {
+    ZThreadPool pool(n);
+    pool.start(threads, mode);
+    std::vector<EmptyTask*> tasks(n);
+
+    uint64_t best_submit = ~uint64_t(0);
+    uint64_t best_total = ~uint64_t(0);
+    for (uint32_t round = 0; round < 3; ++round) {
+        uint64_t begin = now_ns();
+        for (uint32_t i = 0; i < n; ++i) {
+            tasks[i] = new EmptyTask;
+            pool.commit(tasks[i]);
+        }
+        uint64_t submit = now_ns() - begin;
+        for (uint32_t i = 0; i < n; ++i) {
+            tasks[i]->wait();
+            delete tasks[i];
+        }
+        uint64_t total = now_ns() - begin;
+        best_submit = (submit < best_submit) ? submit : best_submit;
+        best_total = (total < best_total) ? total : best_total;
+    }
+    pool.stop();
+    report("ZThreadTask", mode, threads, n, best_submit, best_total);
+}
+
+template <typename F>
+static void run_batch_call(const char *name, ZThreadPool::ScheduleMode mode, uint32_t threads,
+        uint32_t n, const F &f) {
+    ZThreadPool pool(n);
+    pool.start(threads, mode);
+
+    uint64_t best_submit = ~uint64_t(0);
+    uint64_t best_total = ~uint64_t(0);
+    for (uint32_t round = 0; round < 3; ++round) {
+        ZTaskGroup group(&pool);
+        uint64_t begin = now_ns();
+        for (uint32_t i = 0; i < n; ++i) {
+            group.commit(f);
+        }
+        uint64_t submit = now_ns() - begin;
+        group.wait();
+        uint64_t total = now_ns() - begin;
+        best_submit = (submit < best_submit) ? submit : best_submit;
+        best_total = (total < best_total) ? total : best_total;
+    }
+    pool.stop();
+    report(name, mode, threads, n, best_submit, best_total);
+}
+
+/// the batch committed from a worker: times the whole fan-out and join
+static void run_fan_out(uint32_t threads, uint32_t n) {
+    ZThreadPool pool(n);
+    pool.start(threads, ZThreadPool::WORK_STEALING);
+    std::vector<EmptyTask*> tasks(n);
+
+    uint64_t task_ns = ~uint64_t(0);
+    uint64_t call_ns = ~uint64_t(0);
+    for (uint32_t round = 0; round < 3; ++round) {
+        ZTaskEvent done;
+        pool.commit([&] () {
+            uint64_t begin = now_ns();
+            {
+                ZTaskGroup group(&pool);
+                for (uint32_t i = 0; i < n; ++i) {
+                    tasks[i] = new EmptyTask;
+                    group.commit(tasks[i]);
+                }
+                group.wait();
+            }
+            for (uint32_t i = 0; i < n; ++i) {
+                delete tasks[i];
+            }
+            uint64_t ns = now_ns() - begin;
+            task_ns = (ns < task_ns) ? ns : task_ns;
+
+            begin = now_ns();
+            {
+                ZTaskGroup group(&pool);
+                for (uint32_t i = 0; i < n; ++i) {
+                    group.commit([] () {});
+                }
+                group.wait();
+            }
+            ns = now_ns() - begin;
+            call_ns = (ns < call_ns) ? ns : call_ns;
+        }, &done);
+        done.wait();
+    }
+    pool.stop();
+    printf("%-14s %8u %14.1f %14.1f\n", "work stealing", threads, double(task_ns) / n, double(call_ns) / n);
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t n = (argc > 1) ? atoi(argv[1]) : 100000;
+    uint32_t trips = (argc > 2) ? atoi(argv[2]) : 20000;
+    uint32_t max_threads = (argc > 3) ? atoi(argv[3]) : 4;
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("%u online cpus\n", uint32_t(sysconf(_SC_NPROCESSORS_ONLN) ) );
+
+    printf("\nround trip, ns per task, 1 thread\n%-14s %14s %14s\n", "", "ZThreadTask", "commit(F&&)");
+    run_round_trip(ZThreadPool::SHARED_QUEUE, trips);
+    run_round_trip(ZThreadPool::WORK_STEALING, trips);
+
+    const ZThreadPool::ScheduleMode modes[] = {ZThreadPool::SHARED_QUEUE, ZThreadPool::WORK_STEALING};
+    printf("\nbatch of %u, ns per task\n%-14s %-14s %8s %12s %12s\n", n, "", "", "threads", "submit", "total");
+    for (uint32_t threads = 1; threads <= max_threads; threads *= 2) {
+        for (uint32_t m = 0; m < 2; ++m) {
+            run_batch_task(modes[m], threads, n);
+            run_batch_call("commit(F&&)", modes[m], threads, n, [] () {});
+        }
+    }
+
+    printf("\nfan-out of %u from a worker, ns per task\n%-14s %8s %14s %14s\n", n, "", "threads", "ZThreadTask", "commit(F&&)");
+    for (uint32_t threads = 1; threads <= max_threads; threads *= 2) {
+        run_fan_out(threads, n);
+    }
+
+    printf("\ncapture, batch of %u, ns per task, 1 thread\n%-14s %-14s %8s %12s %12s\n", n, "", "", "threads", "submit", "total");
+    for (uint32_t m = 0; m < 2; ++m) {
+        run_batch_call("48B inline", modes[m], 1, n, Capture<ZCallTask::INLINE_BYTES>() );
+        run_batch_call("64B heap", modes[m], 1, n, Capture<64>() );
+    }
+    return 0;
+}
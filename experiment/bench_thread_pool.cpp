@@ -0,0 +1,204 @@
+/**
+ * @brief Fine grained task throughput of ZThreadPool, SHARED_QUEUE against
+ *        WORK_STEALING, from 1 to 64 threads.
+ *
+ * tree: a full binary tree of tasks, each committing its two children and
+ * never waiting, the leaves doing a few ns of work. Both modes.
+ *
+ * fib: fib(n) where every call above the cutoff commits fib(n - 1) as a
+ * task, computes fib(n - 2) itself and joins, running other tasks with
+ * run_one() meanwhile. WORK_STEALING only: a SHARED_QUEUE worker may hold
+ * the very child it waits for in its dequeued batch.
+ *
+ * usage: bench_thread_pool [tree_depth] [fib_n] [fib_cutoff] [max_threads]
+ */
+
+#include "experiment/bench.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <atomic>
+
+using namespace z;
+using namespace z::bench;
+
+/**
+ * The tasks of a run are preallocated and live until the next run: a task
+ * is still touched by signal_done() after its waiter sees DONE.
+ */
+template <typename TASK>
+struct Arena {
+    Arena(size_t n) : tasks(new TASK[n]), count(n) {}
+    ~Arena() {delete [] tasks; }
+
+    TASK* alloc() {return &tasks[next.fetch_add(1, std::memory_order_relaxed)]; }
+    void reset() {
+        for (size_t i = 0; i < count; ++i) {
+            tasks[i].reset();
+        }
+        next.store(0);
+    }
+
+    TASK                    *tasks;
+    size_t                  count;
+    std::atomic<uint32_t>   next;
+};
+
+class TreeTask : public ZThreadTask {
+public:
+    virtual int exec(void*);
+
+    ZThreadPool             *pool;
+    Arena<TreeTask>         *arena;
+    std::atomic<uint32_t>   *done;
+    uint32_t                depth;
+};
+
+int TreeTask::exec(void*) {
+    for (uint32_t i = 0; depth > 0 && i < 2; ++i) {
+        TreeTask *child = arena->alloc();
+        child->pool = pool;
+        child->arena = arena;
+        child->done = done;
+        child->depth = depth - 1;
+        if (!pool->commit(child) ) {
+            child->exec(nullptr);
+        }
+    }
+    keep(cycles() );
+    done->fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+class FibTask : public ZThreadTask {
+public:
+    virtual int exec(void*);
+
+    ZThreadPool     *pool;
+    Arena<FibTask>  *arena;
+    uint32_t        cutoff;
+    uint32_t        n;
+    uint64_t        result;
+};
+
+static uint64_t fib_seq(uint32_t n) {
+    return (n < 2) ? n : fib_seq(n - 1) + fib_seq(n - 2);
+}
+
+static uint64_t fib_tasks(uint32_t n, uint32_t cutoff) {
+    return (n < cutoff) ? 0 : 1 + fib_tasks(n - 1, cutoff) + fib_tasks(n - 2, cutoff);
+}
+
+static uint64_t fib(FibTask *self, uint32_t n) {
+    if (n < self->cutoff) {
+        return fib_seq(n);
+    }
+
+    FibTask *child = self->arena->alloc();
+    child->pool = self->pool;
+    child->arena = self->arena;
+    child->cutoff = self->cutoff;
+    child->n = n - 1;
+    child->result = 0;
+    if (!self->pool->commit(child) ) {
+        return fib(self, n - 1) + fib(self, n - 2);
+    }
+    uint64_t r = fib(self, n - 2);
+    while (child->status() != ZThreadTask::DONE) {
+        if (!self->pool->run_one() ) {
+            ::sched_yield();
+        }
+    }
+    return r + child->result;
+}
+
+int FibTask::exec(void*) {
+    result = fib(this, n);
+    return 0;
+}
+
+static void report(const char *name, uint32_t threads, uint64_t tasks, uint64_t best_ns, bool ok) {
+    printf("%-14s %8u %10lu %10.2f %10.1f %12.0f%s\n", name, threads, tasks, best_ns / 1e6,
+        double(best_ns) / tasks, tasks / (best_ns / 1e9), ok ? "" : "  WRONG");
+}
+
+static void run_tree(const char *name, ZThreadPool::ScheduleMode mode, uint32_t threads, uint32_t depth) {
+    // the shared queue unfolds the tree breadth first: room for all of it
+    uint32_t total = (2u << depth) - 1;
+    ZThreadPool pool( (mode == ZThreadPool::SHARED_QUEUE) ? total : 4096);
+    pool.start(threads, mode);
+    Arena<TreeTask> arena(total);
+    std::atomic<uint32_t> done(0);
+
+    uint64_t best = ~uint64_t(0);
+    for (uint32_t round = 0; round < 3; ++round) {
+        arena.reset();
+        done.store(0);
+        TreeTask *root = arena.alloc();
+        root->pool = &pool;
+        root->arena = &arena;
+        root->done = &done;
+        root->depth = depth;
+
+        uint64_t begin = now_ns();
+        pool.commit(root);
+        while (done.load() < total) {
+            ::sched_yield();
+        }
+        uint64_t ns = now_ns() - begin;
+        best = (ns < best) ? ns : best;
+    }
+    pool.stop();
+    report(name, threads, total, best, arena.next.load() == total);
+}
+
+static void run_fib(const char *name, uint32_t threads, uint32_t n, uint32_t cutoff) {
+    ZThreadPool pool(4096);
+    pool.start(threads, ZThreadPool::WORK_STEALING);
+    Arena<FibTask> arena(fib_tasks(n, cutoff) + 1);
+
+    uint64_t best = ~uint64_t(0);
+    uint64_t result = 0;
+    for (uint32_t round = 0; round < 3; ++round) {
+        arena.reset();
+        FibTask *root = arena.alloc();
+        root->pool = &pool;
+        root->arena = &arena;
+        root->cutoff = cutoff;
+        root->n = n;
+
+        uint64_t begin = now_ns();
+        pool.commit(root);
+        while (root->status() != ZThreadTask::DONE) {
+            ::sched_yield();
+        }
+        uint64_t ns = now_ns() - begin;
+        best = (ns < best) ? ns : best;
+        result = root->result;
+    }
+    pool.stop();
+    report(name, threads, arena.next.load(), best, result == fib_seq(n) );
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t depth = (argc > 1) ? atoi(argv[1]) : 16;
+    uint32_t n = (argc > 2) ? atoi(argv[2]) : 30;
+    uint32_t cutoff = (argc > 3) ? atoi(argv[3]) : 12;
+    uint32_t max_threads = (argc > 4) ? atoi(argv[4]) : 64;
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("%u online cpus\n", uint32_t(sysconf(_SC_NPROCESSORS_ONLN) ) );
+
+    printf("\ntree of depth %u\n%-14s %8s %10s %10s %10s %12s\n", depth, "", "threads", "tasks", "ms", "ns/task", "tasks/s");
+    for (uint32_t threads = 1; threads <= max_threads; threads *= 2) {
+        run_tree("shared queue", ZThreadPool::SHARED_QUEUE, threads, depth);
+        run_tree("work stealing", ZThreadPool::WORK_STEALING, threads, depth);
+    }
+
+    printf("\nfib(%u), below fib(%u) inline\n%-14s %8s %10s %10s %10s %12s\n", n, cutoff, "", "threads", "tasks", "ms", "ns/task", "tasks/s");
+    for (uint32_t threads = 1; threads <= max_threads; threads *= 2) {
+        run_fib("work stealing", threads, n, cutoff);
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+/**
+ * @brief TimingWheel with 1M timers: ns per add, per cancel and per expired
+ *        timer (advance() ticking 1ms at a time over the whole span, the
+ *        moves down the levels included), against a std::multimap timer
+ *        queue.
+ *
+ * usage: bench_timer_wheel [timers] [max_delay_ms]
+ */
+
+#include "experiment/bench.h"
+#include "algo_ds.h"
+#include <stdlib.h>
+#include <map>
+#include <vector>
+
+using namespace z;
+using namespace z::bench;
+
+struct Timer {
+    TimerNode       node;
+    uint64_t        expire_ms;
+    std::multimap<uint64_t, Timer*>::iterator it;
+};
+
+static void expired(TimerNode *node, void *arg) {
+    ++*(uint64_t*)(arg);
+    keep(Z_FIND_OBJ_BY_MEMBER(Timer, node, node)->expire_ms);
+}
+
+static void wheel_run(std::vector<Timer> &timers, uint64_t max_delay) {
+    TimingWheel<> wheel(1, 0);
+    uint64_t begin = now_ns();
+    for (size_t i = 0; i < timers.size(); ++i) {
+        wheel.add(&timers[i].node, timers[i].expire_ms);
+    }
+    double add_ns = double(now_ns() - begin) / timers.size();
+
+    begin = now_ns();
+    for (size_t i = 0; i < timers.size(); i += 2) {
+        wheel.cancel(&timers[i].node);
+    }
+    double cancel_ns = double(now_ns() - begin) / (timers.size() / 2);
+
+    uint64_t fired = 0;
+    begin = now_ns();
+    for (uint64_t now = 0; now <= max_delay; ++now) {
+        wheel.advance(now, expired, &fired);
+    }
+    double expire_ns = double(now_ns() - begin) / fired;
+
+    printf("%-12s %10.1f %10.1f %10.1f %10lu\n", "wheel", add_ns, cancel_ns, expire_ns, fired);
+}
+
+static void map_run(std::vector<Timer> &timers, uint64_t max_delay) {
+    std::multimap<uint64_t, Timer*> queue;
+    uint64_t begin = now_ns();
+    for (size_t i = 0; i < timers.size(); ++i) {
+        timers[i].it = queue.insert(std::make_pair(timers[i].expire_ms, &timers[i]) );
+    }
+    double add_ns = double(now_ns() - begin) / timers.size();
+
+    begin = now_ns();
+    for (size_t i = 0; i < timers.size(); i += 2) {
+        queue.erase(timers[i].it);
+    }
+    double cancel_ns = double(now_ns() - begin) / (timers.size() / 2);
+
+    uint64_t fired = 0;
+    begin = now_ns();
+    for (uint64_t now = 0; now <= max_delay; ++now) {
+        while (!queue.empty() && queue.begin()->first <= now) {
+            expired(&queue.begin()->second->node, &fired);
+            queue.erase(queue.begin() );
+        }
+    }
+    double expire_ns = double(now_ns() - begin) / fired;
+
+    printf("%-12s %10.1f %10.1f %10.1f %10lu\n", "multimap", add_ns, cancel_ns, expire_ns, fired);
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t n = (argc > 1) ? atoi(argv[1]) : 1000000;
+    uint64_t max_delay = (argc > 2) ? atoll(argv[2]) : 600000;
+
+    std::vector<Timer> timers(n);
+    Rand r;
+    for (uint32_t i = 0; i < n; ++i) {
+        timers[i].expire_ms = 1 + r.next() % max_delay;
+    }
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("%u online cpus, %u timers over %lu ms, 1ms ticks, ns per op\n",
+        uint32_t(sysconf(_SC_NPROCESSORS_ONLN) ), n, max_delay);
+    printf("%-12s %10s %10s %10s %10s\n", "", "add", "cancel", "expire", "fired");
+    wheel_run(timers, max_delay);
+    map_run(timers, max_delay);
+
+    return 0;
+}
@@ -0,0 +1,272 @@
+#include "algo_bloom.h"
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+namespace z {
+;
+
+enum {
+    BLOOM_BITS_ROUND    = 512,      ///< the bits are whole cache lines
+    BLOOM_MAX_K         = 32,
+};
+
+/// odd multipliers, one per lane, spreading a 32-bit key over 8 bit indexes
+const uint32_t BlockedBloomFilter::SALT[BlockedBloomFilter::LANES] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+};
+
+BloomFilterBase::BloomFilterBase(uint32_t kind)
+: _h(nullptr), _words(nullptr), _kind(kind), _readonly(false) {
+}
+
+BloomFilterBase::~BloomFilterBase() {
+    release();
+}
+
+void BloomFilterBase::release() {
+    if (!_readonly) {
+        ::free(_h);
+    }
+    _h = nullptr;
+    _words = nullptr;
+    _readonly = false;
+}
+
+bool BloomFilterBase::alloc(uint64_t bits, uint32_t k, uint64_t seed) {
+    release();
+    bits = (bits + BLOOM_BITS_ROUND - 1) / BLOOM_BITS_ROUND * BLOOM_BITS_ROUND;
+    size_t bytes = sizeof(BloomFileHeader) + bits / 8;
+    void *mem = nullptr;
+    if (0 != ::posix_memalign(&mem, DEF_SIZE_CACHE_LINE, bytes) ) {
+        ZLOG(LOG_WARN, "Fail to allocate a bloom filter of %lu bits.", bits);
+        return false;
+    }
+    ::memset(mem, 0, bytes);
+
+    _h = (BloomFileHeader*)(mem);
+    _h->magic = BLOOM_MAGIC;
+    _h->kind = _kind;
+    _h->bits = bits;
+    _h->count = 0;
+    _h->seed = seed;
+    _h->k = k;
+    _words = (uint64_t*)(_h + 1);
+    return true;
+}
+
+bool BloomFilterBase::check(const void *buf, size_t size) const {
+    Z_RET_IF(nullptr == buf || size < sizeof(BloomFileHeader) || (uintptr_t(buf) & 7), false);
+    const BloomFileHeader *h = (const BloomFileHeader*)(buf);
+    if (BLOOM_MAGIC != h->magic || _kind != h->kind || 0 == h->bits || (h->bits % BLOOM_BITS_ROUND)
+        || 0 == h->k || h->k > BLOOM_MAX_K || size < sizeof(BloomFileHeader) + h->bits / 8) {
+        ZLOG(LOG_WARN, "Not a bloom filter of kind %u. [size: %lu]", _kind, size);
+        return false;
+    }
+    return true;
+}
+
+bool BloomFilterBase::serialize(void *buf, size_t size) const {
+    Z_RET_IF(nullptr == _h || nullptr == buf || size < serialized_size(), false);
+    ::memcpy(buf, _h, serialized_size() );
+    return true;
+}
+
+bool BloomFilterBase::load(const void *buf, size_t size) {
+    Z_RET_IF(!check(buf, size), false);
+    const BloomFileHeader *h = (const BloomFileHeader*)(buf);
+    Z_RET_IF(!alloc(h->bits, h->k, h->seed), false);
+    ::memcpy(_h, h, sizeof(BloomFileHeader) + h->bits / 8);
+    return true;
+}
+
+bool BloomFilterBase::attach(const void *buf, size_t size) {
+    Z_RET_IF(!check(buf, size), false);
+    release();
+    _h = (BloomFileHeader*)(const_cast<void*>(buf) );
+    _words = (uint64_t*)(_h + 1);
+    _readonly = true;
+    return true;
+}
+
+void BloomFilterBase::clear() {
+    Z_RET_IF(nullptr == _h || _readonly, );
+    ::memset(_words, 0, _h->bits / 8);
+    _h->count = 0;
+}
+
+/**
+ * m = -n ln(fpr) / ln(2)^2 bits and k = m / n ln(2) are the optimum; k is
+ * rounded, so the rate is checked and m grown until it is met.
+ */
+bool BloomFilter::init(uint64_t n, double fpr_target, uint64_t seed) {
+    Z_RET_IF(!(fpr_target > 0 && fpr_target < 1), false);
+    n = (n > 0) ? n : 1;
+    double bpk = -::log(fpr_target) / (M_LN2 * M_LN2);
+    uint32_t k = uint32_t(::lround(bpk * M_LN2) );
+    k = (k < 1) ? 1 : ( (k > BLOOM_MAX_K) ? uint32_t(BLOOM_MAX_K) : k);
+    while (fpr(bpk, k) > fpr_target) {
+        bpk *= 1.01;
+    }
+    return alloc(uint64_t(::ceil(bpk * n) ), k, seed);
+}
+
+double BloomFilter::fpr(double bits_per_key, uint32_t k) {
+    return ::pow(1 - ::exp(-double(k) / bits_per_key), k);
+}
+
+/// the smallest bits per key meeting the rate, by bisection: fpr() falls with it
+bool BlockedBloomFilter::init(uint64_t n, double fpr_target, uint64_t seed) {
+    Z_RET_IF(!(fpr_target > 0 && fpr_target < 1), false);
+    n = (n > 0) ? n : 1;
+    double lo = 1;
+    double hi = 256;
+    for (int i = 0; i < 50; ++i) {
+        double mid = (lo + hi) / 2;
+        if (fpr(mid) > fpr_target) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return alloc(uint64_t(::ceil(hi * n) ), LANES, seed);
+}
+
+/**
+ * A block holding j keys answers yes for a stranger if each of the 8 lanes
+ * has its bit set, (1 - (31/32)^j)^8. j is Poisson with the mean number of
+ * keys per block, 256 / bits_per_key.
+ */
+double BlockedBloomFilter::fpr(double bits_per_key) {
+    double mean = BLOOM_BLOCK_BITS / bits_per_key;
+    double p = ::exp(-mean);    // P(j = 0)
+    double total = 0;
+    uint32_t last = uint32_t(mean + 12 * ::sqrt(mean) + 32);
+    for (uint32_t j = 0; j <= last; ++j) {
+        total += p * ::pow(1 - ::pow(31.0 / 32.0, j), LANES);
+        p *= mean / (j + 1);
+    }
+    return total;
+}
+
+} // namespace z
+
+#if Z_COMPILE_FLAG_ENABLE_UT
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace {
+;
+
+/// add n keys, none missed; the rate over other keys is near the target
+template <typename Filter>
+void check_bloom(uint64_t n, double rate) {
+    Filter f;
+    ASSERT_TRUE(f.init(n, rate, 7) );
+    for (uint64_t i = 0; i < n; ++i) {
+        f.add(&i, sizeof(i) );
+    }
+    ASSERT_EQ(n, f.count() );
+    for (uint64_t i = 0; i < n; ++i) {
+        ASSERT_TRUE(f.contains(&i, sizeof(i) ) ) << i;
+    }
+
+    uint64_t probes = 200000;
+    uint64_t hits = 0;
+    for (uint64_t i = n; i < n + probes; ++i) {
+        hits += f.contains(&i, sizeof(i) ) ? 1 : 0;
+    }
+    double measured = double(hits) / probes;
+    EXPECT_LT(measured, rate * 1.3) << n << " keys at " << rate;
+    EXPECT_GT(measured, rate * 0.5) << n << " keys at " << rate;
+}
+
+/// serialize, then load a copy and attach in place: the same answers
+template <typename Filter>
+void check_bloom_flat() {
+    Filter f;
+    ASSERT_TRUE(f.init(10000, 0.01) );
+    for (uint64_t i = 0; i < 10000; i += 2) {
+        f.add(&i, sizeof(i) );
+    }
+    std::vector<uint64_t> buf( (f.serialized_size() + 7) / 8);
+    ASSERT_FALSE(f.serialize(&buf[0], f.serialized_size() - 1) );
+    ASSERT_TRUE(f.serialize(&buf[0], f.serialized_size() ) );
+
+    Filter copy;
+    Filter view;
+    ASSERT_FALSE(view.attach(&buf[0], f.serialized_size() - 1) );
+    ASSERT_TRUE(copy.load(&buf[0], f.serialized_size() ) );
+    ASSERT_TRUE(view.attach(&buf[0], f.serialized_size() ) );
+    ASSERT_FALSE(copy.readonly() );
+    ASSERT_TRUE(view.readonly() );
+    ASSERT_EQ(f.bits(), view.bits() );
+    ASSERT_EQ(5000u, view.count() );
+    for (uint64_t i = 0; i < 20000; ++i) {
+        bool in = f.contains(&i, sizeof(i) );
+        ASSERT_EQ(in, copy.contains(&i, sizeof(i) ) );
+        ASSERT_EQ(in, view.contains(&i, sizeof(i) ) );
+    }
+
+    // the view ignores adds, the copy takes them
+    uint64_t key = 1000001;
+    view.add(&key, sizeof(key) );
+    ASSERT_EQ(5000u, view.count() );
+    copy.add(&key, sizeof(key) );
+    ASSERT_TRUE(copy.contains(&key, sizeof(key) ) );
+    copy.clear();
+    ASSERT_EQ(0u, copy.count() );
+
+    // nor does a filter with no bits yet
+    Filter none;
+    none.add(&key, sizeof(key) );
+    none.add_hash(key);
+    ASSERT_FALSE(none.valid() );
+    ASSERT_EQ(0u, none.count() );
+    ASSERT_FALSE(none.contains(&key, sizeof(key) ) );
+    ASSERT_FALSE(none.contains_hash(key) );
+}
+
+} // namespace
+
+TEST(ut_low_bloom, standard) {
+    using namespace z;
+
+    check_bloom<BloomFilter>(100000, 0.1);
+    check_bloom<BloomFilter>(100000, 0.01);
+    check_bloom<BloomFilter>(100000, 0.001);
+    check_bloom_flat<BloomFilter>();
+
+    ASSERT_FALSE(BloomFilter().init(100, 0) );
+    ASSERT_FALSE(BloomFilter().init(100, 1) );
+    // about 9.6 bits and 7 bits per key at 1%
+    BloomFilter f;
+    ASSERT_TRUE(f.init(1000000, 0.01) );
+    EXPECT_EQ(7u, f.k() );
+    EXPECT_NEAR(9.6, f.bits() / 1e6, 0.2);
+}
+
+TEST(ut_low_bloom, blocked) {
+    using namespace z;
+
+    check_bloom<BlockedBloomFilter>(100000, 0.1);
+    check_bloom<BlockedBloomFilter>(100000, 0.01);
+    check_bloom<BlockedBloomFilter>(100000, 0.001);
+    check_bloom_flat<BlockedBloomFilter>();
+
+    // a flat standard filter is not a blocked one
+    BloomFilter s;
+    ASSERT_TRUE(s.init(1000, 0.01) );
+    std::vector<uint64_t> buf( (s.serialized_size() + 7) / 8);
+    ASSERT_TRUE(s.serialize(&buf[0], s.serialized_size() ) );
+    BlockedBloomFilter b;
+    ASSERT_FALSE(b.load(&buf[0], s.serialized_size() ) );
+    ASSERT_FALSE(b.valid() );
+
+    // blocking costs bits: more than the standard filter at 1%
+    EXPECT_GT(BlockedBloomFilter::fpr(9.6), 0.01);
+    EXPECT_LT(BlockedBloomFilter::fpr(12), 0.01);
+}
+#endif
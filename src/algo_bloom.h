@@ -0,0 +1,195 @@
+#ifndef Z_ALGO_BLOOM_H__
+#define Z_ALGO_BLOOM_H__
+
+/**
+ * @brief Bloom filters over hash_bytes64(), sized from the expected key
+ *        count and a target false positive rate.
+ *
+ * BloomFilter is the standard one: k bits anywhere in the array, so k cache
+ * misses per query, and the fewest bits for a rate. BlockedBloomFilter puts
+ * all the bits of a key in one 256-bit block of a 64 byte aligned array, one
+ * bit per 32-bit lane: a query is one cache miss and one SIMD test, for some
+ * more bits per key at the same rate.
+ *
+ * Both serialize to a flat buffer, a 64 byte BloomFileHeader then the bits,
+ * in host byte order. attach() uses such a buffer in place, e.g. an mmap of
+ * the file, read only; load() copies it.
+ */
+
+#include "def.h"
+#include "algo_hash.h"
+#include <stdint.h>
+#include <stddef.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace z {
+;
+
+enum BloomKindEnum {
+    BLOOM_STANDARD      = 1,
+    BLOOM_BLOCKED       = 2,
+};
+
+enum {
+    BLOOM_MAGIC         = 0x31465A42,   ///< "BZF1"
+    BLOOM_BLOCK_BITS    = 256,
+};
+
+struct BloomFileHeader {
+    uint32_t    magic;
+    uint32_t    kind;
+    uint64_t    bits;       ///< a multiple of 512
+    uint64_t    count;      ///< keys added
+    uint64_t    seed;       ///< of hash_bytes64()
+    uint32_t    k;          ///< bits per key
+    uint32_t    reserved[7];
+};
+static_assert(sizeof(BloomFileHeader) == 64, "the bits start on a cache line");
+
+/**
+ * @brief The storage and the flat format shared by the two filters.
+ */
+class BloomFilterBase {
+private:
+    Z_DECLARE_COPY_FUNCTIONS(BloomFilterBase);
+public:
+    bool valid() const {return nullptr != _h; }
+    bool readonly() const {return _readonly; }
+    uint64_t bits() const {return _h ? _h->bits : 0; }
+    uint64_t count() const {return _h ? _h->count : 0; }
+    uint64_t seed() const {return _h ? _h->seed : 0; }
+    uint32_t k() const {return _h ? _h->k : 0; }
+
+    /// the size of the flat buffer
+    size_t serialized_size() const {return _h ? sizeof(BloomFileHeader) + _h->bits / 8 : 0; }
+    bool serialize(void *buf, size_t size) const;
+    /// copy a flat buffer, the filter may be added to
+    bool load(const void *buf, size_t size);
+    /// use a flat buffer in place, read only; it must outlive the filter
+    bool attach(const void *buf, size_t size);
+    void clear();
+protected:
+    explicit BloomFilterBase(uint32_t kind);
+    ~BloomFilterBase();
+
+    bool alloc(uint64_t bits, uint32_t k, uint64_t seed);
+    bool check(const void *buf, size_t size) const;
+    void release();
+protected:
+    BloomFileHeader *_h;
+    uint64_t        *_words;
+    uint32_t        _kind;
+    bool            _readonly;
+};
+
+class BloomFilter : public BloomFilterBase {
+public:
+    BloomFilter() : BloomFilterBase(BLOOM_STANDARD) {}
+
+    /// room for n keys at a false positive rate of fpr, in (0, 1)
+    bool init(uint64_t n, double fpr, uint64_t seed = 0);
+
+    /// a filter not yet set up takes no keys and contains none
+    void add_hash(uint64_t h);
+    bool contains_hash(uint64_t h) const;
+    void add(const void *key, size_t len) {add_hash(hash_bytes64(key, len, seed() ) ); }
+    bool contains(const void *key, size_t len) const {return contains_hash(hash_bytes64(key, len, seed() ) ); }
+
+    /// the expected false positive rate with bits_per_key and k bits per key
+    static double fpr(double bits_per_key, uint32_t k);
+private:
+    /// double hashing: h, h + d, h + 2d, ... mapped onto the bits
+    static uint64_t step(uint64_t h) {return ( (h >> 29) | (h << 35) ) | 1; }
+    static uint64_t bit_of(uint64_t h, uint64_t bits) {return uint64_t( (__uint128_t(h) * bits) >> 64); }
+};
+
+class BlockedBloomFilter : public BloomFilterBase {
+public:
+    BlockedBloomFilter() : BloomFilterBase(BLOOM_BLOCKED) {}
+
+    /// room for n keys at a false positive rate of fpr, in (0, 1)
+    bool init(uint64_t n, double fpr, uint64_t seed = 0);
+
+    /// a filter not yet set up takes no keys and contains none
+    void add_hash(uint64_t h);
+    bool contains_hash(uint64_t h) const;
+    void add(const void *key, size_t len) {add_hash(hash_bytes64(key, len, seed() ) ); }
+    bool contains(const void *key, size_t len) const {return contains_hash(hash_bytes64(key, len, seed() ) ); }
+
+    /// the expected false positive rate with bits_per_key
+    static double fpr(double bits_per_key);
+private:
+    enum {
+        LANES   = BLOOM_BLOCK_BITS / 32,
+    };
+
+    /// the high bits of h pick the block, the low 32 bits the bit of each lane
+    const uint32_t* block(uint64_t h) const {
+        return (const uint32_t*)(_words) + LANES * uint64_t( (__uint128_t(h) * (_h->bits / BLOOM_BLOCK_BITS) ) >> 64);
+    }
+    static const uint32_t SALT[LANES];
+};
+
+// ------------------------------------------------------------------------ //
+
+inline void BloomFilter::add_hash(uint64_t h) {
+    Z_RET_IF(nullptr == _h || _readonly, );
+    uint64_t d = step(h);
+    for (uint32_t i = 0; i < _h->k; ++i, h += d) {
+        uint64_t b = bit_of(h, _h->bits);
+        _words[b >> 6] |= uint64_t(1) << (b & 63);
+    }
+    ++_h->count;
+}
+
+inline bool BloomFilter::contains_hash(uint64_t h) const {
+    Z_RET_IF(nullptr == _h, false);
+    uint64_t d = step(h);
+    for (uint32_t i = 0; i < _h->k; ++i, h += d) {
+        uint64_t b = bit_of(h, _h->bits);
+        if (!(_words[b >> 6] & (uint64_t(1) << (b & 63) ) ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline void BlockedBloomFilter::add_hash(uint64_t h) {
+    Z_RET_IF(nullptr == _h || _readonly, );
+    uint32_t *b = const_cast<uint32_t*>(block(h) );
+    uint32_t key = uint32_t(h);
+#ifdef __AVX2__
+    __m256i x = _mm256_mullo_epi32(_mm256_set1_epi32(int32_t(key) ), _mm256_loadu_si256((const __m256i*)(SALT) ) );
+    __m256i mask = _mm256_sllv_epi32(_mm256_set1_epi32(1), _mm256_srli_epi32(x, 27) );
+    _mm256_store_si256((__m256i*)(b), _mm256_or_si256(_mm256_load_si256((const __m256i*)(b) ), mask) );
+#else
+    for (uint32_t i = 0; i < LANES; ++i) {
+        b[i] |= 1u << ( (key * SALT[i]) >> 27);
+    }
+#endif
+    ++_h->count;
+}
+
+inline bool BlockedBloomFilter::contains_hash(uint64_t h) const {
+    Z_RET_IF(nullptr == _h, false);
+    const uint32_t *b = block(h);
+    uint32_t key = uint32_t(h);
+#ifdef __AVX2__
+    __m256i x = _mm256_mullo_epi32(_mm256_set1_epi32(int32_t(key) ), _mm256_loadu_si256((const __m256i*)(SALT) ) );
+    __m256i mask = _mm256_sllv_epi32(_mm256_set1_epi32(1), _mm256_srli_epi32(x, 27) );
+    // an attached buffer may be aligned to 8 bytes only
+    return _mm256_testc_si256(_mm256_loadu_si256((const __m256i*)(b) ), mask);
+#else
+    uint32_t miss = 0;
+    for (uint32_t i = 0; i < LANES; ++i) {
+        miss |= ~b[i] & (1u << ( (key * SALT[i]) >> 27) );
+    }
+    return 0 == miss;
+#endif
+}
+
+} // namespace z
+
+#endif
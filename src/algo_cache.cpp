@@ -0,0 +1,139 @@
+#include "algo_cache.h"
+
+#if Z_COMPILE_FLAG_ENABLE_UT 
+#include <gtest/gtest.h>
+TEST(ut_low_cache, get_put) {
+    using namespace z;
+
+    ZCache<uint64_t, uint64_t> c(16 * 100, 4);
+    uint64_t v = 0;
+    ASSERT_FALSE(c.get(1, &v) );
+    c.put(1, 100);
+    ASSERT_TRUE(c.get(1, &v) );
+    ASSERT_EQ(100u, v);
+    c.put(1, 200);
+    ASSERT_TRUE(c.get(1, &v) );
+    ASSERT_EQ(200u, v);
+    ASSERT_EQ(1u, c.size() );
+    ASSERT_EQ(16u, c.bytes() );
+    ASSERT_TRUE(c.erase(1) );
+    ASSERT_FALSE(c.erase(1) );
+    ASSERT_FALSE(c.get(1) );
+    ASSERT_EQ(0u, c.bytes() );
+
+    // an entry larger than a shard is not cached, nor is the old value kept
+    c.put(2, 20);
+    ASSERT_TRUE(c.get(2, &v) );
+    ASSERT_EQ(20u, v);
+    c.put(2, 2, 1000);
+    ASSERT_FALSE(c.get(2, &v) );
+    ASSERT_EQ(0u, c.size() );
+    ASSERT_EQ(0u, c.bytes() );
+
+    ZCacheStats st;
+    c.stats(&st);
+    EXPECT_EQ(3u, st.hits);
+    EXPECT_EQ(3u, st.misses);
+    EXPECT_EQ(3u, st.inserts);
+}
+
+TEST(ut_low_cache, clock_eviction) {
+    using namespace z;
+
+    // one shard of 10 entries
+    ZCache<std::string, uint32_t, ZNoLock> c(10 * 100, 1);
+    for (uint32_t i = 0; i < 10; ++i) {
+        c.put("key" + std::to_string(i), i, 100);
+    }
+    ASSERT_EQ(10u, c.size() );
+
+    // referenced entries survive a sweep, the others go in order
+    for (uint32_t i = 0; i < 10; i += 2) {
+        ASSERT_TRUE(c.get("key" + std::to_string(i) ) );
+    }
+    for (uint32_t i = 10; i < 15; ++i) {
+        c.put("key" + std::to_string(i), i, 100);
+    }
+    ASSERT_EQ(10u, c.size() );
+    ASSERT_LE(c.bytes(), c.capacity() );
+    for (uint32_t i = 0; i < 10; ++i) {
+        EXPECT_EQ(i % 2 == 0, c.get("key" + std::to_string(i) ) ) << i;
+    }
+    for (uint32_t i = 10; i < 15; ++i) {
+        EXPECT_TRUE(c.get("key" + std::to_string(i) ) ) << i;
+    }
+
+    // a big entry pushes out several
+    c.put("big", 1, 450);
+    EXPECT_TRUE(c.get("big") );
+    EXPECT_LE(c.bytes(), c.capacity() );
+    ZCacheStats st;
+    c.stats(&st);
+    EXPECT_EQ(10u, st.evictions);
+
+    c.clear();
+    EXPECT_EQ(0u, c.size() );
+    EXPECT_FALSE(c.get("big") );
+}
+
+TEST(ut_low_cache, ttl) {
+    using namespace z;
+
+    ZCache<uint32_t, uint32_t> c(1 << 20);
+    c.put(1, 1, 0, 30);
+    c.put(2, 2);
+    ASSERT_TRUE(c.get(1) );
+    zsleep_ms(50);
+    ASSERT_FALSE(c.get(1) );
+    ASSERT_TRUE(c.get(2) );
+    ASSERT_EQ(1u, c.size() );
+    ZCacheStats st;
+    c.stats(&st);
+    EXPECT_EQ(1u, st.expirations);
+}
+
+struct CacheArgs {
+    z::ZCache<uint64_t, uint64_t>   *cache;
+    uint32_t    id;
+    uint32_t    errors;
+};
+
+static void *cache_main(void *arg) {
+    CacheArgs *a = (CacheArgs*)(arg);
+    uint64_t v = 0;
+    for (uint64_t i = 0; i < 50000; ++i) {
+        uint64_t k = (i * 7919 + a->id) % 3000;
+        if (a->cache->get(k, &v) ) {
+            a->errors += (v != k * 3);
+        } else {
+            a->cache->put(k, k * 3);
+        }
+    }
+    return nullptr;
+}
+
+TEST(ut_low_cache, threads) {
+    using namespace z;
+
+    const uint32_t N = 4;
+    ZCache<uint64_t, uint64_t> c(16 * 1000, 8);
+    pthread_t ids[N];
+    CacheArgs args[N];
+    for (uint32_t i = 0; i < N; ++i) {
+        args[i].cache = &c;
+        args[i].id = i;
+        args[i].errors = 0;
+        pthread_create(&ids[i], nullptr, cache_main, &args[i]);
+    }
+    for (uint32_t i = 0; i < N; ++i) {
+        pthread_join(ids[i], nullptr);
+        EXPECT_EQ(0u, args[i].errors);
+    }
+    EXPECT_LE(c.bytes(), c.capacity() );
+    ZCacheStats st;
+    c.stats(&st);
+    EXPECT_EQ(N * 50000u, st.hits + st.misses);
+    EXPECT_GT(st.evictions, 0u);
+}
+
+#endif // Z_COMPILE_FLAG_ENABLE_UT
@@ -0,0 +1,308 @@
+#ifndef Z_ALGO_CACHE_H__
+#define Z_ALGO_CACHE_H__
+
+/**
+ * @brief ZCache: a bounded cache sharded by key hash.
+ *
+ * Every shard has its own lock, a HashTable64 from the 64-bit key hash to an
+ * entry, and CLOCK eviction: a hit only sets the entry's reference bit, so
+ * the hit path moves nothing. On insert the hand sweeps the entries, giving
+ * referenced ones a second chance, until the new entry's bytes fit. Two keys
+ * with the same 64-bit hash share one entry, the later replaces the earlier.
+ *
+ * The capacity is in bytes, split evenly over the shards; an entry charges
+ * the bytes given to put(), or sizeof(K) + sizeof(V). A TTL makes the entry
+ * expire that many ms after put(), checked with zmonotonic_ms().
+ */
+
+#include "algo_ds.h"
+#include "thread.h"
+#include "tm.h"
+#include <string>
+#include <vector>
+
+namespace z {
+;
+
+/// the key hash of ZCache, integers and std::string are built in
+template <typename K>
+    struct ZCacheHash {
+        uint64_t operator()(const K &k) const {return hash_int64(uint64_t(k) ); }
+    };
+
+template <>
+    struct ZCacheHash<std::string> {
+        uint64_t operator()(const std::string &k) const {return hash_bytes64(k.data(), k.size() ); }
+    };
+
+struct ZCacheStats {
+    uint64_t    hits;
+    uint64_t    misses;
+    uint64_t    inserts;
+    uint64_t    evictions;
+    uint64_t    expirations;
+};
+
+template <typename K, typename V, typename LOCK = z::ZSpinLock, typename HASH = ZCacheHash<K> >
+    class ZCache {
+    private:
+        Z_DECLARE_COPY_FUNCTIONS(ZCache);
+    public:
+        ZCache(uint64_t capacity_bytes, uint32_t shard_num = 16);
+        ~ZCache();
+
+        bool get(const K &key, V *value = nullptr);
+        /// bytes = 0 charges sizeof(K) + sizeof(V), ttl_ms = 0 never expires;
+        /// a value larger than a shard is not cached, the old one is dropped
+        void put(const K &key, const V &value, uint32_t bytes = 0, uint32_t ttl_ms = 0);
+        bool erase(const K &key);
+        void clear();
+
+        uint32_t size() const;
+        uint64_t bytes() const;
+        uint64_t capacity() const {return _capacity; }
+        void stats(ZCacheStats *s) const;
+    private:
+        enum {
+            NIL             = 0xFFFFFFFF,
+        };
+
+        struct Entry {
+            K           key;
+            V           value;
+            uint64_t    hash;
+            uint64_t    expire_ms;  ///< 0 for none
+            uint32_t    bytes;
+            uint8_t     used;
+            uint8_t     ref;
+        };
+
+        struct __attribute__((aligned(DEF_SIZE_CACHE_LINE))) Shard {
+            LOCK                    lock;
+            HashTable64<uint32_t>   index;      ///< key hash -> entry
+            std::vector<Entry>      entries;
+            std::vector<uint32_t>   free;
+            uint32_t                hand;
+            uint64_t                bytes;
+            uint64_t                capacity;
+            ZCacheStats             stats;
+        };
+
+        Shard &shard(uint64_t h) const {return _shards[(h >> 32) & (_shard_num - 1)]; }
+        static bool expired(const Entry &e);
+        static void remove(Shard *s, uint32_t idx);
+        static void evict(Shard *s, uint64_t need);
+    private:
+        Shard       *_shards;
+        uint32_t    _shard_num;
+        uint64_t    _capacity;
+    };
+
+// ------------------------------------------------------------------------ //
+
+template <typename K, typename V, typename LOCK, typename HASH>
+    ZCache<K, V, LOCK, HASH>::ZCache(uint64_t capacity_bytes, uint32_t shard_num)
+    : _shards(nullptr), _shard_num(1), _capacity(capacity_bytes) {
+        while (_shard_num < shard_num && _shard_num < (1u << 16) ) {
+            _shard_num *= 2;
+        }
+
+        void *mem = nullptr;
+        int ret = posix_memalign(&mem, DEF_SIZE_CACHE_LINE, sizeof(Shard) * _shard_num);
+        ZASSERT(0 == ret);
+        Z_USE_VAR(ret);
+        _shards = (Shard*)(mem);
+        for (uint32_t i = 0; i < _shard_num; ++i) {
+            Shard *s = new (&_shards[i]) Shard();
+            s->hand = 0;
+            s->bytes = 0;
+            s->capacity = capacity_bytes / _shard_num;
+            ::memset(&s->stats, 0, sizeof(s->stats) );
+        }
+    }
+
+template <typename K, typename V, typename LOCK, typename HASH>
+    ZCache<K, V, LOCK, HASH>::~ZCache() {
+        for (uint32_t i = 0; i < _shard_num; ++i) {
+            _shards[i].~Shard();
+        }
+        ::free(_shards);
+        _shards = nullptr;
+    }
+
+template <typename K, typename V, typename LOCK, typename HASH>
+    bool ZCache<K, V, LOCK, HASH>::get(const K &key, V *value) {
+        uint64_t h = HASH()(key);
+        Shard &s = shard(h);
+        uint32_t idx = NIL;
+        s.lock.lock();
+        if (!s.index.find(h, &idx) || !(s.entries[idx].key == key) ) {
+            ++s.stats.misses;
+            s.lock.unlock();
+            return false;
+        }
+
+        Entry &e = s.entries[idx];
+        if (expired(e) ) {
+            remove(&s, idx);
+            ++s.stats.expirations;
+            ++s.stats.misses;
+            s.lock.unlock();
+            return false;
+        }
+        e.ref = 1;
+        if (value) {
+            *value = e.value;
+        }
+        ++s.stats.hits;
+        s.lock.unlock();
+        return true;
+    }
+
+template <typename K, typename V, typename LOCK, typename HASH>
+    void ZCache<K, V, LOCK, HASH>::put(const K &key, const V &value, uint32_t bytes, uint32_t ttl_ms) {
+        uint64_t h = HASH()(key);
+        Shard &s = shard(h);
+        bytes = bytes ? bytes : uint32_t(sizeof(K) + sizeof(V) );
+        uint64_t expire_ms = ttl_ms ? zmonotonic_ms() + ttl_ms : 0;
+
+        s.lock.lock();
+        uint32_t idx = NIL;
+        if (s.index.find(h, &idx) ) {
+            remove(&s, idx);
+        }
+        if (bytes > s.capacity) {
+            // not cached, and the old value must not outlive the put
+            s.lock.unlock();
+            return;
+        }
+        evict(&s, bytes);
+
+        if (s.free.empty() ) {
+            idx = uint32_t(s.entries.size() );
+            s.entries.push_back(Entry() );
+        } else {
+            idx = s.free.back();
+            s.free.pop_back();
+        }
+        Entry &e = s.entries[idx];
+        e.key = key;
+        e.value = value;
+        e.hash = h;
+        e.expire_ms = expire_ms;
+        e.bytes = bytes;
+        e.used = 1;
+        e.ref = 0;
+        s.index.insert(h, idx);
+        s.bytes += bytes;
+        ++s.stats.inserts;
+        s.lock.unlock();
+    }
+
+template <typename K, typename V, typename LOCK, typename HASH>
+    bool ZCache<K, V, LOCK, HASH>::erase(const K &key) {
+        uint64_t h = HASH()(key);
+        Shard &s = shard(h);
+        uint32_t idx = NIL;
+        s.lock.lock();
+        bool found = s.index.find(h, &idx) && s.entries[idx].key == key;
+        if (found) {
+            remove(&s, idx);
+        }
+        s.lock.unlock();
+        return found;
+    }
+
+template <typename K, typename V, typename LOCK, typename HASH>
+    void ZCache<K, V, LOCK, HASH>::clear() {
+        for (uint32_t i = 0; i < _shard_num; ++i) {
+            Shard &s = _shards[i];
+            s.lock.lock();
+            s.index.clear();
+            s.entries.clear();
+            s.free.clear();
+            s.hand = 0;
+            s.bytes = 0;
+            s.lock.unlock();
+        }
+    }
+
+template <typename K, typename V, typename LOCK, typename HASH>
+    uint32_t ZCache<K, V, LOCK, HASH>::size() const {
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < _shard_num; ++i) {
+            n += _shards[i].index.size();
+        }
+        return n;
+    }
+
+template <typename K, typename V, typename LOCK, typename HASH>
+    uint64_t ZCache<K, V, LOCK, HASH>::bytes() const {
+        uint64_t n = 0;
+        for (uint32_t i = 0; i < _shard_num; ++i) {
+            n += _shards[i].bytes;
+        }
+        return n;
+    }
+
+/// a snapshot, the shards are read without their locks
+template <typename K, typename V, typename LOCK, typename HASH>
+    void ZCache<K, V, LOCK, HASH>::stats(ZCacheStats *out) const {
+        Z_RET_IF_ANY_ZERO_1(out, );
+        ::memset(out, 0, sizeof(*out) );
+        for (uint32_t i = 0; i < _shard_num; ++i) {
+            const ZCacheStats &s = _shards[i].stats;
+            out->hits += s.hits;
+            out->misses += s.misses;
+            out->inserts += s.inserts;
+            out->evictions += s.evictions;
+            out->expirations += s.expirations;
+        }
+    }
+
+template <typename K, typename V, typename LOCK, typename HASH>
+    bool ZCache<K, V, LOCK, HASH>::expired(const Entry &e) {
+        return e.expire_ms && zmonotonic_ms() >= e.expire_ms;
+    }
+
+template <typename K, typename V, typename LOCK, typename HASH>
+    void ZCache<K, V, LOCK, HASH>::remove(Shard *s, uint32_t idx) {
+        Entry &e = s->entries[idx];
+        s->index.erase(e.hash);
+        s->bytes -= e.bytes;
+        e.used = 0;
+        e.key = K();
+        e.value = V();
+        s->free.push_back(idx);
+    }
+
+/**
+ * Sweep the hand until need more bytes fit: a referenced entry loses its
+ * bit and is passed over once, an expired or unreferenced one goes.
+ */
+template <typename K, typename V, typename LOCK, typename HASH>
+    void ZCache<K, V, LOCK, HASH>::evict(Shard *s, uint64_t need) {
+        uint64_t now = (s->bytes + need > s->capacity) ? zmonotonic_ms() : 0;
+        while (s->bytes + need > s->capacity) {
+            if (s->hand >= s->entries.size() ) {
+                s->hand = 0;
+            }
+            Entry &e = s->entries[s->hand];
+            if (e.used) {
+                if (e.expire_ms && now >= e.expire_ms) {
+                    remove(s, s->hand);
+                    ++s->stats.expirations;
+                } else if (e.ref) {
+                    e.ref = 0;
+                } else {
+                    remove(s, s->hand);
+                    ++s->stats.evictions;
+                }
+            }
+            ++s->hand;
+        }
+    }
+
+} // namespace z
+
+#endif
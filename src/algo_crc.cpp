@@ -0,0 +1,245 @@
+#include "algo_crc.h"
+#include <string.h>
+#include <nmmintrin.h>
+
+namespace z {
+;
+
+enum {
+    CRC32C_POLY         = 0x82F63B78u,  // reflected
+    CRC32C_LONG         = 8192,         // stream length of the interleaved kernel
+    CRC32C_SHORT        = 256,
+};
+
+// a * b modulo the polynomial, both in the reflected bit order
+static uint32_t crc32c_multmodp(uint32_t a, uint32_t b) {
+    uint32_t m = 1u << 31;
+    uint32_t p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = (b & 1) ? ((b >> 1) ^ CRC32C_POLY) : (b >> 1);
+    }
+    return p;
+}
+
+struct Crc32cTables {
+    uint32_t    slice[8][256];      // slicing-by-8
+    uint32_t    x2n[32];            // x^(2^n) mod p
+    uint32_t    shift_long[4][256]; // multiply by x^(8 * CRC32C_LONG), bytewise
+    uint32_t    shift_short[4][256];
+
+    Crc32cTables() {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (uint32_t k = 0; k < 8; ++k) {
+                c = (c & 1) ? ((c >> 1) ^ CRC32C_POLY) : (c >> 1);
+            }
+            slice[0][n] = c;
+        }
+        for (uint32_t n = 0; n < 256; ++n) {
+            for (uint32_t k = 1; k < 8; ++k) {
+                slice[k][n] = (slice[k - 1][n] >> 8) ^ slice[0][slice[k - 1][n] & 0xFF];
+            }
+        }
+
+        uint32_t p = 1u << 30;  // x^1
+        x2n[0] = p;
+        for (uint32_t n = 1; n < 32; ++n) {
+            x2n[n] = p = crc32c_multmodp(p, p);
+        }
+
+        build_shift(shift_long, x2nmodp(CRC32C_LONG, 3) );
+        build_shift(shift_short, x2nmodp(CRC32C_SHORT, 3) );
+    }
+
+    // x^(n * 2^k) mod p
+    uint32_t x2nmodp(size_t n, uint32_t k) const {
+        uint32_t p = 1u << 31;  // x^0
+        while (n) {
+            if (n & 1) {
+                p = crc32c_multmodp(x2n[k & 31], p);
+            }
+            n >>= 1;
+            ++k;
+        }
+        return p;
+    }
+
+    static void build_shift(uint32_t table[4][256], uint32_t op) {
+        for (uint32_t n = 0; n < 256; ++n) {
+            for (uint32_t k = 0; k < 4; ++k) {
+                table[k][n] = crc32c_multmodp(op, n << (8 * k) );
+            }
+        }
+    }
+};
+
+static const Crc32cTables &crc32c_tables() {
+    static const Crc32cTables tables;
+    return tables;
+}
+
+static inline uint32_t crc32c_shift(const uint32_t table[4][256], uint32_t crc) {
+    return table[0][crc & 0xFF] ^ table[1][(crc >> 8) & 0xFF]
+         ^ table[2][(crc >> 16) & 0xFF] ^ table[3][crc >> 24];
+}
+
+static inline uint64_t crc32c_read8(const uint8_t *p) {
+    uint64_t v;
+    ::memcpy(&v, p, sizeof(v) );
+    return v;
+}
+
+uint32_t crc32c_sw(const void *data, size_t size, uint32_t crc) {
+    const Crc32cTables &t = crc32c_tables();
+    const uint8_t *p = (const uint8_t*)(data);
+    uint32_t c = ~crc;
+
+    while (size && (uintptr_t(p) & 7) ) {
+        c = t.slice[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+        --size;
+    }
+
+    while (size >= 8) {
+        uint64_t w = crc32c_read8(p) ^ c;
+        c = t.slice[7][w & 0xFF]         ^ t.slice[6][(w >> 8) & 0xFF]
+          ^ t.slice[5][(w >> 16) & 0xFF] ^ t.slice[4][(w >> 24) & 0xFF]
+          ^ t.slice[3][(w >> 32) & 0xFF] ^ t.slice[2][(w >> 40) & 0xFF]
+          ^ t.slice[1][(w >> 48) & 0xFF] ^ t.slice[0][w >> 56];
+        p += 8;
+        size -= 8;
+    }
+
+    while (size--) {
+        c = t.slice[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+    }
+
+    return ~c;
+}
+
+/**
+ * Three streams of `len' bytes each are fed to independent crc32 chains, then
+ * joined: crc(A + B + C) = shift(shift(crc(A)) ^ crc(B)) ^ crc(C), where the
+ * chains of B and C start from 0 and shift() appends `len' zero bytes.
+ */
+__attribute__((target("sse4.2")))
+static inline uint64_t crc32c_hw_3way(uint64_t c0, const uint8_t **pp, size_t len,
+                                      const uint32_t shift[4][256]) {
+    const uint8_t *p = *pp;
+    const uint8_t *end = p + len;
+    uint64_t c1 = 0;
+    uint64_t c2 = 0;
+    do {
+        c0 = _mm_crc32_u64(c0, crc32c_read8(p) );
+        c1 = _mm_crc32_u64(c1, crc32c_read8(p + len) );
+        c2 = _mm_crc32_u64(c2, crc32c_read8(p + 2 * len) );
+        p += 8;
+    } while (p < end);
+
+    c0 = crc32c_shift(shift, uint32_t(c0) ) ^ c1;
+    c0 = crc32c_shift(shift, uint32_t(c0) ) ^ c2;
+    *pp = p + 2 * len;
+    return c0;
+}
+
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hw(const void *data, size_t size, uint32_t crc) {
+    const Crc32cTables &t = crc32c_tables();
+    const uint8_t *p = (const uint8_t*)(data);
+    uint64_t c = uint32_t(~crc);
+
+    while (size && (uintptr_t(p) & 7) ) {
+        c = _mm_crc32_u8(uint32_t(c), *p++);
+        --size;
+    }
+
+    while (size >= 3 * CRC32C_LONG) {
+        c = crc32c_hw_3way(c, &p, CRC32C_LONG, t.shift_long);
+        size -= 3 * CRC32C_LONG;
+    }
+
+    while (size >= 3 * CRC32C_SHORT) {
+        c = crc32c_hw_3way(c, &p, CRC32C_SHORT, t.shift_short);
+        size -= 3 * CRC32C_SHORT;
+    }
+
+    while (size >= 8) {
+        c = _mm_crc32_u64(c, crc32c_read8(p) );
+        p += 8;
+        size -= 8;
+    }
+
+    while (size--) {
+        c = _mm_crc32_u8(uint32_t(c), *p++);
+    }
+
+    return ~uint32_t(c);
+}
+
+bool crc32c_hw_available() {
+    static const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+    return has_sse42;
+}
+
+uint32_t crc32c(const void *data, size_t size, uint32_t crc) {
+    return crc32c_hw_available() ? crc32c_hw(data, size, crc) : crc32c_sw(data, size, crc);
+}
+
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, size_t size_b) {
+    const Crc32cTables &t = crc32c_tables();
+    return crc32c_multmodp(t.x2nmodp(size_b, 3), crc_a) ^ crc_b;
+}
+
+} // namespace z
+
+#if Z_COMPILE_FLAG_ENABLE_UT
+#include <gtest/gtest.h>
+#include <vector>
+TEST(ut_low_crc, crc32c) {
+    using namespace z;
+
+    // RFC 3720 B.4 test vectors
+    uint8_t buf[32];
+    memset(buf, 0, sizeof(buf) );
+    EXPECT_EQ(0x8A9136AAu, crc32c(buf, sizeof(buf) ) );
+    memset(buf, 0xFF, sizeof(buf) );
+    EXPECT_EQ(0x62A8AB43u, crc32c(buf, sizeof(buf) ) );
+    for (uint32_t i = 0; i < sizeof(buf); ++i) {
+        buf[i] = uint8_t(i);
+    }
+    EXPECT_EQ(0x46DD794Eu, crc32c(buf, sizeof(buf) ) );
+    EXPECT_EQ(0xE3069283u, crc32c("123456789", 9) );
+    EXPECT_EQ(0xE3069283u, crc32c_sw("123456789", 9) );
+}
+
+TEST(ut_low_crc, hw_sw_combine) {
+    using namespace z;
+
+    std::vector<uint8_t> data(3 * 8192 * 2 + 1000);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = uint8_t(i * 131 + (i >> 7) );
+    }
+
+    const size_t sizes[] = {0, 1, 7, 8, 255, 768, 769, 3 * 8192, data.size() - 3};
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        uint32_t sw = crc32c_sw(&data[3], sizes[i]);
+        if (crc32c_hw_available() ) {
+            EXPECT_EQ(sw, crc32c_hw(&data[3], sizes[i]) ) << sizes[i];
+        }
+
+        // extend and combine across a split point
+        size_t half = sizes[i] / 3;
+        uint32_t a = crc32c(&data[3], half);
+        uint32_t b = crc32c(&data[3 + half], sizes[i] - half);
+        EXPECT_EQ(sw, crc32c(&data[3 + half], sizes[i] - half, a) ) << sizes[i];
+        EXPECT_EQ(sw, crc32c_combine(a, b, sizes[i] - half) ) << sizes[i];
+    }
+}
+
+#endif // Z_COMPILE_FLAG_ENABLE_UT
@@ -0,0 +1,32 @@
+#ifndef Z_ALGO_CRC_H__
+#define Z_ALGO_CRC_H__
+
+/**
+ * @brief CRC-32C (Castagnoli) checksums.
+ *
+ * crc32c() uses the SSE4.2 crc32 instruction when the CPU has it, with three
+ * independent streams interleaved on large buffers to hide the 3-cycle
+ * latency of the instruction. Otherwise a slicing-by-8 table is used. Both
+ * give the same values; a crc can be extended by passing it back in.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace z {
+;
+
+/// crc of [data, data + size) appended to the data whose crc is `crc'
+uint32_t crc32c(const void *data, size_t size, uint32_t crc = 0);
+
+/// the crc of A + B, given crc(A), crc(B) and the length of B
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, size_t size_b);
+
+/// the implementations behind crc32c(), exposed for tests and benchmarks
+bool     crc32c_hw_available();
+uint32_t crc32c_hw(const void *data, size_t size, uint32_t crc = 0);
+uint32_t crc32c_sw(const void *data, size_t size, uint32_t crc = 0);
+
+} // namespace z
+
+#endif
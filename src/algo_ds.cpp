@@ -3,6 +3,11 @@
 
 #if Z_COMPILE_FLAG_ENABLE_UT 
 #include <gtest/gtest.h>
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <poll.h>
+#include <string>
 TEST(ut_low_ds, static_linked_list) {
     using namespace z::low::ds;
 
@@ -33,6 +38,519 @@ TEST(ut_low_ds, static_linked_list) {
     ASSERT_TRUE(sl.isEmpty() );
 }
 
+TEST(ut_low_ds, static_linked_list_lock_free) {
+    using namespace z;
+
+    // with and without magazines, every item can be taken and comes back
+    for (uint32_t mag = 0; mag <= 4; mag += 4) {
+        StaticLinkedList<uint32_t, ZLockFree> sl(100, mag);
+        std::vector<uint32_t*> ptrs;
+        for (uint32_t round = 0; round < 3; ++round) {
+            while (uint32_t *p = sl.allocate() ) {
+                ptrs.push_back(p);
+            }
+            ASSERT_EQ(100u, ptrs.size() );
+            ASSERT_TRUE(sl.isEmpty() );
+            std::sort(ptrs.begin(), ptrs.end() );
+            ASSERT_TRUE(std::unique(ptrs.begin(), ptrs.end() ) == ptrs.end() );
+            for (size_t i = 0; i < ptrs.size(); ++i) {
+                sl.release(ptrs[i]);
+            }
+            ptrs.clear();
+        }
+    }
+}
+
+struct LockFreeListArgs {
+    z::StaticLinkedList<uint64_t, z::ZLockFree> *list;
+    uint64_t    id;
+    uint32_t    errors;
+};
+
+static void *lock_free_list_main(void *arg) {
+    LockFreeListArgs *a = (LockFreeListArgs*)(arg);
+    uint64_t *held[16];
+    for (uint32_t round = 0; round < 20000; ++round) {
+        uint32_t n = 1 + (round * 7 + a->id) % 16;
+        uint32_t got = 0;
+        for (; got < n; ++got) {
+            held[got] = a->list->allocate();
+            if (!held[got]) {
+                break;
+            }
+            *held[got] = a->id;
+        }
+        sched_yield();
+        // nobody else may have been handed the same item
+        for (uint32_t i = 0; i < got; ++i) {
+            a->errors += (*held[i] != a->id);
+            a->list->release(held[i]);
+        }
+    }
+    return nullptr;
+}
+
+TEST(ut_low_ds, static_linked_list_lock_free_threads) {
+    using namespace z;
+
+    const uint32_t N = 4;
+    for (uint32_t mag = 0; mag <= 8; mag += 8) {
+        StaticLinkedList<uint64_t, ZLockFree> sl(N * 16, mag);
+        pthread_t ids[N];
+        LockFreeListArgs args[N];
+        for (uint32_t i = 0; i < N; ++i) {
+            args[i].list = &sl;
+            args[i].id = i + 1;
+            args[i].errors = 0;
+            pthread_create(&ids[i], nullptr, lock_free_list_main, &args[i]);
+        }
+        for (uint32_t i = 0; i < N; ++i) {
+            pthread_join(ids[i], nullptr);
+            EXPECT_EQ(0u, args[i].errors);
+        }
+
+        uint32_t count = 0;
+        while (sl.allocate() ) {
+            ++count;
+        }
+        EXPECT_EQ(N * 16, count);
+    }
+}
+
+struct PoolObject {
+    static int  live;
+    uint64_t    value;
+    char        pad[40];
+
+    PoolObject(uint64_t v = 7) : value(v) {++live; }
+    ~PoolObject() {--live; }
+};
+int PoolObject::live = 0;
+
+TEST(ut_low_ds, object_pool) {
+    using namespace z;
+
+    for (uint32_t flags = 0; flags <= OBJECT_POOL_HUGEPAGE; flags += OBJECT_POOL_HUGEPAGE) {
+        const uint32_t N = 5000;
+        ObjectPool<PoolObject> pool(N, flags);
+        ASSERT_EQ(0u, pool.slab_count() );
+        ASSERT_EQ(N, pool.capacity() );
+
+        std::vector<PoolObject*> objs;
+        for (uint32_t i = 0; i < N; ++i) {
+            objs.push_back(pool.allocate(i) );
+            ASSERT_NE(nullptr, objs.back() );
+            ASSERT_EQ(i, objs.back()->value);
+            ASSERT_EQ(0u, (uintptr_t)(objs.back() ) % alignof(PoolObject) );
+        }
+        ASSERT_EQ(nullptr, pool.allocate() );
+        ASSERT_EQ(int(N), PoolObject::live);
+        ASSERT_EQ(N, pool.size() );
+        uint32_t full_slabs = pool.slab_count();
+
+        // handles are unique and map back
+        std::vector<uint32_t> handles;
+        for (uint32_t i = 0; i < N; ++i) {
+            handles.push_back(pool.handle(objs[i]) );
+            ASSERT_EQ(objs[i], pool.get(handles[i]) );
+        }
+        std::sort(handles.begin(), handles.end() );
+        ASSERT_TRUE(std::unique(handles.begin(), handles.end() ) == handles.end() );
+
+        // freed slots are reused, survivors do not move
+        for (uint32_t i = 0; i < N; i += 2) {
+            pool.release(objs[i]);
+        }
+        ASSERT_EQ(int(N / 2), PoolObject::live);
+        for (uint32_t i = 0; i < N; i += 2) {
+            objs[i] = pool.allocate();
+            ASSERT_EQ(7u, objs[i]->value);
+        }
+        ASSERT_EQ(full_slabs, pool.slab_count() );
+        for (uint32_t i = 1; i < N; i += 2) {
+            ASSERT_EQ(i, objs[i]->value);
+        }
+
+        // the empty slabs go back but one
+        for (uint32_t i = 0; i < N; ++i) {
+            pool.release(objs[i]);
+        }
+        ASSERT_EQ(0, PoolObject::live);
+        ASSERT_EQ(0u, pool.size() );
+        ASSERT_EQ(1u, pool.slab_count() );
+        PoolObject *o = pool.allocate();
+        ASSERT_EQ(o, pool.get(pool.handle(o) ) );
+        ASSERT_EQ(1u, pool.slab_count() );
+        pool.release(o);
+    }
+}
+
+struct ObjectPoolArgs {
+    z::ObjectPool<PoolObject, z::ZSpinLock>     *pool;
+    uint64_t    id;
+    uint32_t    errors;
+};
+
+static void *object_pool_main(void *arg) {
+    ObjectPoolArgs *a = (ObjectPoolArgs*)(arg);
+    PoolObject *held[64];
+    for (uint32_t round = 0; round < 2000; ++round) {
+        uint32_t n = 1 + (round * 13 + a->id) % 64;
+        for (uint32_t i = 0; i < n; ++i) {
+            held[i] = a->pool->allocate(a->id);
+            a->errors += (nullptr == held[i]);
+        }
+        sched_yield();
+        for (uint32_t i = 0; i < n; ++i) {
+            a->errors += (held[i]->value != a->id);
+            a->pool->release(held[i]);
+        }
+    }
+    return nullptr;
+}
+
+TEST(ut_low_ds, object_pool_threads) {
+    using namespace z;
+
+    const uint32_t N = 4;
+    ObjectPool<PoolObject, ZSpinLock> pool(N * 64);
+    pthread_t ids[N];
+    ObjectPoolArgs args[N];
+    for (uint32_t i = 0; i < N; ++i) {
+        args[i].pool = &pool;
+        args[i].id = i + 1;
+        args[i].errors = 0;
+        pthread_create(&ids[i], nullptr, object_pool_main, &args[i]);
+    }
+    for (uint32_t i = 0; i < N; ++i) {
+        pthread_join(ids[i], nullptr);
+        EXPECT_EQ(0u, args[i].errors);
+    }
+    EXPECT_EQ(0u, pool.size() );
+    EXPECT_EQ(0, PoolObject::live);
+}
+
+struct WheelTimer {
+    z::TimerNode    node;
+    uint64_t        expire_ms;
+    uint64_t        fired_ms;
+    uint32_t        fired;
+};
+
+struct WheelRun {
+    uint64_t        now_ms;
+    uint32_t        errors;
+};
+
+static void wheel_timer_expired(z::TimerNode *node, void *arg) {
+    WheelTimer *t = Z_FIND_OBJ_BY_MEMBER(WheelTimer, node, node);
+    WheelRun *run = (WheelRun*)(arg);
+    t->fired_ms = run->now_ms;
+    ++t->fired;
+}
+
+template <typename Wheel>
+static void check_timing_wheel(uint32_t tick_ms, uint64_t max_delay, uint64_t step) {
+    const uint64_t start = 1000000;
+    Wheel wheel(tick_ms, start);
+    std::vector<WheelTimer> timers(3000);
+    uint64_t seed = 1;
+    for (size_t i = 0; i < timers.size(); ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        timers[i].expire_ms = start + (seed >> 33) % max_delay;
+        timers[i].fired = 0;
+        wheel.add(&timers[i].node, timers[i].expire_ms);
+    }
+    for (size_t i = 0; i < timers.size(); i += 3) {
+        ASSERT_TRUE(wheel.cancel(&timers[i].node) );
+        ASSERT_FALSE(wheel.cancel(&timers[i].node) );
+    }
+    ASSERT_EQ(2000u, wheel.size() );
+
+    WheelRun run = {start, 0};
+    uint32_t expired = 0;
+    while (wheel.size() > 0) {
+        uint64_t next = wheel.next_expiry_ms();
+        ASSERT_NE(uint64_t(-1), next);
+        ASSERT_LE(run.now_ms, next + tick_ms);
+        run.now_ms += step;
+        expired += wheel.advance(run.now_ms, wheel_timer_expired, &run);
+    }
+    ASSERT_EQ(2000u, expired);
+    ASSERT_EQ(uint64_t(-1), wheel.next_expiry_ms() );
+    ASSERT_EQ(-1, wheel.epoll_timeout(run.now_ms) );
+
+    // never early, late by less than a step plus a tick
+    for (size_t i = 0; i < timers.size(); ++i) {
+        if (i % 3 == 0) {
+            ASSERT_EQ(0u, timers[i].fired);
+            continue;
+        }
+        ASSERT_EQ(1u, timers[i].fired) << i;
+        ASSERT_GE(timers[i].fired_ms, timers[i].expire_ms) << i;
+        ASSERT_LT(timers[i].fired_ms, timers[i].expire_ms + step + tick_ms) << i;
+    }
+}
+
+TEST(ut_low_ds, timing_wheel) {
+    using namespace z;
+
+    check_timing_wheel<TimingWheel<> >(1, 5000, 1);
+    check_timing_wheel<TimingWheel<> >(1, 50000000, 997);
+    check_timing_wheel<TimingWheel<> >(10, 1000000, 33);
+    // past the top window of 2^12 ticks
+    check_timing_wheel<TimingWheel<6, 2> >(1, 100000, 7);
+    check_timing_wheel<TimingWheel<6, 2> >(1, 100000, 20000);
+
+    // the epoll timeout, and re-arming from the callback
+    TimingWheel<> wheel(1, 0);
+    WheelTimer t;
+    t.fired = 0;
+    ASSERT_EQ(100, wheel.epoll_timeout(0, 100) );
+    wheel.add(&t.node, 50);
+    ASSERT_EQ(50, wheel.epoll_timeout(0, 100) );
+    ASSERT_EQ(20, wheel.epoll_timeout(30, 100) );
+    ASSERT_EQ(0, wheel.epoll_timeout(60, 100) );
+    wheel.add(&t.node, 500);
+    ASSERT_EQ(1u, wheel.size() );
+    ASSERT_GE(500u, wheel.next_expiry_ms() );
+    WheelRun run = {499, 0};
+    ASSERT_EQ(0u, wheel.advance(499, wheel_timer_expired, &run) );
+    ASSERT_EQ(1, wheel.epoll_timeout(499) );
+    run.now_ms = 500;
+    ASSERT_EQ(1u, wheel.advance(500, wheel_timer_expired, &run) );
+    ASSERT_FALSE(t.node.pending() );
+    wheel.add(&t.node, 0);
+    ASSERT_EQ(1u, wheel.advance(501, wheel_timer_expired, &run) );
+    ASSERT_EQ(2u, t.fired);
+}
+
+/// the tree against a std::map: contents, point lookups and lower bounds
+template <typename Tree, typename K, typename V>
+void check_bplus_tree(const Tree &t, const std::map<K, V> &ref, const std::vector<K> &probes) {
+    ASSERT_EQ(ref.size(), t.size() );
+    typename std::map<K, V>::const_iterator r = ref.begin();
+    for (typename Tree::Iterator it = t.begin(); it.valid(); it.next(), ++r) {
+        ASSERT_TRUE(r != ref.end() );
+        ASSERT_EQ(r->first, it.key() );
+        ASSERT_EQ(r->second, it.value() );
+    }
+    ASSERT_TRUE(r == ref.end() );
+
+    for (size_t i = 0; i < probes.size(); ++i) {
+        V v = V();
+        typename std::map<K, V>::const_iterator f = ref.find(probes[i]);
+        ASSERT_EQ(f != ref.end(), t.find(probes[i], &v) );
+        if (f != ref.end() ) {
+            ASSERT_EQ(f->second, v);
+        }
+        typename Tree::Iterator lb = t.lower_bound(probes[i]);
+        typename std::map<K, V>::const_iterator rlb = ref.lower_bound(probes[i]);
+        ASSERT_EQ(rlb != ref.end(), lb.valid() );
+        if (lb.valid() ) {
+            ASSERT_EQ(rlb->first, lb.key() );
+        }
+    }
+}
+
+/// random inserts, updates and erases until empty; keys come from make_key
+template <typename Tree, typename K>
+void check_bplus_tree_random(K (*make_key)(uint64_t), uint32_t n, uint64_t range) {
+    Tree t;
+    std::map<K, uint64_t> ref;
+    std::vector<K> probes;
+    uint64_t seed = 12345;
+    for (uint32_t i = 0; i < n; ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        K k = make_key( (seed >> 20) % range);
+        bool fresh = ref.insert(std::make_pair(k, uint64_t(i) ) ).second;
+        ASSERT_EQ(fresh, t.insert(k, i) );
+        if (i % 5 == 0) {
+            ref[k] = i + 1;
+            t.update(k, i + 1);
+        }
+        if (i % 97 == 0) {
+            probes.push_back(k);
+            probes.push_back(make_key( (seed >> 7) % range) );
+        }
+    }
+    check_bplus_tree(t, ref, probes);
+    ASSERT_GT(t.height(), 2u);
+
+    // erase in random order, checking as the tree shrinks
+    std::vector<K> keys;
+    for (typename std::map<K, uint64_t>::iterator it = ref.begin(); it != ref.end(); ++it) {
+        keys.push_back(it->first);
+    }
+    std::random_shuffle(keys.begin(), keys.end() );
+    for (size_t i = 0; i < keys.size(); ++i) {
+        uint64_t v = 0;
+        ASSERT_TRUE(t.erase(keys[i], &v) );
+        ASSERT_EQ(ref[keys[i]], v);
+        ref.erase(keys[i]);
+        ASSERT_FALSE(t.erase(keys[i]) );
+        if (i % (keys.size() / 8) == 0) {
+            check_bplus_tree(t, ref, probes);
+        }
+    }
+    ASSERT_TRUE(t.isEmpty() );
+    ASSERT_EQ(1u, t.height() );
+    ASSERT_FALSE(t.begin().valid() );
+}
+
+static uint64_t bpt_u64(uint64_t x) {return x * 3; }
+static int32_t bpt_i32(uint64_t x) {return int32_t(x) - 50000; }
+static uint32_t bpt_u32(uint64_t x) {return uint32_t(x) | ( (x & 1) << 31); }
+static int64_t bpt_i64(uint64_t x) {return (x & 1) ? -int64_t(x) : int64_t(x) << 20; }
+static std::string bpt_str(uint64_t x) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "k%lu", x);
+    return buf;
+}
+
+TEST(ut_low_ds, bplus_tree) {
+    using namespace z;
+
+    // small nodes for deep trees; signed keys and unsigned keys past 2^31
+    check_bplus_tree_random<BPlusTree<uint64_t, uint64_t, 256>, uint64_t>(bpt_u64, 50000, 30000);
+    check_bplus_tree_random<BPlusTree<int32_t, uint64_t, 128>, int32_t>(bpt_i32, 50000, 100000);
+    check_bplus_tree_random<BPlusTree<uint32_t, uint64_t, 128>, uint32_t>(bpt_u32, 50000, 100000);
+    check_bplus_tree_random<BPlusTree<int64_t, uint64_t>, int64_t>(bpt_i64, 100000, 1000000);
+    check_bplus_tree_random<BPlusTree<std::string, uint64_t, 512>, std::string>(bpt_str, 20000, 50000);
+
+    // bulk load, then a range scan and more inserts
+    BPlusTree<uint64_t, uint64_t> t;
+    std::vector<uint64_t> keys;
+    for (uint64_t i = 0; i < 100000; ++i) {
+        keys.push_back(i * 2);
+    }
+    std::vector<uint64_t> values(keys.begin(), keys.end() );
+    std::swap(keys[10], keys[11]);
+    ASSERT_FALSE(t.bulk_load(&keys[0], &values[0], uint32_t(keys.size() ) ) );
+    std::swap(keys[10], keys[11]);
+    for (uint32_t n = 0; n < 200; ++n) {
+        ASSERT_TRUE(t.bulk_load(&keys[0], &values[0], n) );
+        ASSERT_EQ(n, t.size() );
+        uint32_t seen = 0;
+        for (BPlusTree<uint64_t, uint64_t>::Iterator it = t.begin(); it.valid(); it.next() ) {
+            ASSERT_EQ(keys[seen++], it.key() );
+        }
+        ASSERT_EQ(n, seen);
+    }
+    ASSERT_TRUE(t.bulk_load(&keys[0], &values[0], uint32_t(keys.size() ) ) );
+    ASSERT_EQ(keys.size(), t.size() );
+
+    uint64_t sum = 0;
+    uint32_t count = 0;
+    for (BPlusTree<uint64_t, uint64_t>::Iterator it = t.lower_bound(1001); it.valid() && it.key() < 2001; it.next() ) {
+        sum += it.value();
+        ++count;
+    }
+    ASSERT_EQ(500u, count);
+    ASSERT_EQ( (1002u + 2000u) * 500 / 2, sum);
+
+    std::map<uint64_t, uint64_t> ref;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        ref[keys[i]] = values[i];
+    }
+    for (uint64_t i = 0; i < 100000; i += 3) {
+        ASSERT_TRUE(t.insert(i * 2 + 1, i) );
+        ref[i * 2 + 1] = i;
+    }
+    for (uint64_t i = 0; i < 200000; i += 7) {
+        ASSERT_EQ(ref.erase(i) > 0, t.erase(i) );
+    }
+    std::vector<uint64_t> probes(keys.begin(), keys.begin() + 1000);
+    check_bplus_tree(t, ref, probes);
+}
+
+TEST(ut_low_ds, id_pool) {
+    using namespace z;
+
+    // one level, a partial word, and several summary levels
+    const uint32_t sizes[] = {1, 64, 65, 4096, 4097, 300000};
+    for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        uint32_t n = sizes[s];
+        IDPool<> pool(n);
+        for (uint32_t i = 0; i < n; ++i) {
+            ASSERT_EQ(i, pool.allocate() );
+        }
+        ASSERT_EQ(uint32_t(-1), pool.allocate() );
+        ASSERT_EQ(0u, pool.free_count() );
+
+        // the lowest free id comes back first
+        for (uint32_t i = n; i > 0; i -= (i > 100) ? 97 : 1) {
+            pool.release(i - 1);
+        }
+        pool.release(n);
+        pool.release(0);
+        uint32_t last = 0;
+        for (uint32_t k = 0; pool.free_count() > 0; ++k) {
+            uint32_t id = pool.allocate();
+            ASSERT_TRUE(k == 0 || id > last);
+            last = id;
+        }
+        ASSERT_EQ(uint32_t(-1), pool.allocate() );
+    }
+}
+
+struct IDPoolArgs {
+    z::IDPool<z::ZLockFree>     *pool;
+    std::atomic<uint32_t>       *owner;
+    uint32_t                    id;
+    uint32_t                    errors;
+};
+
+static void *id_pool_main(void *arg) {
+    IDPoolArgs *a = (IDPoolArgs*)(arg);
+    uint32_t held[8];
+    for (uint32_t round = 0; round < 20000; ++round) {
+        uint32_t n = 1 + (round + a->id) % 8;
+        for (uint32_t i = 0; i < n; ++i) {
+            held[i] = a->pool->allocate();
+            a->errors += (held[i] == uint32_t(-1) );
+            a->errors += (0 != a->owner[held[i]].exchange(a->id) );
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            a->errors += (a->id != a->owner[held[i]].exchange(0) );
+            a->pool->release(held[i]);
+        }
+    }
+    return nullptr;
+}
+
+TEST(ut_low_ds, id_pool_lock_free_threads) {
+    using namespace z;
+
+    // exactly enough ids left, allocate() may never fail. They straddle two
+    // leaf words under three levels, so the summaries race too.
+    const uint32_t N = 4;
+    const uint32_t TAKEN = 4096 + 48;
+    IDPool<ZLockFree> pool(TAKEN + N * 8);
+    for (uint32_t i = 0; i < TAKEN; ++i) {
+        ASSERT_EQ(i, pool.allocate() );
+    }
+    std::vector<std::atomic<uint32_t> > owner(TAKEN + N * 8);
+    for (uint32_t i = 0; i < owner.size(); ++i) {
+        owner[i].store(0);
+    }
+    pthread_t ids[N];
+    IDPoolArgs args[N];
+    for (uint32_t i = 0; i < N; ++i) {
+        args[i].pool = &pool;
+        args[i].owner = &owner[0];
+        args[i].id = i + 1;
+        args[i].errors = 0;
+        pthread_create(&ids[i], nullptr, id_pool_main, &args[i]);
+    }
+    for (uint32_t i = 0; i < N; ++i) {
+        pthread_join(ids[i], nullptr);
+        EXPECT_EQ(0u, args[i].errors);
+    }
+    EXPECT_EQ(N * 8, pool.free_count() );
+    EXPECT_EQ(TAKEN, pool.allocate() );
+}
+
 
 TEST(ut_low_ds, fixed_length_queue) {
     using namespace z::low::ds;
@@ -132,4 +650,551 @@ TEST(ut_low_ds, fixed_length_queue_with_fd) {
     ASSERT_FALSE(q.dequeue(&v));
 }
 
+TEST(ut_low_ds, fixed_length_queue_with_fd_signal) {
+    using namespace z;
+
+    // a burst signals once, draining it resets the fd
+    FixedLengthQueueWithFd<uint32_t, ZNoLock, 1024, MPMCQueue<uint32_t> > q(8);
+    pollfd pfd = {q.dequeue_fd(), POLLIN, 0};
+    uint32_t v = 0;
+    ASSERT_EQ(0, poll(&pfd, 1, 0) );
+    for (uint32_t i = 0; i < 5; ++i) {
+        ASSERT_TRUE(q.enqueue(i) );
+    }
+    ASSERT_EQ(1, poll(&pfd, 1, 0) );
+    uint32_t n = 0;
+    while (q.dequeue(&v) ) {
+        ASSERT_EQ(n++, v);
+    }
+    ASSERT_EQ(5u, n);
+    ASSERT_EQ(0, poll(&pfd, 1, 0) );
+    ASSERT_TRUE(q.enqueue(7) );
+    ASSERT_EQ(1, poll(&pfd, 1, 0) );
+
+    // one count per item
+    FixedLengthQueueWithFd<uint32_t> sem(8, EFD_SEMAPHORE);
+    pfd.fd = sem.dequeue_fd();
+    for (uint32_t i = 0; i < 3; ++i) {
+        ASSERT_TRUE(sem.enqueue(i) );
+    }
+    for (uint32_t i = 0; i < 3; ++i) {
+        ASSERT_EQ(1, poll(&pfd, 1, 0) );
+        ASSERT_TRUE(sem.dequeue(&v) );
+        ASSERT_EQ(i, v);
+    }
+    ASSERT_EQ(0, poll(&pfd, 1, 0) );
+    ASSERT_FALSE(sem.dequeue(&v) );
+}
+
+TEST(ut_low_ds, mpmc_queue) {
+    using namespace z;
+
+    MPMCQueue<uint32_t>   q(6);
+    uint32_t v = 0;
+
+    ASSERT_EQ(8u, q.capacity() );
+    ASSERT_EQ(0u, q.count() );
+    ASSERT_TRUE(q.isEmpty() );
+    ASSERT_FALSE(q.dequeue(&v) );
+
+    // several laps over the ring
+    for (uint32_t lap = 0; lap < 5; ++lap) {
+        for (uint32_t i = 0; i < 8; ++i) {
+            ASSERT_TRUE(q.enqueue(lap * 8 + i) );
+        }
+        ASSERT_TRUE(q.isFull() );
+        ASSERT_FALSE(q.enqueue(0) );
+        for (uint32_t i = 0; i < 5; ++i) {
+            ASSERT_TRUE(q.dequeue(&v) );
+            ASSERT_EQ(lap * 8 + i, v);
+        }
+        ASSERT_EQ(3u, q.count() );
+        for (uint32_t i = 5; i < 8; ++i) {
+            ASSERT_TRUE(q.dequeue(&v) );
+            ASSERT_EQ(lap * 8 + i, v);
+        }
+        ASSERT_TRUE(q.isEmpty() );
+    }
+}
+
+struct MPMCQueueArgs {
+    z::MPMCQueue<uint64_t>  *queue;
+    uint64_t                sum;
+    uint32_t                count;
+};
+
+static void *mpmc_queue_producer(void *arg) {
+    MPMCQueueArgs *a = (MPMCQueueArgs*)(arg);
+    for (uint64_t i = 1; i <= a->count; ++i) {
+        while (!a->queue->enqueue(i) ) {
+            sched_yield();
+        }
+        a->sum += i;
+    }
+    return nullptr;
+}
+
+static void *mpmc_queue_consumer(void *arg) {
+    MPMCQueueArgs *a = (MPMCQueueArgs*)(arg);
+    uint64_t v = 0;
+    for (uint32_t n = 0; n < a->count; ) {
+        if (a->queue->dequeue(&v) ) {
+            a->sum += v;
+            ++n;
+        } else {
+            sched_yield();
+        }
+    }
+    return nullptr;
+}
+
+TEST(ut_low_ds, mpmc_queue_threads) {
+    using namespace z;
+
+    MPMCQueue<uint64_t> q(64);
+    const uint32_t N = 4;
+    pthread_t ids[2 * N];
+    MPMCQueueArgs args[2 * N];
+    for (uint32_t i = 0; i < 2 * N; ++i) {
+        args[i].queue = &q;
+        args[i].sum = 0;
+        args[i].count = 20000;
+        pthread_create(&ids[i], nullptr, (i < N) ? mpmc_queue_producer : mpmc_queue_consumer, &args[i]);
+    }
+
+    uint64_t in = 0;
+    uint64_t out = 0;
+    for (uint32_t i = 0; i < 2 * N; ++i) {
+        pthread_join(ids[i], nullptr);
+        ((i < N) ? in : out) += args[i].sum;
+    }
+    EXPECT_EQ(in, out);
+    EXPECT_TRUE(q.isEmpty() );
+}
+
+template <typename Q>
+static void check_queue_bulk(Q *q) {
+    uint32_t in[12];
+    uint32_t out[12];
+    for (uint32_t i = 0; i < 12; ++i) {
+        in[i] = i + 1;
+    }
+
+    // a capacity of 8: partial enqueue, then wrap around with bulk calls
+    ASSERT_EQ(0u, q->dequeue_bulk(out, 12) );
+    ASSERT_EQ(8u, q->enqueue_bulk(in, 12) );
+    ASSERT_EQ(0u, q->enqueue_bulk(in, 1) );
+    ASSERT_EQ(5u, q->dequeue_bulk(out, 5) );
+    for (uint32_t i = 0; i < 5; ++i) {
+        ASSERT_EQ(i + 1, out[i]);
+    }
+    ASSERT_EQ(4u, q->enqueue_bulk(in + 8, 4) );
+    ASSERT_EQ(7u, q->count() );
+    ASSERT_EQ(7u, q->dequeue_bulk(out, 12) );
+    for (uint32_t i = 0; i < 7; ++i) {
+        ASSERT_EQ(i + 6, out[i]);
+    }
+    ASSERT_TRUE(q->isEmpty() );
+    ASSERT_EQ(0u, q->dequeue_bulk(out, 12) );
+}
+
+TEST(ut_low_ds, queue_bulk) {
+    using namespace z;
+
+    FixedLengthQueue<uint32_t> q1(8);
+    check_queue_bulk(&q1);
+    MPMCQueue<uint32_t> q2(8);
+    check_queue_bulk(&q2);
+    SPSCQueue<uint32_t> q3(8);
+    check_queue_bulk(&q3);
+
+    // one signal per batch, the drain resets it
+    FixedLengthQueueWithFd<uint32_t> q4(8);
+    pollfd pfd = {q4.dequeue_fd(), POLLIN, 0};
+    check_queue_bulk(&q4);
+    ASSERT_EQ(0, poll(&pfd, 1, 0) );
+
+    FixedLengthQueueWithFd<uint32_t> sem(8, EFD_SEMAPHORE);
+    uint32_t v[4] = {1, 2, 3, 4};
+    ASSERT_EQ(4u, sem.enqueue_bulk(v, 4) );
+    ASSERT_EQ(3u, sem.dequeue_bulk(v, 3) );
+    ASSERT_EQ(3u, v[2]);
+    ASSERT_TRUE(sem.dequeue(v) );
+    ASSERT_EQ(4u, v[0]);
+    ASSERT_EQ(0u, sem.dequeue_bulk(v, 4) );
+}
+
+static void *mpmc_queue_bulk_producer(void *arg) {
+    MPMCQueueArgs *a = (MPMCQueueArgs*)(arg);
+    uint64_t items[7];
+    for (uint64_t i = 1; i <= a->count; ) {
+        uint32_t n = 0;
+        for (; n < 7 && i + n <= a->count; ++n) {
+            items[n] = i + n;
+        }
+        uint32_t done = a->queue->enqueue_bulk(items, n);
+        for (uint32_t k = 0; k < done; ++k) {
+            a->sum += items[k];
+        }
+        i += done;
+        if (done < n) {
+            sched_yield();
+        }
+    }
+    return nullptr;
+}
+
+static void *mpmc_queue_bulk_consumer(void *arg) {
+    MPMCQueueArgs *a = (MPMCQueueArgs*)(arg);
+    uint64_t items[5];
+    for (uint32_t n = 0; n < a->count; ) {
+        uint32_t got = a->queue->dequeue_bulk(items, std::min(5u, a->count - n) );
+        for (uint32_t k = 0; k < got; ++k) {
+            a->sum += items[k];
+        }
+        n += got;
+        if (0 == got) {
+            sched_yield();
+        }
+    }
+    return nullptr;
+}
+
+TEST(ut_low_ds, mpmc_queue_bulk_threads) {
+    using namespace z;
+
+    // bulk and single calls on both sides
+    MPMCQueue<uint64_t> q(64);
+    const uint32_t N = 4;
+    void *(*mains[N])(void*) = {mpmc_queue_bulk_producer, mpmc_queue_producer,
+                                mpmc_queue_bulk_consumer, mpmc_queue_consumer};
+    pthread_t ids[N];
+    MPMCQueueArgs args[N];
+    for (uint32_t i = 0; i < N; ++i) {
+        args[i].queue = &q;
+        args[i].sum = 0;
+        args[i].count = 30000;
+        pthread_create(&ids[i], nullptr, mains[i], &args[i]);
+    }
+
+    uint64_t in = 0;
+    uint64_t out = 0;
+    for (uint32_t i = 0; i < N; ++i) {
+        pthread_join(ids[i], nullptr);
+        ((i < N / 2) ? in : out) += args[i].sum;
+    }
+    EXPECT_EQ(in, out);
+    EXPECT_TRUE(q.isEmpty() );
+}
+
+TEST(ut_low_ds, spsc_queue) {
+    using namespace z;
+
+    SPSCQueue<uint32_t>   q(8);
+    uint32_t v = 0;
+
+    ASSERT_EQ(8u, q.capacity() );
+    ASSERT_TRUE(q.isEmpty() );
+    ASSERT_FALSE(q.dequeue(&v) );
+
+    for (uint32_t lap = 0; lap < 5; ++lap) {
+        for (uint32_t i = 0; i < 8; ++i) {
+            ASSERT_TRUE(q.enqueue(lap * 8 + i) );
+        }
+        ASSERT_TRUE(q.isFull() );
+        ASSERT_FALSE(q.enqueue(0) );
+        for (uint32_t i = 0; i < 8; ++i) {
+            ASSERT_TRUE(q.dequeue(&v) );
+            ASSERT_EQ(lap * 8 + i, v);
+        }
+        ASSERT_TRUE(q.isEmpty() );
+    }
+
+    // staged items are invisible until published
+    ASSERT_TRUE(q.enqueue_deferred(1) );
+    ASSERT_TRUE(q.enqueue_deferred(2) );
+    ASSERT_TRUE(q.isEmpty() );
+    ASSERT_FALSE(q.dequeue(&v) );
+    q.publish();
+    ASSERT_EQ(2u, q.count() );
+    ASSERT_TRUE(q.dequeue(&v) );
+    ASSERT_EQ(1u, v);
+    ASSERT_TRUE(q.dequeue(&v) );
+    ASSERT_EQ(2u, v);
+}
+
+static void *spsc_queue_producer(void *arg) {
+    z::SPSCQueue<uint64_t> *q = (z::SPSCQueue<uint64_t>*)(arg);
+    for (uint64_t i = 0; i < 200000; ++i) {
+        bool ok = (i & 1) ? q->enqueue(i) : q->enqueue_deferred(i);
+        while (!ok) {
+            q->publish();
+            sched_yield();
+            ok = q->enqueue(i);
+        }
+    }
+    q->publish();
+    return nullptr;
+}
+
+TEST(ut_low_ds, spsc_queue_threads) {
+    using namespace z;
+
+    SPSCQueue<uint64_t> q(64);
+    pthread_t id;
+    pthread_create(&id, nullptr, spsc_queue_producer, &q);
+    uint64_t v = 0;
+    for (uint64_t i = 0; i < 200000; ) {
+        if (q.dequeue(&v) ) {
+            ASSERT_EQ(i, v);
+            ++i;
+        } else {
+            sched_yield();
+        }
+    }
+    pthread_join(id, nullptr);
+    EXPECT_TRUE(q.isEmpty() );
+}
+
+TEST(ut_low_ds, work_stealing_deque) {
+    using namespace z;
+
+    WorkStealingDeque<uint32_t> q(8);
+    uint32_t v = 0;
+
+    ASSERT_EQ(8u, q.capacity() );
+    ASSERT_FALSE(q.pop(&v) );
+    ASSERT_FALSE(q.steal(&v) );
+
+    // the owner pops the newest, thieves steal the oldest
+    for (uint32_t lap = 0; lap < 3; ++lap) {
+        for (uint32_t i = 0; i < 8; ++i) {
+            ASSERT_TRUE(q.push(i) );
+        }
+        ASSERT_FALSE(q.push(8) );
+        ASSERT_EQ(8u, q.count() );
+        for (uint32_t i = 0; i < 4; ++i) {
+            ASSERT_TRUE(q.steal(&v) );
+            ASSERT_EQ(i, v);
+            ASSERT_TRUE(q.pop(&v) );
+            ASSERT_EQ(7 - i, v);
+        }
+        ASSERT_TRUE(q.isEmpty() );
+        ASSERT_FALSE(q.pop(&v) );
+        ASSERT_FALSE(q.steal(&v) );
+    }
+}
+
+static const uint32_t WSD_ITEMS = 200000;
+static const uint32_t WSD_THIEVES = 3;
+
+struct WSDArgs {
+    z::WorkStealingDeque<uint32_t>  *q;
+    std::atomic<uint32_t>           *taken;
+    std::atomic<uint32_t>           *done;
+};
+
+static void *wsd_thief(void *arg) {
+    WSDArgs *a = (WSDArgs*)(arg);
+    uint32_t v = 0;
+    while (a->done->load() < WSD_ITEMS) {
+        if (a->q->steal(&v) ) {
+            a->taken[v].fetch_add(1);
+            a->done->fetch_add(1);
+        } else {
+            sched_yield();
+        }
+    }
+    return nullptr;
+}
+
+TEST(ut_low_ds, work_stealing_deque_threads) {
+    using namespace z;
+
+    // every item is taken once, by the owner or by exactly one thief
+    WorkStealingDeque<uint32_t> q(64);
+    std::vector<std::atomic<uint32_t> > taken(WSD_ITEMS);
+    for (uint32_t i = 0; i < WSD_ITEMS; ++i) {
+        taken[i].store(0);
+    }
+    std::atomic<uint32_t> done(0);
+    WSDArgs args = {&q, &taken[0], &done};
+    pthread_t ids[WSD_THIEVES];
+    for (uint32_t i = 0; i < WSD_THIEVES; ++i) {
+        pthread_create(&ids[i], nullptr, wsd_thief, &args);
+    }
+
+    uint32_t v = 0;
+    for (uint32_t i = 0; i < WSD_ITEMS; ++i) {
+        while (!q.push(i) ) {
+            sched_yield();
+        }
+        if ( (i % 3) == 0 && q.pop(&v) ) {
+            taken[v].fetch_add(1);
+            done.fetch_add(1);
+        }
+    }
+    while (q.pop(&v) ) {
+        taken[v].fetch_add(1);
+        done.fetch_add(1);
+    }
+    for (uint32_t i = 0; i < WSD_THIEVES; ++i) {
+        pthread_join(ids[i], nullptr);
+    }
+
+    EXPECT_EQ(WSD_ITEMS, done.load() );
+    for (uint32_t i = 0; i < WSD_ITEMS; ++i) {
+        ASSERT_EQ(1u, taken[i].load() ) << i;
+    }
+}
+
+TEST(ut_low_ds, hash_table64) {
+    using namespace z;
+
+    HashTable64<uint32_t> t(16);
+    uint32_t v = 0;
+
+    ASSERT_TRUE(t.isEmpty() );
+    ASSERT_FALSE(t.find(1, &v) );
+    ASSERT_TRUE(t.insert(1, 100) );
+    ASSERT_FALSE(t.insert(1, 200) );
+    ASSERT_TRUE(t.find(1, &v) );
+    ASSERT_EQ(100u, v);
+    t.update(1, 200);
+    t.update(2, 300);
+    ASSERT_TRUE(t.find(1, &v) );
+    ASSERT_EQ(200u, v);
+    ASSERT_EQ(2u, t.size() );
+
+    ASSERT_TRUE(t.erase(1, &v) );
+    ASSERT_EQ(200u, v);
+    ASSERT_FALSE(t.erase(1) );
+    ASSERT_FALSE(t.find(1) );
+    ASSERT_TRUE(t.find(2) );
+
+    t.clear();
+    ASSERT_EQ(0u, t.size() );
+    ASSERT_FALSE(t.find(2) );
+}
+
+TEST(ut_low_ds, hash_table64_random) {
+    using namespace z;
+
+    // small keys collide in the low bits of the home slot a lot
+    std::unique_ptr<HashTable64<uint64_t, ZSpinLock> > t(new HashTable64<uint64_t, ZSpinLock>(16) );
+    std::map<uint64_t, uint64_t> ref;
+    uint64_t seed = 88172645463325252ull;
+    for (uint32_t i = 0; i < 200000; ++i) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        uint64_t key = seed % 5000;
+        uint32_t op = (seed >> 32) % 8;
+        uint64_t v = 0;
+        if (op < 4) {
+            ASSERT_EQ(ref.insert(std::make_pair(key, i) ).second, t->insert(key, i) );
+        } else if (op < 6) {
+            ASSERT_EQ(ref.erase(key) > 0, t->erase(key) );
+        } else {
+            bool found = t->find(key, &v);
+            ASSERT_EQ(ref.count(key) > 0, found);
+            if (found) {
+                ASSERT_EQ(ref[key], v);
+            }
+        }
+        ASSERT_EQ(ref.size(), t->size() );
+
+        // drain sometimes, then start over from a small table: it never
+        // shrinks, so only a new one grows through the resizes again
+        if (i % 50000 == 49999) {
+            ASSERT_LE(4096u, t->capacity() );
+            for (std::map<uint64_t, uint64_t>::iterator it = ref.begin(); it != ref.end(); ++it) {
+                ASSERT_TRUE(t->erase(it->first, &v) );
+                ASSERT_EQ(it->second, v);
+            }
+            ref.clear();
+            ASSERT_TRUE(t->isEmpty() );
+            t.reset(new HashTable64<uint64_t, ZSpinLock>(16) );
+        }
+    }
+
+    for (uint64_t k = 0; k < 100000; ++k) {
+        ASSERT_TRUE(t->insert(k << 32, k) );
+    }
+    for (uint64_t k = 0; k < 100000; ++k) {
+        uint64_t v = 0;
+        ASSERT_TRUE(t->find(k << 32, &v) );
+        ASSERT_EQ(k, v);
+    }
+}
+
+struct ConcurrentHashTableArgs {
+    z::ConcurrentHashTable64<uint64_t>  *table;
+    uint32_t                            id;
+    uint64_t                            bad;
+};
+
+// writers own the keys k % 4 == id, readers check value == ~key
+static void *concurrent_hash_table_thread(void *arg) {
+    ConcurrentHashTableArgs *a = (ConcurrentHashTableArgs*)(arg);
+    for (uint64_t round = 0; round < 20; ++round) {
+        for (uint64_t k = a->id & 3; k < 20000; k += 4) {
+            uint64_t v = 0;
+            if (a->id < 4) {
+                if ( (k + round) & 1) {
+                    a->table->update(k, ~k);
+                } else {
+                    a->table->erase(k);
+                }
+            } else if (a->table->find(k, &v) && v != ~k) {
+                ++a->bad;
+            }
+        }
+    }
+    return nullptr;
+}
+
+static void concurrent_hash_table_sum(uint64_t key, const uint64_t &value, void *arg) {
+    *(uint64_t*)(arg) += key ^ value;
+}
+
+TEST(ut_low_ds, concurrent_hash_table64) {
+    using namespace z;
+
+    ConcurrentHashTable64<uint64_t> t(16, 8);
+    EXPECT_EQ(8u, t.shard_num() );
+
+    const uint32_t N = 8;
+    pthread_t ids[N];
+    ConcurrentHashTableArgs args[N];
+    for (uint32_t i = 0; i < N; ++i) {
+        args[i].table = &t;
+        args[i].id = i;
+        args[i].bad = 0;
+        pthread_create(&ids[i], nullptr, concurrent_hash_table_thread, &args[i]);
+    }
+    for (uint32_t i = 0; i < N; ++i) {
+        pthread_join(ids[i], nullptr);
+        EXPECT_EQ(0u, args[i].bad);
+    }
+
+    // the last round (19) kept the even keys
+    uint64_t v = 0;
+    for (uint64_t k = 0; k < 20000; ++k) {
+        ASSERT_EQ(k % 2 == 0, t.find(k, &v) ) << k;
+    }
+    EXPECT_EQ(10000u, t.size() );
+    EXPECT_FALSE(t.insert(0, 0) );
+    EXPECT_TRUE(t.erase(0, &v) );
+    EXPECT_EQ(~0ull, v);
+
+    uint64_t sum = 0;
+    t.for_each(concurrent_hash_table_sum, &sum);
+    EXPECT_EQ(9999u * uint64_t(-1), sum);
+
+    t.clear();
+    EXPECT_EQ(0u, t.size() );
+    EXPECT_FALSE(t.find(2) );
+}
+
 #endif // Z_COMPILE_FLAG_ENABLE_UT
@@ -7,13 +7,52 @@
 
 #include "def.h"
 #include "log.h"
+#include "algo_hash.h"
 #include <stdint.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <new>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <type_traits>
+#include <limits>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sched.h>
+#include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 namespace z {
 ;
 class ZNoLock;
+class ZSpinLock;
+
+/// the LOCK policy of the lock-free specializations, it is not a lock
+struct ZLockFree {};
+
+/**
+ * The read side of a LOCK policy, for the read-only paths of the templates:
+ * read_lock() and read_unlock() if LOCK has them (ZRWLock), lock() and
+ * unlock() otherwise.
+ */
+template <typename LOCK>
+    struct ZSharedLock {
+        static void lock(LOCK *l) {lock(l, 0); }
+        static void unlock(LOCK *l) {unlock(l, 0); }
+    private:
+        template <typename L>
+            static auto lock(L *l, int) -> decltype(l->read_lock() ) {l->read_lock(); }
+        static void lock(LOCK *l, long) {l->lock(); }
+        template <typename L>
+            static auto unlock(L *l, int) -> decltype(l->read_unlock() ) {l->read_unlock(); }
+        static void unlock(LOCK *l, long) {l->unlock(); }
+    };
 
 template <typename T, typename LOCK = z::ZNoLock>
     class StaticLinkedList {
@@ -39,6 +78,145 @@ template <typename T, typename LOCK = z::ZNoLock>
         LOCK            _lock;
     };
 
+/**
+ * @brief Lock-free StaticLinkedList: a Treiber stack of 32-bit indexes, with
+ *        an ABA tag in the upper half of the head word.
+ *
+ * With magazine_size > 0, a thread keeps up to 2 * magazine_size free items
+ * in a local magazine, refilled and flushed magazine_size items at a time
+ * with one CAS each. A magazine is a slot picked by thread, guarded by a
+ * try-lock; the shared stack is used when the slot is busy. When the shared
+ * stack runs dry allocate() takes items cached by the other magazines, so it
+ * only fails when the pool is really exhausted (or contended everywhere).
+ */
+template <typename T>
+    class StaticLinkedList<T, ZLockFree> {
+    private:
+        Z_DECLARE_COPY_FUNCTIONS(StaticLinkedList);
+        struct ItemWrapper {
+            std::atomic<uint32_t>   next_ptr;
+            T                       item;
+        };
+        struct __attribute__((aligned(DEF_SIZE_CACHE_LINE))) Magazine {
+            std::atomic<bool>       busy;
+            uint32_t                count;
+            uint32_t                *ids;
+        };
+    public:
+        StaticLinkedList(uint32_t max_item_num, uint32_t magazine_size = 0);
+        ~StaticLinkedList();
+
+        T *allocate();
+        void release(T *t);
+
+        /// the shared stack is empty, the magazines may still hold items
+        bool isEmpty() const;
+    private:
+        enum {
+            MAGAZINE_SLOTS  = 64,
+        };
+
+        static uint64_t pack(uint64_t head, uint32_t id);
+        static uint32_t thread_slot();
+        uint32_t pop(uint32_t *ids, uint32_t max);
+        void push(const uint32_t *ids, uint32_t n);
+        Magazine *lock_magazine(uint32_t slot);
+        T *steal();
+    private:
+        ItemWrapper             *_item_pool;
+        uint32_t                _item_num;
+        uint32_t                _magazine_size;
+        Magazine                *_magazines;
+        char                    _pad0[DEF_SIZE_CACHE_LINE];
+        std::atomic<uint64_t>   _head;
+        char                    _pad1[DEF_SIZE_CACHE_LINE - sizeof(std::atomic<uint64_t>)];
+    };
+
+enum OBJECT_POOL_FLAG_ENUM {
+    OBJECT_POOL_HUGEPAGE    = 0x0001,
+};
+
+/**
+ * @brief A typed object pool growing in slabs, up to max_item_num objects.
+ *
+ * A slab is one aligned mmap: a header, then the slots. Slots are handed out
+ * from a bump pointer before the free list, so an idle pool touches no
+ * memory, and the slab of an object is found by masking its address.
+ * Objects never move; handle() numbers them with 32 bits for compact
+ * references. When a slab empties and another empty slab is already kept,
+ * it is unmapped. OBJECT_POOL_HUGEPAGE maps 2MB slabs with MADV_HUGEPAGE.
+ */
+template <typename T, typename LOCK = z::ZNoLock>
+    class ObjectPool {
+    private:
+        Z_DECLARE_COPY_FUNCTIONS(ObjectPool);
+        typedef typename std::aligned_storage<(sizeof(T) < sizeof(uint32_t) ) ? sizeof(uint32_t) : sizeof(T),
+                    (alignof(T) < alignof(uint32_t) ) ? alignof(uint32_t) : alignof(T)>::type Slot;
+        struct __attribute__((aligned(DEF_SIZE_CACHE_LINE))) Slab {
+            uint32_t    index;
+            uint32_t    used;
+            uint32_t    fresh;      // [fresh, per slab) was never handed out
+            uint32_t    free_head;  // 1 + the first free slot, 0 for none
+            uint32_t    prev;       // the list of slabs with free slots
+            uint32_t    next;
+        };
+    public:
+        ObjectPool(uint32_t max_item_num, uint32_t flags = 0);
+        ~ObjectPool();
+
+        /// nullptr when the pool is full or a slab fails to map
+        template <typename... Args>
+        T *allocate(Args&&... args);
+        void release(T *t);
+
+        /// the handle of a live object, and back
+        uint32_t handle(const T *t) const;
+        T *get(uint32_t handle) const;
+
+        uint32_t size() const;
+        uint32_t slab_count() const;
+        uint32_t capacity() const;
+    private:
+        enum {
+            SLAB_BYTES      = 64 << 10,
+            HUGE_PAGE_SIZE  = 2 << 20,
+            MIN_SLOTS       = 16,
+            NIL             = 0xFFFFFFFF,
+        };
+
+        Slab *map_slab() const;
+        void unmap_slab(Slab *slab) const;
+        Slot *slots(Slab *slab) const;
+        Slab *slab_of(const T *t) const;
+        void link(Slab *slab);
+        void unlink(Slab *slab);
+    private:
+        uint32_t    _max_item_num;
+        uint32_t    _flags;
+        size_t      _slab_bytes;
+        uint32_t    _per_slab;
+        uint32_t    _slab_max;
+        Slab        **_slabs;
+        uint32_t    _slab_count;
+        uint32_t    _size;
+        uint32_t    _empty;         // the empty slabs kept mapped
+        uint32_t    _partial;       // the first slab with free slots
+        LOCK        _lock;
+    };
+
+/**
+ * @brief Ids in [0, max_id), the lowest free one first.
+ *
+ * A hierarchical bitmap: a set bit in level 0 is a free id, a set bit in
+ * level k + 1 is a word of level k with a free id in it. allocate() walks
+ * down with ctz, one word per level, so it is O(log64 n) and the memory is
+ * one bit per id plus 1/63 for the summaries.
+ *
+ * IDPool<ZLockFree> updates the words with atomic fetch_and/fetch_or and no
+ * lock. A summary bit may then be stale for a moment; a free counter is
+ * reserved first, so allocate() only fails when every id is taken, and the
+ * id is the lowest free one unless concurrent calls race on it.
+ */
 template <typename LOCK = z::ZNoLock>
 class IDPool {
     Z_DECLARE_COPY_FUNCTIONS(IDPool)
@@ -46,12 +224,33 @@ public:
     IDPool(uint32_t max_id);
     ~IDPool();
 
+    /// @return uint32_t(-1) if all the ids are taken
     uint32_t allocate();
+    /// ids not allocated are ignored
     void release(uint32_t id);
+    uint32_t free_count() const;
+private:
+    enum {
+        MAX_LEVEL   = 6,    // 64^6 > 2^32
+    };
+    static const bool LOCK_FREE = std::is_same<LOCK, ZLockFree>::value;
+    typedef typename std::conditional<LOCK_FREE, ZNoLock, LOCK>::type lock_t;
+    typedef std::atomic<uint64_t> word_t;
+
+    static uint64_t fetch_and(word_t *w, uint64_t mask);
+    static uint64_t fetch_or(word_t *w, uint64_t mask);
+    word_t *word(uint32_t level, uint32_t idx) const;
+    bool reserve();
+    uint32_t take();
+    void mark_empty(uint32_t level, uint32_t idx);
+    void mark_free(uint32_t level, uint32_t idx);
 private:
-    uint32_t    _size;
-    uint32_t    *_pool;
-    LOCK         _lock;
+    uint32_t            _max_id;
+    uint32_t            _levels;
+    uint32_t            _offset[MAX_LEVEL];
+    word_t              *_words;
+    std::atomic<uint32_t> _free;
+    lock_t              _lock;
 };
 
 template <typename T, 
@@ -70,6 +269,9 @@ template <typename T,
 
         bool enqueue(const T &t);
         bool dequeue(T *t);
+        /// @return the number of items moved, under one lock
+        uint32_t enqueue_bulk(const T *t, uint32_t n);
+        uint32_t dequeue_bulk(T *t, uint32_t max);
 
         uint32_t count() const;
         bool isFull() const;
@@ -82,39 +284,542 @@ template <typename T,
         StaticLinkedList<ItemWrapper> _free_list;
     };
 
+/**
+ * @brief Lock-free bounded multi-producer multi-consumer queue.
+ *
+ * An array ring where every cell carries a sequence number telling whose
+ * turn it is, so producers and consumers only contend on a CAS of the
+ * tail or the head, each on its own cache line. Same interface as
+ * FixedLengthQueue; the capacity is max_length rounded up to a power of
+ * two. dequeue() may fail while a producer that claimed the head cell
+ * has not finished writing it.
+ */
+template <typename T, int DefaultLength = 1024>
+    class MPMCQueue {
+    private:
+        Z_DECLARE_COPY_FUNCTIONS(MPMCQueue);
+        struct Cell {
+            std::atomic<uint64_t>   seq;
+            T                       item;
+        };
+    public:
+        MPMCQueue(uint32_t max_length = DefaultLength);
+        ~MPMCQueue();
+
+        bool enqueue(const T &t);
+        bool dequeue(T *t);
+        /**
+         * Claim a run of cells with one CAS. The cells of a run may still
+         * be finished by the other side, which is waited for.
+         * @return the number of items moved
+         */
+        uint32_t enqueue_bulk(const T *t, uint32_t n);
+        uint32_t dequeue_bulk(T *t, uint32_t max);
+
+        uint32_t count() const;
+        bool isFull() const {return count() > _mask; }
+        bool isEmpty() const {return count() == 0; }
+        uint32_t capacity() const {return uint32_t(_mask + 1); }
+    private:
+        enum {
+            SPIN_BEFORE_YIELD   = 64,
+        };
+
+        static void wait_seq(const Cell *cell, uint64_t seq);
+    private:
+        Cell                    *_cells;
+        uint64_t                _mask;
+        char                    _pad0[DEF_SIZE_CACHE_LINE];
+        std::atomic<uint64_t>   _tail;      ///< the next cell to enqueue
+        char                    _pad1[DEF_SIZE_CACHE_LINE];
+        std::atomic<uint64_t>   _head;      ///< the next cell to dequeue
+        char                    _pad2[DEF_SIZE_CACHE_LINE];
+    };
+
+/**
+ * @brief Wait-free bounded single-producer single-consumer queue.
+ *
+ * Each side keeps a cached copy of the other side's index and only reads
+ * the shared one when the cache says full (or empty), so in the steady
+ * state the two threads share no cache line but the items. Besides the
+ * FixedLengthQueue interface, the producer can stage items with
+ * enqueue_deferred() and make them visible at once with publish().
+ */
+template <typename T, int DefaultLength = 1024>
+    class SPSCQueue {
+    private:
+        Z_DECLARE_COPY_FUNCTIONS(SPSCQueue);
+    public:
+        SPSCQueue(uint32_t max_length = DefaultLength);
+        ~SPSCQueue();
+
+        /// producer side
+        bool enqueue(const T &t);
+        bool enqueue_deferred(const T &t);
+        void publish();
+        /// @return the number of items enqueued and published
+        uint32_t enqueue_bulk(const T *t, uint32_t n);
+
+        /// consumer side
+        bool dequeue(T *t);
+        uint32_t dequeue_bulk(T *t, uint32_t max);
+
+        uint32_t count() const;
+        bool isFull() const {return count() > _mask; }
+        bool isEmpty() const {return count() == 0; }
+        uint32_t capacity() const {return _mask + 1; }
+    private:
+        T                       *_items;
+        uint32_t                _mask;
+        char                    _pad0[DEF_SIZE_CACHE_LINE];
+        std::atomic<uint32_t>   _tail;          ///< published by the producer
+        uint32_t                _tail_staged;
+        uint32_t                _head_cache;
+        char                    _pad1[DEF_SIZE_CACHE_LINE];
+        std::atomic<uint32_t>   _head;
+        uint32_t                _tail_cache;
+        char                    _pad2[DEF_SIZE_CACHE_LINE];
+    };
+
+/**
+ * @brief Bounded Chase-Lev work-stealing deque (the C11 version of Le et
+ *        al., "Correct and Efficient Work-Stealing for Weak Memory Models").
+ *
+ * The owner thread push()es and pop()s at the bottom, LIFO, touching no
+ * shared line but the bottom index unless the deque is nearly empty; any
+ * other thread steal()s the oldest item at the top with one CAS. steal()
+ * also fails when it loses a race, so a thief moves on to another victim
+ * rather than spinning. The capacity is max_length rounded up to a power of
+ * two; T is copied around unsynchronized, keep it a pointer or an integer.
+ */
+template <typename T, int DefaultLength = 1024>
+    class WorkStealingDeque {
+    private:
+        Z_DECLARE_COPY_FUNCTIONS(WorkStealingDeque);
+    public:
+        WorkStealingDeque(uint32_t max_length = DefaultLength);
+        ~WorkStealingDeque();
+
+        /// owner side
+        bool push(const T &t);
+        bool pop(T *t);
+
+        /// any thread
+        bool steal(T *t);
+
+        uint32_t count() const;
+        bool isEmpty() const {return count() == 0; }
+        uint32_t capacity() const {return uint32_t(_mask + 1); }
+    private:
+        T                       *_items;
+        int64_t                 _mask;
+        char                    _pad0[DEF_SIZE_CACHE_LINE];
+        std::atomic<int64_t>    _top;       ///< the next item to steal
+        char                    _pad1[DEF_SIZE_CACHE_LINE];
+        std::atomic<int64_t>    _bottom;    ///< the next cell to push
+        char                    _pad2[DEF_SIZE_CACHE_LINE];
+    };
+
+/**
+ * @brief A queue with an eventfd to poll.
+ *
+ * By default the eventfd is only written when the queue goes from drained
+ * to non-empty, and a consumer woken by it should dequeue() until false:
+ * the failing call resets the eventfd, so a burst costs two syscalls
+ * rather than two per item. With EFD_SEMAPHORE in efd_flags every item is
+ * counted in the eventfd and dequeue() reads one count back, for callers
+ * that need the fd to tell exactly how many items wait.
+ *
+ * QUEUE is any queue with the FixedLengthQueue interface.
+ */
 template <typename T, 
          typename LOCK = z::ZNoLock,
-         int DefaultLength = 1024>
+         int DefaultLength = 1024,
+         typename QUEUE = FixedLengthQueue<T, LOCK, DefaultLength> >
     class FixedLengthQueueWithFd {
     private:
         Z_DECLARE_COPY_FUNCTIONS(FixedLengthQueueWithFd);
     public:
-        FixedLengthQueueWithFd(uint32_t max_length = DefaultLength);
+        FixedLengthQueueWithFd(uint32_t max_length = DefaultLength, int efd_flags = 0);
         ~FixedLengthQueueWithFd();
 
         bool enqueue(const T &t);
         bool dequeue(T *t);
+        /// @return the number of items moved, signalled with one write
+        uint32_t enqueue_bulk(const T *t, uint32_t n);
+        /// like dequeue(), a consumer drains until it returns 0
+        uint32_t dequeue_bulk(T *t, uint32_t max);
 
         uint32_t count() const {return _queue.count(); }
         bool isFull() const {return _queue.isFull(); }
         bool isEmpty() const {return _queue.isEmpty(); }
 
-        int enqueue_fd() const {return _fds[1];}
-        int dequeue_fd() const {return _fds[0];}
+        int enqueue_fd() const {return _efd;}
+        int dequeue_fd() const {return _efd;}
+    private:
+        void signal(uint64_t n = 1);
+        void signal_added();
+        bool wait_one();
+        void reset();
     private:
-        int                             _fds[2];
-        FixedLengthQueue<T, LOCK>       _queue;
+        int                             _efd;
+        bool                            _semaphore;
+        std::atomic<bool>               _signaled;  ///< written since the last reset()
+        QUEUE                           _queue;
     };
 
 
-template <typename LOCK = z::ZNoLock>
+/**
+ * @brief uint64_t keyed open addressing hash table.
+ *
+ * Every slot has a control byte: EMPTY or the top 7 bits of the key hash.
+ * Lookups compare a group of 16 control bytes at once with SSE2, starting
+ * at the home slot, and stop at the first group with an EMPTY byte. The
+ * group does not widen with AVX2: objects built with and without it share
+ * the instantiations, so the layout must not depend on compiler flags. Probing is linear, so erase() shifts the following
+ * entries back instead of leaving tombstones.
+ *
+ * The capacity is a power of two. When the load passes 7/8 a table twice as
+ * large is allocated and the old entries move over a few clusters per
+ * insert/update/erase, so no single call pays for a full rehash.
+ *
+ * find() only reads: with a ZRWLock as LOCK, finds run side by side.
+ */
+template <typename T, typename LOCK = z::ZNoLock>
     class HashTable64 {
+    private:
+        Z_DECLARE_COPY_FUNCTIONS(HashTable64);
     public:
         typedef uint64_t HashKey;
+
+        HashTable64(uint32_t capacity = 64);
+        ~HashTable64();
+
+        /// @retval false the key exists already
+        bool insert(HashKey key, const T &value);
+        /// insert or overwrite
+        void update(HashKey key, const T &value);
+        bool find(HashKey key, T *value = nullptr);
+        bool erase(HashKey key, T *value = nullptr);
+        void clear();
+
+        uint32_t size() const {return _size; }
+        uint32_t capacity() const {return _table.mask + 1; }
+        bool isEmpty() const {return _size == 0; }
+    private:
+        enum {
+            CTRL_EMPTY      = 0x80,
+            MIGRATE_SLOTS   = 64,   ///< old slots moved per modification while resizing
+            HUGE_PAGE_SIZE  = 2 << 20,
+            GROUP           = 16,
+        };
+
+        struct Slot {
+            HashKey     key;
+            T           value;
+        };
+
+        struct Table {
+            uint8_t     *ctrl;      ///< mask + 1 + GROUP bytes, the tail clones the head
+            Slot        *slots;
+            uint32_t    mask;
+            uint32_t    size;
+        };
+
+        static uint64_t hash(HashKey key) {return hash_int64(key); }
+        static uint8_t  tag(uint64_t h) {return uint8_t(h >> 57); }
+        static uint32_t match(const uint8_t *ctrl, uint8_t tag);
+
+        static bool alloc_table(Table *t, uint32_t capacity);
+        static void free_table(Table *t);
+        static void set_ctrl(Table *t, uint32_t i, uint8_t c);
+        static Slot *lookup(Table *t, HashKey key, uint64_t h);
+        static void put(Table *t, HashKey key, uint64_t h, const T &value);
+        static void remove(Table *t, uint32_t i);
+
+        Slot *find_slot(HashKey key, uint64_t h);
+        bool reserve_one();
+        void migrate();
+
+        template <typename U, typename L> friend class ConcurrentHashTable64;
     private:
         LOCK        _lock;
-        HashKey     *_buckets;
-        uint32_t    _bucket_size;
+        Table       _table;
+        Table       _old;           ///< being migrated into _table, if ctrl != nullptr
+        uint32_t    _old_start;     ///< an EMPTY slot of _old where the migration began
+        uint32_t    _old_scanned;
+        uint32_t    _size;
+    };
+
+/**
+ * @brief HashTable64 for many readers and writers.
+ *
+ * Keys are spread over shards by bits 32.. of the hash. Writers take the
+ * lock of one shard. find() takes no lock and writes nothing shared: it
+ * reads under the shard's sequence counter and retries if a writer was
+ * inside, so T must be trivially copyable. A shard grows by building a
+ * whole new table and publishing it; the old one is kept until the
+ * destructor for readers that may still be probing it, which costs at
+ * most the size of the live tables again.
+ */
+template <typename T, typename LOCK = z::ZSpinLock>
+    class ConcurrentHashTable64 {
+    private:
+        Z_DECLARE_COPY_FUNCTIONS(ConcurrentHashTable64);
+        static_assert(std::is_trivially_copyable<T>::value, "find() copies T while it may be written");
+    public:
+        typedef uint64_t HashKey;
+        typedef void (*visitor_t)(HashKey key, const T &value, void *arg);
+
+        ConcurrentHashTable64(uint32_t capacity = 1024, uint32_t shard_num = 64);
+        ~ConcurrentHashTable64();
+
+        /// @retval false the key exists already
+        bool insert(HashKey key, const T &value);
+        /// insert or overwrite
+        void update(HashKey key, const T &value);
+        bool find(HashKey key, T *value = nullptr) const;
+        bool erase(HashKey key, T *value = nullptr);
+        void clear();
+
+        /**
+         * Visit every entry, locking one shard at a time: readers never
+         * wait and writers wait only on the shard being visited. The
+         * visitor must not modify this table.
+         */
+        void for_each(visitor_t visitor, void *arg);
+
+        /// exact when no writer is running
+        uint32_t size() const;
+        uint32_t shard_num() const {return _shard_mask + 1; }
+    private:
+        typedef HashTable64<T, LOCK>    Base;
+        typedef typename Base::Table    Table;
+        typedef typename Base::Slot     Slot;
+
+        enum {
+            PROBE_RETRY         = -1,
+            SPIN_BEFORE_YIELD   = 64,
+        };
+
+        struct Shard {
+            LOCK                    lock;
+            std::atomic<uint32_t>   seq;        ///< odd while a writer is changing the table
+            std::atomic<Table*>     table;
+            std::atomic<uint32_t>   size;
+            std::vector<Table*>     retired;
+        } __attribute__((aligned(64)));
+
+        Shard &shard(uint64_t h) const {return _shards[(h >> 32) & _shard_mask]; }
+        static int probe(const Table *t, HashKey key, uint64_t h, T *value);
+        static void write_begin(Shard *s);
+        static void write_end(Shard *s);
+        static bool grow(Shard *s);
+    private:
+        Shard       *_shards;
+        uint32_t    _shard_mask;
+    };
+
+/**
+ * @brief A timer linked into a TimingWheel. Embed it in the owner and find
+ *        the owner back with Z_FIND_OBJ_BY_MEMBER in the expire callback.
+ */
+struct TimerNode {
+    TimerNode   *prev;
+    TimerNode   *next;
+    uint64_t    expire;     ///< in ticks
+    uint32_t    slot;
+
+    TimerNode() : prev(nullptr), next(nullptr), expire(0), slot(0) {}
+    bool pending() const {return nullptr != next; }
+};
+
+/**
+ * @brief A hierarchical timing wheel: LEVELS wheels of 2^BITS slots, a slot
+ *        of level k spans 2^(BITS * k) ticks.
+ *
+ * A timer goes to the lowest level whose window still holds its expiry, and
+ * moves down a level when the tick reaches its slot, so add() and cancel()
+ * are O(1) and a timer is moved at most LEVELS - 1 times. An occupancy
+ * bitmap per level lets advance() jump over empty ticks, and gives the next
+ * expiry (a lower bound while it is in a higher level) for epoll_wait.
+ * Expiries past the top window wait in its last slot. Timers never fire
+ * early: expiries round up to a tick, now rounds down. The wheel does not
+ * own the timers, they may be gone before it.
+ */
+template <uint32_t BITS = 8, uint32_t LEVELS = 4>
+    class TimingWheel {
+    private:
+        Z_DECLARE_COPY_FUNCTIONS(TimingWheel);
+        static_assert(BITS >= 6 && BITS * LEVELS <= 63, "64 to 2^63 ticks");
+    public:
+        typedef void (*timer_func_t)(TimerNode *node, void *arg);
+
+        /// times are in ms from any clock, e.g. zmonotonic_ms()
+        TimingWheel(uint32_t tick_ms = 1, uint64_t now_ms = 0);
+        ~TimingWheel();
+
+        /// (re)arm a timer
+        void add(TimerNode *node, uint64_t expire_ms);
+        bool cancel(TimerNode *node);
+
+        /// run the timers expired by now_ms, they may add timers again
+        uint32_t advance(uint64_t now_ms, timer_func_t func, void *arg);
+
+        /// uint64_t(-1) without timers
+        uint64_t next_expiry_ms() const;
+        /// ms until next_expiry_ms(), at most max_ms; -1 to wait forever
+        int epoll_timeout(uint64_t now_ms, int max_ms = -1) const;
+
+        uint32_t size() const {return _size; }
+    private:
+        enum : uint64_t {
+            SLOTS   = 1u << BITS,
+            MASK    = SLOTS - 1,
+            WORDS   = SLOTS / 64,
+            NONE    = ~uint64_t(0),
+        };
+
+        TimerNode *head(uint32_t slot) const {return &_heads[slot]; }
+        void link(TimerNode *node);
+        void unlink(TimerNode *node);
+        uint64_t next_tick() const;
+        static int32_t find_from(const uint64_t *bits, uint32_t start);
+    private:
+        uint64_t    _origin_ms;
+        uint32_t    _tick_ms;
+        uint32_t    _size;
+        uint64_t    _now;           ///< the next tick to run
+        TimerNode   *_heads;        ///< LEVELS * SLOTS list heads
+        uint64_t    _bits[LEVELS][WORDS];
+    };
+
+/**
+ * @brief The in-node search of BPlusTree: how many of the n sorted keys are
+ *        less than (lower) or not greater than (upper) k. A binary search in
+ *        general, a SIMD compare of the whole node for 32 and 64 bit integers.
+ */
+template <typename K, bool SIMD = std::is_integral<K>::value && (sizeof(K) == 4 || sizeof(K) == 8)>
+    struct BPlusTreeSearch {
+        static uint32_t lower(const K *keys, uint32_t n, const K &k) {
+            return uint32_t(std::lower_bound(keys, keys + n, k) - keys);
+        }
+        static uint32_t upper(const K *keys, uint32_t n, const K &k) {
+            return uint32_t(std::upper_bound(keys, keys + n, k) - keys);
+        }
+    };
+
+template <typename K>
+    struct BPlusTreeSearch<K, true> {
+        static uint32_t lower(const K *keys, uint32_t n, const K &k) {return prefix(keys, n, k, false); }
+        static uint32_t upper(const K *keys, uint32_t n, const K &k) {return prefix(keys, n, k, true); }
+        /// the length of the prefix of keys < k, or keys <= k with or_equal
+        static uint32_t prefix(const K *keys, uint32_t n, const K &k, bool or_equal);
+    };
+
+/**
+ * @brief An ordered map of unique keys, a B+tree.
+ *
+ * A node fills up to NODE_BYTES: keys first, then values or children, so a
+ * search reads only the keys, a few cache lines. Nodes are 64 byte aligned
+ * and hold a multiple of 8 keys, the unit of the SIMD search. Leaves are
+ * linked both ways for scans; an Iterator stays valid until the tree is
+ * modified. Nodes but the root are at least half full.
+ */
+template <typename K, typename V, uint32_t NODE_BYTES = 1024>
+    class BPlusTree {
+    private:
+        Z_DECLARE_COPY_FUNCTIONS(BPlusTree);
+        struct Leaf;
+    public:
+        class Iterator {
+        public:
+            Iterator() : _leaf(nullptr), _pos(0) {}
+            bool valid() const {return nullptr != _leaf; }
+            const K& key() const {return _leaf->keys[_pos]; }
+            V& value() const {return _leaf->values[_pos]; }
+            void next() {++_pos; skip(); }
+        private:
+            friend class BPlusTree;
+            Iterator(Leaf *leaf, uint32_t pos) : _leaf(leaf), _pos(pos) {skip(); }
+            void skip() {
+                while (_leaf && _pos >= _leaf->count) {
+                    _leaf = _leaf->next;
+                    _pos = 0;
+                }
+            }
+        private:
+            Leaf        *_leaf;
+            uint32_t    _pos;
+        };
+
+        BPlusTree();
+        ~BPlusTree();
+
+        /// @retval false the key exists already
+        bool insert(const K &key, const V &value) {return upsert(key, value, false); }
+        /// insert or overwrite
+        void update(const K &key, const V &value) {upsert(key, value, true); }
+        bool find(const K &key, V *value = nullptr) const;
+        bool erase(const K &key, V *value = nullptr);
+        void clear();
+
+        /**
+         * Replace the content by n keys in strictly increasing order, with
+         * packed leaves.
+         * @retval false the keys are not sorted, nothing changed
+         */
+        bool bulk_load(const K *keys, const V *values, uint32_t n);
+
+        Iterator begin() const {return Iterator(_first, 0); }
+        /// the first key not less than key, iterate from it for a range
+        Iterator lower_bound(const K &key) const;
+
+        uint32_t size() const {return _size; }
+        bool isEmpty() const {return _size == 0; }
+        uint32_t height() const {return _height; }
+    private:
+        enum : uint32_t {
+            HEADER      = 2 * sizeof(uint32_t),
+            LEAF_CAP    = ( (NODE_BYTES - HEADER - 2 * sizeof(void*) ) / (sizeof(K) + sizeof(V) ) ) & ~7u,
+            INNER_CAP   = ( (NODE_BYTES - HEADER - sizeof(void*) ) / (sizeof(K) + sizeof(void*) ) ) & ~7u,
+            LEAF_MIN    = LEAF_CAP / 2,
+            INNER_MIN   = INNER_CAP / 2,
+            MAX_DEPTH   = 32,
+        };
+        static_assert(LEAF_CAP >= 8 && INNER_CAP >= 8, "NODE_BYTES holds too few keys");
+
+        typedef BPlusTreeSearch<K> Search;
+
+        struct Node {
+            uint32_t    leaf;
+            uint32_t    count;      ///< keys
+        };
+        struct Inner : Node {
+            K           keys[INNER_CAP];
+            Node        *child[INNER_CAP + 1];  ///< child[i] holds [keys[i - 1], keys[i])
+        };
+        struct Leaf : Node {
+            Leaf        *prev;
+            Leaf        *next;
+            K           keys[LEAF_CAP];
+            V           values[LEAF_CAP];
+        };
+
+        bool upsert(const K &key, const V &value, bool overwrite);
+        Leaf* descend(const K &key, Inner **path, uint32_t *slot, uint32_t *depth) const;
+        bool rebalance_leaf(Leaf *leaf, Inner *parent, uint32_t i);
+        bool rebalance_inner(Inner *node, Inner *parent, uint32_t i);
+        static void remove_child(Inner *node, uint32_t key_pos);
+
+        template <typename N> static N* alloc_node();
+        template <typename N> static void free_node(N *n);
+        void free_tree(Node *n);
+    private:
+        Node        *_root;
+        Leaf        *_first;
+        uint32_t    _size;
+        uint32_t    _height;
     };
 
 // ------------------------------------------------------------------------ //
@@ -134,7 +839,10 @@ template <typename T, typename LOCK>
     T *StaticLinkedList<T, LOCK>::allocate() {
         Z_RET_IF_ANY_ZERO_2(_item_pool, _item_pool[0].next_ptr, nullptr);
         _lock.lock();
-        Z_RET_IF_ANY_ZERO_2(_item_pool, _item_pool[0].next_ptr, nullptr);
+        if (0 == _item_pool[0].next_ptr) {
+            _lock.unlock();
+            return nullptr;
+        }
         ItemWrapper *free_item = &_item_pool[_item_pool[0].next_ptr];
         _item_pool[0].next_ptr = free_item->next_ptr;
         _lock.unlock();
@@ -174,82 +882,573 @@ template <typename T, typename LOCK>
         _item_pool = nullptr;
     }
 
-template <typename LOCK>
-IDPool<LOCK>::IDPool(uint32_t max_id) 
-: _size(max_id + 1) {
-    _pool = new uint32_t[_size];
+template <typename T>
+    StaticLinkedList<T, ZLockFree>::StaticLinkedList(uint32_t max_item_num, uint32_t magazine_size)
+    : _item_pool(new ItemWrapper[max_item_num + 1]), _item_num(max_item_num),
+      _magazine_size(magazine_size), _magazines(nullptr), _head(0) {
+        for (uint32_t i = 1; i <= max_item_num; ++i) {
+            _item_pool[i].next_ptr.store(i - 1, std::memory_order_relaxed);
+        }
+        _head.store(max_item_num, std::memory_order_release);
 
-    for (uint32_t i = 0; i < _size; ++i) {
-        _pool[i] = i + 1;
+        if (magazine_size > 0) {
+            void *mem = nullptr;
+            int ret = posix_memalign(&mem, DEF_SIZE_CACHE_LINE, sizeof(Magazine) * MAGAZINE_SLOTS);
+            ZASSERT(0 == ret);
+            Z_USE_VAR(ret);
+            _magazines = (Magazine*)(mem);
+            for (uint32_t i = 0; i < MAGAZINE_SLOTS; ++i) {
+                new (&_magazines[i].busy) std::atomic<bool>(false);
+                _magazines[i].count = 0;
+                _magazines[i].ids = new uint32_t[2 * magazine_size];
+            }
+        }
     }
 
-    _pool[_size - 1] = 0;
-}
-
-template <typename LOCK>
-IDPool<LOCK>::~IDPool() {
-    delete _pool;
-    _size = 0;
-    _pool = nullptr;
-}
-
-template <typename LOCK>
-uint32_t IDPool<LOCK>::allocate() {
-    if (0 == _pool[0]) {
-        return uint32_t(-1);
+template <typename T>
+    StaticLinkedList<T, ZLockFree>::~StaticLinkedList() {
+        if (_magazines) {
+            for (uint32_t i = 0; i < MAGAZINE_SLOTS; ++i) {
+                delete [] _magazines[i].ids;
+            }
+            ::free(_magazines);
+            _magazines = nullptr;
+        }
+        delete [] _item_pool;
+        _item_pool = nullptr;
     }
 
-    _lock.lock();
-    uint32_t offset = _pool[0];
-    _pool[0] = _pool[offset];
-    _pool[offset] = uint32_t(-1);
-    _lock.unlock();
-
-    return (offset - 1);
-}
+template <typename T>
+    T *StaticLinkedList<T, ZLockFree>::allocate() {
+        uint32_t id = 0;
+        if (_magazines) {
+            Magazine *m = lock_magazine(thread_slot() );
+            if (m) {
+                if (0 == m->count) {
+                    m->count = pop(m->ids, _magazine_size);
+                }
+                if (m->count > 0) {
+                    id = m->ids[--m->count];
+                }
+                m->busy.store(false, std::memory_order_release);
+            }
+        }
 
-template <typename LOCK>
-void IDPool<LOCK>::release(uint32_t id) {
-    uint32_t offset = id + 1;
-    if (offset >= _size || _pool[offset] != uint32_t(-1) ) {
-        return ;
+        if (0 == id && 0 == pop(&id, 1) ) {
+            return _magazines ? steal() : nullptr;
+        }
+        return &_item_pool[id].item;
     }
 
-    _lock.lock();
-    _pool[offset] = _pool[0];
-    _pool[0] = offset;
-    _lock.unlock();
-}
+template <typename T>
+    void StaticLinkedList<T, ZLockFree>::release(T *t) {
+        Z_RET_IF_ANY_ZERO_2(t, _item_pool, );
+        ItemWrapper *item = Z_FIND_OBJ_BY_MEMBER(ItemWrapper, item, t);
+        uint32_t id = uint32_t(item - _item_pool);
 
+        if (_magazines) {
+            Magazine *m = lock_magazine(thread_slot() );
+            if (m) {
+                if (m->count == 2 * _magazine_size) {
+                    m->count -= _magazine_size;
+                    push(m->ids + m->count, _magazine_size);
+                }
+                m->ids[m->count++] = id;
+                m->busy.store(false, std::memory_order_release);
+                return;
+            }
+        }
+        push(&id, 1);
+    }
 
+template <typename T>
+    bool StaticLinkedList<T, ZLockFree>::isEmpty() const {
+        return 0 == uint32_t(_head.load(std::memory_order_acquire) );
+    }
 
-template <typename T, typename LOCK, int L>
-    FixedLengthQueue<T, LOCK, L>::FixedLengthQueue(uint32_t max_length)
-    : _head(nullptr), _tail(nullptr), _count(0), _free_list(max_length + 1) {
-        _head = _tail = _free_list.allocate();
-        _tail->next = nullptr;
+template <typename T>
+    uint64_t StaticLinkedList<T, ZLockFree>::pack(uint64_t head, uint32_t id) {
+        return (((head >> 32) + 1) << 32) | id;
     }
 
-template <typename T, typename LOCK, int L>
-    FixedLengthQueue<T, LOCK, L>::~FixedLengthQueue() {}
+template <typename T>
+    uint32_t StaticLinkedList<T, ZLockFree>::thread_slot() {
+        static std::atomic<uint32_t> next_slot(0);
+        static __thread uint32_t slot = uint32_t(-1);
+        if (slot == uint32_t(-1) ) {
+            slot = next_slot.fetch_add(1, std::memory_order_relaxed) % MAGAZINE_SLOTS;
+        }
+        return slot;
+    }
 
-template <typename T, typename LOCK, int L>
-    bool FixedLengthQueue<T, LOCK, L>::enqueue(const T &t) {
-        _lock.lock();
-        ItemWrapper * new_item = _free_list.allocate();
-        if (new_item) {
-            new_item->item = t;
-            new_item->next = nullptr;
-            _tail->next = new_item;
-            _tail = new_item;
-            ++_count;
-            _lock.unlock();
-            return true;
-        } else {
-            _lock.unlock();
-            ZLOG(LOG_DEBUG, "call enqueue on a full queue. count: %u",
-                count() );
-            return false;
+/**
+ * Pop a chain of up to max items with one CAS. The walk may read links that
+ * are being changed, but then the head (and its tag) has changed as well and
+ * the CAS fails. Items are never freed, so the reads stay in the pool.
+ */
+template <typename T>
+    uint32_t StaticLinkedList<T, ZLockFree>::pop(uint32_t *ids, uint32_t max) {
+        uint64_t head = _head.load(std::memory_order_acquire);
+        for (;;) {
+            uint32_t n = 0;
+            uint32_t next = uint32_t(head);
+            while (n < max && next != 0) {
+                ids[n++] = next;
+                next = _item_pool[next].next_ptr.load(std::memory_order_relaxed);
+            }
+            Z_RET_IF(0 == n, 0);
+            if (_head.compare_exchange_weak(head, pack(head, next),
+                        std::memory_order_acquire, std::memory_order_acquire) ) {
+                return n;
+            }
+        }
+    }
+
+template <typename T>
+    void StaticLinkedList<T, ZLockFree>::push(const uint32_t *ids, uint32_t n) {
+        for (uint32_t i = 1; i < n; ++i) {
+            _item_pool[ids[i - 1]].next_ptr.store(ids[i], std::memory_order_relaxed);
+        }
+        std::atomic<uint32_t> &last = _item_pool[ids[n - 1]].next_ptr;
+        uint64_t head = _head.load(std::memory_order_relaxed);
+        do {
+            last.store(uint32_t(head), std::memory_order_relaxed);
+        } while (!_head.compare_exchange_weak(head, pack(head, ids[0]),
+                        std::memory_order_release, std::memory_order_relaxed) );
+    }
+
+template <typename T>
+    typename StaticLinkedList<T, ZLockFree>::Magazine *
+    StaticLinkedList<T, ZLockFree>::lock_magazine(uint32_t slot) {
+        Magazine *m = &_magazines[slot];
+        Z_RET_IF(m->busy.load(std::memory_order_relaxed), nullptr);
+        Z_RET_IF(m->busy.exchange(true, std::memory_order_acquire), nullptr);
+        return m;
+    }
+
+template <typename T>
+    T *StaticLinkedList<T, ZLockFree>::steal() {
+        for (uint32_t i = 0; i < MAGAZINE_SLOTS; ++i) {
+            Magazine *m = lock_magazine(i);
+            if (!m) {
+                continue;
+            }
+            uint32_t id = (m->count > 0) ? m->ids[--m->count] : 0;
+            m->busy.store(false, std::memory_order_release);
+            if (id) {
+                return &_item_pool[id].item;
+            }
+        }
+        return nullptr;
+    }
+
+template <typename T, typename LOCK>
+    ObjectPool<T, LOCK>::ObjectPool(uint32_t max_item_num, uint32_t flags)
+    : _max_item_num(max_item_num), _flags(flags), _slab_bytes(SLAB_BYTES),
+      _slab_count(0), _size(0), _empty(0), _partial(NIL) {
+        if (flags & OBJECT_POOL_HUGEPAGE) {
+            _slab_bytes = HUGE_PAGE_SIZE;
+        }
+        while (_slab_bytes < sizeof(Slab) + sizeof(Slot) * MIN_SLOTS) {
+            _slab_bytes *= 2;
+        }
+        _per_slab = uint32_t((_slab_bytes - sizeof(Slab) ) / sizeof(Slot) );
+        _slab_max = (max_item_num + _per_slab - 1) / _per_slab;
+        _slabs = new Slab*[_slab_max + 1]();
+    }
+
+template <typename T, typename LOCK>
+    ObjectPool<T, LOCK>::~ObjectPool() {
+        if (_size > 0) {
+            ZLOG(LOG_WARN, "ObjectPool destroyed with %u live objects, not destructed.", _size);
+        }
+        for (uint32_t i = 0; i < _slab_max; ++i) {
+            if (_slabs[i]) {
+                unmap_slab(_slabs[i]);
+            }
+        }
+        delete [] _slabs;
+        _slabs = nullptr;
+    }
+
+template <typename T, typename LOCK>
+    template <typename... Args>
+    T *ObjectPool<T, LOCK>::allocate(Args&&... args) {
+        Slab *spare = nullptr;  // mapped in vain, unmapped after
+        _lock.lock();
+        if (NIL == _partial && _size < _max_item_num) {
+            // mapping is slow, do it unlocked
+            _lock.unlock();
+            Slab *fresh = map_slab();
+            Z_RET_IF(nullptr == fresh, nullptr);
+            _lock.lock();
+
+            // another thread may have added slabs meanwhile
+            uint32_t i = 0;
+            while (i < _slab_max && _slabs[i]) {
+                ++i;
+            }
+            if (i < _slab_max) {
+                fresh->index = i;
+                _slabs[i] = fresh;
+                ++_slab_count;
+                ++_empty;
+                link(fresh);
+            } else {
+                spare = fresh;
+            }
+        }
+
+        Slot *slot = nullptr;
+        if (NIL != _partial && _size < _max_item_num) {
+            Slab *slab = _slabs[_partial];
+            if (slab->free_head) {
+                slot = slots(slab) + (slab->free_head - 1);
+                slab->free_head = *(uint32_t*)(slot);
+            } else {
+                slot = slots(slab) + slab->fresh++;
+            }
+            if (0 == slab->used++) {
+                --_empty;
+            }
+            if (slab->used == _per_slab) {
+                unlink(slab);
+            }
+            ++_size;
+        }
+        _lock.unlock();
+
+        if (spare) {
+            unmap_slab(spare);
+        }
+        return slot ? new (slot) T(std::forward<Args>(args)...) : nullptr;
+    }
+
+template <typename T, typename LOCK>
+    void ObjectPool<T, LOCK>::release(T *t) {
+        Z_RET_IF_ANY_ZERO_1(t, );
+        t->~T();
+
+        Slab *slab = slab_of(t);
+        Slab *to_unmap = nullptr;
+        _lock.lock();
+        uint32_t *slot = (uint32_t*)(t);
+        *slot = slab->free_head;
+        slab->free_head = uint32_t((Slot*)(t) - slots(slab) ) + 1;
+        if (slab->used-- == _per_slab) {
+            link(slab);
+        }
+        --_size;
+        if (0 == slab->used) {
+            if (_empty > 0) {
+                unlink(slab);
+                _slabs[slab->index] = nullptr;
+                --_slab_count;
+                to_unmap = slab;
+            } else {
+                ++_empty;
+            }
+        }
+        _lock.unlock();
+
+        if (to_unmap) {
+            unmap_slab(to_unmap);
+        }
+    }
+
+template <typename T, typename LOCK>
+    uint32_t ObjectPool<T, LOCK>::handle(const T *t) const {
+        Slab *slab = slab_of(t);
+        return slab->index * _per_slab + uint32_t((const Slot*)(t) - slots(slab) );
+    }
+
+template <typename T, typename LOCK>
+    T *ObjectPool<T, LOCK>::get(uint32_t handle) const {
+        uint32_t i = handle / _per_slab;
+        Z_RET_IF(i >= _slab_max || nullptr == _slabs[i], nullptr);
+        return (T*)(slots(_slabs[i]) + handle % _per_slab);
+    }
+
+template <typename T, typename LOCK>
+    uint32_t ObjectPool<T, LOCK>::size() const {
+        return _size;
+    }
+
+template <typename T, typename LOCK>
+    uint32_t ObjectPool<T, LOCK>::slab_count() const {
+        return _slab_count;
+    }
+
+template <typename T, typename LOCK>
+    uint32_t ObjectPool<T, LOCK>::capacity() const {
+        return _max_item_num;
+    }
+
+/// an mmap aligned to its size: map twice as much and trim
+template <typename T, typename LOCK>
+    typename ObjectPool<T, LOCK>::Slab *ObjectPool<T, LOCK>::map_slab() const {
+        void *mem = ::mmap(nullptr, 2 * _slab_bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        Z_RET_IF(MAP_FAILED == mem, nullptr);
+        uintptr_t begin = uintptr_t(mem);
+        uintptr_t aligned = (begin + _slab_bytes - 1) & ~(uintptr_t(_slab_bytes) - 1);
+        if (aligned > begin) {
+            ::munmap(mem, aligned - begin);
+        }
+        ::munmap((void*)(aligned + _slab_bytes), begin + _slab_bytes - aligned);
+        if (_flags & OBJECT_POOL_HUGEPAGE) {
+            ::madvise((void*)(aligned), _slab_bytes, MADV_HUGEPAGE);
+        }
+
+        Slab *slab = new ((void*)(aligned) ) Slab();
+        slab->prev = NIL;
+        slab->next = NIL;
+        return slab;
+    }
+
+template <typename T, typename LOCK>
+    void ObjectPool<T, LOCK>::unmap_slab(Slab *slab) const {
+        ::munmap(slab, _slab_bytes);
+    }
+
+template <typename T, typename LOCK>
+    typename ObjectPool<T, LOCK>::Slot *ObjectPool<T, LOCK>::slots(Slab *slab) const {
+        return (Slot*)(slab + 1);
+    }
+
+template <typename T, typename LOCK>
+    typename ObjectPool<T, LOCK>::Slab *ObjectPool<T, LOCK>::slab_of(const T *t) const {
+        return (Slab*)(uintptr_t(t) & ~(uintptr_t(_slab_bytes) - 1) );
+    }
+
+template <typename T, typename LOCK>
+    void ObjectPool<T, LOCK>::link(Slab *slab) {
+        slab->prev = NIL;
+        slab->next = _partial;
+        if (NIL != _partial) {
+            _slabs[_partial]->prev = slab->index;
+        }
+        _partial = slab->index;
+    }
+
+template <typename T, typename LOCK>
+    void ObjectPool<T, LOCK>::unlink(Slab *slab) {
+        if (NIL != slab->prev) {
+            _slabs[slab->prev]->next = slab->next;
+        } else {
+            _partial = slab->next;
+        }
+        if (NIL != slab->next) {
+            _slabs[slab->next]->prev = slab->prev;
+        }
+        slab->prev = NIL;
+        slab->next = NIL;
+    }
+
+template <typename LOCK>
+IDPool<LOCK>::IDPool(uint32_t max_id) 
+: _max_id(max_id), _levels(0), _words(nullptr), _free(max_id) {
+    // level 0 first, the single top word last
+    uint32_t total = 0;
+    uint32_t bits = max_id;
+    do {
+        _offset[_levels++] = total;
+        bits = (bits + 63) / 64;
+        total += bits;
+    } while (bits > 1);
+
+    _words = new word_t[total];
+    for (uint32_t i = 0; i < total; ++i) {
+        _words[i].store(0, std::memory_order_relaxed);
+    }
+    bits = max_id;
+    for (uint32_t l = 0; l < _levels; ++l) {
+        for (uint32_t i = 0; i < bits / 64; ++i) {
+            word(l, i)->store(~uint64_t(0), std::memory_order_relaxed);
+        }
+        if (bits % 64) {
+            word(l, bits / 64)->store((uint64_t(1) << (bits % 64) ) - 1, std::memory_order_relaxed);
+        }
+        bits = (bits + 63) / 64;
+    }
+}
+
+template <typename LOCK>
+IDPool<LOCK>::~IDPool() {
+    delete [] _words;
+    _words = nullptr;
+}
+
+template <typename LOCK>
+uint32_t IDPool<LOCK>::allocate() {
+    if (LOCK_FREE) {
+        Z_RET_IF(!reserve(), uint32_t(-1) );
+        return take();
+    }
+
+    _lock.lock();
+    uint32_t n = _free.load(std::memory_order_relaxed);
+    uint32_t id = uint32_t(-1);
+    if (n > 0) {
+        _free.store(n - 1, std::memory_order_relaxed);
+        id = take();
+    }
+    _lock.unlock();
+    return id;
+}
+
+template <typename LOCK>
+void IDPool<LOCK>::release(uint32_t id) {
+    Z_RET_IF(id >= _max_id, );
+    uint64_t bit = uint64_t(1) << (id % 64);
+
+    _lock.lock();
+    uint64_t old = fetch_or(word(0, id / 64), bit);
+    if (0 == old) {
+        mark_free(0, id / 64);
+    }
+    if (0 == (old & bit) ) {
+        if (LOCK_FREE) {
+            _free.fetch_add(1, std::memory_order_release);
+        } else {
+            _free.store(_free.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    }
+    _lock.unlock();
+}
+
+template <typename LOCK>
+uint32_t IDPool<LOCK>::free_count() const {
+    return _free.load(std::memory_order_relaxed);
+}
+
+template <typename LOCK>
+uint64_t IDPool<LOCK>::fetch_and(word_t *w, uint64_t mask) {
+    if (LOCK_FREE) {
+        return w->fetch_and(mask);
+    }
+    uint64_t old = w->load(std::memory_order_relaxed);
+    w->store(old & mask, std::memory_order_relaxed);
+    return old;
+}
+
+template <typename LOCK>
+uint64_t IDPool<LOCK>::fetch_or(word_t *w, uint64_t mask) {
+    if (LOCK_FREE) {
+        return w->fetch_or(mask);
+    }
+    uint64_t old = w->load(std::memory_order_relaxed);
+    w->store(old | mask, std::memory_order_relaxed);
+    return old;
+}
+
+template <typename LOCK>
+typename IDPool<LOCK>::word_t *IDPool<LOCK>::word(uint32_t level, uint32_t idx) const {
+    return &_words[_offset[level] + idx];
+}
+
+template <typename LOCK>
+bool IDPool<LOCK>::reserve() {
+    uint32_t n = _free.load(std::memory_order_relaxed);
+    do {
+        Z_RET_IF(0 == n, false);
+    } while (!_free.compare_exchange_weak(n, n - 1, std::memory_order_acquire) );
+    return true;
+}
+
+/**
+ * One free bit is reserved for the caller. Walk down the summaries; a
+ * stale summary (set over an empty word) is cleared and the walk restarts.
+ */
+template <typename LOCK>
+uint32_t IDPool<LOCK>::take() {
+    for (;;) {
+        uint32_t idx = 0;
+        uint32_t l = _levels - 1;
+        for (; l > 0; --l) {
+            uint64_t w = word(l, idx)->load(std::memory_order_acquire);
+            if (0 == w) {
+                break;
+            }
+            idx = idx * 64 + __builtin_ctzll(w);
+        }
+        if (l > 0) {
+            _mm_pause();
+            continue;
+        }
+
+        word_t *leaf = word(0, idx);
+        uint64_t w = leaf->load(std::memory_order_acquire);
+        while (w) {
+            uint64_t bit = w & (~w + 1);
+            uint64_t old = fetch_and(leaf, ~bit);
+            if (old & bit) {
+                if (old == bit) {
+                    mark_empty(0, idx);
+                }
+                return idx * 64 + __builtin_ctzll(bit);
+            }
+            w = old & ~bit;
+        }
+        if (_levels > 1) {
+            mark_empty(0, idx);
+        }
+    }
+}
+
+/**
+ * Word idx of the level went empty: clear its summary bit. A release may
+ * have refilled it meanwhile, so look again after clearing.
+ */
+template <typename LOCK>
+void IDPool<LOCK>::mark_empty(uint32_t level, uint32_t idx) {
+    Z_RET_IF(level + 1 >= _levels, );
+    uint64_t bit = uint64_t(1) << (idx % 64);
+    uint64_t old = fetch_and(word(level + 1, idx / 64), ~bit);
+    if (word(level, idx)->load(std::memory_order_seq_cst) ) {
+        mark_free(level, idx);
+    } else if (old == bit) {
+        mark_empty(level + 1, idx / 64);
+    }
+}
+
+/// word idx of the level was empty and has a free bit now
+template <typename LOCK>
+void IDPool<LOCK>::mark_free(uint32_t level, uint32_t idx) {
+    for (; level + 1 < _levels; ++level, idx /= 64) {
+        if (fetch_or(word(level + 1, idx / 64), uint64_t(1) << (idx % 64) ) ) {
+            break;
+        }
+    }
+}
+
+template <typename T, typename LOCK, int L>
+    FixedLengthQueue<T, LOCK, L>::FixedLengthQueue(uint32_t max_length)
+    : _head(nullptr), _tail(nullptr), _count(0), _free_list(max_length + 1) {
+        _head = _tail = _free_list.allocate();
+        _tail->next = nullptr;
+    }
+
+template <typename T, typename LOCK, int L>
+    FixedLengthQueue<T, LOCK, L>::~FixedLengthQueue() {}
+
+template <typename T, typename LOCK, int L>
+    bool FixedLengthQueue<T, LOCK, L>::enqueue(const T &t) {
+        _lock.lock();
+        ItemWrapper * new_item = _free_list.allocate();
+        if (new_item) {
+            new_item->item = t;
+            new_item->next = nullptr;
+            _tail->next = new_item;
+            _tail = new_item;
+            ++_count;
+            _lock.unlock();
+            return true;
+        } else {
+            _lock.unlock();
+            ZLOG(LOG_DEBUG, "call enqueue on a full queue. count: %u",
+                count() );
+            return false;
         }
     }
 
@@ -274,6 +1473,45 @@ template <typename T, typename LOCK, int L>
         }
     }
 
+template <typename T, typename LOCK, int L>
+    uint32_t FixedLengthQueue<T, LOCK, L>::enqueue_bulk(const T *t, uint32_t n) {
+        Z_RET_IF_ANY_ZERO_1(t, 0);
+        uint32_t i = 0;
+        _lock.lock();
+        for (; i < n; ++i) {
+            ItemWrapper *new_item = _free_list.allocate();
+            if (!new_item) {
+                break;
+            }
+            new_item->item = t[i];
+            new_item->next = nullptr;
+            _tail->next = new_item;
+            _tail = new_item;
+        }
+        _count += i;
+        _lock.unlock();
+        return i;
+    }
+
+template <typename T, typename LOCK, int L>
+    uint32_t FixedLengthQueue<T, LOCK, L>::dequeue_bulk(T *t, uint32_t max) {
+        Z_RET_IF_ANY_ZERO_1(t, 0);
+        uint32_t i = 0;
+        _lock.lock();
+        for (; i < max && _head->next; ++i) {
+            ItemWrapper *to_del = _head->next;
+            t[i] = to_del->item;
+            _head->next = to_del->next;
+            if (to_del == _tail) {
+                _tail = _head;
+            }
+            _free_list.release(to_del);
+        }
+        _count -= i;
+        _lock.unlock();
+        return i;
+    }
+
 template <typename T, typename LOCK, int L>
     uint32_t FixedLengthQueue<T, LOCK, L>::count() const {
         return _count;
@@ -289,68 +1527,1567 @@ template <typename T, typename LOCK, int L>
         return (count() == 0);
     }
 
-template <typename T, typename LOCK, int L>
-    FixedLengthQueueWithFd<T, LOCK, L>::FixedLengthQueueWithFd(uint32_t max_length)
-    : _queue(max_length) {
-        int ret = ::pipe2(_fds, O_CLOEXEC | O_NONBLOCK);
-        ZASSERT(0 == ret);
+template <typename T, typename LOCK, int L, typename Q>
+    FixedLengthQueueWithFd<T, LOCK, L, Q>::FixedLengthQueueWithFd(uint32_t max_length, int efd_flags)
+    : _semaphore(efd_flags & EFD_SEMAPHORE), _queue(max_length) {
+        _efd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK | (efd_flags & EFD_SEMAPHORE) );
+        ZASSERT(-1 != _efd);
+        _signaled.store(false, std::memory_order_relaxed);
     }
 
-template <typename T, typename LOCK, int L>
-    FixedLengthQueueWithFd<T, LOCK, L>::~FixedLengthQueueWithFd() {
-        ::close(_fds[0]);
-        ::close(_fds[1]);
+template <typename T, typename LOCK, int L, typename Q>
+    FixedLengthQueueWithFd<T, LOCK, L, Q>::~FixedLengthQueueWithFd() {
+        ::close(_efd);
     }
 
-template <typename T, typename LOCK, int L>
-    bool FixedLengthQueueWithFd<T, LOCK, L>::enqueue(const T &t) {
-        if (_queue.enqueue(t) ) {
-            for (;;) {
-                int ret = ::write(enqueue_fd(), "\1", 1);
-                if (ret > 0) {
-                    break;
-                } else if (ret == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
-                    ZASSERT(0);
-                }
-                ZLOG(LOG_WARN, "blocking enqueue(). sleep 1ms, ret = %d, errno = %d (%s)",
-                    ret, errno, ZSTRERR(errno).c_str());
-                ZLOG(LOG_WARN, "AG=%d, WB=%d, INT=%d", EAGAIN, EWOULDBLOCK, EINTR);
-                usleep(1000);
+template <typename T, typename LOCK, int L, typename Q>
+    bool FixedLengthQueueWithFd<T, LOCK, L, Q>::enqueue(const T &t) {
+        Z_RET_IF(!_queue.enqueue(t), false);
+
+        if (_semaphore) {
+            signal();
+        } else {
+            signal_added();
+        }
+        return true;
+    }
+
+template <typename T, typename LOCK, int L, typename Q>
+    uint32_t FixedLengthQueueWithFd<T, LOCK, L, Q>::enqueue_bulk(const T *t, uint32_t n) {
+        uint32_t added = _queue.enqueue_bulk(t, n);
+        Z_RET_IF(0 == added, 0);
+
+        if (_semaphore) {
+            signal(added);
+        } else {
+            signal_added();
+        }
+        return added;
+    }
+
+template <typename T, typename LOCK, int L, typename Q>
+    bool FixedLengthQueueWithFd<T, LOCK, L, Q>::dequeue(T *t) {
+        if (_semaphore) {
+            Z_RET_IF(!wait_one(), false);
+            // the count is written after the item, but a lock-free queue may
+            // still have an earlier cell being filled by a preempted producer.
+            // The count taken stands for an item that is bound to show up:
+            // giving up would leave it in the queue with no count behind it
+            while (!_queue.dequeue(t) ) {
+                ::sched_yield();
             }
             return true;
         }
 
-        return false;
+        Z_RET_IF(_queue.dequeue(t), true);
+        reset();
+        _signaled.store(false, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return _queue.dequeue(t);
     }
 
-template <typename T, typename LOCK, int L>
-    bool FixedLengthQueueWithFd<T, LOCK, L>::dequeue(T *t) {
-        char buf = 0;
-        for (;;) {
-            int ret = ::read(dequeue_fd(), &buf, 1);
-            if (    (ret == 0)
-                ||  (ret == -1 && errno != EINTR) )
-            {
-                /*
-                ZLOG(LOG_DEBUG, "pipe not ready now, maybe too busy, ret = %d, error = %d (%s)",
-                    ret, errno, ZSTRERR(errno).c_str() );
-                */
-                return false;
-            } else if (ret > 0) {
-                break;
+template <typename T, typename LOCK, int L, typename Q>
+    uint32_t FixedLengthQueueWithFd<T, LOCK, L, Q>::dequeue_bulk(T *t, uint32_t max) {
+        Z_RET_IF_ANY_ZERO_2(t, max, 0);
+        if (_semaphore) {
+            uint32_t n = 0;
+            while (n < max && dequeue(&t[n]) ) {
+                ++n;
             }
-            ZLOG(LOG_DEBUG, "blocking dequeue(). ret = %d, errno = %d (%s)",
-                ret, errno, ZSTRERR(errno).c_str());
+            return n;
         }
 
-        if (_queue.dequeue(t) ) {
-            return true;
+        uint32_t n = _queue.dequeue_bulk(t, max);
+        Z_RET_IF(n > 0, n);
+        reset();
+        _signaled.store(false, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return _queue.dequeue_bulk(t, max);
+    }
+
+template <typename T, typename LOCK, int L, typename Q>
+    void FixedLengthQueueWithFd<T, LOCK, L, Q>::signal(uint64_t n) {
+        while (-1 == ::write(_efd, &n, sizeof(n) ) && errno == EINTR) {
         }
+    }
 
-        ZLOG(LOG_WARN, "Logic error. some data lost...");
-        return false;
+/**
+ * After adding items in the default mode. Pairs with the fence in
+ * dequeue(): either the consumer sees the items after its reset, or this
+ * sees the flag cleared and signals again.
+ */
+template <typename T, typename LOCK, int L, typename Q>
+    void FixedLengthQueueWithFd<T, LOCK, L, Q>::signal_added() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!_signaled.exchange(true) ) {
+            signal();
+        }
+    }
+
+/// take one count in EFD_SEMAPHORE mode
+template <typename T, typename LOCK, int L, typename Q>
+    bool FixedLengthQueueWithFd<T, LOCK, L, Q>::wait_one() {
+        uint64_t n = 0;
+        for (;;) {
+            ssize_t ret = ::read(_efd, &n, sizeof(n) );
+            if (ret == sizeof(n) ) {
+                return true;
+            } else if (ret == -1 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+    }
+
+template <typename T, typename LOCK, int L, typename Q>
+    void FixedLengthQueueWithFd<T, LOCK, L, Q>::reset() {
+        uint64_t n = 0;
+        while (-1 == ::read(_efd, &n, sizeof(n) ) && errno == EINTR) {
+        }
     }
 
+template <typename T, int L>
+    MPMCQueue<T, L>::MPMCQueue(uint32_t max_length) {
+        uint64_t cap = 2;
+        while (cap < max_length) {
+            cap <<= 1;
+        }
+        _mask = cap - 1;
+        _cells = new Cell[cap];
+        for (uint64_t i = 0; i < cap; ++i) {
+            _cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+        _tail.store(0, std::memory_order_relaxed);
+        _head.store(0, std::memory_order_relaxed);
+    }
+
+template <typename T, int L>
+    MPMCQueue<T, L>::~MPMCQueue() {
+        delete [] _cells;
+    }
+
+/**
+ * A cell is free for position pos when its seq == pos, and holds the item
+ * of pos when seq == pos + 1; the consumer hands it to the next lap by
+ * setting seq = pos + capacity.
+ */
+template <typename T, int L>
+    bool MPMCQueue<T, L>::enqueue(const T &t) {
+        uint64_t pos = _tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell *cell = &_cells[pos & _mask];
+            int64_t diff = int64_t(cell->seq.load(std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed) ) {
+                    cell->item = t;
+                    cell->seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+template <typename T, int L>
+    bool MPMCQueue<T, L>::dequeue(T *t) {
+        Z_RET_IF_ANY_ZERO_1(t, false);
+        uint64_t pos = _head.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell *cell = &_cells[pos & _mask];
+            int64_t diff = int64_t(cell->seq.load(std::memory_order_acquire) - (pos + 1) );
+            if (diff == 0) {
+                if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed) ) {
+                    *t = cell->item;
+                    cell->seq.store(pos + _mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+template <typename T, int L>
+    uint32_t MPMCQueue<T, L>::enqueue_bulk(const T *t, uint32_t n) {
+        Z_RET_IF_ANY_ZERO_2(t, n, 0);
+        uint64_t pos = _tail.load(std::memory_order_relaxed);
+        uint64_t k = 0;
+        do {
+            uint64_t used = pos - _head.load(std::memory_order_acquire);
+            Z_RET_IF(int64_t(used) > int64_t(_mask), 0);
+            k = std::min(uint64_t(n), _mask + 1 - (int64_t(used) < 0 ? 0 : used) );
+        } while (!_tail.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed) );
+
+        for (uint64_t i = 0; i < k; ++i) {
+            Cell *cell = &_cells[(pos + i) & _mask];
+            wait_seq(cell, pos + i);
+            cell->item = t[i];
+            cell->seq.store(pos + i + 1, std::memory_order_release);
+        }
+        return uint32_t(k);
+    }
+
+template <typename T, int L>
+    uint32_t MPMCQueue<T, L>::dequeue_bulk(T *t, uint32_t max) {
+        Z_RET_IF_ANY_ZERO_2(t, max, 0);
+        uint64_t pos = _head.load(std::memory_order_relaxed);
+        uint64_t k = 0;
+        do {
+            int64_t avail = int64_t(_tail.load(std::memory_order_acquire) - pos);
+            Z_RET_IF(avail <= 0, 0);
+            k = std::min(uint64_t(max), uint64_t(avail) );
+        } while (!_head.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed) );
+
+        for (uint64_t i = 0; i < k; ++i) {
+            Cell *cell = &_cells[(pos + i) & _mask];
+            wait_seq(cell, pos + i + 1);
+            t[i] = cell->item;
+            cell->seq.store(pos + i + _mask + 1, std::memory_order_release);
+        }
+        return uint32_t(k);
+    }
+
+template <typename T, int L>
+    void MPMCQueue<T, L>::wait_seq(const Cell *cell, uint64_t seq) {
+        for (uint32_t spin = 0; cell->seq.load(std::memory_order_acquire) != seq; ++spin) {
+            if (spin < SPIN_BEFORE_YIELD) {
+                _mm_pause();
+            } else {
+                ::sched_yield();
+            }
+        }
+    }
+
+template <typename T, int L>
+    uint32_t MPMCQueue<T, L>::count() const {
+        uint64_t head = _head.load(std::memory_order_acquire);
+        uint64_t tail = _tail.load(std::memory_order_acquire);
+        return (tail > head) ? uint32_t(tail - head) : 0;
+    }
+
+template <typename T, int L>
+    SPSCQueue<T, L>::SPSCQueue(uint32_t max_length)
+    : _tail_staged(0), _head_cache(0), _tail_cache(0) {
+        uint32_t cap = 2;
+        while (cap < max_length && cap < (1u << 31) ) {
+            cap <<= 1;
+        }
+        _mask = cap - 1;
+        _items = new T[cap];
+        _tail.store(0, std::memory_order_relaxed);
+        _head.store(0, std::memory_order_relaxed);
+    }
+
+template <typename T, int L>
+    SPSCQueue<T, L>::~SPSCQueue() {
+        delete [] _items;
+    }
+
+template <typename T, int L>
+    bool SPSCQueue<T, L>::enqueue(const T &t) {
+        Z_RET_IF(!enqueue_deferred(t), false);
+        _tail.store(_tail_staged, std::memory_order_release);
+        return true;
+    }
+
+template <typename T, int L>
+    bool SPSCQueue<T, L>::enqueue_deferred(const T &t) {
+        if (_tail_staged - _head_cache > _mask) {
+            _head_cache = _head.load(std::memory_order_acquire);
+            Z_RET_IF(_tail_staged - _head_cache > _mask, false);
+        }
+        _items[_tail_staged & _mask] = t;
+        ++_tail_staged;
+        return true;
+    }
+
+template <typename T, int L>
+    void SPSCQueue<T, L>::publish() {
+        _tail.store(_tail_staged, std::memory_order_release);
+    }
+
+template <typename T, int L>
+    bool SPSCQueue<T, L>::dequeue(T *t) {
+        Z_RET_IF_ANY_ZERO_1(t, false);
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail_cache) {
+            _tail_cache = _tail.load(std::memory_order_acquire);
+            Z_RET_IF(head == _tail_cache, false);
+        }
+        *t = _items[head & _mask];
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+template <typename T, int L>
+    uint32_t SPSCQueue<T, L>::enqueue_bulk(const T *t, uint32_t n) {
+        Z_RET_IF_ANY_ZERO_1(t, 0);
+        if (_tail_staged - _head_cache + n > _mask + 1) {
+            _head_cache = _head.load(std::memory_order_acquire);
+        }
+        uint32_t k = std::min(n, _mask + 1 - (_tail_staged - _head_cache) );
+        for (uint32_t i = 0; i < k; ++i) {
+            _items[(_tail_staged + i) & _mask] = t[i];
+        }
+        _tail_staged += k;
+        _tail.store(_tail_staged, std::memory_order_release);
+        return k;
+    }
+
+template <typename T, int L>
+    uint32_t SPSCQueue<T, L>::dequeue_bulk(T *t, uint32_t max) {
+        Z_RET_IF_ANY_ZERO_1(t, 0);
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (_tail_cache - head < max) {
+            _tail_cache = _tail.load(std::memory_order_acquire);
+        }
+        uint32_t k = std::min(max, _tail_cache - head);
+        for (uint32_t i = 0; i < k; ++i) {
+            t[i] = _items[(head + i) & _mask];
+        }
+        _head.store(head + k, std::memory_order_release);
+        return k;
+    }
+
+template <typename T, int L>
+    uint32_t SPSCQueue<T, L>::count() const {
+        uint32_t head = _head.load(std::memory_order_acquire);
+        return _tail.load(std::memory_order_acquire) - head;
+    }
+
+template <typename T, int L>
+    WorkStealingDeque<T, L>::WorkStealingDeque(uint32_t max_length) {
+        int64_t cap = 2;
+        while (cap < max_length) {
+            cap <<= 1;
+        }
+        _mask = cap - 1;
+        _items = new T[cap];
+        _top.store(0, std::memory_order_relaxed);
+        _bottom.store(0, std::memory_order_relaxed);
+    }
+
+template <typename T, int L>
+    WorkStealingDeque<T, L>::~WorkStealingDeque() {
+        delete [] _items;
+    }
+
+template <typename T, int L>
+    bool WorkStealingDeque<T, L>::push(const T &t) {
+        int64_t b = _bottom.load(std::memory_order_relaxed);
+        int64_t top = _top.load(std::memory_order_acquire);
+        Z_RET_IF(b - top > _mask, false);
+        _items[b & _mask] = t;
+        std::atomic_thread_fence(std::memory_order_release);
+        _bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+/**
+ * Take the bottom cell first, then look at the top: a thief that read the
+ * old bottom can only race for the last item, which goes to whoever moves
+ * the top past it.
+ */
+template <typename T, int L>
+    bool WorkStealingDeque<T, L>::pop(T *t) {
+        Z_RET_IF_ANY_ZERO_1(t, false);
+        int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+        _bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = _top.load(std::memory_order_relaxed);
+        if (top > b) {
+            _bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        *t = _items[b & _mask];
+        if (top < b) {
+            return true;
+        }
+        bool won = _top.compare_exchange_strong(top, top + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed);
+        _bottom.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+
+template <typename T, int L>
+    bool WorkStealingDeque<T, L>::steal(T *t) {
+        Z_RET_IF_ANY_ZERO_1(t, false);
+        int64_t top = _top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = _bottom.load(std::memory_order_acquire);
+        Z_RET_IF(top >= b, false);
+
+        T item = _items[top & _mask];
+        Z_RET_IF(!_top.compare_exchange_strong(top, top + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed), false);
+        *t = item;
+        return true;
+    }
+
+template <typename T, int L>
+    uint32_t WorkStealingDeque<T, L>::count() const {
+        int64_t top = _top.load(std::memory_order_acquire);
+        int64_t b = _bottom.load(std::memory_order_acquire);
+        return (b > top) ? uint32_t(b - top) : 0;
+    }
+
+template <typename T, typename LOCK>
+    HashTable64<T, LOCK>::HashTable64(uint32_t capacity)
+    : _old_start(0), _old_scanned(0), _size(0) {
+        _old.ctrl = nullptr;
+        _old.slots = nullptr;
+        uint32_t cap = GROUP;
+        while (cap < capacity && cap < (1u << 31) ) {
+            cap <<= 1;
+        }
+        bool ok = alloc_table(&_table, cap);
+        ZASSERT(ok);
+        Z_USE_VAR(ok);
+    }
+
+template <typename T, typename LOCK>
+    HashTable64<T, LOCK>::~HashTable64() {
+        free_table(&_table);
+        free_table(&_old);
+    }
+
+template <typename T, typename LOCK>
+    bool HashTable64<T, LOCK>::insert(HashKey key, const T &value) {
+        uint64_t h = hash(key);
+        _lock.lock();
+        if (find_slot(key, h) || !reserve_one() ) {
+            _lock.unlock();
+            return false;
+        }
+        put(&_table, key, h, value);
+        ++_size;
+        _lock.unlock();
+        return true;
+    }
+
+template <typename T, typename LOCK>
+    void HashTable64<T, LOCK>::update(HashKey key, const T &value) {
+        uint64_t h = hash(key);
+        _lock.lock();
+        Slot *slot = find_slot(key, h);
+        if (slot) {
+            slot->value = value;
+        } else if (reserve_one() ) {
+            put(&_table, key, h, value);
+            ++_size;
+        } else {
+            ZLOG(LOG_WARN, "HashTable64 is full. size: %u", _size);
+        }
+        _lock.unlock();
+    }
+
+template <typename T, typename LOCK>
+    bool HashTable64<T, LOCK>::find(HashKey key, T *value) {
+        uint64_t h = hash(key);
+        ZSharedLock<LOCK>::lock(&_lock);
+        Slot *slot = find_slot(key, h);
+        if (slot && value) {
+            *value = slot->value;
+        }
+        ZSharedLock<LOCK>::unlock(&_lock);
+        return slot != nullptr;
+    }
+
+template <typename T, typename LOCK>
+    bool HashTable64<T, LOCK>::erase(HashKey key, T *value) {
+        uint64_t h = hash(key);
+        _lock.lock();
+        Table *t = &_table;
+        Slot *slot = lookup(t, key, h);
+        if (!slot && _old.ctrl) {
+            t = &_old;
+            slot = lookup(t, key, h);
+        }
+        if (!slot) {
+            _lock.unlock();
+            return false;
+        }
+
+        if (value) {
+            *value = slot->value;
+        }
+        remove(t, slot - t->slots);
+        --_size;
+        if (_old.ctrl) {
+            migrate();
+        }
+        _lock.unlock();
+        return true;
+    }
+
+template <typename T, typename LOCK>
+    void HashTable64<T, LOCK>::clear() {
+        _lock.lock();
+        free_table(&_old);
+        for (uint32_t i = 0; i <= _table.mask; ++i) {
+            if (!(_table.ctrl[i] & CTRL_EMPTY) ) {
+                _table.slots[i].value = T();
+            }
+        }
+        ::memset(_table.ctrl, CTRL_EMPTY, _table.mask + 1 + GROUP);
+        _table.size = 0;
+        _size = 0;
+        _lock.unlock();
+    }
+
+template <typename T, typename LOCK>
+    uint32_t HashTable64<T, LOCK>::match(const uint8_t *ctrl, uint8_t tag) {
+        __m128i g = _mm_loadu_si128((const __m128i*)(ctrl) );
+        return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(char(tag) ) ) ) );
+    }
+
+/**
+ * Slots and control bytes share one block. Big tables are aligned to and
+ * advised for huge pages, a probe touches two random pages otherwise.
+ */
+template <typename T, typename LOCK>
+    bool HashTable64<T, LOCK>::alloc_table(Table *t, uint32_t capacity) {
+        size_t slot_bytes = sizeof(Slot) * size_t(capacity);
+        size_t bytes = slot_bytes + capacity + GROUP;
+        size_t align = (bytes >= HUGE_PAGE_SIZE) ? size_t(HUGE_PAGE_SIZE) : size_t(64);
+        void *mem = nullptr;
+        if (0 != ::posix_memalign(&mem, align, bytes) ) {
+            t->ctrl = nullptr;
+            t->slots = nullptr;
+            return false;
+        }
+        if (align == HUGE_PAGE_SIZE) {
+            ::madvise(mem, bytes & ~size_t(HUGE_PAGE_SIZE - 1), MADV_HUGEPAGE);
+        }
+
+        t->slots = (Slot*)(mem);
+        for (uint32_t i = 0; i < capacity; ++i) {
+            new (&t->slots[i]) Slot();
+        }
+        t->ctrl = (uint8_t*)(mem) + slot_bytes;
+        ::memset(t->ctrl, CTRL_EMPTY, capacity + GROUP);
+        t->mask = capacity - 1;
+        t->size = 0;
+        return true;
+    }
+
+template <typename T, typename LOCK>
+    void HashTable64<T, LOCK>::free_table(Table *t) {
+        Z_RET_IF(nullptr == t->slots, );
+        for (uint32_t i = 0; i <= t->mask; ++i) {
+            t->slots[i].~Slot();
+        }
+        ::free(t->slots);
+        t->ctrl = nullptr;
+        t->slots = nullptr;
+    }
+
+template <typename T, typename LOCK>
+    void HashTable64<T, LOCK>::set_ctrl(Table *t, uint32_t i, uint8_t c) {
+        t->ctrl[i] = c;
+        if (i < GROUP) {
+            t->ctrl[t->mask + 1 + i] = c;
+        }
+    }
+
+template <typename T, typename LOCK>
+    typename HashTable64<T, LOCK>::Slot *
+    HashTable64<T, LOCK>::lookup(Table *t, HashKey key, uint64_t h) {
+        uint32_t pos = uint32_t(h) & t->mask;
+        uint8_t  tg = tag(h);
+        for (;;) {
+            const uint8_t *ctrl = t->ctrl + pos;
+            for (uint32_t m = match(ctrl, tg); m; m &= m - 1) {
+                Slot *slot = &t->slots[(pos + __builtin_ctz(m) ) & t->mask];
+                if (slot->key == key) {
+                    return slot;
+                }
+            }
+            if (match(ctrl, CTRL_EMPTY) ) {
+                return nullptr;
+            }
+            pos = (pos + GROUP) & t->mask;
+        }
+    }
+
+template <typename T, typename LOCK>
+    void HashTable64<T, LOCK>::put(Table *t, HashKey key, uint64_t h, const T &value) {
+        uint32_t pos = uint32_t(h) & t->mask;
+        uint32_t m = 0;
+        while (0 == (m = match(t->ctrl + pos, CTRL_EMPTY) ) ) {
+            pos = (pos + GROUP) & t->mask;
+        }
+
+        uint32_t i = (pos + __builtin_ctz(m) ) & t->mask;
+        set_ctrl(t, i, tag(h) );
+        t->slots[i].key = key;
+        t->slots[i].value = value;
+        ++t->size;
+    }
+
+/**
+ * Backward shift: walk the cluster after slot i and move back every entry
+ * whose home is not in (i, j], so no probe sequence crosses a hole.
+ */
+template <typename T, typename LOCK>
+    void HashTable64<T, LOCK>::remove(Table *t, uint32_t i) {
+        uint32_t j = i;
+        for (;;) {
+            j = (j + 1) & t->mask;
+            if (t->ctrl[j] & CTRL_EMPTY) {
+                break;
+            }
+
+            uint32_t home = uint32_t(hash(t->slots[j].key) ) & t->mask;
+            bool stay = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+            if (!stay) {
+                t->slots[i] = t->slots[j];
+                set_ctrl(t, i, t->ctrl[j]);
+                i = j;
+            }
+        }
+
+        t->slots[i].value = T();
+        set_ctrl(t, i, CTRL_EMPTY);
+        --t->size;
+    }
+
+template <typename T, typename LOCK>
+    typename HashTable64<T, LOCK>::Slot *
+    HashTable64<T, LOCK>::find_slot(HashKey key, uint64_t h) {
+        Slot *slot = lookup(&_table, key, h);
+        if (!slot && _old.ctrl) {
+            slot = lookup(&_old, key, h);
+        }
+        return slot;
+    }
+
+/// make room for one more entry in _table, starting a resize if needed
+template <typename T, typename LOCK>
+    bool HashTable64<T, LOCK>::reserve_one() {
+        if (_old.ctrl) {
+            migrate();
+        }
+
+        uint64_t cap = uint64_t(_table.mask) + 1;
+        if ( (uint64_t(_table.size) + 1) * 8 <= cap * 7) {
+            return true;
+        }
+
+        while (_old.ctrl) {
+            migrate();
+        }
+        Table bigger;
+        if (cap >= (1u << 31) || !alloc_table(&bigger, cap * 2) ) {
+            return false;
+        }
+        _old = _table;
+        _table = bigger;
+        _old_scanned = 0;
+        for (_old_start = 0; !(_old.ctrl[_old_start] & CTRL_EMPTY); ++_old_start) {
+        }
+        migrate();
+        return true;
+    }
+
+/**
+ * Move at least MIGRATE_SLOTS slots of _old, whole clusters at a time: a
+ * cluster is either untouched or empty, so probing the rest of _old still
+ * works and erase() in _old never shifts entries across the cursor.
+ */
+template <typename T, typename LOCK>
+    void HashTable64<T, LOCK>::migrate() {
+        int32_t budget = MIGRATE_SLOTS;
+        uint32_t old_cap = _old.mask + 1;
+        while (budget > 0 && _old_scanned < old_cap) {
+            uint32_t i = (_old_start + _old_scanned) & _old.mask;
+            while (!(_old.ctrl[i] & CTRL_EMPTY) ) {
+                Slot &slot = _old.slots[i];
+                put(&_table, slot.key, hash(slot.key), slot.value);
+                slot.value = T();
+                set_ctrl(&_old, i, CTRL_EMPTY);
+                --_old.size;
+                ++_old_scanned;
+                --budget;
+                i = (i + 1) & _old.mask;
+            }
+            ++_old_scanned;
+            --budget;
+        }
+
+        if (_old_scanned >= old_cap) {
+            ZASSERT(_old.size == 0);
+            free_table(&_old);
+        }
+    }
+
+
+template <typename T, typename LOCK>
+    ConcurrentHashTable64<T, LOCK>::ConcurrentHashTable64(uint32_t capacity, uint32_t shard_num) {
+        uint32_t n = 1;
+        while (n < shard_num && n < (1u << 16) ) {
+            n <<= 1;
+        }
+        _shard_mask = n - 1;
+
+        uint32_t cap = Base::GROUP;
+        while (uint64_t(cap) * n < capacity && cap < (1u << 31) ) {
+            cap <<= 1;
+        }
+
+        void *mem = nullptr;
+        int ret = ::posix_memalign(&mem, 64, sizeof(Shard) * n);
+        ZASSERT(0 == ret);
+        Z_USE_VAR(ret);
+        _shards = (Shard*)(mem);
+        for (uint32_t i = 0; i < n; ++i) {
+            Shard *s = new (&_shards[i]) Shard();
+            Table *t = new Table;
+            bool ok = Base::alloc_table(t, cap);
+            ZASSERT(ok);
+            Z_USE_VAR(ok);
+            s->seq.store(0, std::memory_order_relaxed);
+            s->table.store(t, std::memory_order_relaxed);
+            s->size.store(0, std::memory_order_relaxed);
+        }
+    }
+
+template <typename T, typename LOCK>
+    ConcurrentHashTable64<T, LOCK>::~ConcurrentHashTable64() {
+        for (uint32_t i = 0; i <= _shard_mask; ++i) {
+            Shard *s = &_shards[i];
+            s->retired.push_back(s->table.load(std::memory_order_relaxed) );
+            for (size_t k = 0; k < s->retired.size(); ++k) {
+                Base::free_table(s->retired[k]);
+                delete s->retired[k];
+            }
+            s->~Shard();
+        }
+        ::free(_shards);
+    }
+
+template <typename T, typename LOCK>
+    bool ConcurrentHashTable64<T, LOCK>::insert(HashKey key, const T &value) {
+        uint64_t h = Base::hash(key);
+        Shard *s = &shard(h);
+        s->lock.lock();
+        Table *t = s->table.load(std::memory_order_relaxed);
+        if (Base::lookup(t, key, h) || !grow(s) ) {
+            s->lock.unlock();
+            return false;
+        }
+        t = s->table.load(std::memory_order_relaxed);
+        write_begin(s);
+        Base::put(t, key, h, value);
+        write_end(s);
+        s->size.store(t->size, std::memory_order_relaxed);
+        s->lock.unlock();
+        return true;
+    }
+
+template <typename T, typename LOCK>
+    void ConcurrentHashTable64<T, LOCK>::update(HashKey key, const T &value) {
+        uint64_t h = Base::hash(key);
+        Shard *s = &shard(h);
+        s->lock.lock();
+        Slot *slot = Base::lookup(s->table.load(std::memory_order_relaxed), key, h);
+        if (slot) {
+            write_begin(s);
+            slot->value = value;
+            write_end(s);
+        } else if (grow(s) ) {
+            Table *t = s->table.load(std::memory_order_relaxed);
+            write_begin(s);
+            Base::put(t, key, h, value);
+            write_end(s);
+            s->size.store(t->size, std::memory_order_relaxed);
+        } else {
+            ZLOG(LOG_WARN, "ConcurrentHashTable64 shard is full. size: %u",
+                s->size.load(std::memory_order_relaxed) );
+        }
+        s->lock.unlock();
+    }
+
+template <typename T, typename LOCK>
+    bool ConcurrentHashTable64<T, LOCK>::find(HashKey key, T *value) const {
+        uint64_t h = Base::hash(key);
+        const Shard &s = shard(h);
+        for (uint32_t spin = 0; ; ++spin) {
+            uint32_t seq = s.seq.load(std::memory_order_acquire);
+            if (seq & 1) {
+                // the writer may be preempted, do not burn its time slice
+                if (spin < SPIN_BEFORE_YIELD) {
+                    _mm_pause();
+                } else {
+                    ::sched_yield();
+                }
+                continue;
+            }
+
+            T v = T();
+            int found = probe(s.table.load(std::memory_order_acquire), key, h, &v);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (found != PROBE_RETRY && s.seq.load(std::memory_order_relaxed) == seq) {
+                if (found && value) {
+                    *value = v;
+                }
+                return found;
+            }
+        }
+    }
+
+template <typename T, typename LOCK>
+    bool ConcurrentHashTable64<T, LOCK>::erase(HashKey key, T *value) {
+        uint64_t h = Base::hash(key);
+        Shard *s = &shard(h);
+        s->lock.lock();
+        Table *t = s->table.load(std::memory_order_relaxed);
+        Slot *slot = Base::lookup(t, key, h);
+        if (!slot) {
+            s->lock.unlock();
+            return false;
+        }
+
+        if (value) {
+            *value = slot->value;
+        }
+        write_begin(s);
+        Base::remove(t, slot - t->slots);
+        write_end(s);
+        s->size.store(t->size, std::memory_order_relaxed);
+        s->lock.unlock();
+        return true;
+    }
+
+template <typename T, typename LOCK>
+    void ConcurrentHashTable64<T, LOCK>::clear() {
+        for (uint32_t i = 0; i <= _shard_mask; ++i) {
+            Shard *s = &_shards[i];
+            s->lock.lock();
+            Table *t = s->table.load(std::memory_order_relaxed);
+            write_begin(s);
+            ::memset(t->ctrl, Base::CTRL_EMPTY, t->mask + 1 + Base::GROUP);
+            t->size = 0;
+            write_end(s);
+            s->size.store(0, std::memory_order_relaxed);
+            s->lock.unlock();
+        }
+    }
+
+template <typename T, typename LOCK>
+    void ConcurrentHashTable64<T, LOCK>::for_each(visitor_t visitor, void *arg) {
+        Z_RET_IF(nullptr == visitor, );
+        for (uint32_t i = 0; i <= _shard_mask; ++i) {
+            Shard *s = &_shards[i];
+            s->lock.lock();
+            const Table *t = s->table.load(std::memory_order_relaxed);
+            for (uint32_t k = 0; k <= t->mask; ++k) {
+                if (!(t->ctrl[k] & Base::CTRL_EMPTY) ) {
+                    visitor(t->slots[k].key, t->slots[k].value, arg);
+                }
+            }
+            s->lock.unlock();
+        }
+    }
+
+template <typename T, typename LOCK>
+    uint32_t ConcurrentHashTable64<T, LOCK>::size() const {
+        uint32_t n = 0;
+        for (uint32_t i = 0; i <= _shard_mask; ++i) {
+            n += _shards[i].size.load(std::memory_order_relaxed);
+        }
+        return n;
+    }
+
+/**
+ * Base::lookup() without the assumptions a torn read may break: the walk is
+ * bounded and gives up with PROBE_RETRY, the caller then checks the seq.
+ */
+template <typename T, typename LOCK>
+    int ConcurrentHashTable64<T, LOCK>::probe(const Table *t, HashKey key, uint64_t h, T *value) {
+        uint32_t mask = t->mask;
+        uint32_t pos = uint32_t(h) & mask;
+        uint8_t  tg = Base::tag(h);
+        for (uint32_t n = 0; n <= mask; n += Base::GROUP) {
+            const uint8_t *ctrl = t->ctrl + pos;
+            for (uint32_t m = Base::match(ctrl, tg); m; m &= m - 1) {
+                const Slot *slot = &t->slots[(pos + __builtin_ctz(m) ) & mask];
+                if (slot->key == key) {
+                    *value = slot->value;
+                    return 1;
+                }
+            }
+            if (Base::match(ctrl, Base::CTRL_EMPTY) ) {
+                return 0;
+            }
+            pos = (pos + Base::GROUP) & mask;
+        }
+        return PROBE_RETRY;
+    }
+
+template <typename T, typename LOCK>
+    void ConcurrentHashTable64<T, LOCK>::write_begin(Shard *s) {
+        s->seq.store(s->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+template <typename T, typename LOCK>
+    void ConcurrentHashTable64<T, LOCK>::write_end(Shard *s) {
+        s->seq.store(s->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+/// make room for one more entry; readers keep probing the old table meanwhile
+template <typename T, typename LOCK>
+    bool ConcurrentHashTable64<T, LOCK>::grow(Shard *s) {
+        Table *t = s->table.load(std::memory_order_relaxed);
+        uint64_t cap = uint64_t(t->mask) + 1;
+        if ( (uint64_t(t->size) + 1) * 8 <= cap * 7) {
+            return true;
+        }
+
+        Table *bigger = new Table;
+        if (cap >= (1u << 31) || !Base::alloc_table(bigger, cap * 2) ) {
+            delete bigger;
+            return false;
+        }
+        for (uint32_t i = 0; i <= t->mask; ++i) {
+            if (!(t->ctrl[i] & Base::CTRL_EMPTY) ) {
+                const Slot &slot = t->slots[i];
+                Base::put(bigger, slot.key, Base::hash(slot.key), slot.value);
+            }
+        }
+        s->table.store(bigger, std::memory_order_release);
+        s->retired.push_back(t);
+        return true;
+    }
+
+template <uint32_t B, uint32_t L>
+    TimingWheel<B, L>::TimingWheel(uint32_t tick_ms, uint64_t now_ms)
+    : _origin_ms(now_ms), _tick_ms(tick_ms ? tick_ms : 1), _size(0), _now(0) {
+        _heads = new TimerNode[L * SLOTS];
+        for (uint32_t i = 0; i < L * SLOTS; ++i) {
+            _heads[i].prev = _heads[i].next = &_heads[i];
+        }
+        ::memset(_bits, 0, sizeof(_bits) );
+    }
+
+template <uint32_t B, uint32_t L>
+    TimingWheel<B, L>::~TimingWheel() {
+        delete [] _heads;
+        _heads = nullptr;
+    }
+
+template <uint32_t B, uint32_t L>
+    void TimingWheel<B, L>::add(TimerNode *node, uint64_t expire_ms) {
+        Z_RET_IF_ANY_ZERO_1(node, );
+        if (node->pending() ) {
+            unlink(node);
+        }
+        uint64_t ms = (expire_ms > _origin_ms) ? expire_ms - _origin_ms : 0;
+        node->expire = std::max(_now, (ms + _tick_ms - 1) / _tick_ms);
+        link(node);
+    }
+
+template <uint32_t B, uint32_t L>
+    bool TimingWheel<B, L>::cancel(TimerNode *node) {
+        Z_RET_IF(!node || !node->pending(), false);
+        unlink(node);
+        return true;
+    }
+
+template <uint32_t B, uint32_t L>
+    uint32_t TimingWheel<B, L>::advance(uint64_t now_ms, timer_func_t func, void *arg) {
+        Z_RET_IF(now_ms < _origin_ms, 0);
+        uint64_t target = (now_ms - _origin_ms) / _tick_ms;
+        uint32_t expired = 0;
+        while (_now <= target) {
+            uint64_t t = next_tick();
+            if (t > target) {
+                _now = target + 1;
+                break;
+            }
+
+            // move the higher slots starting at tick t down, top first
+            _now = t;
+            for (uint32_t k = L - 1; k > 0; --k) {
+                if (t & ((uint64_t(1) << (B * k) ) - 1) ) {
+                    continue;
+                }
+                uint32_t slot = k * SLOTS + ((t >> (B * k) ) & MASK);
+                TimerNode *h = head(slot);
+                while (h->next != h) {
+                    TimerNode *n = h->next;
+                    unlink(n);
+                    link(n);
+                }
+            }
+
+            // detach the due list first, the callbacks may add or cancel
+            TimerNode due;
+            TimerNode *h = head(t & MASK);
+            _now = t + 1;
+            if (h->next == h) {
+                continue;
+            }
+            due.next = h->next;
+            due.prev = h->prev;
+            due.next->prev = &due;
+            due.prev->next = &due;
+            h->next = h->prev = h;
+            _bits[0][(t & MASK) / 64] &= ~(uint64_t(1) << (t & 63) );
+            while (due.next != &due) {
+                TimerNode *n = due.next;
+                due.next = n->next;
+                n->next->prev = &due;
+                n->prev = n->next = nullptr;
+                --_size;
+                ++expired;
+                func(n, arg);
+            }
+        }
+        return expired;
+    }
+
+template <uint32_t B, uint32_t L>
+    uint64_t TimingWheel<B, L>::next_expiry_ms() const {
+        uint64_t t = next_tick();
+        return (NONE == t) ? NONE : _origin_ms + t * _tick_ms;
+    }
+
+template <uint32_t B, uint32_t L>
+    int TimingWheel<B, L>::epoll_timeout(uint64_t now_ms, int max_ms) const {
+        uint64_t e = next_expiry_ms();
+        Z_RET_IF(NONE == e, max_ms);
+        Z_RET_IF(e <= now_ms, 0);
+        uint64_t wait = e - now_ms;
+        if (max_ms >= 0 && wait > uint64_t(max_ms) ) {
+            return max_ms;
+        }
+        return (wait > uint64_t(INT32_MAX) ) ? INT32_MAX : int(wait);
+    }
+
+/// the lowest level whose window [_now, +2^B slots) holds the expiry
+template <uint32_t B, uint32_t L>
+    void TimingWheel<B, L>::link(TimerNode *node) {
+        uint32_t k = 0;
+        while (k < L && (node->expire >> (B * k) ) - (_now >> (B * k) ) >= SLOTS) {
+            ++k;
+        }
+        uint64_t idx = (k < L) ? (node->expire >> (B * k) ) : (_now >> (B * (L - 1) ) ) + MASK;
+        k = (k < L) ? k : L - 1;
+
+        node->slot = uint32_t(k * SLOTS + (idx & MASK) );
+        TimerNode *h = head(node->slot);
+        node->next = h;
+        node->prev = h->prev;
+        h->prev->next = node;
+        h->prev = node;
+        _bits[k][(idx & MASK) / 64] |= uint64_t(1) << (idx & 63);
+        ++_size;
+    }
+
+template <uint32_t B, uint32_t L>
+    void TimingWheel<B, L>::unlink(TimerNode *node) {
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        TimerNode *h = head(node->slot);
+        if (h->next == h) {
+            uint32_t idx = node->slot & MASK;
+            _bits[node->slot / SLOTS][idx / 64] &= ~(uint64_t(1) << (idx & 63) );
+        }
+        node->prev = node->next = nullptr;
+        --_size;
+    }
+
+/**
+ * The first tick with work: a level 0 slot to expire, or a higher slot to
+ * move down. Slot j of level k is due at tick j << (B * k); the current
+ * slot is still due when _now is exactly its start.
+ */
+template <uint32_t B, uint32_t L>
+    uint64_t TimingWheel<B, L>::next_tick() const {
+        Z_RET_IF(0 == _size, NONE);
+        uint64_t best = NONE;
+        for (uint32_t k = 0; k < L; ++k) {
+            uint64_t low = (uint64_t(1) << (B * k) ) - 1;
+            uint64_t c = (_now >> (B * k) ) + ((_now & low) ? 1 : 0);
+            int32_t s = find_from(_bits[k], uint32_t(c & MASK) );
+            if (s >= 0) {
+                uint64_t j = c + ((uint64_t(s) - c) & MASK);
+                best = std::min(best, j << (B * k) );
+            }
+        }
+        return best;
+    }
+
+/// the first set bit at or after start, wrapping around
+template <uint32_t B, uint32_t L>
+    int32_t TimingWheel<B, L>::find_from(const uint64_t *bits, uint32_t start) {
+        uint32_t w = start / 64;
+        uint64_t first = bits[w] & (~uint64_t(0) << (start & 63) );
+        if (first) {
+            return int32_t(w * 64 + __builtin_ctzll(first) );
+        }
+        for (uint32_t i = 1; i <= WORDS; ++i) {
+            uint32_t j = (w + i) % WORDS;
+            if (bits[j]) {
+                return int32_t(j * 64 + __builtin_ctzll(bits[j]) );
+            }
+        }
+        return -1;
+    }
+
+template <typename K>
+    uint32_t BPlusTreeSearch<K, true>::prefix(const K *keys, uint32_t n, const K &k, bool or_equal) {
+        typedef typename std::make_signed<K>::type S;
+        // unsigned keys compare as signed after flipping the top bit
+        const S bias = std::is_signed<K>::value ? S(0) : std::numeric_limits<S>::min();
+        const S key = S(S(k) ^ bias);
+        uint32_t c = 0;
+#ifdef __AVX2__
+        const uint32_t LANES = 32 / sizeof(K);
+        const uint32_t FULL = (1u << LANES) - 1;
+        const __m256i kv = (sizeof(K) == 8) ? _mm256_set1_epi64x(int64_t(key) ) : _mm256_set1_epi32(int32_t(key) );
+        const __m256i bv = (sizeof(K) == 8) ? _mm256_set1_epi64x(int64_t(bias) ) : _mm256_set1_epi32(int32_t(bias) );
+        for (uint32_t i = 0; i < n; i += LANES) {
+            __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(keys + i) ), bv);
+            // less: k > x; or equal: !(x > k)
+            __m256i gt = (sizeof(K) == 8)
+                ? (or_equal ? _mm256_cmpgt_epi64(x, kv) : _mm256_cmpgt_epi64(kv, x) )
+                : (or_equal ? _mm256_cmpgt_epi32(x, kv) : _mm256_cmpgt_epi32(kv, x) );
+            uint32_t bits = (sizeof(K) == 8)
+                ? uint32_t(_mm256_movemask_pd(_mm256_castsi256_pd(gt) ) )
+                : uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(gt) ) );
+            uint32_t valid = (n - i < LANES) ? (1u << (n - i) ) - 1 : FULL;
+            bits = (or_equal ? ~bits : bits) & valid;
+            c += __builtin_popcount(bits);
+            if (bits != FULL) {
+                break;
+            }
+        }
+#else
+        if (sizeof(K) == 4) {
+            const __m128i kv = _mm_set1_epi32(int32_t(key) );
+            const __m128i bv = _mm_set1_epi32(int32_t(bias) );
+            for (uint32_t i = 0; i < n; i += 4) {
+                __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(keys + i) ), bv);
+                __m128i gt = or_equal ? _mm_cmpgt_epi32(x, kv) : _mm_cmpgt_epi32(kv, x);
+                uint32_t bits = uint32_t(_mm_movemask_ps(_mm_castsi128_ps(gt) ) );
+                uint32_t valid = (n - i < 4) ? (1u << (n - i) ) - 1 : 0xF;
+                bits = (or_equal ? ~bits : bits) & valid;
+                c += __builtin_popcount(bits);
+                if (bits != 0xF) {
+                    break;
+                }
+            }
+        } else {
+            // no 64 bit compare before SSE4.2: a branch-free count
+            for (uint32_t i = 0; i < n; ++i) {
+                c += or_equal ? uint32_t(!(k < keys[i]) ) : uint32_t(keys[i] < k);
+            }
+        }
+#endif
+        return c;
+    }
+
+template <typename K, typename V, uint32_t NB>
+    BPlusTree<K, V, NB>::BPlusTree() : _root(nullptr), _first(nullptr), _size(0), _height(1) {
+        _first = alloc_node<Leaf>();
+        _root = _first;
+    }
+
+template <typename K, typename V, uint32_t NB>
+    BPlusTree<K, V, NB>::~BPlusTree() {
+        free_tree(_root);
+        _root = nullptr;
+        _first = nullptr;
+    }
+
+template <typename K, typename V, uint32_t NB>
+    bool BPlusTree<K, V, NB>::find(const K &key, V *value) const {
+        Leaf *leaf = descend(key, nullptr, nullptr, nullptr);
+        uint32_t pos = Search::lower(leaf->keys, leaf->count, key);
+        if (pos < leaf->count && !(key < leaf->keys[pos]) ) {
+            if (value) {
+                *value = leaf->values[pos];
+            }
+            return true;
+        }
+        return false;
+    }
+
+template <typename K, typename V, uint32_t NB>
+    typename BPlusTree<K, V, NB>::Iterator BPlusTree<K, V, NB>::lower_bound(const K &key) const {
+        Leaf *leaf = descend(key, nullptr, nullptr, nullptr);
+        return Iterator(leaf, Search::lower(leaf->keys, leaf->count, key) );
+    }
+
+template <typename K, typename V, uint32_t NB>
+    void BPlusTree<K, V, NB>::clear() {
+        free_tree(_root);
+        _first = alloc_node<Leaf>();
+        _root = _first;
+        _size = 0;
+        _height = 1;
+    }
+
+/**
+ * A full leaf splits in halves. The separator, the first key of the new
+ * right node, goes up the path, splitting full inner nodes on the way; a
+ * split root makes the tree one level higher.
+ */
+template <typename K, typename V, uint32_t NB>
+    bool BPlusTree<K, V, NB>::upsert(const K &key, const V &value, bool overwrite) {
+        Inner *path[MAX_DEPTH];
+        uint32_t slot[MAX_DEPTH];
+        uint32_t depth = 0;
+        Leaf *leaf = descend(key, path, slot, &depth);
+        uint32_t pos = Search::lower(leaf->keys, leaf->count, key);
+        if (pos < leaf->count && !(key < leaf->keys[pos]) ) {
+            if (overwrite) {
+                leaf->values[pos] = value;
+            }
+            return false;
+        }
+
+        ++_size;
+        Leaf *right = nullptr;
+        if (leaf->count == LEAF_CAP) {
+            right = alloc_node<Leaf>();
+            std::copy(leaf->keys + LEAF_MIN, leaf->keys + LEAF_CAP, right->keys);
+            std::copy(leaf->values + LEAF_MIN, leaf->values + LEAF_CAP, right->values);
+            right->count = LEAF_CAP - LEAF_MIN;
+            leaf->count = LEAF_MIN;
+            right->prev = leaf;
+            right->next = leaf->next;
+            if (leaf->next) {
+                leaf->next->prev = right;
+            }
+            leaf->next = right;
+            if (pos > LEAF_MIN) {
+                leaf = right;
+                pos -= LEAF_MIN;
+            }
+        }
+        std::copy_backward(leaf->keys + pos, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+        std::copy_backward(leaf->values + pos, leaf->values + leaf->count, leaf->values + leaf->count + 1);
+        leaf->keys[pos] = key;
+        leaf->values[pos] = value;
+        ++leaf->count;
+        Z_RET_IF(nullptr == right, true);
+
+        K sep = right->keys[0];
+        Node *child = right;
+        while (depth > 0) {
+            --depth;
+            Inner *in = path[depth];
+            uint32_t i = slot[depth];   // child goes to i + 1, sep to i
+            if (in->count < INNER_CAP) {
+                std::copy_backward(in->keys + i, in->keys + in->count, in->keys + in->count + 1);
+                std::copy_backward(in->child + i + 1, in->child + in->count + 1, in->child + in->count + 2);
+                in->keys[i] = sep;
+                in->child[i + 1] = child;
+                ++in->count;
+                return true;
+            }
+
+            K keys[INNER_CAP + 1];
+            Node *kids[INNER_CAP + 2];
+            std::copy(in->keys, in->keys + i, keys);
+            keys[i] = sep;
+            std::copy(in->keys + i, in->keys + INNER_CAP, keys + i + 1);
+            std::copy(in->child, in->child + i + 1, kids);
+            kids[i + 1] = child;
+            std::copy(in->child + i + 1, in->child + INNER_CAP + 1, kids + i + 2);
+
+            // INNER_MIN keys stay, the next one goes up, the rest move right
+            Inner *r = alloc_node<Inner>();
+            std::copy(keys, keys + INNER_MIN, in->keys);
+            std::copy(kids, kids + INNER_MIN + 1, in->child);
+            in->count = INNER_MIN;
+            std::copy(keys + INNER_MIN + 1, keys + INNER_CAP + 1, r->keys);
+            std::copy(kids + INNER_MIN + 1, kids + INNER_CAP + 2, r->child);
+            r->count = INNER_CAP - INNER_MIN;
+            sep = keys[INNER_MIN];
+            child = r;
+        }
+
+        Inner *root = alloc_node<Inner>();
+        root->keys[0] = sep;
+        root->child[0] = _root;
+        root->child[1] = child;
+        root->count = 1;
+        _root = root;
+        ++_height;
+        return true;
+    }
+
+/**
+ * An underfull node borrows an entry from a sibling with more than the
+ * minimum, or merges with one. A merge takes a key and a child from the
+ * parent, which may underflow in turn; a root left with one child goes.
+ */
+template <typename K, typename V, uint32_t NB>
+    bool BPlusTree<K, V, NB>::erase(const K &key, V *value) {
+        Inner *path[MAX_DEPTH];
+        uint32_t slot[MAX_DEPTH];
+        uint32_t depth = 0;
+        Leaf *leaf = descend(key, path, slot, &depth);
+        uint32_t pos = Search::lower(leaf->keys, leaf->count, key);
+        if (pos >= leaf->count || key < leaf->keys[pos]) {
+            return false;
+        }
+
+        if (value) {
+            *value = leaf->values[pos];
+        }
+        std::copy(leaf->keys + pos + 1, leaf->keys + leaf->count, leaf->keys + pos);
+        std::copy(leaf->values + pos + 1, leaf->values + leaf->count, leaf->values + pos);
+        --leaf->count;
+        --_size;
+
+        if (0 == depth || leaf->count >= LEAF_MIN) {
+            return true;
+        }
+        --depth;
+        if (!rebalance_leaf(leaf, path[depth], slot[depth]) ) {
+            return true;
+        }
+        while (depth > 0 && path[depth]->count < INNER_MIN) {
+            --depth;
+            if (!rebalance_inner(path[depth + 1], path[depth], slot[depth]) ) {
+                return true;
+            }
+        }
+
+        if (0 == _root->count && !_root->leaf) {
+            Inner *old = static_cast<Inner*>(_root);
+            _root = old->child[0];
+            free_node(old);
+            --_height;
+        }
+        return true;
+    }
+
+/// @return true if leaf merged with a sibling, so parent lost a child
+template <typename K, typename V, uint32_t NB>
+    bool BPlusTree<K, V, NB>::rebalance_leaf(Leaf *leaf, Inner *parent, uint32_t i) {
+        Leaf *left = (i > 0) ? static_cast<Leaf*>(parent->child[i - 1]) : nullptr;
+        Leaf *right = (i < parent->count) ? static_cast<Leaf*>(parent->child[i + 1]) : nullptr;
+
+        if (left && left->count > LEAF_MIN) {
+            std::copy_backward(leaf->keys, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+            std::copy_backward(leaf->values, leaf->values + leaf->count, leaf->values + leaf->count + 1);
+            --left->count;
+            leaf->keys[0] = left->keys[left->count];
+            leaf->values[0] = left->values[left->count];
+            ++leaf->count;
+            parent->keys[i - 1] = leaf->keys[0];
+            return false;
+        }
+        if (right && right->count > LEAF_MIN) {
+            leaf->keys[leaf->count] = right->keys[0];
+            leaf->values[leaf->count] = right->values[0];
+            ++leaf->count;
+            std::copy(right->keys + 1, right->keys + right->count, right->keys);
+            std::copy(right->values + 1, right->values + right->count, right->values);
+            --right->count;
+            parent->keys[i] = right->keys[0];
+            return false;
+        }
+
+        // merge into the left one of the pair
+        if (left) {
+            right = leaf;
+            --i;
+        } else {
+            left = leaf;
+        }
+        std::copy(right->keys, right->keys + right->count, left->keys + left->count);
+        std::copy(right->values, right->values + right->count, left->values + left->count);
+        left->count += right->count;
+        left->next = right->next;
+        if (right->next) {
+            right->next->prev = left;
+        }
+        remove_child(parent, i);
+        free_node(right);
+        return true;
+    }
+
+/// @return true if node merged with a sibling, so parent lost a child
+template <typename K, typename V, uint32_t NB>
+    bool BPlusTree<K, V, NB>::rebalance_inner(Inner *node, Inner *parent, uint32_t i) {
+        Inner *left = (i > 0) ? static_cast<Inner*>(parent->child[i - 1]) : nullptr;
+        Inner *right = (i < parent->count) ? static_cast<Inner*>(parent->child[i + 1]) : nullptr;
+
+        if (left && left->count > INNER_MIN) {
+            // rotate right through the parent key
+            std::copy_backward(node->keys, node->keys + node->count, node->keys + node->count + 1);
+            std::copy_backward(node->child, node->child + node->count + 1, node->child + node->count + 2);
+            node->keys[0] = parent->keys[i - 1];
+            node->child[0] = left->child[left->count];
+            ++node->count;
+            parent->keys[i - 1] = left->keys[left->count - 1];
+            --left->count;
+            return false;
+        }
+        if (right && right->count > INNER_MIN) {
+            // rotate left through the parent key
+            node->keys[node->count] = parent->keys[i];
+            node->child[node->count + 1] = right->child[0];
+            ++node->count;
+            parent->keys[i] = right->keys[0];
+            std::copy(right->keys + 1, right->keys + right->count, right->keys);
+            std::copy(right->child + 1, right->child + right->count + 1, right->child);
+            --right->count;
+            return false;
+        }
+
+        if (left) {
+            right = node;
+            --i;
+        } else {
+            left = node;
+        }
+        left->keys[left->count] = parent->keys[i];
+        std::copy(right->keys, right->keys + right->count, left->keys + left->count + 1);
+        std::copy(right->child, right->child + right->count + 1, left->child + left->count + 1);
+        left->count += 1 + right->count;
+        remove_child(parent, i);
+        free_node(right);
+        return true;
+    }
+
+/// drop keys[key_pos] and child[key_pos + 1], the right one of a merged pair
+template <typename K, typename V, uint32_t NB>
+    void BPlusTree<K, V, NB>::remove_child(Inner *node, uint32_t key_pos) {
+        std::copy(node->keys + key_pos + 1, node->keys + node->count, node->keys + key_pos);
+        std::copy(node->child + key_pos + 2, node->child + node->count + 1, node->child + key_pos + 1);
+        --node->count;
+    }
+
+/**
+ * Leaves get n / leaves keys each, one more for the first n % leaves; with
+ * as few leaves as fit, that is more than half full. Inner levels are
+ * spread the same way, the first key of a subtree is its separator.
+ */
+template <typename K, typename V, uint32_t NB>
+    bool BPlusTree<K, V, NB>::bulk_load(const K *keys, const V *values, uint32_t n) {
+        for (uint32_t i = 1; i < n; ++i) {
+            Z_RET_IF(!(keys[i - 1] < keys[i]), false);
+        }
+        clear();
+        Z_RET_IF(0 == n, true);
+
+        std::vector<Node*> level;
+        std::vector<K> mins;
+        uint32_t leaves = (n + LEAF_CAP - 1) / LEAF_CAP;
+        level.reserve(leaves);
+        mins.reserve(leaves);
+        Leaf *leaf = _first;
+        for (uint32_t l = 0, off = 0; l < leaves; ++l) {
+            if (l > 0) {
+                Leaf *next = alloc_node<Leaf>();
+                next->prev = leaf;
+                leaf->next = next;
+                leaf = next;
+            }
+            uint32_t cnt = n / leaves + ( (l < n % leaves) ? 1 : 0);
+            std::copy(keys + off, keys + off + cnt, leaf->keys);
+            std::copy(values + off, values + off + cnt, leaf->values);
+            leaf->count = cnt;
+            level.push_back(leaf);
+            mins.push_back(keys[off]);
+            off += cnt;
+        }
+
+        while (level.size() > 1) {
+            uint32_t m = uint32_t(level.size() );
+            uint32_t nodes = (m + INNER_CAP) / (INNER_CAP + 1);
+            std::vector<Node*> up;
+            std::vector<K> up_mins;
+            up.reserve(nodes);
+            up_mins.reserve(nodes);
+            for (uint32_t j = 0, off = 0; j < nodes; ++j) {
+                uint32_t cnt = m / nodes + ( (j < m % nodes) ? 1 : 0);
+                Inner *in = alloc_node<Inner>();
+                std::copy(level.begin() + off, level.begin() + off + cnt, in->child);
+                std::copy(mins.begin() + off + 1, mins.begin() + off + cnt, in->keys);
+                in->count = cnt - 1;
+                up.push_back(in);
+                up_mins.push_back(mins[off]);
+                off += cnt;
+            }
+            level.swap(up);
+            mins.swap(up_mins);
+            ++_height;
+        }
+        _root = level[0];
+        _size = n;
+        return true;
+    }
+
+template <typename K, typename V, uint32_t NB>
+    typename BPlusTree<K, V, NB>::Leaf* BPlusTree<K, V, NB>::descend(const K &key,
+        Inner **path, uint32_t *slot, uint32_t *depth) const {
+        Node *n = _root;
+        uint32_t d = 0;
+        while (!n->leaf) {
+            Inner *in = static_cast<Inner*>(n);
+            uint32_t i = Search::upper(in->keys, in->count, key);
+            if (path) {
+                path[d] = in;
+                slot[d] = i;
+            }
+            ++d;
+            n = in->child[i];
+        }
+        if (depth) {
+            *depth = d;
+        }
+        return static_cast<Leaf*>(n);
+    }
+
+template <typename K, typename V, uint32_t NB>
+    template <typename N>
+    N* BPlusTree<K, V, NB>::alloc_node() {
+        void *mem = nullptr;
+        int ret = ::posix_memalign(&mem, DEF_SIZE_CACHE_LINE, sizeof(N) );
+        ZASSERT(0 == ret);
+        Z_USE_VAR(ret);
+        N *n = new (mem) N();
+        n->leaf = std::is_same<N, Leaf>::value ? 1 : 0;
+        n->count = 0;
+        return n;
+    }
+
+template <typename K, typename V, uint32_t NB>
+    template <typename N>
+    void BPlusTree<K, V, NB>::free_node(N *n) {
+        n->~N();
+        ::free(n);
+    }
+
+template <typename K, typename V, uint32_t NB>
+    void BPlusTree<K, V, NB>::free_tree(Node *n) {
+        Z_RET_IF_ANY_ZERO_1(n, );
+        if (n->leaf) {
+            free_node(static_cast<Leaf*>(n) );
+            return;
+        }
+        Inner *in = static_cast<Inner*>(n);
+        for (uint32_t i = 0; i <= in->count; ++i) {
+            free_tree(in->child[i]);
+        }
+        free_node(in);
+    }
 
 } // namespace z
 
@@ -1,9 +1,95 @@
 #include "algo_hash.h"
 
-#if Z_COMPILE_FLAG_ENABLE_UT 
+namespace z {
+;
+
+// RFC 1321. Only used by the legacy HASH_ALGO_MD5 mode, kept here so that
+// the library does not depend on libcrypto.
+static const uint32_t g_md5_k[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static const uint8_t g_md5_r[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+};
+
+static void md5_block(uint32_t h[4], const uint8_t *block) {
+    uint32_t w[16];
+    ::memcpy(w, block, sizeof(w) );
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+    for (uint32_t i = 0; i < 64; ++i) {
+        uint32_t f, g;
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) & 0x0F;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) & 0x0F;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) & 0x0F;
+        }
+
+        uint32_t t = d;
+        d = c;
+        c = b;
+        uint32_t x = a + f + g_md5_k[i] + w[g];
+        b = b + ((x << g_md5_r[i]) | (x >> (32 - g_md5_r[i])) );
+        a = t;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+}
+
+void hash_md5(const void *data, size_t size, unsigned char digest[HASH_MD5_DIGEST_LENGTH]) {
+    uint32_t h[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+    const uint8_t *p = (const uint8_t*)(data);
+
+    size_t left = size;
+    while (left >= 64) {
+        md5_block(h, p);
+        p += 64;
+        left -= 64;
+    }
+
+    uint8_t tail[128] = {0};
+    ::memcpy(tail, p, left);
+    tail[left] = 0x80;
+    size_t tail_size = (left < 56) ? 64 : 128;
+    uint64_t bits = uint64_t(size) << 3;
+    ::memcpy(tail + tail_size - 8, &bits, 8);
+
+    md5_block(h, tail);
+    if (tail_size == 128) {
+        md5_block(h, tail + 64);
+    }
+
+    ::memcpy(digest, h, HASH_MD5_DIGEST_LENGTH);
+}
+
+} // namespace z
+
+#if Z_COMPILE_FLAG_ENABLE_UT
 #include <gtest/gtest.h>
 TEST(ut_low_hash, fast_hash) {
-    using namespace z::low;
+    using namespace z;
 
     uint64_t v = 0;
     v = hash64("ABCDEFG", 7);
@@ -13,21 +99,137 @@ TEST(ut_low_hash, fast_hash) {
     std::string s((const char*)(&v), 8);
     EXPECT_STREQ("12345678", s.c_str() );
 
-    v = hash64("123456789", 9);
+    v = legacy_hash64("123456789", 9);
     EXPECT_EQ(4054712127949633829lu, v);
     fprintf(stdout, "v64 = %lx\n", v);
 
-    v = hash32("123456789", 9);
+    v = legacy_hash32("123456789", 9);
     EXPECT_EQ(2498230565lu, v);
     fprintf(stdout, "v32 = %lx\n", v);
-    
-    v = hash64("abcdefghijk", 11);
+
+    v = legacy_hash64("abcdefghijk", 11);
     EXPECT_EQ(11584269842975078802ul, v);
     fprintf(stdout, "v64 = %lx\n", v);
 
-    v = hash32("abcdefghijk", 11);
+    v = legacy_hash32("abcdefghijk", 11);
     EXPECT_EQ(3435968914lu, v);
     fprintf(stdout, "v32 = %lx\n", v);
 }
 
+TEST(ut_low_hash, md5_digest) {
+    using namespace z;
+
+    unsigned char d[HASH_MD5_DIGEST_LENGTH];
+    const unsigned char empty[] = {
+        0xd4, 0x1d, 0x8c, 0xd9, 0x8f, 0x00, 0xb2, 0x04,
+        0xe9, 0x80, 0x09, 0x98, 0xec, 0xf8, 0x42, 0x7e};
+    hash_md5("", 0, d);
+    EXPECT_EQ(0, memcmp(empty, d, sizeof(d) ) );
+
+    const char *fox = "The quick brown fox jumps over the lazy dog";
+    const unsigned char fox_md5[] = {
+        0x9e, 0x10, 0x7d, 0x9d, 0x37, 0x2b, 0xb6, 0x82,
+        0x6b, 0xd8, 0x1d, 0x35, 0x42, 0xa4, 0x19, 0xd6};
+    hash_md5(fox, strlen(fox), d);
+    EXPECT_EQ(0, memcmp(fox_md5, d, sizeof(d) ) );
+}
+
+TEST(ut_low_hash, hash_engine) {
+    using namespace z;
+
+    char key[256];
+    for (uint32_t i = 0; i < sizeof(key); ++i) {
+        key[i] = char(i * 7 + 1);
+    }
+
+    // every length hits a different read path, all must differ
+    for (uint32_t len = 9; len < sizeof(key); ++len) {
+        EXPECT_NE(hash64(key, len), hash64(key, len - 1) );
+        EXPECT_NE(hash64(key, len, 1), hash64(key, len, 2) );
+        EXPECT_EQ(hash64(key, len), hash_bytes64(key, len) );
+        EXPECT_EQ(hash64(key, len), hash128(key, len).lo);
+        EXPECT_EQ(hash32(key, len), hash_fold32(hash64(key, len) ) );
+    }
+
+    // seeded short keys are hashed instead of copied
+    EXPECT_NE(uint64_t('A'), hash64("A", 1, 7) );
+}
+
+TEST(ut_low_hash, batch) {
+    using namespace z;
+
+    char key[256];
+    for (uint32_t i = 0; i < sizeof(key); ++i) {
+        key[i] = char(i * 5 + 11);
+    }
+
+    const uint32_t N = 67;
+    const void *keys[N];
+    uint32_t lens[N];
+    uint64_t ikeys[N];
+    uint64_t out[N];
+    for (uint32_t i = 0; i < N; ++i) {
+        keys[i] = key + i;
+        lens[i] = (i * 7) % ((i & 8) ? 17 : 120);
+        ikeys[i] = i * 0x9E3779B97F4A7C15ull;
+    }
+
+    hash_bytes64_batch(keys, lens, out, N, 3);
+    for (uint32_t i = 0; i < N; ++i) {
+        EXPECT_EQ(hash_bytes64(keys[i], lens[i], 3), out[i]) << i;
+    }
+
+    hash_int64_batch(ikeys, out, N, 3);
+    for (uint32_t i = 0; i < N; ++i) {
+        EXPECT_EQ(hash_int64(ikeys[i], 3), out[i]) << i;
+    }
+}
+
+TEST(ut_low_hash, hash_str) {
+    using namespace z;
+
+    static_assert("CONTENT-LENGTH:"_zh == hash_str("CONTENT-LENGTH:", 15), "constexpr");
+    EXPECT_EQ("CONTENT-LENGTH:"_zh, hash_str_ci("Content-Length:", 15) );
+    EXPECT_EQ("CONTENT-LENGTH:"_zh, hash_str_ci("CONTENT-length:", 15) );
+    EXPECT_EQ("HTTP/1.1"_zh, hash_str_ci("http/1.1", 8) );
+    EXPECT_EQ(""_zh, hash_str_ci("", 0) );
+    EXPECT_NE("HTTP/1.1"_zh, "HTTP/1.0"_zh);
+    EXPECT_NE("LOCATION:"_zh, hash_str_ci("LOCATION", 8) );
+    // only letters are folded
+    EXPECT_NE("[@"_zh, hash_str_ci("{`", 2) );
+    EXPECT_EQ("\xE1\xC1"_zh, hash_str_ci("\xE1\xC1", 2) );
+    EXPECT_EQ("ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"_zh,
+              hash_str_ci("abcdefghijklmnopqrstuvwxyz0123456789", 36) );
+    EXPECT_NE("ABCDEFGH"_zh, "ABCDEFGH\0"_zh);
+
+    int selected = 0;
+    switch (hash_str_ci("location:", 9) ) {
+    case "CONTENT-LENGTH:"_zh: selected = 1; break;
+    case "LOCATION:"_zh: selected = 2; break;
+    default: break;
+    }
+    EXPECT_EQ(2, selected);
+}
+
+TEST(ut_low_hash, stream_hasher) {
+    using namespace z;
+
+    char key[1024];
+    for (uint32_t i = 0; i < sizeof(key); ++i) {
+        key[i] = char(i * 31 + 3);
+    }
+
+    const uint32_t chunks[] = {1, 3, 16, 17, 47, 48, 49, 100};
+    for (uint32_t len = 0; len < sizeof(key); len += (len < 130) ? 1 : 37) {
+        for (uint32_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); ++c) {
+            StreamHasher h(len);
+            for (uint32_t off = 0; off < len; off += chunks[c]) {
+                h.update(key + off, std::min(chunks[c], len - off) );
+            }
+            ASSERT_EQ(hash_bytes64(key, len, len), h.finalize() ) << len << "/" << chunks[c];
+            ASSERT_EQ(hash_bytes128(key, len, len).hi, h.finalize128().hi);
+        }
+    }
+}
+
 #endif // Z_COMPILE_FLAG_ENABLE_UT
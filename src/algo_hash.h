@@ -1,27 +1,387 @@
 #ifndef Z_ALGO_HASH_H__
 #define Z_ALGO_HASH_H__
 
+/**
+ * @brief Non-cryptographic hashing.
+ *
+ * The default engine is a multiply-mix hash in the wyhash family: keys up to
+ * 16 bytes are read with at most four unaligned loads, longer keys are
+ * consumed 48 bytes per round by three independent lanes. MD5 is kept only
+ * as an explicitly selected legacy mode (HASH_ALGO_MD5) for data persisted
+ * with the old hash values.
+ */
+
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
-#include <openssl/md5.h>
 
 namespace z {
 ;
 
+enum HashAlgoEnum {
+    HASH_ALGO_WY        = 0,    ///< multiply-mix hash, the default
+    HASH_ALGO_MD5       = 1,    ///< legacy: leading bytes of the MD5 digest
+};
+
+enum {
+    HASH_MD5_DIGEST_LENGTH  = 16,
+};
+
+struct hash128_t {
+    uint64_t    lo;
+    uint64_t    hi;
+};
+
+/// The legacy MD5 digest, implemented in algo_hash.cpp.
+void hash_md5(const void *data, size_t size, unsigned char digest[HASH_MD5_DIGEST_LENGTH]);
+
+// ------------------------------------------------------------------------ //
+
+static const uint64_t HASH_SECRET[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+    0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull,
+};
+
+inline void hash_mum(uint64_t *a, uint64_t *b) {
+    __uint128_t r = *a;
+    r *= *b;
+    *a = uint64_t(r);
+    *b = uint64_t(r >> 64);
+}
+
+inline uint64_t hash_mix(uint64_t a, uint64_t b) {
+    hash_mum(&a, &b);
+    return a ^ b;
+}
+
+inline uint64_t hash_read8(const uint8_t *p) {uint64_t v; ::memcpy(&v, p, 8); return v; }
+inline uint64_t hash_read4(const uint8_t *p) {uint32_t v; ::memcpy(&v, p, 4); return v; }
+inline uint64_t hash_read3(const uint8_t *p, size_t k) {
+    return (uint64_t(p[0]) << 16) | (uint64_t(p[k >> 1]) << 8) | p[k - 1];
+}
+
+inline void hash_short_key(const uint8_t *p, size_t len, uint64_t *a, uint64_t *b) {
+    *a = *b = 0;
+    if (__builtin_expect(len >= 4, 1) ) {
+        *a = (hash_read4(p) << 32) | hash_read4(p + ((len >> 3) << 2) );
+        *b = (hash_read4(p + len - 4) << 32) | hash_read4(p + len - 4 - ((len >> 3) << 2) );
+    } else if (len > 0) {
+        *a = hash_read3(p, len);
+    }
+}
+
+inline void hash_round48(const uint8_t *p, uint64_t *seed, uint64_t *see1, uint64_t *see2) {
+    const uint64_t *s = HASH_SECRET;
+    *seed = hash_mix(hash_read8(p) ^ s[1], hash_read8(p + 8) ^ *seed);
+    *see1 = hash_mix(hash_read8(p + 16) ^ s[2], hash_read8(p + 24) ^ *see1);
+    *see2 = hash_mix(hash_read8(p + 32) ^ s[3], hash_read8(p + 40) ^ *see2);
+}
+
+/**
+ * @brief the 16-byte rounds and the final read of a key longer than 16 bytes.
+ * NOTE: the final read may reach back to p[i - 16], before p.
+ */
+inline void hash_long_tail(const uint8_t *p, size_t i, uint64_t *seed, uint64_t *a, uint64_t *b) {
+    while (i > 16) {
+        *seed = hash_mix(hash_read8(p) ^ HASH_SECRET[1], hash_read8(p + 8) ^ *seed);
+        p += 16;
+        i -= 16;
+    }
+    *a = hash_read8(p + i - 16);
+    *b = hash_read8(p + i - 8);
+}
+
+inline uint64_t hash_init_seed(uint64_t seed) {
+    return seed ^ hash_mix(seed ^ HASH_SECRET[0], HASH_SECRET[1]);
+}
+
+/**
+ * @brief absorb the key into the 128-bit state (a, b).
+ * Shared by the 64-bit and 128-bit outputs.
+ */
+inline void hash_absorb(const void *key, size_t len, uint64_t seed, uint64_t *pa, uint64_t *pb) {
+    const uint8_t *p = (const uint8_t*)(key);
+    uint64_t a = 0;
+    uint64_t b = 0;
+
+    seed = hash_init_seed(seed);
+    if (__builtin_expect(len <= 16, 1) ) {
+        hash_short_key(p, len, &a, &b);
+    } else {
+        size_t i = len;
+        if (__builtin_expect(i >= 48, 0) ) {
+            uint64_t see1 = seed;
+            uint64_t see2 = seed;
+            do {
+                hash_round48(p, &seed, &see1, &see2);
+                p += 48;
+                i -= 48;
+            } while (i >= 48);
+            seed ^= see1 ^ see2;
+        }
+        hash_long_tail(p, i, &seed, &a, &b);
+    }
+
+    a ^= HASH_SECRET[1];
+    b ^= seed;
+    hash_mum(&a, &b);
+    *pa = a;
+    *pb = b;
+}
+
+inline uint64_t hash_out64(uint64_t a, uint64_t b, size_t len) {
+    return hash_mix(a ^ HASH_SECRET[0] ^ len, b ^ HASH_SECRET[1]);
+}
+
+inline hash128_t hash_out128(uint64_t a, uint64_t b, size_t len) {
+    hash128_t h;
+    h.lo = hash_out64(a, b, len);
+    h.hi = hash_mix(a ^ HASH_SECRET[2], b ^ HASH_SECRET[3] ^ len);
+    return h;
+}
+
+inline uint64_t hash_bytes64(const void *key, size_t len, uint64_t seed = 0) {
+    uint64_t a, b;
+    hash_absorb(key, len, seed, &a, &b);
+    return hash_out64(a, b, len);
+}
+
+inline hash128_t hash_bytes128(const void *key, size_t len, uint64_t seed = 0) {
+    uint64_t a, b;
+    hash_absorb(key, len, seed, &a, &b);
+    return hash_out128(a, b, len);
+}
+
+/// mix a single 64-bit integer, e.g. to spread an identity hash over all bits
+inline uint64_t hash_int64(uint64_t v, uint64_t seed = 0) {
+    return hash_mix(v ^ HASH_SECRET[0], seed ^ HASH_SECRET[1]);
+}
+
+inline uint32_t hash_fold32(uint64_t h) {
+    return uint32_t(h ^ (h >> 32) );
+}
+
+// ------------------------------------------------------------------------ //
+
+enum {
+    HASH_BATCH_PREFETCH = 16,   ///< how far ahead hash_bytes64_batch() prefetches keys
+};
+
+/**
+ * @brief out[i] = hash_bytes64(keys[i], lens[i], seed) for i in [0, n).
+ *
+ * Hashing a batch of scattered keys is bound by cache misses on the keys,
+ * not by the arithmetic: the key HASH_BATCH_PREFETCH positions ahead is
+ * prefetched while the current one is hashed.
+ */
+inline void hash_bytes64_batch(const void *const keys[], const uint32_t lens[],
+                               uint64_t out[], uint32_t n, uint64_t seed = 0) {
+    for (uint32_t i = 0; i < n; ++i) {
+        if (i + HASH_BATCH_PREFETCH < n) {
+            __builtin_prefetch(keys[i + HASH_BATCH_PREFETCH]);
+        }
+        out[i] = hash_bytes64(keys[i], lens[i], seed);
+    }
+}
+
+/// out[i] = hash_int64(keys[i], seed) for i in [0, n)
+inline void hash_int64_batch(const uint64_t keys[], uint64_t out[], uint32_t n, uint64_t seed = 0) {
+    const uint64_t b = seed ^ HASH_SECRET[1];
+    for (uint32_t i = 0; i < n; ++i) {
+        out[i] = hash_mix(keys[i] ^ HASH_SECRET[0], b);
+    }
+}
+
+// ------------------------------------------------------------------------ //
+
+/**
+ * @brief Incremental version of hash_bytes64()/hash_bytes128().
+ *
+ * Feeding the same bytes in any number of update() calls gives exactly the
+ * value of the one-shot hash. At most 48 bytes are buffered; whole 48-byte
+ * rounds are consumed in place from the caller's memory.
+ */
+class StreamHasher {
+public:
+    explicit StreamHasher(uint64_t seed = 0) {init(seed); }
+
+    void init(uint64_t seed = 0) {
+        _seed = _see1 = _see2 = hash_init_seed(seed);
+        _total = 0;
+        _pending = 0;
+    }
+
+    void update(const void *data, size_t len) {
+        const uint8_t *p = (const uint8_t*)(data);
+        _total += len;
+
+        if (_pending) {
+            size_t n = (len < ROUND - _pending) ? len : (ROUND - _pending);
+            ::memcpy(_buf + HISTORY + _pending, p, n);
+            _pending += n;
+            p += n;
+            len -= n;
+            if (_pending < ROUND) {
+                return ;
+            }
+            hash_round48(_buf + HISTORY, &_seed, &_see1, &_see2);
+            ::memcpy(_buf, _buf + ROUND, HISTORY);
+            _pending = 0;
+        }
+
+        if (len >= ROUND) {
+            do {
+                hash_round48(p, &_seed, &_see1, &_see2);
+                p += ROUND;
+                len -= ROUND;
+            } while (len >= ROUND);
+            ::memcpy(_buf, p - HISTORY, HISTORY);
+        }
+
+        ::memcpy(_buf + HISTORY + _pending, p, len);
+        _pending += len;
+    }
+
+    uint64_t finalize() const {
+        uint64_t a, b;
+        absorb_tail(&a, &b);
+        return hash_out64(a, b, _total);
+    }
+
+    hash128_t finalize128() const {
+        uint64_t a, b;
+        absorb_tail(&a, &b);
+        return hash_out128(a, b, _total);
+    }
+private:
+    enum {
+        ROUND   = 48,
+        HISTORY = 16,   ///< the tail of consumed data, read back by hash_long_tail()
+    };
+
+    void absorb_tail(uint64_t *a, uint64_t *b) const {
+        uint64_t seed = _seed;
+        const uint8_t *p = _buf + HISTORY;
+        if (_total <= 16) {
+            hash_short_key(p, _total, a, b);
+        } else {
+            if (_total >= ROUND) {
+                seed ^= _see1 ^ _see2;
+            }
+            hash_long_tail(p, _pending, &seed, a, b);
+        }
+
+        *a ^= HASH_SECRET[1];
+        *b ^= seed;
+        hash_mum(a, b);
+    }
+private:
+    uint64_t    _seed;
+    uint64_t    _see1;
+    uint64_t    _see2;
+    uint64_t    _total;
+    uint32_t    _pending;
+    uint8_t     _buf[HISTORY + ROUND];
+};
+
+// ------------------------------------------------------------------------ //
+
+/**
+ * @brief String hashing for dispatch on literals.
+ *
+ * hash_str() is constexpr, so a literal can be a case label:
+ *
+ *     switch (hash_str_ci(token, len) ) {
+ *     case "CONTENT-LENGTH:"_zh: ...   // then verify the token once
+ *     }
+ *
+ * hash_str_ci() folds ASCII letters to upper case, so it equals hash_str()
+ * of the upper-cased text. Both consume 8 bytes per multiply. Meant for
+ * short tokens (header names, method names); the values differ from hash64().
+ */
+enum : uint64_t {
+    HASH_STR_BASIS  = 0xcbf29ce484222325ull,
+    HASH_STR_MUL    = 0xff51afd7ed558ccdull,
+    HASH_STR_ONES   = 0x0101010101010101ull,
+    HASH_STR_HIGH   = 0x8080808080808080ull,
+};
+
+// 8 bytes per round, the last word is zero padded
+constexpr uint64_t hash_str_xs(uint64_t x) {
+    return x ^ (x >> 32);
+}
+
+constexpr uint64_t hash_str_round(uint64_t h, uint64_t w) {
+    return hash_str_xs((h ^ w) * HASH_STR_MUL);
+}
+
+constexpr uint64_t hash_str_final(uint64_t h) {
+    return hash_str_xs(hash_str_xs(h) * HASH_STR_MUL);
+}
+
+/// little-endian word of s[0, n), n <= 8
+constexpr uint64_t hash_str_word(const char *s, size_t n) {
+    return (n == 0) ? 0 : (uint64_t(uint8_t(s[0]) ) | (hash_str_word(s + 1, n - 1) << 8) );
+}
+
+constexpr uint64_t hash_str_words(const char *s, size_t n, uint64_t h) {
+    return (n <= 8) ? hash_str_round(h, hash_str_word(s, n) )
+                    : hash_str_words(s + 8, n - 8, hash_str_round(h, hash_str_word(s, 8) ) );
+}
+
+constexpr uint64_t hash_str(const char *s, size_t n) {
+    return hash_str_final(hash_str_words(s, n, HASH_STR_BASIS ^ n) );
+}
+
+/// fold 'a'-'z' in all 8 bytes to upper case at once
+inline uint64_t hash_str_upper8(uint64_t w) {
+    uint64_t low7 = w & ~HASH_STR_HIGH;
+    uint64_t ge_a = low7 + (0x80 - 'a') * HASH_STR_ONES;
+    uint64_t gt_z = low7 + (0x80 - 'z' - 1) * HASH_STR_ONES;
+    uint64_t lower = ge_a & ~gt_z & ~w & HASH_STR_HIGH;
+    return w ^ (lower >> 2);
+}
+
+inline uint64_t hash_str_ci(const char *s, size_t n) {
+    uint64_t h = HASH_STR_BASIS ^ n;
+    while (n > 8) {
+        uint64_t w;
+        ::memcpy(&w, s, sizeof(w) );
+        h = hash_str_round(h, hash_str_upper8(w) );
+        s += 8;
+        n -= 8;
+    }
+
+    uint64_t w = 0;
+    for (size_t i = 0; i < n; ++i) {
+        w |= uint64_t(uint8_t(s[i]) ) << (8 * i);
+    }
+    return hash_str_final(hash_str_round(h, hash_str_upper8(w) ) );
+}
+
+constexpr uint64_t operator"" _zh(const char *s, size_t n) {
+    return hash_str(s, n);
+}
+
+// ------------------------------------------------------------------------ //
+
 template <typename T, typename HashType>
     HashType fast_hash(const T &v) {
         return (HashType)(v);
     }
 
-template <typename T, typename HashType>
-    HashType fast_hash(const T *v, uint32_t size) {
+template <typename T, typename HashType, int HashAlgo = HASH_ALGO_WY>
+    HashType fast_hash(const T *v, uint32_t size, uint64_t seed = 0) {
         HashType hv = 0;
-        if (size <= sizeof(HashType) ) {
+        if (size <= sizeof(HashType) && seed == 0) {
             ::memcpy(&hv, (const void*)v, size);
-        } else {
-            char md5sum[MD5_DIGEST_LENGTH];
-            ::MD5((const unsigned char*)v, size, (unsigned char*)md5sum);
+        } else if (HashAlgo == HASH_ALGO_MD5) {
+            unsigned char md5sum[HASH_MD5_DIGEST_LENGTH];
+            hash_md5((const void*)v, size, md5sum);
             ::memcpy(&hv, md5sum, sizeof(hv) );
+        } else {
+            uint64_t h = hash_bytes64((const void*)v, size, seed);
+            hv = (sizeof(HashType) >= sizeof(h) ) ? HashType(h) : HashType(hash_fold32(h) );
         }
 
         return hv;
@@ -33,12 +393,28 @@ uint64_t hash64(const T &v) { return fast_hash<T, uint64_t>(v); }
 template <typename T>
 uint64_t hash64(const T *v, uint32_t size) {return fast_hash<T, uint64_t>(v, size); }
 
+template <typename T>
+uint64_t hash64(const T *v, uint32_t size, uint64_t seed) {return fast_hash<T, uint64_t>(v, size, seed); }
+
 template <typename T>
 uint32_t hash32(const T &v) { return fast_hash<T, uint32_t>(v); }
 
 template <typename T>
 uint32_t hash32(const T *v, uint32_t size) {return fast_hash<T, uint32_t>(v, size); }
 
+template <typename T>
+uint32_t hash32(const T *v, uint32_t size, uint64_t seed) {return fast_hash<T, uint32_t>(v, size, seed); }
+
+template <typename T>
+hash128_t hash128(const T *v, uint32_t size, uint64_t seed = 0) {return hash_bytes128(v, size, seed); }
+
+/// the old MD5 based values, only for compatibility with persisted hashes
+template <typename T>
+uint64_t legacy_hash64(const T *v, uint32_t size) {return fast_hash<T, uint64_t, HASH_ALGO_MD5>(v, size); }
+
+template <typename T>
+uint32_t legacy_hash32(const T *v, uint32_t size) {return fast_hash<T, uint32_t, HASH_ALGO_MD5>(v, size); }
+
 } // namespace z
 
 
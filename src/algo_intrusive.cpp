@@ -0,0 +1,419 @@
+#include "algo_intrusive.h"
+
+namespace z {
+;
+
+static inline bool is_red(const ZRBNode *n) {return n && n->red; }
+
+/// point whatever pointed at old at n instead
+static inline void replace_child(ZRBNode **root, ZRBNode *parent, ZRBNode *old, ZRBNode *n) {
+    if (nullptr == parent) {
+        *root = n;
+    } else if (parent->left == old) {
+        parent->left = n;
+    } else {
+        parent->right = n;
+    }
+}
+
+static void rotate_left(ZRBNode **root, ZRBNode *x) {
+    ZRBNode *y = x->right;
+    x->right = y->left;
+    if (y->left) {
+        y->left->parent = x;
+    }
+    y->parent = x->parent;
+    replace_child(root, x->parent, x, y);
+    y->left = x;
+    x->parent = y;
+}
+
+static void rotate_right(ZRBNode **root, ZRBNode *x) {
+    ZRBNode *y = x->left;
+    x->left = y->right;
+    if (y->right) {
+        y->right->parent = x;
+    }
+    y->parent = x->parent;
+    replace_child(root, x->parent, x, y);
+    y->right = x;
+    x->parent = y;
+}
+
+void zrb_insert_fixup(ZRBNode **root, ZRBNode *n) {
+    while (is_red(n->parent) ) {
+        ZRBNode *p = n->parent;
+        ZRBNode *g = p->parent;     // p is red, so not the root
+        if (p == g->left) {
+            ZRBNode *u = g->right;
+            if (is_red(u) ) {
+                p->red = u->red = 0;
+                g->red = 1;
+                n = g;
+                continue;
+            }
+            if (n == p->right) {
+                rotate_left(root, p);
+                n = p;
+                p = n->parent;
+            }
+            p->red = 0;
+            g->red = 1;
+            rotate_right(root, g);
+        } else {
+            ZRBNode *u = g->left;
+            if (is_red(u) ) {
+                p->red = u->red = 0;
+                g->red = 1;
+                n = g;
+                continue;
+            }
+            if (n == p->left) {
+                rotate_right(root, p);
+                n = p;
+                p = n->parent;
+            }
+            p->red = 0;
+            g->red = 1;
+            rotate_left(root, g);
+        }
+    }
+    (*root)->red = 0;
+}
+
+/// restore the black height after a black node left x (maybe null) under parent
+static void erase_fixup(ZRBNode **root, ZRBNode *x, ZRBNode *parent) {
+    while (x != *root && !is_red(x) ) {
+        if (x == parent->left) {
+            ZRBNode *w = parent->right;
+            if (is_red(w) ) {
+                w->red = 0;
+                parent->red = 1;
+                rotate_left(root, parent);
+                w = parent->right;
+            }
+            if (!is_red(w->left) && !is_red(w->right) ) {
+                w->red = 1;
+                x = parent;
+                parent = x->parent;
+                continue;
+            }
+            if (!is_red(w->right) ) {
+                w->left->red = 0;
+                w->red = 1;
+                rotate_right(root, w);
+                w = parent->right;
+            }
+            w->red = parent->red;
+            parent->red = 0;
+            w->right->red = 0;
+            rotate_left(root, parent);
+        } else {
+            ZRBNode *w = parent->left;
+            if (is_red(w) ) {
+                w->red = 0;
+                parent->red = 1;
+                rotate_right(root, parent);
+                w = parent->left;
+            }
+            if (!is_red(w->left) && !is_red(w->right) ) {
+                w->red = 1;
+                x = parent;
+                parent = x->parent;
+                continue;
+            }
+            if (!is_red(w->left) ) {
+                w->right->red = 0;
+                w->red = 1;
+                rotate_left(root, w);
+                w = parent->left;
+            }
+            w->red = parent->red;
+            parent->red = 0;
+            w->left->red = 0;
+            rotate_right(root, parent);
+        }
+        x = *root;
+    }
+    if (x) {
+        x->red = 0;
+    }
+}
+
+void zrb_erase(ZRBNode **root, ZRBNode *n) {
+    ZRBNode *x = nullptr;
+    ZRBNode *parent = nullptr;
+    uint32_t removed_red = n->red;
+
+    if (nullptr == n->left || nullptr == n->right) {
+        x = n->left ? n->left : n->right;
+        parent = n->parent;
+        if (x) {
+            x->parent = parent;
+        }
+        replace_child(root, parent, n, x);
+    } else {
+        // the successor s takes the place and color of n
+        ZRBNode *s = n->right;
+        while (s->left) {
+            s = s->left;
+        }
+        removed_red = s->red;
+        x = s->right;
+        if (s->parent == n) {
+            parent = s;
+        } else {
+            parent = s->parent;
+            parent->left = x;
+            if (x) {
+                x->parent = parent;
+            }
+            s->right = n->right;
+            s->right->parent = s;
+        }
+        s->left = n->left;
+        s->left->parent = s;
+        s->parent = n->parent;
+        s->red = n->red;
+        replace_child(root, n->parent, n, s);
+    }
+
+    n->parent = n->left = n->right = nullptr;
+    n->red = 0;
+    if (!removed_red) {
+        erase_fixup(root, x, parent);
+    }
+}
+
+ZRBNode* zrb_first(const ZRBNode *root) {
+    Z_RET_IF_ANY_ZERO_1(root, nullptr);
+    while (root->left) {
+        root = root->left;
+    }
+    return const_cast<ZRBNode*>(root);
+}
+
+ZRBNode* zrb_last(const ZRBNode *root) {
+    Z_RET_IF_ANY_ZERO_1(root, nullptr);
+    while (root->right) {
+        root = root->right;
+    }
+    return const_cast<ZRBNode*>(root);
+}
+
+ZRBNode* zrb_next(const ZRBNode *n) {
+    if (n->right) {
+        return zrb_first(n->right);
+    }
+    while (n->parent && n == n->parent->right) {
+        n = n->parent;
+    }
+    return n->parent;
+}
+
+ZRBNode* zrb_prev(const ZRBNode *n) {
+    if (n->left) {
+        return zrb_last(n->left);
+    }
+    while (n->parent && n == n->parent->left) {
+        n = n->parent;
+    }
+    return n->parent;
+}
+
+} // namespace z
+
+#if Z_COMPILE_FLAG_ENABLE_UT
+#include <gtest/gtest.h>
+#include <set>
+#include <vector>
+
+namespace {
+;
+
+struct Item {
+    int                 key;
+    z::ZListNode        link;
+    z::ZHListNode       hlink;
+    z::ZRBNode          rb;
+};
+
+struct ItemLess {
+    bool operator()(const z::ZRBNode *a, const z::ZRBNode *b) const {
+        return Z_FIND_OBJ_BY_MEMBER(Item, rb, a)->key < Z_FIND_OBJ_BY_MEMBER(Item, rb, b)->key;
+    }
+};
+
+/// @return the black height, -1 if a rule is broken
+int rb_check(const z::ZRBNode *n, const z::ZRBNode *parent) {
+    if (nullptr == n) {
+        return 1;
+    }
+    if (n->parent != parent || (n->red && parent && parent->red) ) {
+        return -1;
+    }
+    int l = rb_check(n->left, n);
+    int r = rb_check(n->right, n);
+    if (l < 0 || l != r) {
+        return -1;
+    }
+    return l + (n->red ? 0 : 1);
+}
+
+const z::ZRBNode* rb_root(const z::ZRBNode *n) {
+    while (n && n->parent) {
+        n = n->parent;
+    }
+    return n;
+}
+
+} // namespace
+
+TEST(ut_low_intrusive, list) {
+    using namespace z;
+
+    std::vector<Item> items(8);
+    ZList l;
+    ASSERT_TRUE(l.isEmpty() );
+    ASSERT_EQ(nullptr, l.first() );
+    for (int i = 0; i < 8; ++i) {
+        items[i].key = i;
+        ASSERT_FALSE(items[i].link.linked() );
+        if (i % 2) {
+            l.push_back(&items[i].link);
+        } else {
+            l.push_front(&items[i].link);
+        }
+    }
+    ASSERT_EQ(8u, l.size() );
+
+    // 6 4 2 0 1 3 5 7
+    int expect[] = {6, 4, 2, 0, 1, 3, 5, 7};
+    int k = 0;
+    for (ZListNode *n = l.first(); n; n = l.next(n), ++k) {
+        ASSERT_EQ(expect[k], Z_FIND_OBJ_BY_MEMBER(Item, link, n)->key);
+    }
+    ASSERT_EQ(8, k);
+    ASSERT_EQ(7, Z_FIND_OBJ_BY_MEMBER(Item, link, l.last() )->key);
+    ASSERT_EQ(5, Z_FIND_OBJ_BY_MEMBER(Item, link, l.prev(l.last() ) )->key);
+
+    // unlink from the middle, then relink before another node
+    l.erase(&items[0].link);
+    ASSERT_FALSE(items[0].link.linked() );
+    l.insert_before(&items[6].link, &items[0].link);
+    ASSERT_EQ(&items[0].link, l.first() );
+    ASSERT_EQ(&items[0].link, l.pop_front() );
+    ASSERT_EQ(&items[7].link, l.pop_back() );
+    ASSERT_EQ(6u, l.size() );
+
+    ZList other;
+    other.push_back(&items[0].link);
+    other.push_back(&items[7].link);
+    l.splice_back(&other);
+    ASSERT_TRUE(other.isEmpty() );
+    ASSERT_EQ(8u, l.size() );
+    ASSERT_EQ(&items[7].link, l.last() );
+
+    while (!l.isEmpty() ) {
+        l.pop_front();
+    }
+    ASSERT_EQ(0u, l.size() );
+}
+
+TEST(ut_low_intrusive, hlist) {
+    using namespace z;
+
+    const int BUCKETS = 4;
+    ZHList buckets[BUCKETS];
+    std::vector<Item> items(32);
+    for (int i = 0; i < 32; ++i) {
+        items[i].key = i;
+        buckets[i % BUCKETS].push_front(&items[i].hlink);
+    }
+
+    // unlink without knowing the bucket: the head, a middle and the tail
+    ZHList::erase(&items[31].hlink);
+    ZHList::erase(&items[15].hlink);
+    ZHList::erase(&items[3].hlink);
+    ASSERT_FALSE(items[15].hlink.linked() );
+
+    int total = 0;
+    for (int b = 0; b < BUCKETS; ++b) {
+        for (ZHListNode *n = buckets[b].first(); n; n = ZHList::next(n) ) {
+            Item *it = Z_FIND_OBJ_BY_MEMBER(Item, hlink, n);
+            ASSERT_EQ(b, it->key % BUCKETS);
+            ASSERT_TRUE(it->key != 31 && it->key != 15 && it->key != 3);
+            ++total;
+        }
+    }
+    ASSERT_EQ(29, total);
+    ASSERT_EQ(&items[27].hlink, buckets[3].first() );
+}
+
+TEST(ut_low_intrusive, rb_tree) {
+    using namespace z;
+
+    const int N = 2000;
+    std::vector<Item> items(N);
+    std::set<int> ref;
+    ZRBTree<ItemLess> t;
+    uint32_t seed = 7;
+    for (int i = 0; i < N; ++i) {
+        seed = seed * 1103515245 + 12345;
+        items[i].key = int(seed >> 16) % 5000;
+        bool fresh = ref.insert(items[i].key).second;
+        ZRBNode *r = t.insert(&items[i].rb);
+        ASSERT_EQ(fresh, r == &items[i].rb);
+        if (!fresh) {
+            ASSERT_EQ(items[i].key, Z_FIND_OBJ_BY_MEMBER(Item, rb, r)->key);
+        }
+    }
+    ASSERT_EQ(ref.size(), t.size() );
+    ASSERT_GT(rb_check(rb_root(t.first() ), nullptr), 0);
+
+    // in order, both ways
+    std::set<int>::iterator it = ref.begin();
+    for (ZRBNode *n = t.first(); n; n = t.next(n), ++it) {
+        ASSERT_EQ(*it, Z_FIND_OBJ_BY_MEMBER(Item, rb, n)->key);
+    }
+    ASSERT_TRUE(it == ref.end() );
+    ASSERT_EQ(*ref.rbegin(), Z_FIND_OBJ_BY_MEMBER(Item, rb, t.last() )->key);
+    ASSERT_EQ(*++ref.rbegin(), Z_FIND_OBJ_BY_MEMBER(Item, rb, t.prev(t.last() ) )->key);
+
+    Item probe;
+    for (int k = -1; k <= 5000; k += 7) {
+        probe.key = k;
+        ZRBNode *f = t.find(&probe.rb);
+        ASSERT_EQ(ref.count(k) > 0, nullptr != f);
+        ZRBNode *lb = t.lower_bound(&probe.rb);
+        std::set<int>::iterator rlb = ref.lower_bound(k);
+        if (rlb == ref.end() ) {
+            ASSERT_EQ(nullptr, lb);
+        } else {
+            ASSERT_EQ(*rlb, Z_FIND_OBJ_BY_MEMBER(Item, rb, lb)->key);
+        }
+    }
+
+    // erase the linked half of the nodes, checking the rules as we go
+    for (int i = 0; i < N; i += 2) {
+        probe.key = items[i].key;
+        ZRBNode *n = t.find(&probe.rb);
+        if (n) {
+            t.erase(n);
+            ref.erase(probe.key);
+        }
+        ASSERT_GT(rb_check(rb_root(t.first() ), nullptr), 0);
+    }
+    ASSERT_EQ(ref.size(), t.size() );
+    it = ref.begin();
+    for (ZRBNode *n = t.first(); n; n = t.next(n), ++it) {
+        ASSERT_EQ(*it, Z_FIND_OBJ_BY_MEMBER(Item, rb, n)->key);
+    }
+
+    while (!t.isEmpty() ) {
+        t.erase(t.first() );
+    }
+    ASSERT_EQ(0u, t.size() );
+    ASSERT_EQ(nullptr, t.first() );
+}
+#endif
@@ -0,0 +1,249 @@
+#ifndef Z_ALGO_INTRUSIVE_H__
+#define Z_ALGO_INTRUSIVE_H__
+
+/**
+ * @brief Intrusive containers: the links live in the objects, the containers
+ *        never allocate, and an object unlinks itself in O(1).
+ *
+ * Embed a ZListNode, ZHListNode or ZRBNode in the owner, link the node, and
+ * find the owner back with Z_FIND_OBJ_BY_MEMBER:
+ *
+ *     struct Conn { int fd; ZListNode link; };
+ *     for (ZListNode *n = list.first(); n; n = list.next(n) ) {
+ *         Conn *c = Z_FIND_OBJ_BY_MEMBER(Conn, link, n);
+ *     }
+ *
+ * The containers do not own the objects and are not thread safe.
+ */
+
+#include "def.h"
+#include <stdint.h>
+
+namespace z {
+;
+
+/// a node of a ZList, unlinked while next is null
+struct ZListNode {
+    ZListNode   *prev;
+    ZListNode   *next;
+
+    ZListNode() : prev(nullptr), next(nullptr) {}
+    bool linked() const {return nullptr != next; }
+};
+
+/// a circular doubly-linked list around a sentinel node
+class ZList {
+private:
+    Z_DECLARE_COPY_FUNCTIONS(ZList);
+public:
+    ZList() : _size(0) {_head.prev = _head.next = &_head; }
+
+    bool isEmpty() const {return _head.next == &_head; }
+    uint32_t size() const {return _size; }
+
+    ZListNode* first() const {return isEmpty() ? nullptr : _head.next; }
+    ZListNode* last() const {return isEmpty() ? nullptr : _head.prev; }
+    ZListNode* next(const ZListNode *n) const {return (n->next == &_head) ? nullptr : n->next; }
+    ZListNode* prev(const ZListNode *n) const {return (n->prev == &_head) ? nullptr : n->prev; }
+
+    void push_front(ZListNode *n) {link(n, &_head, _head.next); }
+    void push_back(ZListNode *n) {link(n, _head.prev, &_head); }
+    /// link n right before pos, a node of this list
+    void insert_before(ZListNode *pos, ZListNode *n) {link(n, pos->prev, pos); }
+
+    /// n must be linked into this list
+    void erase(ZListNode *n) {
+        n->prev->next = n->next;
+        n->next->prev = n->prev;
+        n->prev = n->next = nullptr;
+        --_size;
+    }
+    ZListNode* pop_front() {
+        ZListNode *n = first();
+        if (n) {
+            erase(n);
+        }
+        return n;
+    }
+    ZListNode* pop_back() {
+        ZListNode *n = last();
+        if (n) {
+            erase(n);
+        }
+        return n;
+    }
+    /// move every node of other to the back of this list
+    void splice_back(ZList *other) {
+        Z_RET_IF(other->isEmpty(), );
+        other->_head.next->prev = _head.prev;
+        _head.prev->next = other->_head.next;
+        other->_head.prev->next = &_head;
+        _head.prev = other->_head.prev;
+        _size += other->_size;
+        other->_head.prev = other->_head.next = &other->_head;
+        other->_size = 0;
+    }
+private:
+    void link(ZListNode *n, ZListNode *prev, ZListNode *next) {
+        n->prev = prev;
+        n->next = next;
+        prev->next = n;
+        next->prev = n;
+        ++_size;
+    }
+private:
+    ZListNode   _head;
+    uint32_t    _size;
+};
+
+/// a node of a ZHList, unlinked while pprev is null
+struct ZHListNode {
+    ZHListNode  *next;
+    ZHListNode  **pprev;    ///< the pointer pointing at this node
+
+    ZHListNode() : next(nullptr), pprev(nullptr) {}
+    bool linked() const {return nullptr != pprev; }
+};
+
+/**
+ * @brief A singly-linked list with a one pointer head, for hash buckets.
+ *        pprev still lets a node unlink itself in O(1) without the head.
+ */
+struct ZHList {
+    ZHListNode  *head;
+
+    ZHList() : head(nullptr) {}
+
+    bool isEmpty() const {return nullptr == head; }
+    ZHListNode* first() const {return head; }
+    static ZHListNode* next(const ZHListNode *n) {return n->next; }
+
+    void push_front(ZHListNode *n) {
+        n->next = head;
+        if (head) {
+            head->pprev = &n->next;
+        }
+        head = n;
+        n->pprev = &head;
+    }
+    static void erase(ZHListNode *n) {
+        *n->pprev = n->next;
+        if (n->next) {
+            n->next->pprev = n->pprev;
+        }
+        n->next = nullptr;
+        n->pprev = nullptr;
+    }
+};
+
+/// a node of a ZRBTree
+struct ZRBNode {
+    ZRBNode     *parent;
+    ZRBNode     *left;
+    ZRBNode     *right;
+    uint32_t    red;
+
+    ZRBNode() : parent(nullptr), left(nullptr), right(nullptr), red(0) {}
+};
+
+/**
+ * @brief The non-template half of ZRBTree: rebalancing after a node is
+ *        linked as a leaf, unlinking, and in-order walking.
+ */
+void zrb_insert_fixup(ZRBNode **root, ZRBNode *n);
+void zrb_erase(ZRBNode **root, ZRBNode *n);
+ZRBNode* zrb_first(const ZRBNode *root);
+ZRBNode* zrb_last(const ZRBNode *root);
+ZRBNode* zrb_next(const ZRBNode *n);
+ZRBNode* zrb_prev(const ZRBNode *n);
+
+/**
+ * @brief A red-black tree of unique keys. LESS compares two nodes, usually
+ *        by looking at their owners:
+ *
+ *     struct ConnLess {
+ *         bool operator()(const ZRBNode *a, const ZRBNode *b) const {
+ *             return Z_FIND_OBJ_BY_MEMBER(Conn, rb, a)->fd < Z_FIND_OBJ_BY_MEMBER(Conn, rb, b)->fd;
+ *         }
+ *     };
+ *
+ * Lookups take a probe node, embedded in a stack object holding the key.
+ */
+template <typename LESS>
+    class ZRBTree {
+    private:
+        Z_DECLARE_COPY_FUNCTIONS(ZRBTree);
+    public:
+        ZRBTree() : _root(nullptr), _size(0) {}
+
+        bool isEmpty() const {return nullptr == _root; }
+        uint32_t size() const {return _size; }
+
+        /// @return n, or the node already holding an equal key (n is not linked)
+        ZRBNode* insert(ZRBNode *n);
+        /// n must be linked into this tree
+        void erase(ZRBNode *n) {zrb_erase(&_root, n); --_size; }
+        ZRBNode* find(const ZRBNode *probe) const;
+        /// the first node not less than probe
+        ZRBNode* lower_bound(const ZRBNode *probe) const;
+
+        ZRBNode* first() const {return zrb_first(_root); }
+        ZRBNode* last() const {return zrb_last(_root); }
+        static ZRBNode* next(const ZRBNode *n) {return zrb_next(n); }
+        static ZRBNode* prev(const ZRBNode *n) {return zrb_prev(n); }
+    private:
+        ZRBNode     *_root;
+        uint32_t    _size;
+        LESS        _less;
+    };
+
+// ------------------------------------------------------------------------ //
+
+template <typename LESS>
+    ZRBNode* ZRBTree<LESS>::insert(ZRBNode *n) {
+        ZRBNode *parent = nullptr;
+        ZRBNode **link = &_root;
+        while (*link) {
+            parent = *link;
+            if (_less(n, parent) ) {
+                link = &parent->left;
+            } else if (_less(parent, n) ) {
+                link = &parent->right;
+            } else {
+                return parent;
+            }
+        }
+
+        n->parent = parent;
+        n->left = n->right = nullptr;
+        n->red = 1;
+        *link = n;
+        zrb_insert_fixup(&_root, n);
+        ++_size;
+        return n;
+    }
+
+template <typename LESS>
+    ZRBNode* ZRBTree<LESS>::find(const ZRBNode *probe) const {
+        ZRBNode *n = lower_bound(probe);
+        return (n && !_less(probe, n) ) ? n : nullptr;
+    }
+
+template <typename LESS>
+    ZRBNode* ZRBTree<LESS>::lower_bound(const ZRBNode *probe) const {
+        ZRBNode *n = _root;
+        ZRBNode *found = nullptr;
+        while (n) {
+            if (_less(n, probe) ) {
+                n = n->right;
+            } else {
+                found = n;
+                n = n->left;
+            }
+        }
+        return found;
+    }
+
+} // namespace z
+
+#endif
@@ -0,0 +1,437 @@
+#include "algo_sketch.h"
+#include <math.h>
+#include <algorithm>
+#include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace z {
+;
+
+/// dst[i] = max(dst[i], src[i]), a register merge
+static void max_bytes(uint8_t *dst, const uint8_t *src, size_t n) {
+    size_t i = 0;
+#ifdef __AVX2__
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(dst + i) );
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + i) );
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_max_epu8(a, b) );
+    }
+#endif
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(dst + i) );
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + i) );
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_max_epu8(a, b) );
+    }
+    for (; i < n; ++i) {
+        dst[i] = std::max(dst[i], src[i]);
+    }
+}
+
+HyperLogLog::HyperLogLog(uint32_t precision)
+: _p(std::min(std::max(precision, uint32_t(MIN_PRECISION) ), uint32_t(MAX_PRECISION) ) ) {
+}
+
+void HyperLogLog::add_sparse(uint32_t idx, uint8_t rank) {
+    _pending.push_back(entry(idx, rank) );
+    Z_RET_IF(_pending.size() < PENDING, );
+    compact();
+    if (_sparse.size() * sizeof(uint32_t) >= (size_t(1) << _p) ) {
+        to_dense();
+    }
+}
+
+/// fold the pending entries into the sorted list, the highest rank wins
+void HyperLogLog::compact() const {
+    Z_RET_IF(_pending.empty(), );
+    std::sort(_pending.begin(), _pending.end() );
+    std::vector<uint32_t> all(_sparse.size() + _pending.size() );
+    std::merge(_sparse.begin(), _sparse.end(), _pending.begin(), _pending.end(), all.begin() );
+    _pending.clear();
+
+    // of the entries of one register, the last has the highest rank
+    size_t n = 0;
+    for (size_t i = 0; i < all.size(); ++i) {
+        if (i + 1 < all.size() && (all[i] >> 6) == (all[i + 1] >> 6) ) {
+            continue;
+        }
+        all[n++] = all[i];
+    }
+    all.resize(n);
+    _sparse.swap(all);
+}
+
+void HyperLogLog::to_dense() {
+    compact();
+    _dense.assign(size_t(1) << _p, 0);
+    for (size_t i = 0; i < _sparse.size(); ++i) {
+        _dense[_sparse[i] >> 6] = uint8_t(_sparse[i] & 63);
+    }
+    std::vector<uint32_t>().swap(_sparse);
+    std::vector<uint32_t>().swap(_pending);
+}
+
+/**
+ * Ertl, "New cardinality estimation algorithms for HyperLogLog sketches":
+ * sigma() and tau() fold the registers stuck at 0 and at the maximum into
+ * the harmonic mean, which is what linear counting and the range
+ * corrections patch up in the original estimator.
+ */
+static double hll_sigma(double x) {
+    double y = 1;
+    double z = x;
+    double last = 0;
+    do {
+        x *= x;
+        last = z;
+        z += x * y;
+        y += y;
+    } while (z != last);
+    return z;
+}
+
+static double hll_tau(double x) {
+    Z_RET_IF(x == 0 || x == 1, 0);
+    double y = 1;
+    double z = 1 - x;
+    double last = 0;
+    do {
+        x = ::sqrt(x);
+        last = z;
+        y *= 0.5;
+        z -= (1 - x) * (1 - x) * y;
+    } while (z != last);
+    return z / 3;
+}
+
+double HyperLogLog::estimate() const {
+    const uint32_t q = 64 - _p;
+    const double m = double(uint64_t(1) << _p);
+    uint32_t hist[64 + 2] = {0};
+    if (_dense.empty() ) {
+        compact();
+        hist[0] = uint32_t( (size_t(1) << _p) - _sparse.size() );
+        for (size_t i = 0; i < _sparse.size(); ++i) {
+            ++hist[_sparse[i] & 63];
+        }
+    } else {
+        for (size_t i = 0; i < _dense.size(); ++i) {
+            ++hist[_dense[i]];
+        }
+    }
+    Z_RET_IF(hist[0] == uint32_t(m), 0);
+
+    double z = m * hll_tau(1 - hist[q + 1] / m);
+    for (uint32_t k = q; k >= 1; --k) {
+        z = 0.5 * (z + hist[k]);
+    }
+    z += m * hll_sigma(hist[0] / m);
+    return 0.5 / M_LN2 * m * m / z;
+}
+
+bool HyperLogLog::merge(const HyperLogLog &other) {
+    Z_RET_IF(other._p != _p, false);
+    if (other._dense.empty() ) {
+        other.compact();
+        for (size_t i = 0; i < other._sparse.size(); ++i) {
+            uint32_t e = other._sparse[i];
+            if (_dense.empty() ) {
+                add_sparse(e >> 6, uint8_t(e & 63) );
+            } else {
+                _dense[e >> 6] = std::max(_dense[e >> 6], uint8_t(e & 63) );
+            }
+        }
+        return true;
+    }
+
+    if (_dense.empty() ) {
+        to_dense();
+    }
+    max_bytes(&_dense[0], &other._dense[0], _dense.size() );
+    return true;
+}
+
+void HyperLogLog::clear() {
+    std::vector<uint8_t>().swap(_dense);
+    std::vector<uint32_t>().swap(_sparse);
+    std::vector<uint32_t>().swap(_pending);
+}
+
+// ------------------------------------------------------------------------ //
+
+CountMinSketch::CountMinSketch(double epsilon, double delta) : _mask(0), _depth(1), _total(0) {
+    epsilon = (epsilon > 0 && epsilon < 1) ? epsilon : 0.0001;
+    delta = (delta > 0 && delta < 1) ? delta : 0.01;
+    uint64_t width = 16;
+    while (width < uint64_t(::ceil(M_E / epsilon) ) && width < (uint64_t(1) << 30) ) {
+        width *= 2;
+    }
+    _mask = uint32_t(width - 1);
+    _depth = uint32_t(::ceil(::log(1 / delta) ) );
+    _depth = std::min(std::max(_depth, 1u), uint32_t(MAX_DEPTH) );
+    _counters.assign(size_t(width) * _depth, 0);
+}
+
+uint32_t CountMinSketch::add_hash(uint64_t h, uint32_t count) {
+    uint32_t *pos[MAX_DEPTH];
+    uint32_t a = uint32_t(h);
+    uint32_t b = h2(h);
+    uint32_t min = 0xFFFFFFFF;
+    for (uint32_t i = 0; i < _depth; ++i, a += b) {
+        pos[i] = &_counters[size_t(i) * (_mask + 1) + (a & _mask)];
+        min = std::min(min, *pos[i]);
+    }
+
+    // conservative update: no counter is raised past the new estimate
+    uint32_t v = (min > 0xFFFFFFFF - count) ? 0xFFFFFFFF : min + count;
+    for (uint32_t i = 0; i < _depth; ++i) {
+        if (*pos[i] < v) {
+            *pos[i] = v;
+        }
+    }
+    _total += count;
+    return v;
+}
+
+uint32_t CountMinSketch::estimate_hash(uint64_t h) const {
+    uint32_t a = uint32_t(h);
+    uint32_t b = h2(h);
+    uint32_t min = 0xFFFFFFFF;
+    for (uint32_t i = 0; i < _depth; ++i, a += b) {
+        min = std::min(min, _counters[size_t(i) * (_mask + 1) + (a & _mask)]);
+    }
+    return min;
+}
+
+/// saturating sums, counters of the two sketches still bound the counts
+bool CountMinSketch::merge(const CountMinSketch &other) {
+    Z_RET_IF(other._mask != _mask || other._depth != _depth, false);
+    uint32_t *dst = &_counters[0];
+    const uint32_t *src = &other._counters[0];
+    for (size_t i = 0; i < _counters.size(); ++i) {
+        uint32_t s = dst[i] + src[i];
+        dst[i] = (s < dst[i]) ? 0xFFFFFFFF : s;
+    }
+    _total += other._total;
+    return true;
+}
+
+void CountMinSketch::clear() {
+    std::fill(_counters.begin(), _counters.end(), 0);
+    _total = 0;
+}
+
+// ------------------------------------------------------------------------ //
+
+HeavyHitters::HeavyHitters(uint32_t k, double epsilon, double delta)
+: _cms(epsilon, delta), _k(k ? k : 1), _index(2 * (k ? k : 1) ) {
+    _heap.reserve(_k);
+}
+
+uint32_t HeavyHitters::add(const void *key, size_t len, uint32_t count) {
+    uint64_t h = hash_bytes64(key, len);
+    uint32_t est = _cms.add_hash(h, count);
+    // a key in the heap has an estimate of at least the minimum
+    if (_heap.size() == _k && est <= _heap[0].count) {
+        return est;
+    }
+
+    uint32_t i = 0;
+    if (_index.find(h, &i) ) {
+        _heap[i].count = est;
+        sift_down(i);
+        return est;
+    }
+
+    if (_heap.size() < _k) {
+        Item item;
+        item.key.assign((const char*)(key), len);
+        item.hash = h;
+        item.count = est;
+        _heap.push_back(item);
+        _index.insert(h, uint32_t(_heap.size() - 1) );
+        sift_up(uint32_t(_heap.size() - 1) );
+    } else {
+        _index.erase(_heap[0].hash);
+        _heap[0].key.assign((const char*)(key), len);
+        _heap[0].hash = h;
+        _heap[0].count = est;
+        _index.insert(h, 0);
+        sift_down(0);
+    }
+    return est;
+}
+
+void HeavyHitters::top(std::vector<Item> *out) const {
+    Z_RET_IF_ANY_ZERO_1(out, );
+    *out = _heap;
+    std::sort(out->begin(), out->end(), [](const Item &a, const Item &b) {return a.count > b.count; });
+}
+
+void HeavyHitters::clear() {
+    _cms.clear();
+    _heap.clear();
+    _index.clear();
+}
+
+void HeavyHitters::sift_down(uint32_t i) {
+    uint32_t n = uint32_t(_heap.size() );
+    for (;;) {
+        uint32_t l = 2 * i + 1;
+        uint32_t r = l + 1;
+        uint32_t m = i;
+        if (l < n && _heap[l].count < _heap[m].count) {
+            m = l;
+        }
+        if (r < n && _heap[r].count < _heap[m].count) {
+            m = r;
+        }
+        Z_RET_IF(m == i, );
+        swap_items(i, m);
+        i = m;
+    }
+}
+
+void HeavyHitters::sift_up(uint32_t i) {
+    while (i > 0) {
+        uint32_t p = (i - 1) / 2;
+        Z_RET_IF(_heap[p].count <= _heap[i].count, );
+        swap_items(i, p);
+        i = p;
+    }
+}
+
+void HeavyHitters::swap_items(uint32_t a, uint32_t b) {
+    std::swap(_heap[a], _heap[b]);
+    _index.update(_heap[a].hash, a);
+    _index.update(_heap[b].hash, b);
+}
+
+} // namespace z
+
+#if Z_COMPILE_FLAG_ENABLE_UT
+#include <gtest/gtest.h>
+#include <map>
+
+TEST(ut_low_sketch, hyper_log_log) {
+    using namespace z;
+
+    // within 4 standard errors over small and large counts, sparse then dense
+    const uint64_t counts[] = {0, 1, 10, 100, 1000, 5000, 20000, 100000, 1000000};
+    HyperLogLog h;
+    uint64_t added = 0;
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+        for (; added < counts[c]; ++added) {
+            h.add(&added, sizeof(added) );
+            h.add(&added, sizeof(added) );
+        }
+        double err = 4 * 1.04 / ::sqrt(16384.0);
+        EXPECT_NEAR(double(counts[c]), h.estimate(), counts[c] * err + 1) << counts[c];
+        if (counts[c] <= 1000) {
+            EXPECT_TRUE(h.sparse() ) << counts[c];
+        }
+    }
+    EXPECT_FALSE(h.sparse() );
+    EXPECT_EQ(16384u, h.bytes() );
+
+    // merges: sparse into sparse, sparse into dense, dense into dense
+    HyperLogLog a;
+    HyperLogLog b;
+    HyperLogLog big;
+    for (uint64_t i = 0; i < 2000; ++i) {
+        a.add(&i, sizeof(i) );
+    }
+    for (uint64_t i = 1000; i < 3000; ++i) {
+        b.add(&i, sizeof(i) );
+    }
+    for (uint64_t i = 0; i < 200000; ++i) {
+        big.add(&i, sizeof(i) );
+    }
+    ASSERT_TRUE(a.merge(b) );
+    EXPECT_NEAR(3000.0, a.estimate(), 3000 * 0.04);
+    ASSERT_TRUE(big.merge(a) );
+    EXPECT_NEAR(200000.0, big.estimate(), 200000 * 0.04);
+    ASSERT_TRUE(a.merge(big) );
+    EXPECT_FALSE(a.sparse() );
+    EXPECT_NEAR(big.estimate(), a.estimate(), 1e-6);
+    HyperLogLog other(10);
+    ASSERT_FALSE(a.merge(other) );
+
+    a.clear();
+    EXPECT_TRUE(a.sparse() );
+    EXPECT_EQ(0, a.estimate() );
+}
+
+TEST(ut_low_sketch, count_min) {
+    using namespace z;
+
+    CountMinSketch cms(0.001, 0.01);
+    EXPECT_EQ(4096u, cms.width() );
+    EXPECT_EQ(5u, cms.depth() );
+
+    // key i is added i % 100 + 1 times: estimates never fall short, and
+    // stay within epsilon * total
+    std::map<uint64_t, uint32_t> truth;
+    for (uint64_t i = 0; i < 20000; ++i) {
+        uint32_t n = uint32_t(i % 100 + 1);
+        cms.add(&i, sizeof(i), n);
+        truth[i] = n;
+    }
+    uint32_t over = 0;
+    for (std::map<uint64_t, uint32_t>::iterator it = truth.begin(); it != truth.end(); ++it) {
+        uint32_t e = cms.estimate(&it->first, sizeof(it->first) );
+        ASSERT_GE(e, it->second);
+        over += (e - it->second > 0.001 * cms.total() ) ? 1 : 0;
+    }
+    EXPECT_LT(over, truth.size() / 100);
+
+    CountMinSketch half(0.001, 0.01);
+    uint64_t key = 7;
+    half.add(&key, sizeof(key), 10);
+    uint32_t before = cms.estimate(&key, sizeof(key) );
+    ASSERT_TRUE(cms.merge(half) );
+    EXPECT_EQ(before + 10, cms.estimate(&key, sizeof(key) ) );
+    CountMinSketch other(0.1, 0.01);
+    ASSERT_FALSE(cms.merge(other) );
+
+    // counters saturate
+    cms.add(&key, sizeof(key), 0xFFFFFFF0);
+    cms.add(&key, sizeof(key), 0x100);
+    EXPECT_EQ(0xFFFFFFFFu, cms.estimate(&key, sizeof(key) ) );
+    cms.clear();
+    EXPECT_EQ(0u, cms.estimate(&key, sizeof(key) ) );
+}
+
+TEST(ut_low_sketch, heavy_hitters) {
+    using namespace z;
+
+    // 10 heavy keys in a stream of 100000 rare ones
+    HeavyHitters hh(10, 0.0001, 0.01);
+    char key[32];
+    for (uint32_t round = 0; round < 100; ++round) {
+        for (uint32_t i = 0; i < 1000; ++i) {
+            int n = snprintf(key, sizeof(key), "rare-%u", round * 1000 + i);
+            hh.add(key, n);
+        }
+        for (uint32_t h = 0; h < 10; ++h) {
+            int n = snprintf(key, sizeof(key), "/uri/%u", h);
+            hh.add(key, n, h + 1);
+        }
+    }
+
+    std::vector<HeavyHitters::Item> top;
+    hh.top(&top);
+    ASSERT_EQ(10u, top.size() );
+    for (uint32_t i = 0; i < 10; ++i) {
+        char expect[32];
+        snprintf(expect, sizeof(expect), "/uri/%u", 9 - i);
+        EXPECT_EQ(std::string(expect), top[i].key);
+        EXPECT_GE(top[i].count, (10 - i) * 100);
+    }
+
+    hh.clear();
+    hh.top(&top);
+    EXPECT_TRUE(top.empty() );
+}
+#endif
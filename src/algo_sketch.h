@@ -0,0 +1,167 @@
+#ifndef Z_ALGO_SKETCH_H__
+#define Z_ALGO_SKETCH_H__
+
+/**
+ * @brief Streaming sketches in bounded memory, over hash_bytes64():
+ *        HyperLogLog counts distinct keys, CountMinSketch counts keys, and
+ *        HeavyHitters keeps the top K keys of a CountMinSketch.
+ *
+ * An update is one hash and a few stores into a structure sized at
+ * construction, cheap enough to run on every request. None of them is
+ * thread safe; keep one per thread and merge() them.
+ */
+
+#include "def.h"
+#include "algo_hash.h"
+#include "algo_ds.h"
+#include "thread.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace z {
+;
+
+/**
+ * @brief HyperLogLog with 2^precision one byte registers: a standard error
+ *        of 1.04 / sqrt(2^precision), 0.81% at the default 14.
+ *
+ * It starts sparse, a sorted list of the touched registers, and turns dense
+ * when the list would outgrow the registers. The estimate is Ertl's
+ * improved estimator over the register histogram, unbiased from small to
+ * large counts without empirical correction tables.
+ */
+class HyperLogLog {
+private:
+    Z_DECLARE_COPY_FUNCTIONS(HyperLogLog);
+public:
+    enum {
+        MIN_PRECISION       = 4,
+        MAX_PRECISION       = 18,
+        DEFAULT_PRECISION   = 14,
+    };
+
+    /// the precision is clamped into [MIN_PRECISION, MAX_PRECISION]
+    explicit HyperLogLog(uint32_t precision = DEFAULT_PRECISION);
+
+    void add_hash(uint64_t h) {
+        uint32_t idx = uint32_t(h >> (64 - _p) );
+        uint64_t w = h << _p;
+        uint8_t rank = uint8_t(w ? __builtin_clzll(w) + 1 : 64 - _p + 1);
+        if (!_dense.empty() ) {
+            if (_dense[idx] < rank) {
+                _dense[idx] = rank;
+            }
+        } else {
+            add_sparse(idx, rank);
+        }
+    }
+    void add(const void *key, size_t len) {add_hash(hash_bytes64(key, len) ); }
+
+    double estimate() const;
+    /// @retval false the precisions differ
+    bool merge(const HyperLogLog &other);
+    void clear();
+
+    uint32_t precision() const {return _p; }
+    bool sparse() const {return _dense.empty(); }
+    size_t bytes() const {return _dense.size() + (_sparse.size() + _pending.size() ) * sizeof(uint32_t); }
+private:
+    enum {
+        PENDING     = 256,      ///< sparse entries buffered before a sort
+    };
+
+    /// a sparse entry: idx << 6 | rank, sorting them sorts by register
+    static uint32_t entry(uint32_t idx, uint8_t rank) {return (idx << 6) | rank; }
+    void add_sparse(uint32_t idx, uint8_t rank);
+    void compact() const;
+    void to_dense();
+private:
+    uint32_t                        _p;
+    std::vector<uint8_t>            _dense;
+    mutable std::vector<uint32_t>   _sparse;    ///< sorted, a register at most once
+    mutable std::vector<uint32_t>   _pending;
+};
+
+/**
+ * @brief A count-min sketch of depth rows of width counters: a count is
+ *        overestimated by at most epsilon * total with probability
+ *        1 - delta, for width = e / epsilon and depth = ln(1 / delta).
+ *
+ * Updates are conservative, only the counters at the minimum grow, which
+ * cuts the overestimate without breaking the bound. Counters saturate at
+ * 2^32 - 1; clear() per window.
+ */
+class CountMinSketch {
+private:
+    Z_DECLARE_COPY_FUNCTIONS(CountMinSketch);
+public:
+    CountMinSketch(double epsilon = 0.0001, double delta = 0.01);
+
+    /// @return the new estimate of the key
+    uint32_t add_hash(uint64_t h, uint32_t count = 1);
+    uint32_t estimate_hash(uint64_t h) const;
+    uint32_t add(const void *key, size_t len, uint32_t count = 1) {return add_hash(hash_bytes64(key, len), count); }
+    uint32_t estimate(const void *key, size_t len) const {return estimate_hash(hash_bytes64(key, len) ); }
+
+    /// @retval false the shapes differ
+    bool merge(const CountMinSketch &other);
+    void clear();
+
+    uint32_t width() const {return _mask + 1; }
+    uint32_t depth() const {return _depth; }
+    uint64_t total() const {return _total; }
+private:
+    enum {
+        MAX_DEPTH   = 16,
+    };
+
+    /// double hashing: row i uses h1 + i * h2
+    static uint32_t h2(uint64_t h) {return uint32_t(h >> 32) | 1; }
+private:
+    std::vector<uint32_t>   _counters;      ///< depth rows of width
+    uint32_t                _mask;
+    uint32_t                _depth;
+    uint64_t                _total;
+};
+
+/**
+ * @brief The k most frequent keys by the estimates of a CountMinSketch.
+ *
+ * The candidates are a min-heap on the estimate, indexed by key hash. A key
+ * whose estimate does not pass the heap minimum cannot be in the heap, so
+ * most updates cost one sketch update and one compare.
+ */
+class HeavyHitters {
+private:
+    Z_DECLARE_COPY_FUNCTIONS(HeavyHitters);
+public:
+    struct Item {
+        std::string     key;
+        uint64_t        hash;
+        uint32_t        count;
+    };
+
+    HeavyHitters(uint32_t k, double epsilon = 0.0001, double delta = 0.01);
+
+    /// @return the estimate of the key
+    uint32_t add(const void *key, size_t len, uint32_t count = 1);
+    /// the top keys, by estimate in descending order
+    void top(std::vector<Item> *out) const;
+    void clear();
+
+    const CountMinSketch& sketch() const {return _cms; }
+private:
+    void sift_down(uint32_t i);
+    void sift_up(uint32_t i);
+    void swap_items(uint32_t a, uint32_t b);
+private:
+    CountMinSketch          _cms;
+    uint32_t                _k;
+    std::vector<Item>       _heap;
+    HashTable64<uint32_t>   _index;     ///< key hash -> heap position
+};
+
+} // namespace z
+
+#endif
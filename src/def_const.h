@@ -12,6 +12,7 @@ enum DEF_CONST_ENUM {
     DEF_SIZE_LINE           = 1024,
     DEF_SIZE_LONG_PAGE      = 64 * 1024,
     DEF_SIZE_LONG_LINE      = 4 * 1024,
+    DEF_SIZE_CACHE_LINE     = 64,
     
     // bit in a byte
     BYTE_B0   = 0x01u,
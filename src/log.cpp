@@ -3,6 +3,7 @@
 #include "mem.h"
 #include "thread.h"
 #include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
@@ -43,7 +44,7 @@ private:
     static void* log_thread_main(void *controller);
 private:
     typedef z::BytesQueue               queue_t;
-    typedef z::ZSpinLock                lock_t;
+    typedef z::ZAdaptiveLock            lock_t;   ///< held across write(2)
     
     struct log_device_t {
         std::string file;
@@ -121,7 +122,9 @@ commit(zlog_level_t log_level, const char *log_msg, size_t log_length) {
         }
 
         if (pdev->msg.in_size() < log_length ) {
+            // full: let the log thread drain it
             pdev->lock.unlock();
+            ::sched_yield();
             continue;
         }
         memcpy(pdev->msg.in_pos(), log_msg, log_length);
@@ -240,7 +243,7 @@ log_thread_main(void *controller) {
     uint32_t bytes = 0;
     while (!this_ptr->_flag_exit) {
         bytes = 0;
-        for (int i = LOG_LEVEL_BEGIN; i <= LOG_LEVEL_END; ++i) {
+        for (int i = LOG_LEVEL_BEGIN; i < LOG_LEVEL_END; ++i) {
             bytes += this_ptr->write_log_for_level(zlog_level_t(i) );
         }
 
@@ -252,7 +255,7 @@ log_thread_main(void *controller) {
 
     do {
         bytes = 0;
-        for (int i = LOG_LEVEL_BEGIN; i <= LOG_LEVEL_END; ++i) {
+        for (int i = LOG_LEVEL_BEGIN; i < LOG_LEVEL_END; ++i) {
             bytes += this_ptr->write_log_for_level(zlog_level_t(i) );
         }
     } while (bytes);
@@ -1,4 +1,6 @@
 #include "mem_buffer.h"
+#include "algo_hash.h"
+#include "algo_crc.h"
 #include <algorithm>
 #include <string.h>
 
@@ -276,6 +278,26 @@ block_ref(void **buf, uint32_t *bytes) {
                 (_w_pos.offset - _r_pos.offset) : ( _block_data_size - _r_pos.offset);
 }
 
+void RWBuffer::
+visit(block_visitor_t visitor, void *arg) const {
+    Z_RET_IF_ANY_ZERO_1(visitor, );
+
+    BufferOffset pos = _r_pos;
+    uint32_t left = _data_size;
+    while (left > 0 && pos.block) {
+        uint32_t bytes = (pos.block == _w_pos.block) ?
+                    (_w_pos.offset - pos.offset) : (_block_data_size - pos.offset);
+        bytes = std::min(bytes, left);
+        if (bytes > 0) {
+            visitor(pos.block->data + pos.offset, bytes, arg);
+        }
+
+        left -= bytes;
+        pos.block = pos.block->next;
+        pos.offset = 0;
+    }
+}
+
 RWBuffer::
 BufferBlock *RWBuffer::make_new_block() {
     if (_mempool) {
@@ -297,6 +319,37 @@ release_block(BufferBlock *block) {
     }
 }
 
+static void rwbuffer_hash_block(const void *buf, uint32_t bytes, void *hasher) {
+    ((StreamHasher*)(hasher))->update(buf, bytes);
+}
+
+static void rwbuffer_copy_block(const void *buf, uint32_t bytes, void *dst) {
+    uint8_t **p = (uint8_t**)(dst);
+    ::memcpy(*p, buf, bytes);
+    *p += bytes;
+}
+
+uint64_t rwbuffer_hash64(const RWBuffer &buf, uint64_t seed) {
+    if (0 == seed && buf.data_size() <= sizeof(uint64_t) ) {
+        uint64_t hv = 0;
+        uint8_t *p = (uint8_t*)(&hv);
+        buf.visit(rwbuffer_copy_block, &p);
+        return hv;
+    }
+    StreamHasher hasher(seed);
+    buf.visit(rwbuffer_hash_block, &hasher);
+    return hasher.finalize();
+}
+
+static void rwbuffer_crc_block(const void *buf, uint32_t bytes, void *crc) {
+    *(uint32_t*)(crc) = crc32c(buf, bytes, *(uint32_t*)(crc) );
+}
+
+uint32_t rwbuffer_crc32c(const RWBuffer &buf, uint32_t crc) {
+    buf.visit(rwbuffer_crc_block, &crc);
+    return crc;
+}
+
 BytesQueue::
 BytesQueue(uint32_t bytes) {
     void *buf = ::malloc(bytes);
@@ -480,6 +533,55 @@ TEST(ut_low_mem, rwbuffer_block_ref_and_skip) {
     ASSERT_EQ(0, memcmp(req, res, DSIZE) );
 }
 
+TEST(ut_low_mem, rwbuffer_hash64) {
+    using namespace z;
+
+    RWBuffer io(nullptr, 256);
+    const uint32_t DSIZE = 10 * 1024;
+    char req[DSIZE];
+    for (uint32_t i = 0; i < DSIZE; ++i) {
+        req[i] = char(i * 13);
+    }
+
+    EXPECT_EQ(hash_bytes64(req, 0, 5), rwbuffer_hash64(io, 5) );
+    EXPECT_EQ(hash64(req, 0), rwbuffer_hash64(io) );
+
+    // short data as hash64(): the bytes themselves with seed 0, wherever
+    // the blocks split them
+    for (uint32_t i = 0; i < 1000; ++i) {
+        uint32_t n = i % 10;
+        ASSERT_EQ(n, io.write(req + i, n) );
+        EXPECT_EQ(hash64(req + i, n), rwbuffer_hash64(io) ) << i;
+        EXPECT_EQ(hash64(req + i, n, 5), rwbuffer_hash64(io, 5) ) << i;
+        ASSERT_EQ(n, io.skip(n) );
+    }
+
+    ASSERT_EQ(DSIZE, io.write(req, DSIZE) );
+    EXPECT_EQ(hash_bytes64(req, DSIZE, 5), rwbuffer_hash64(io, 5) );
+
+    // partly consumed, the read position is in the middle of a block
+    ASSERT_EQ(1000, io.skip(1000) );
+    EXPECT_EQ(hash_bytes64(req + 1000, DSIZE - 1000), rwbuffer_hash64(io) );
+    EXPECT_EQ(hash64(req + 1000, DSIZE - 1000), rwbuffer_hash64(io) );
+    EXPECT_EQ(DSIZE - 1000, io.data_size() );
+}
+
+TEST(ut_low_mem, rwbuffer_crc32c) {
+    using namespace z;
+
+    RWBuffer io(nullptr, 256);
+    const uint32_t DSIZE = 10 * 1024;
+    char req[DSIZE];
+    for (uint32_t i = 0; i < DSIZE; ++i) {
+        req[i] = char(i * 17);
+    }
+
+    ASSERT_EQ(DSIZE, io.write(req, DSIZE) );
+    ASSERT_EQ(333, io.skip(333) );
+    EXPECT_EQ(crc32c(req + 333, DSIZE - 333), rwbuffer_crc32c(io) );
+    EXPECT_EQ(crc32c(req + 333, DSIZE - 333, 9), rwbuffer_crc32c(io, 9) );
+}
+
 TEST(ut_low_mem, bytes_queue) {
     using namespace z::low::mem;
     const uint32_t BUFSIZE = 64;
@@ -48,6 +48,10 @@ protected:
 
 
 class RWBuffer {
+public:
+    /// called for each readable span, in order. @see visit()
+    typedef void (*block_visitor_t)(const void *buf, uint32_t bytes, void *arg);
+private:
     struct BufferBlock {
         BufferBlock     *next;
         char            data[];
@@ -70,6 +74,9 @@ public:
 
     void block_read(void **buf, uint32_t *bytes);
     void block_ref(void **buf, uint32_t *bytes);
+
+    /// walk the readable data block by block, in place. Nothing is consumed.
+    void visit(block_visitor_t visitor, void *arg) const;
 private:
     BufferBlock* make_new_block();
     void release_block(BufferBlock *block);
@@ -83,6 +90,13 @@ private:
     uint32_t        _own_mempool:1;
 };
 
+/// hash64() of the readable data, same value as hash64() of a flat copy of it:
+/// with seed 0, 8 bytes or less are the bytes themselves, as in fast_hash().
+uint64_t rwbuffer_hash64(const RWBuffer &buf, uint64_t seed = 0);
+
+/// crc32c of the readable data, extending `crc', without flattening it.
+uint32_t rwbuffer_crc32c(const RWBuffer &buf, uint32_t crc = 0);
+
 class BytesQueue {
 private:
     Z_DECLARE_COPY_FUNCTIONS(BytesQueue);
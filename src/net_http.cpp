@@ -1,7 +1,9 @@
 #include "net_http.h"
 #include "net_tcp.h"
+#include "algo_hash.h"
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 
 namespace z {
 ;
@@ -157,45 +159,49 @@ http_read_int(const char * buf, long * i_n_t)
  * @return @cite HTTPResponseHeaderEnum
  */
 static int http_check_response_header(const char * line, const char **end) {
-    char header[HTTP_HEADER_MAX_LEN] = {0};
     size_t header_len = 0;
 
-    // read the header string
-    for (header_len = 0; 
-         header_len < HTTP_HEADER_MAX_LEN && line[header_len];
-         ++header_len) {
-        if (' ' == line[header_len]) {
-            break;
-        }
-        header[header_len] = line[header_len];
-        if (header[header_len] >= 'a' && header[header_len] <= 'z') {
-            header[header_len] += ('A' - 'a');
-        }
+    // find the end of the header string
+    while (header_len < HTTP_HEADER_MAX_LEN
+           && line[header_len]
+           && ' ' != line[header_len]) {
+        ++header_len;
     }
-    header[header_len] = '\0';
     if (line[header_len]) {
         *end = &line[header_len+1];
     } else {
         *end = &line[header_len];
     }
 
-    // check header string
-    if (!strcmp("HTTP/1.0", header)) {
-        return HTTP_RHE_HTTP1_0;
-    } else
-    if (!strcmp("HTTP/1.1", header)) {
-        return HTTP_RHE_HTTP1_1;
-    } else
-    if (!strcmp("CONTENT-LENGTH:", header)) {
-        return HTTP_RHE_CONTENT_LENGTH;
-    } else
-    if (!strcmp("LOCATION:", header)) {
-        return HTTP_RHE_LOCATION;
-    } else {
-        ;
+    // dispatch on the hash, then verify the text once
+    int header = HTTP_RHE_NO_INSTEREST;
+    const char *expected = NULL;
+    switch (hash_str_ci(line, header_len) ) {
+    case "HTTP/1.0"_zh:
+        header = HTTP_RHE_HTTP1_0;
+        expected = "HTTP/1.0";
+        break;
+    case "HTTP/1.1"_zh:
+        header = HTTP_RHE_HTTP1_1;
+        expected = "HTTP/1.1";
+        break;
+    case "CONTENT-LENGTH:"_zh:
+        header = HTTP_RHE_CONTENT_LENGTH;
+        expected = "CONTENT-LENGTH:";
+        break;
+    case "LOCATION:"_zh:
+        header = HTTP_RHE_LOCATION;
+        expected = "LOCATION:";
+        break;
+    default:
+        return HTTP_RHE_NO_INSTEREST;
+    }
+
+    if (strlen(expected) != header_len || strncasecmp(expected, line, header_len) ) {
+        return HTTP_RHE_NO_INSTEREST;
     }
 
-    return HTTP_RHE_NO_INSTEREST;
+    return header;
 }
 
 
@@ -19,6 +19,7 @@ enum EPOLL_LOOP_CONF_ENUM {
 
 enum RPC_WORKER_CONF_ENUM {
     RPC_WORKER_IDLE_WAIT_MS         = 20,
+    RPC_WORKER_BATCH_SIZE           = 32,
 };
 
 enum EPOLL_LOOP_FD_TYPE_ENUM {
@@ -46,6 +47,9 @@ static int g_rpc_op_type[RPC_OP_LIMIT] = {
     RPC_IO_BIND,  // RPC_OP_CLOSE,
 };
 
+// set in the thread running rpc_run_service(), the producer of the task queues
+static __thread bool g_rpc_in_event_loop = false;
+
 struct rpc_worker_thread_arg_t {
     RPCServiceHandle    *service;
     uint32_t            thread_id;
@@ -90,6 +94,7 @@ int rpc_run_service(RPCServiceHandle *service) {
         return -2;
     }
     rpc_init_service(service, epoll);
+    g_rpc_in_event_loop = true;
     RPCTask *listen_task = rpc_build_task(service, service->listen_socket, RPC_EL_FD_LISTEN);
     if (NULL == listen_task) {
         ZLOG(LOG_FATAL, "Fail to build the listen task.");
@@ -143,15 +148,21 @@ int rpc_run_service(RPCServiceHandle *service) {
                 rpc_unknown_event(epoll, e[i]);
             }
         }
+
+        // tasks scheduled by this batch of events become visible at once
+        for (uint32_t i = 0; i < service->calc_thread; ++i) {
+            service->task_queue[i]->publish();
+        }
     }
+    g_rpc_in_event_loop = false;
 
     // stop the epoll
     rpc_unpoll_task(service, listen_task);
     rpc_destroy_task(service, listen_task);
-    close(epoll);
 
-    // deinit the service
+    // deinit the service, the links left are unpolled before the epoll goes
     rpc_deinit_service(service);
+    close(epoll);
 
     return 0;
 }
@@ -271,7 +282,7 @@ static void rpc_deinit_service(RPCServiceHandle *service) {
     if (service->calc_thread > 0) {
         for (uint32_t i = 0; i < service->calc_thread; ++i) {
             pthread_join(service->calc_thread_id[i], NULL);
-            delete [] service->task_queue[i];
+            delete service->task_queue[i];
         }
         delete [] service->task_queue;
         delete [] service->calc_thread_id;
@@ -282,6 +293,14 @@ static void rpc_deinit_service(RPCServiceHandle *service) {
         service->calc_thread_arg = NULL;
     }
 
+    // a forced exit leaves links open, the workers are gone so close them here
+    if (!service->links.isEmpty() ) {
+        ZLOG(LOG_INFO, "Close %u links left open.", service->links.size() );
+    }
+    while (!service->links.isEmpty() ) {
+        rpc_destroy_task(service, Z_FIND_OBJ_BY_MEMBER(RPCTask, link, service->links.first() ) );
+    }
+
     delete service->task_pool;
     service->task_pool = NULL;
 
@@ -305,7 +324,10 @@ static RPCTask* rpc_build_task(RPCServiceHandle *service, int fd, int fd_type) {
     t->dn           = 0;
     t->dptr         = 0;
 
+    service->link_lock.lock();
+    service->links.push_back(&t->link);
     ++service->link_count;
+    service->link_lock.unlock();
     return t;
 }
 
@@ -325,8 +347,11 @@ static void rpc_destroy_task(RPCServiceHandle *service, RPCTask *task) {
     task->dn = 0;
     task->dptr = 0;
 
-    service->task_pool->release(task);
+    service->link_lock.lock();
+    service->links.erase(&task->link);
     --service->link_count;
+    service->link_lock.unlock();
+    service->task_pool->release(task);
 }
 
 static int rpc_poll_task(RPCServiceHandle *service, RPCTask *task, int events) {
@@ -463,12 +488,26 @@ static int rpc_do_op(int op, RPCTask *task) {
                 target_queue_id, task->service->calc_thread);
             op_next = RPC_OP_ERR;
             task->op_next = op_next;
+            return op_next;
+        }
+        if (!g_rpc_in_event_loop) {
+            ZLOG(LOG_FATAL, "RPC_OP_SCHED out of the event loop thread, the task queues "
+                "have a single producer. [queue id: %d]", target_queue_id);
+            op_next = RPC_OP_ERR;
+            task->op_next = op_next;
+            return op_next;
         }
 
         op_next = RPC_OP_NOOP;
         task->op_next = RPC_OP_CALC;
         rpc_unpoll_task(task->service, task);
-        task->service->task_queue[target_queue_id]->enqueue(task);
+        if (!task->service->task_queue[target_queue_id]->enqueue_deferred(task) ) {
+            // already unpolled: the error path closes it and frees the task
+            ZLOG(LOG_WARN, "Task queue [%d] is full, the task fails. [fd: %d]",
+                target_queue_id, task->fd);
+            op_next = RPC_OP_ERR;
+            task->op_next = op_next;
+        }
     } else {
         if (op_next >= RPC_OP_LIMIT || op_next < 0) {
             ZLOG(LOG_FATAL, "Incorrect op_next returned from op function. "
@@ -573,17 +612,20 @@ static void* rpc_worker_thread_main(void *arg_) {
     }
 
     RPCServiceHandle::task_queue_t *task_queue = service->task_queue[arg->thread_id];
-    while (! (service->flags & RPC_FLAG_FORCE_EXIT) ) {
-        RPCTask* task = NULL;
-        if (task_queue->dequeue(&task) ) {
-            if (task->type == RPC_EL_FD_END_FLAG) {
+    bool end = false;
+    while (!end && ! (service->flags & RPC_FLAG_FORCE_EXIT) ) {
+        RPCTask* tasks[RPC_WORKER_BATCH_SIZE];
+        uint32_t n = task_queue->dequeue_bulk(tasks, RPC_WORKER_BATCH_SIZE);
+        for (uint32_t i = 0; i < n; ++i) {
+            if (tasks[i]->type == RPC_EL_FD_END_FLAG) {
+                end = true;
                 break;
             }
 
-            rpc_do_op_rec(task->op_next, task);
+            rpc_do_op_rec(tasks[i]->op_next, tasks[i]);
         }
 
-        if (task_queue->isEmpty() ) {
+        if (0 == n) {
             zsleep_ms(RPC_WORKER_IDLE_WAIT_MS);
         }
     }
@@ -4,6 +4,7 @@
 #include "net.h"
 #include "mem.h"
 #include "algo_ds.h"
+#include "algo_intrusive.h"
 #include "thread.h"
 
 namespace z {
@@ -24,6 +25,7 @@ struct RPCTask {
     char                        buf[RPC_TMP_BUF_SIZE];
     uint64_t                    dn;             // user data of type int
     void                        *dptr;          // user data of type pointer
+    z::ZListNode                link;           // in RPCServiceHandle::links while built
 };
 
 enum RPC_SERVICE_NEXT_OP_ENUM {
@@ -61,14 +63,20 @@ enum RPC_GLOBAL_FLAGS_ENUM {
 
 struct RPCServiceHandle {
     typedef z::socket_fd_t                                  socket_fd_t;
-    typedef z::StaticLinkedList<RPCTask>                    task_pool_t;
-    typedef z::FixedLengthQueue<RPCTask*, z::ZSpinLock>     task_queue_t;
+    // tasks are built by the event loop and destroyed by any thread. The
+    // pool grows with the connections instead of holding link_max tasks.
+    typedef z::ObjectPool<RPCTask, z::ZSpinLock>            task_pool_t;
+    // the event loop is the only producer: RPC_OP_SCHED is refused on a
+    // worker thread, so a CALC op cannot hand a task to another worker
+    typedef z::SPSCQueue<RPCTask*>                          task_queue_t;
 
     socket_fd_t                 listen_socket;
     int                         epoll_fd;
     rpc_service_func_t          service_op[RPC_OP_LIMIT];
     uint32_t                    link_count;
     uint32_t                    link_max;
+    z::ZList                    links;          // every built task, under link_lock
+    z::ZSpinLock                link_lock;
     uint32_t                    calc_thread;
     uint32_t                    task_queue_size;
     task_pool_t                 *task_pool;
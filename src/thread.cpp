@@ -1,16 +1,60 @@
 #include "thread.h"
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 namespace z {
 ;
 
+bool zfutex_wait(std::atomic<uint32_t> *addr, uint32_t val, int timeout_ms) {
+    ::timespec ts = {timeout_ms / 1000, (timeout_ms % 1000) * 1000l * 1000l};
+    long ret = ::syscall(SYS_futex, (uint32_t*)(addr), FUTEX_WAIT_PRIVATE, val,
+            (timeout_ms < 0) ? nullptr : &ts, nullptr, 0);
+    return !(ret == -1 && errno == ETIMEDOUT);
+}
+
+int zfutex_wake(std::atomic<uint32_t> *addr, int n) {
+    long ret = ::syscall(SYS_futex, (uint32_t*)(addr), FUTEX_WAKE_PRIVATE, n, nullptr, nullptr, 0);
+    return (ret < 0) ? 0 : int(ret);
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+/// spinning for a lock only pays off if its holder can run meanwhile
+static bool multi_cpu() {
+    static const bool multi = ::sysconf(_SC_NPROCESSORS_ONLN) > 1;
+    return multi;
+}
+
+/// the ms left until the ztime_now() deadline t, rounded up; 0 once past
+static int ms_until(const ztime_t *t) {
+    ztime_t now;
+    ztime_now(&now);
+    long us = ztime_length_us(now, *t);
+    return (us <= 0) ? 0 : int( (us + 999) / 1000);
+}
+
 ZMutexLock::ZMutexLock() {
-    ZASSERT(0 == pthread_mutex_init(&_mutex, nullptr));
+    int ret = pthread_mutex_init(&_mutex, nullptr);
+    ZASSERT(0 == ret);
+    Z_USE_VAR(ret);
 }
 
 ZMutexLock::~ZMutexLock() {
-    ZASSERT(0 == pthread_mutex_destroy(&_mutex));
+    int ret = pthread_mutex_destroy(&_mutex);
+    ZASSERT(0 == ret);
+    Z_USE_VAR(ret);
 }
 
 bool ZMutexLock::try_lock() {
@@ -21,44 +65,274 @@ void ZMutexLock::lock() {
     pthread_mutex_lock(&_mutex);
 }
 
+int ZMutexLock::timed_lock(const ztime_t *t) {
+    if (nullptr == t) {
+        return pthread_mutex_lock(&_mutex);
+    }
+    return pthread_mutex_timedlock(&_mutex, t);
+}
+
 void ZMutexLock::unlock() {
     pthread_mutex_unlock(&_mutex);
 }
 
 ZSpinLock::ZSpinLock() {
-    ZASSERT(0 == pthread_spin_init(&_spinlock, PTHREAD_PROCESS_SHARED));
+    int ret = pthread_spin_init(&_spinlock, PTHREAD_PROCESS_SHARED);
+    ZASSERT(0 == ret);
+    Z_USE_VAR(ret);
 }
 
 ZSpinLock::~ZSpinLock() {
-    ZASSERT(0 == pthread_spin_destroy(&_spinlock));
+    int ret = pthread_spin_destroy(&_spinlock);
+    ZASSERT(0 == ret);
+    Z_USE_VAR(ret);
 }
 
 bool ZSpinLock::try_lock() {
-    return 0 == pthread_spin_lock(&_spinlock);
+    return 0 == pthread_spin_trylock(&_spinlock);
 }
 
 void ZSpinLock::lock() {
     pthread_spin_lock(&_spinlock);
 }
 
+int ZSpinLock::timed_lock(const ztime_t *t) {
+    if (nullptr == t) {
+        return pthread_spin_lock(&_spinlock);
+    }
+    while (!try_lock() ) {
+        Z_RET_IF(0 == ms_until(t), ETIMEDOUT);
+        cpu_relax();
+    }
+    return 0;
+}
+
 void ZSpinLock::unlock() {
     pthread_spin_unlock(&_spinlock);
 }
 
+ZAdaptiveLock::ZAdaptiveLock() {
+    _state.store(UNLOCKED, std::memory_order_relaxed);
+    _waiters.store(0, std::memory_order_relaxed);
+}
+
+bool ZAdaptiveLock::try_lock() {
+    uint32_t expected = UNLOCKED;
+    return UNLOCKED == _state.load(std::memory_order_relaxed)
+        && _state.compare_exchange_strong(expected, LOCKED, std::memory_order_acquire, std::memory_order_relaxed);
+}
+
+int ZAdaptiveLock::timed_lock(const ztime_t *t) {
+    Z_RET_IF(try_lock(), 0);
+    return lock_slow(t);
+}
+
+void ZAdaptiveLock::unlock() {
+    if (CONTENDED == _state.exchange(UNLOCKED, std::memory_order_release) ) {
+        zfutex_wake(&_state, 1);
+    }
+}
+
+bool ZAdaptiveLock::spin() {
+    Z_RET_IF(!multi_cpu(), false);
+    uint32_t backoff = 1;
+    for (uint32_t round = 0; round < SPIN_ROUNDS; ++round, backoff <<= 1) {
+        for (uint32_t i = 0; i < backoff; ++i) {
+            cpu_relax();
+        }
+        Z_RET_IF(try_lock(), true);
+        // others already sleep: held too long to be worth spinning for
+        Z_RET_IF(0 != _waiters.load(std::memory_order_relaxed), false);
+    }
+    return false;
+}
+
+int ZAdaptiveLock::lock_slow(const ztime_t *t) {
+    Z_RET_IF(spin(), 0);
+
+    // a thread taking the lock here cannot tell whether others still sleep,
+    // so it leaves the word CONTENDED: at worst one wake too many
+    int ret = 0;
+    _waiters.fetch_add(1, std::memory_order_relaxed);
+    while (UNLOCKED != _state.exchange(CONTENDED, std::memory_order_acquire) ) {
+        int left = -1;
+        if (t) {
+            left = ms_until(t);
+            if (0 == left) {
+                ret = ETIMEDOUT;
+                break;
+            }
+        }
+        zfutex_wait(&_state, CONTENDED, left);
+    }
+    _waiters.fetch_sub(1, std::memory_order_relaxed);
+    return ret;
+}
+
+ZRWLock::ZRWLock() : _slots(nullptr), _slot_mask(0) {
+    // a slot per CPU, rounded up to a power of 2 to pick it with a mask
+    long cpus = ::sysconf(_SC_NPROCESSORS_CONF);
+    uint32_t n = 1;
+    while (n < cpus) {
+        n <<= 1;
+    }
+    void *mem = nullptr;
+    int ret = posix_memalign(&mem, DEF_SIZE_CACHE_LINE, n * sizeof(Slot) );
+    ZASSERT(0 == ret);
+    Z_USE_VAR(ret);
+    _slots = (Slot*)(mem);
+    for (uint32_t i = 0; i < n; ++i) {
+        new (&_slots[i]) Slot;
+        _slots[i].readers.store(0, std::memory_order_relaxed);
+    }
+    _slot_mask = n - 1;
+    _writer.store(NO_WRITER, std::memory_order_relaxed);
+}
+
+ZRWLock::~ZRWLock() {
+    free(_slots);
+}
+
+ZRWLock::Slot* ZRWLock::slot() const {
+    int cpu = ::sched_getcpu();
+    return &_slots[(cpu < 0) ? 0 : (uint32_t(cpu) & _slot_mask)];
+}
+
+void ZRWLock::read_lock() {
+    for (;;) {
+        Slot *s = slot();
+        // the count is seen by a writer coming, or its flag is seen here
+        s->readers.fetch_add(1, std::memory_order_seq_cst);
+        Z_RET_IF(NO_WRITER == _writer.load(std::memory_order_seq_cst), );
+        s->readers.fetch_sub(1, std::memory_order_release);
+        wait_writer();
+    }
+}
+
+bool ZRWLock::try_read_lock() {
+    Slot *s = slot();
+    s->readers.fetch_add(1, std::memory_order_seq_cst);
+    Z_RET_IF(NO_WRITER == _writer.load(std::memory_order_seq_cst), true);
+    s->readers.fetch_sub(1, std::memory_order_release);
+    return false;
+}
+
+void ZRWLock::read_unlock() {
+    slot()->readers.fetch_sub(1, std::memory_order_release);
+}
+
+bool ZRWLock::try_lock() {
+    Z_RET_IF(!_writers.try_lock(), false);
+    _writer.store(WRITING, std::memory_order_seq_cst);
+    int32_t sum = 0;
+    for (uint32_t i = 0; i <= _slot_mask; ++i) {
+        sum += _slots[i].readers.load(std::memory_order_seq_cst);
+    }
+    Z_RET_IF(0 == sum, true);
+    end_write();
+    return false;
+}
+
+int ZRWLock::timed_lock(const ztime_t *t) {
+    int ret = _writers.timed_lock(t);
+    Z_RET_IF(0 != ret, ret);
+    _writer.store(WRITING, std::memory_order_seq_cst);
+    Z_RET_IF(wait_readers(t), 0);
+    end_write();
+    return ETIMEDOUT;
+}
+
+void ZRWLock::unlock() {
+    end_write();
+}
+
+bool ZRWLock::wait_readers(const ztime_t *t) const {
+    for (uint32_t round = 0; ; ++round) {
+        int32_t sum = 0;
+        for (uint32_t i = 0; i <= _slot_mask; ++i) {
+            sum += _slots[i].readers.load(std::memory_order_seq_cst);
+        }
+        Z_RET_IF(0 == sum, true);
+        Z_RET_IF(t && 0 == ms_until(t), false);
+        // readers hold the lock briefly, and do not wake anyone leaving it
+        if (round < SPIN_BEFORE_YIELD && multi_cpu() ) {
+            cpu_relax();
+        } else {
+            ::sched_yield();
+        }
+    }
+}
+
+void ZRWLock::wait_writer() {
+    uint32_t w = _writer.load(std::memory_order_relaxed);
+    while (NO_WRITER != w) {
+        if (WRITING == w && !_writer.compare_exchange_weak(w, WRITING_WAITED, std::memory_order_relaxed) ) {
+            continue;
+        }
+        zfutex_wait(&_writer, WRITING_WAITED);
+        w = _writer.load(std::memory_order_relaxed);
+    }
+}
+
+void ZRWLock::end_write() {
+    if (WRITING_WAITED == _writer.exchange(NO_WRITER, std::memory_order_release) ) {
+        zfutex_wake(&_writer, INT_MAX);
+    }
+    _writers.unlock();
+}
+
+bool ZSeqLock::try_lock() {
+    Z_RET_IF(!_writers.try_lock(), false);
+    _seq.store(_seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return true;
+}
+
+int ZSeqLock::timed_lock(const ztime_t *t) {
+    int ret = _writers.timed_lock(t);
+    Z_RET_IF(0 != ret, ret);
+    _seq.store(_seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return 0;
+}
+
+void ZSeqLock::unlock() {
+    _seq.store(_seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    _writers.unlock();
+}
+
+uint32_t ZSeqLock::wait_writer() const {
+    for (uint32_t round = 0; ; ++round) {
+        uint32_t seq = _seq.load(std::memory_order_acquire);
+        Z_RET_IF(0 == (seq & 1), seq);
+        if (round < SPIN_BEFORE_YIELD && multi_cpu() ) {
+            cpu_relax();
+        } else {
+            ::sched_yield();
+        }
+    }
+}
+
 
 // ------------------------------------------------------------------------ //
 
 ZThreadTask::ZThreadTask()
-: _status(TaskStatus::INIT) {
-    ZASSERT(0 == pthread_mutex_init(&_mutex, nullptr));
-    ZASSERT(0 == pthread_cond_init(&_cond, nullptr));
+: _status(TaskStatus::INIT), _group(nullptr) {
+    int ret = pthread_mutex_init(&_mutex, nullptr);
+    ZASSERT(0 == ret);
+    ret |= pthread_cond_init(&_cond, nullptr);
+    ZASSERT(0 == ret);
+    Z_USE_VAR(ret);
     reset();
 }
 
 ZThreadTask::~ZThreadTask() {
     _status = TaskStatus::DONE;
-    ZASSERT(0 == pthread_mutex_destroy(&_mutex));
-    ZASSERT(0 == pthread_cond_destroy(&_cond));
+    int ret = pthread_mutex_destroy(&_mutex);
+    ZASSERT(0 == ret);
+    ret |= pthread_cond_destroy(&_cond);
+    ZASSERT(0 == ret);
+    Z_USE_VAR(ret);
 }
 
 void ZThreadTask::reset() {
@@ -66,7 +340,7 @@ void ZThreadTask::reset() {
 }
 
 ZThreadTask::TaskStatus ZThreadTask::status() const {
-    return TaskStatus(_status);
+    return TaskStatus(__atomic_load_n(&_status, __ATOMIC_ACQUIRE) );
 }
 
 void ZThreadTask::next_status() {
@@ -77,51 +351,141 @@ void ZThreadTask::next_status() {
     ++_status;
 }
 
+/**
+ * Both sides hold the mutex to the end: once wait() returns the task may be
+ * freed, which must not race signal_done() still using the condition.
+ */
 bool ZThreadTask::wait(int timeout_ms) {
-    if (_status == TaskStatus::DONE) {
-        return true;
+    // pthread_cond_timedwait() takes an absolute CLOCK_REALTIME deadline
+    ::timespec tm = {0, 0};
+    if (timeout_ms >= 0) {
+        ::clock_gettime(CLOCK_REALTIME, &tm);
+        tm.tv_sec += timeout_ms / 1000;
+        tm.tv_nsec += (timeout_ms % 1000) * 1000l * 1000l;
+        if (tm.tv_nsec >= 1000l * 1000l * 1000l) {
+            tm.tv_nsec -= 1000l * 1000l * 1000l;
+            ++tm.tv_sec;
+        }
     }
-
-    ::timespec tm = {timeout_ms / 1000, (timeout_ms % 1000) * 1000l * 1000l};
     pthread_mutex_lock(&_mutex);
     while (_status != TaskStatus::DONE) {
-        if (ETIMEDOUT == pthread_cond_timedwait(&_cond, &_mutex, &tm) ) {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&_cond, &_mutex);
+        } else if (ETIMEDOUT == pthread_cond_timedwait(&_cond, &_mutex, &tm) ) {
             break;
         }
     }
+    bool done = (_status == TaskStatus::DONE);
     pthread_mutex_unlock(&_mutex);
 
-    return _status == TaskStatus::DONE;
+    return done;
 }
 
 void ZThreadTask::signal_done() {
     pthread_mutex_lock(&_mutex);
-    _status = TaskStatus::DONE;
+    __atomic_store_n(&_status, int(TaskStatus::DONE), __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&_cond);
     pthread_mutex_unlock(&_mutex);
-    pthread_cond_broadcast(&_cond);   
 }
 
 int ZThreadTask::exec(void* ) {
     return 0;
 }
 
+void ZThreadTask::finish() {
+    if (DONE != status() ) {
+        signal_done();
+    }
+}
+
+void ZTaskEvent::set() {
+    if (WAITING == _state.exchange(SET, std::memory_order_acq_rel) ) {
+        zfutex_wake(&_state, INT_MAX);
+    }
+}
+
+bool ZTaskEvent::wait(int timeout_ms) {
+    uint64_t deadline = (timeout_ms < 0) ? 0 : zmonotonic_ms() + timeout_ms;
+    for (;;) {
+        uint32_t s = _state.load(std::memory_order_acquire);
+        Z_RET_IF(SET == s, true);
+        if (PENDING == s && !_state.compare_exchange_weak(s, WAITING, std::memory_order_acq_rel) ) {
+            continue;
+        }
+
+        int left = -1;
+        if (timeout_ms >= 0) {
+            uint64_t now = zmonotonic_ms();
+            Z_RET_IF(now >= deadline, is_set() );
+            left = int(deadline - now);
+        }
+        zfutex_wait(&_state, WAITING, left);
+    }
+}
+
+int ZCallTask::exec(void*) {
+    _op(_fn, true);
+    _fn = nullptr;
+    return 0;
+}
+
+void ZCallTask::finish() {
+    // the slot may be reused as soon as it is released
+    ZTaskEvent *event = _event;
+    _event = nullptr;
+    reset();
+    _pool->release_call(this);
+    if (event) {
+        event->set();
+    }
+}
+
+void ZCallTask::cancel() {
+    _op(_fn, false);
+    _fn = nullptr;
+    _event = nullptr;
+    reset();
+}
+
+/// the pool whose worker the calling thread is, and its index
+static __thread ZThreadPool *t_pool = nullptr;
+static __thread uint32_t t_worker = 0;
+
 ZThreadPool::ZThreadPool(uint32_t task_queue_size)
-: _status(ThreadPoolStatus::INIT), _sched_epoll(-1), _task_queue(task_queue_size) {
+: _status(ThreadPoolStatus::INIT), _mode(SHARED_QUEUE), _sched_epoll(-1), _task_queue(task_queue_size)
+, _deque_size(task_queue_size), _inject(task_queue_size), _calls(nullptr) {
+    _sleepers.store(0, std::memory_order_relaxed);
+    _searching.store(0, std::memory_order_relaxed);
+    _wake_seq.store(0, std::memory_order_relaxed);
     _sched_epoll = ::epoll_create1(EPOLL_CLOEXEC);
     ZASSERT(_sched_epoll != -1);
     _ev.events = EPOLLIN | EPOLLONESHOT;
     _ev.data.ptr = nullptr;
 
-    ZASSERT(0 == epoll_ctl(_sched_epoll, EPOLL_CTL_ADD, _task_queue.dequeue_fd(), &_ev) );
+    int ret = epoll_ctl(_sched_epoll, EPOLL_CTL_ADD, _task_queue.dequeue_fd(), &_ev);
+    ZASSERT(0 == ret);
+    Z_USE_VAR(ret);
 }
 
 ZThreadPool::~ZThreadPool() {
     stop();
     ::close(_sched_epoll);
+    for (WorkerList::iterator i = _workers.begin(); i != _workers.end(); ++i) {
+        delete *i;
+    }
+    delete _calls;
 }
 
-bool ZThreadPool::start(uint32_t thread_num) {
+bool ZThreadPool::start(uint32_t thread_num, ScheduleMode mode) {
     Z_RET_IF(_status != INIT || thread_num == 0, false);
+    _mode = mode;
+    _calls = new z::StaticLinkedList<ZCallTask, z::ZLockFree>(_deque_size, CALL_MAGAZINE);
+    if (mode == WORK_STEALING) {
+        for (uint32_t i = 0; i < thread_num; ++i) {
+            _workers.push_back(new Worker(_deque_size) );
+            _workers[i]->rand = (i + 1) * 0x9E3779B97F4A7C15ull;
+        }
+    }
     _threads.resize(thread_num);
     for (uint32_t i = 0; i < thread_num; ++i) {
         ThreadInfo & info = _threads[i];
@@ -140,8 +504,13 @@ void ZThreadPool::stop() {
     Z_RET_IF(_status != ThreadPoolStatus::RUNNING, );
     _status = ThreadPoolStatus::STOP;
 
+    if (_mode == WORK_STEALING) {
+        // the workers see STOP once woken, and leave when they find no task
+        _wake_seq.fetch_add(1, std::memory_order_seq_cst);
+        zfutex_wake(&_wake_seq, INT_MAX);
+    }
     int n = 0;
-    while (n < 10000 && !_task_queue.isEmpty() ) {
+    while (_mode == SHARED_QUEUE && n < 10000 && !_task_queue.isEmpty() ) {
         zsleep_us(1000 * 3);
         ++n;
     }
@@ -156,14 +525,33 @@ void ZThreadPool::stop() {
 }
 
 bool ZThreadPool::commit(ZThreadTask *task) {
+    // a worker keeps committing while the pool stops: it drains its deque
+    bool on_worker = this->on_worker();
     Z_RET_IF(task == nullptr 
-            || _status != ThreadPoolStatus::RUNNING
+            || (_status != ThreadPoolStatus::RUNNING && !(on_worker && _status == ThreadPoolStatus::STOP) )
             || task->status() != ZThreadTask::INIT, false);
+
+    if (_mode == WORK_STEALING) {
+        task->next_status();
+        if (on_worker ? _workers[t_worker]->deque.push(task) : _inject.enqueue(task) ) {
+            wake_one();
+            return true;
+        } else if (on_worker) {
+            run_task(task);
+            return true;
+        }
+        task->reset();
+        ZLOG(LOG_WARN, "Enqueue failed: count: %u", _inject.count() );
+        return false;
+    }
     
+    // counted before the enqueue: a worker may run, finish and recycle the
+    // task before enqueue() returns
+    task->next_status();
     if (_task_queue.enqueue(task) ) {
-        task->next_status();
         return true;
     } else {
+        task->reset();
         ZLOG(LOG_WARN, "Enqueue failed: count: %u, is_full: %d",
             _task_queue.count(), int(_task_queue.isFull() ) );
         return false;
@@ -175,7 +563,68 @@ uint32_t ZThreadPool::thread_count() const {
 }
 
 uint32_t ZThreadPool::waiting_task() const {
-    return _task_queue.count();
+    Z_RET_IF(_mode == SHARED_QUEUE, _task_queue.count() );
+    uint32_t n = _inject.count();
+    for (WorkerList::const_iterator i = _workers.begin(); i != _workers.end(); ++i) {
+        n += (*i)->deque.count();
+    }
+    return n;
+}
+
+bool ZThreadPool::run_one() {
+    ZThreadTask *task = nullptr;
+    if (_mode == WORK_STEALING) {
+        Z_RET_IF(_workers.empty(), false);
+        task = find_task( (t_pool == this) ? t_worker : uint32_t(-1) );
+    } else if (!_task_queue.dequeue(&task) ) {
+        task = nullptr;
+    }
+    Z_RET_IF(nullptr == task, false);
+
+    run_task(task);
+    return true;
+}
+
+bool ZThreadPool::on_worker() const {
+    return t_pool == this && _mode == WORK_STEALING;
+}
+
+ZCallTask* ZThreadPool::alloc_call() {
+    Z_RET_IF(nullptr == _calls, nullptr);
+    ZCallTask *task = _calls->allocate();
+    if (task) {
+        task->_pool = this;
+    }
+    return task;
+}
+
+void ZThreadPool::release_call(ZCallTask *task) {
+    _calls->release(task);
+}
+
+bool ZThreadPool::commit_call(ZCallTask *task) {
+    Z_RET_IF(commit(task), true);
+    task->_group = nullptr;
+    task->cancel();
+    release_call(task);
+    return false;
+}
+
+void ZThreadPool::run_task(ZThreadTask *task) {
+    // finish() may free the task, or let its owner free it
+    ZTaskGroup *group = task->_group;
+    task->_group = nullptr;
+    task->next_status();
+    task->exec(nullptr);
+    task->finish();
+    if (group) {
+        group->done();
+    }
+}
+
+uint32_t ZThreadPool::batch_size() const {
+    uint32_t share = _task_queue.count() / _threads.size() + 1;
+    return (share < BATCH_SIZE) ? share : uint32_t(BATCH_SIZE);
 }
 
 void *ZThreadPool::ThreadMain(void *a) {
@@ -185,7 +634,12 @@ void *ZThreadPool::ThreadMain(void *a) {
     ZThreadPool *this_ptr = args->this_ptr;
     ThreadInfo &info = this_ptr->_threads[args->info_offset];
     info.is_running = true;
-    while (this_ptr->_status != ThreadPoolStatus::STOP) {
+    t_pool = this_ptr;
+    t_worker = args->info_offset;
+    if (this_ptr->_mode == WORK_STEALING) {
+        this_ptr->steal_loop(args->info_offset);
+    }
+    while (this_ptr->_mode == SHARED_QUEUE && this_ptr->_status != ThreadPoolStatus::STOP) {
         epoll_event ev;
         int ret = epoll_wait(this_ptr->_sched_epoll, &ev, 1, 100);
         if (ret < 0) {
@@ -198,29 +652,702 @@ void *ZThreadPool::ThreadMain(void *a) {
         } 
 
         if (ev.events & EPOLLIN) {
-            ZThreadTask *task = nullptr;
-            this_ptr->_task_queue.dequeue(&task);
-            ZASSERT(0 == epoll_ctl(this_ptr->_sched_epoll, EPOLL_CTL_MOD, 
-                            this_ptr->_task_queue.dequeue_fd(), &this_ptr->_ev) );
-            if (task) {
-                task->next_status();
-                task->exec(nullptr);
-                if (ZThreadTask::DONE != task->status() ) {
-                    task->signal_done();
+            // take a batch and rearm: the eventfd stays readable until the
+            // queue is drained, so the other threads join while this one
+            // keeps dequeuing. A wakeup with nothing left is normal. The
+            // batch is the fair share of the backlog, so one thread does not
+            // hoard tasks the others could run.
+            ZThreadTask *tasks[BATCH_SIZE];
+            uint32_t n = this_ptr->_task_queue.dequeue_bulk(tasks, this_ptr->batch_size() );
+            ret = epoll_ctl(this_ptr->_sched_epoll, EPOLL_CTL_MOD, 
+                            this_ptr->_task_queue.dequeue_fd(), &this_ptr->_ev);
+            ZASSERT(0 == ret);
+            while (n > 0) {
+                for (uint32_t i = 0; i < n; ++i) {
+                    run_task(tasks[i]);
                 }
-            } else {
-                ZLOG(LOG_WARN, "NO TASK: count:%lu", this_ptr->_task_queue.count() );
+                n = this_ptr->_task_queue.dequeue_bulk(tasks, this_ptr->batch_size() );
             }
         } else {
             ZLOG(LOG_INFO, "FDERROR: 0x%lx, ret=%d, fd=%d", 
                 uint64_t(ev.events), ret, this_ptr->_task_queue.dequeue_fd() );
-            ZASSERT(0 == epoll_ctl(this_ptr->_sched_epoll, EPOLL_CTL_MOD, 
-                            this_ptr->_task_queue.dequeue_fd(), &this_ptr->_ev) );
+            ret = epoll_ctl(this_ptr->_sched_epoll, EPOLL_CTL_MOD, 
+                            this_ptr->_task_queue.dequeue_fd(), &this_ptr->_ev);
+            ZASSERT(0 == ret);
         }
     }
 
+    t_pool = nullptr;
     info.is_running = false;
     return nullptr;
 }
 
+/**
+ * Parking announces itself in _sleepers before the last look for a task,
+ * and a committer reads _sleepers after publishing its task, both behind a
+ * full fence: either the worker finds the task or the committer sees the
+ * sleeper. _wake_seq is read before the announcement, so a wake-up between
+ * the last look and the futex call makes the call return at once.
+ *
+ * A woken worker is searching until it finds a task or parks again, and
+ * committers wake nobody while someone searches: the searcher leaves only
+ * through that same last look. The last searcher to find a task wakes the
+ * next one, so the number of awake workers follows the work instead of one
+ * wake-up per commit.
+ */
+void ZThreadPool::steal_loop(uint32_t self) {
+    bool searching = false;
+    for (;;) {
+        ZThreadTask *task = find_task(self);
+        if (task) {
+            if (searching) {
+                searching = false;
+                if (1 == _searching.fetch_sub(1, std::memory_order_seq_cst) ) {
+                    wake_one();
+                }
+            }
+            run_task(task);
+            continue;
+        }
+
+        if (searching) {
+            searching = false;
+            _searching.fetch_sub(1, std::memory_order_seq_cst);
+        }
+        uint32_t seq = _wake_seq.load(std::memory_order_acquire);
+        _sleepers.fetch_add(1, std::memory_order_seq_cst);
+        task = find_task(self);
+        if (nullptr == task) {
+            if (_status == ThreadPoolStatus::STOP) {
+                _sleepers.fetch_sub(1, std::memory_order_relaxed);
+                break;
+            }
+            zfutex_wait(&_wake_seq, seq, PARK_MS);
+            _searching.fetch_add(1, std::memory_order_seq_cst);
+            searching = true;
+        }
+        _sleepers.fetch_sub(1, std::memory_order_relaxed);
+        if (task) {
+            run_task(task);
+        }
+    }
+}
+
+ZThreadTask* ZThreadPool::find_task(uint32_t self) {
+    ZThreadTask *task = nullptr;
+    uint32_t n = uint32_t(_workers.size() );
+    Z_RET_IF(self < n && _workers[self]->deque.pop(&task), task);
+    Z_RET_IF(_inject.dequeue(&task), task);
+
+    uint64_t r = (self < n) ? _workers[self]->rand : (zmonotonic_ms() | 1);
+    for (uint32_t round = 0; round < STEAL_ROUNDS; ++round) {
+        // xorshift64: a random first victim, then the others in turn
+        r ^= r << 13;
+        r ^= r >> 7;
+        r ^= r << 17;
+        uint32_t start = uint32_t(r % n);
+        for (uint32_t i = 0; i < n; ++i) {
+            uint32_t victim = (start + i < n) ? start + i : start + i - n;
+            if (victim != self && _workers[victim]->deque.steal(&task) ) {
+                if (self < n) {
+                    _workers[self]->rand = r;
+                }
+                return task;
+            }
+        }
+    }
+    if (self < n) {
+        _workers[self]->rand = r;
+    }
+    return nullptr;
+}
+
+void ZThreadPool::wake_one() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    Z_RET_IF(0 == _sleepers.load(std::memory_order_relaxed)
+            || 0 != _searching.load(std::memory_order_relaxed), );
+    _wake_seq.fetch_add(1, std::memory_order_release);
+    zfutex_wake(&_wake_seq, 1);
+}
+
+ZTaskGroup::ZTaskGroup(ZThreadPool *pool) : _pool(pool) {
+    _pending.store(0, std::memory_order_relaxed);
+}
+
+ZTaskGroup::~ZTaskGroup() {
+    wait();
+}
+
+bool ZTaskGroup::commit(ZThreadTask *task) {
+    Z_RET_IF(nullptr == _pool || nullptr == task || nullptr != task->_group, false);
+    _pending.fetch_add(1, std::memory_order_relaxed);
+    task->_group = this;
+    if (!_pool->commit(task) ) {
+        task->_group = nullptr;
+        done();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * The last done() clears WAITING with the count, so the word it leaves is 0
+ * and the exchange alone tells whether a thread sleeps: nothing of the group
+ * is read after it, as the waiter may return and destroy the group at once.
+ * The wake may then reach a freed group: futex only compares the address,
+ * which is harmless.
+ */
+void ZTaskGroup::done() {
+    uint32_t n = _pending.load(std::memory_order_relaxed);
+    uint32_t next = 0;
+    do {
+        next = (1 == (n & ~uint32_t(WAITING) ) ) ? 0 : n - 1;
+    } while (!_pending.compare_exchange_weak(n, next, std::memory_order_acq_rel, std::memory_order_relaxed) );
+    if ( (WAITING | 1) == n) {
+        zfutex_wake(&_pending, INT_MAX);
+    }
+}
+
+bool ZTaskGroup::wait(int timeout_ms) {
+    bool helping = (t_pool != nullptr && t_pool == _pool);
+    uint64_t deadline = (timeout_ms < 0) ? 0 : zmonotonic_ms() + timeout_ms;
+    for (;;) {
+        Z_RET_IF(0 == _pending.load(std::memory_order_acquire), true);
+        if (helping && _pool->run_one() ) {
+            continue;
+        }
+
+        int left = -1;
+        if (timeout_ms >= 0) {
+            uint64_t now = zmonotonic_ms();
+            Z_RET_IF(now >= deadline, 0 == _pending.load(std::memory_order_acquire) );
+            left = int(deadline - now);
+        }
+        if (helping) {
+            // park briefly: tasks may show up for run_one() meanwhile
+            left = (left < 0 || left > int(WAIT_SLICE_MS) ) ? int(WAIT_SLICE_MS) : left;
+        }
+        uint32_t n = _pending.load(std::memory_order_acquire);
+        if (0 != n && 0 == (n & WAITING)
+                && !_pending.compare_exchange_weak(n, n | WAITING, std::memory_order_acq_rel) ) {
+            continue;
+        }
+        if (0 != n) {
+            zfutex_wait(&_pending, n | WAITING, left);
+        }
+    }
+}
+
 } // namespace z
+
+#if Z_COMPILE_FLAG_ENABLE_UT
+#include <gtest/gtest.h>
+#include <memory>
+
+template <typename LOCK>
+struct LockedCounter {
+    LockedCounter() : count(0) {}
+
+    LOCK        lock;
+    uint64_t    count;
+};
+
+template <typename LOCK>
+static void* lock_counter_main(void *arg) {
+    LockedCounter<LOCK> *c = (LockedCounter<LOCK>*)(arg);
+    for (uint32_t i = 0; i < 20000; ++i) {
+        c->lock.lock();
+        ++c->count;
+        c->lock.unlock();
+    }
+    return nullptr;
+}
+
+/// the lock is exclusive, try_lock() does not block, timed_lock() times out
+template <typename LOCK>
+static void check_lock() {
+    using namespace z;
+
+    LockedCounter<LOCK> c;
+    ASSERT_TRUE(c.lock.try_lock() );
+    EXPECT_FALSE(c.lock.try_lock() );
+    ztime_t deadline = ztime_now();
+    deadline.tv_nsec += 20 * 1000 * 1000;
+    if (deadline.tv_nsec >= 1000 * 1000 * 1000) {
+        deadline.tv_nsec -= 1000 * 1000 * 1000;
+        ++deadline.tv_sec;
+    }
+    uint64_t begin = zmonotonic_ms();
+    EXPECT_EQ(ETIMEDOUT, c.lock.timed_lock(&deadline) );
+    EXPECT_LE(begin + 15, zmonotonic_ms() );
+    c.lock.unlock();
+    EXPECT_EQ(0, c.lock.timed_lock(&deadline) );
+    c.lock.unlock();
+    EXPECT_EQ(0, c.lock.timed_lock(nullptr) );
+    c.lock.unlock();
+
+    pthread_t threads[4];
+    for (uint32_t i = 0; i < 4; ++i) {
+        ASSERT_EQ(0, pthread_create(&threads[i], nullptr, &lock_counter_main<LOCK>, &c) );
+    }
+    for (uint32_t i = 0; i < 4; ++i) {
+        pthread_join(threads[i], nullptr);
+    }
+    EXPECT_EQ(4u * 20000, c.count);
+}
+
+TEST(ut_low_thread, locks) {
+    check_lock<z::ZMutexLock>();
+    check_lock<z::ZSpinLock>();
+    check_lock<z::ZAdaptiveLock>();
+    check_lock<z::ZRWLock>();
+    check_lock<z::ZSeqLock>();
+}
+
+static void* adaptive_lock_holder(void *arg) {
+    z::ZAdaptiveLock *lock = (z::ZAdaptiveLock*)(arg);
+    z::zsleep_ms(20);
+    lock->unlock();
+    return nullptr;
+}
+
+TEST(ut_low_thread, adaptive_lock_parks) {
+    using namespace z;
+
+    // a waiter sleeps past the spinning, then the unlock wakes it
+    ZAdaptiveLock lock;
+    lock.lock();
+    pthread_t holder;
+    ASSERT_EQ(0, pthread_create(&holder, nullptr, &adaptive_lock_holder, &lock) );
+    uint64_t begin = zmonotonic_ms();
+    lock.lock();
+    EXPECT_LE(begin + 15, zmonotonic_ms() );
+    lock.unlock();
+    pthread_join(holder, nullptr);
+    EXPECT_TRUE(lock.try_lock() );
+    lock.unlock();
+}
+
+static void* rw_lock_writer(void *arg) {
+    z::ZRWLock *lock = (z::ZRWLock*)(arg);
+    lock->lock();
+    lock->unlock();
+    return nullptr;
+}
+
+/// writers keep the pair equal and the table entries at twice their keys
+struct RWShared {
+    RWShared() : a(0), b(0), torn(0), stop(false) {}
+
+    z::ZRWLock                              lock;
+    uint64_t                                a;
+    uint64_t                                b;
+    z::HashTable64<uint64_t, z::ZRWLock>    table;
+    std::atomic<uint32_t>                   torn;
+    std::atomic<bool>                       stop;
+};
+
+static void* rw_reader_main(void *arg) {
+    RWShared *s = (RWShared*)(arg);
+    uint64_t k = 0;
+    while (!s->stop.load(std::memory_order_relaxed) ) {
+        s->lock.read_lock();
+        if (s->a != s->b) {
+            s->torn.fetch_add(1);
+        }
+        s->lock.read_unlock();
+
+        uint64_t v = 0;
+        k = (k + 1) % 1000;
+        if (s->table.find(k, &v) && v != k * 2) {
+            s->torn.fetch_add(1);
+        }
+    }
+    return nullptr;
+}
+
+static void* rw_writer_main(void *arg) {
+    RWShared *s = (RWShared*)(arg);
+    for (uint32_t i = 0; i < 2000; ++i) {
+        s->lock.lock();
+        ++s->a;
+        // now and then, let the readers run into the writer: each unlock
+        // then wakes them, and they keep a single CPU for a time slice
+        if (0 == i % 256) {
+            sched_yield();
+        }
+        ++s->b;
+        s->lock.unlock();
+        s->table.update(i % 1000, (i % 1000) * 2);
+    }
+    return nullptr;
+}
+
+TEST(ut_low_thread, rw_lock) {
+    using namespace z;
+
+    // readers share the lock, with each other only
+    ZRWLock lock;
+    lock.read_lock();
+    ASSERT_TRUE(lock.try_read_lock() );
+    EXPECT_FALSE(lock.try_lock() );
+    ztime_t deadline = ztime_now();
+    deadline.tv_nsec += 20 * 1000 * 1000;
+    if (deadline.tv_nsec >= 1000 * 1000 * 1000) {
+        deadline.tv_nsec -= 1000 * 1000 * 1000;
+        ++deadline.tv_sec;
+    }
+    EXPECT_EQ(ETIMEDOUT, lock.timed_lock(&deadline) );
+    lock.read_unlock();
+    lock.read_unlock();
+    ASSERT_TRUE(lock.try_lock() );
+    EXPECT_FALSE(lock.try_read_lock() );
+    lock.unlock();
+
+    // a writer waits for the reader, a reader after it for the writer
+    lock.read_lock();
+    pthread_t writer;
+    ASSERT_EQ(0, pthread_create(&writer, nullptr, &rw_lock_writer, &lock) );
+    zsleep_ms(20);
+    lock.read_unlock();
+    pthread_join(writer, nullptr);
+    ASSERT_TRUE(lock.try_read_lock() );
+    lock.read_unlock();
+
+    RWShared s;
+    pthread_t readers[4];
+    pthread_t writers[2];
+    for (uint32_t i = 0; i < 4; ++i) {
+        ASSERT_EQ(0, pthread_create(&readers[i], nullptr, &rw_reader_main, &s) );
+    }
+    for (uint32_t i = 0; i < 2; ++i) {
+        ASSERT_EQ(0, pthread_create(&writers[i], nullptr, &rw_writer_main, &s) );
+    }
+    for (uint32_t i = 0; i < 2; ++i) {
+        pthread_join(writers[i], nullptr);
+    }
+    s.stop.store(true);
+    for (uint32_t i = 0; i < 4; ++i) {
+        pthread_join(readers[i], nullptr);
+    }
+    EXPECT_EQ(0u, s.torn.load() );
+    EXPECT_EQ(4000u, s.a);
+    EXPECT_EQ(4000u, s.b);
+    EXPECT_EQ(1000u, s.table.size() );
+}
+
+struct SeqStats {
+    uint64_t    v[6];   ///< all equal
+};
+
+struct SeqShared {
+    SeqShared() : torn(0), stop(false) {}
+
+    z::ZSeqSnapshot<SeqStats>   stats;
+    std::atomic<uint32_t>       torn;
+    std::atomic<bool>           stop;
+};
+
+static void* seq_reader_main(void *arg) {
+    SeqShared *s = (SeqShared*)(arg);
+    uint64_t last = 0;
+    while (!s->stop.load(std::memory_order_relaxed) ) {
+        SeqStats st = s->stats.load();
+        bool ok = st.v[0] >= last;
+        for (uint32_t i = 1; i < 6; ++i) {
+            ok = ok && st.v[i] == st.v[0];
+        }
+        if (!ok) {
+            s->torn.fetch_add(1);
+        }
+        last = st.v[0];
+    }
+    return nullptr;
+}
+
+TEST(ut_low_thread, seq_snapshot) {
+    using namespace z;
+
+    SeqShared s;
+    EXPECT_EQ(0u, s.stats.load().v[5]);
+    pthread_t readers[3];
+    for (uint32_t i = 0; i < 3; ++i) {
+        ASSERT_EQ(0, pthread_create(&readers[i], nullptr, &seq_reader_main, &s) );
+    }
+    for (uint64_t n = 1; n <= 20000; ++n) {
+        if (n % 2) {
+            SeqStats st;
+            for (uint32_t i = 0; i < 6; ++i) {
+                st.v[i] = n;
+            }
+            s.stats.store(st);
+        } else {
+            s.stats.update([] (SeqStats *st) {
+                for (uint32_t i = 0; i < 6; ++i) {
+                    ++st->v[i];
+                    if (i == 2) {
+                        sched_yield();
+                    }
+                }
+            });
+        }
+    }
+    s.stop.store(true);
+    for (uint32_t i = 0; i < 3; ++i) {
+        pthread_join(readers[i], nullptr);
+    }
+    EXPECT_EQ(0u, s.torn.load() );
+    EXPECT_EQ(20000u, s.stats.load().v[5]);
+
+    // read_begin() waits out a writer, read_retry() sees one ran
+    ZSeqLock seq;
+    uint32_t begin = seq.read_begin();
+    EXPECT_FALSE(seq.read_retry(begin) );
+    seq.lock();
+    seq.unlock();
+    EXPECT_TRUE(seq.read_retry(begin) );
+    EXPECT_FALSE(seq.read_retry(seq.read_begin() ) );
+}
+
+class CountTask : public z::ZThreadTask {
+public:
+    CountTask() : count(nullptr) {}
+    virtual int exec(void*) {
+        __sync_fetch_and_add(count, 1);
+        return 0;
+    }
+
+    uint32_t    *count;
+};
+
+TEST(ut_low_thread, thread_pool) {
+    using namespace z;
+
+    ZThreadPool pool(256);
+    ASSERT_TRUE(pool.start(3) );
+    EXPECT_EQ(3u, pool.thread_count() );
+
+    uint32_t count = 0;
+    CountTask tasks[200];
+    for (uint32_t round = 0; round < 2; ++round) {
+        for (uint32_t i = 0; i < 100; ++i) {
+            CountTask &t = tasks[round * 100 + i];
+            t.count = &count;
+            ASSERT_TRUE(pool.commit(&t) );
+        }
+        for (uint32_t ms = 0; ms < 5000 && __sync_fetch_and_add(&count, 0) < 100 * (round + 1); ++ms) {
+            zsleep_ms(1);
+        }
+        EXPECT_EQ(100 * (round + 1), count);
+    }
+    EXPECT_TRUE(tasks[199].wait(1000) );
+    CountTask idle;
+    EXPECT_FALSE(idle.wait(10) );
+    pool.stop();
+}
+
+/// a full binary tree of tasks, each committed by its parent
+class TreeTask : public z::ZThreadTask {
+public:
+    TreeTask() : pool(nullptr), tasks(nullptr), next(nullptr), count(nullptr), depth(0) {}
+    virtual int exec(void*) {
+        __sync_fetch_and_add(count, 1);
+        for (uint32_t i = 0; depth > 0 && i < 2; ++i) {
+            TreeTask &t = tasks[__sync_fetch_and_add(next, 1)];
+            t.pool = pool;
+            t.tasks = tasks;
+            t.next = next;
+            t.count = count;
+            t.depth = depth - 1;
+            EXPECT_TRUE(pool->commit(&t) );
+        }
+        return 0;
+    }
+
+    z::ZThreadPool  *pool;
+    TreeTask        *tasks;
+    uint32_t        *next;
+    uint32_t        *count;
+    uint32_t        depth;
+};
+
+class BlockTask : public z::ZThreadTask {
+public:
+    BlockTask() : release(0) {}
+    virtual int exec(void*) {
+        while (0 == __sync_fetch_and_add(&release, 0) ) {
+            z::zsleep_us(100);
+        }
+        return 0;
+    }
+
+    uint32_t    release;
+};
+
+TEST(ut_low_thread, thread_pool_work_stealing) {
+    using namespace z;
+
+    // from outside, then from the workers into their small deques, some full
+    ZThreadPool pool(16);
+    ASSERT_TRUE(pool.start(4, ZThreadPool::WORK_STEALING) );
+    uint32_t count = 0;
+    CountTask tasks[100];
+    for (uint32_t i = 0; i < 100; ++i) {
+        tasks[i].count = &count;
+        while (!pool.commit(&tasks[i]) ) {
+            ASSERT_EQ(ZThreadTask::INIT, tasks[i].status() );
+            zsleep_us(100);
+        }
+    }
+    for (uint32_t ms = 0; ms < 5000 && __sync_fetch_and_add(&count, 0) < 100; ++ms) {
+        zsleep_ms(1);
+    }
+    EXPECT_EQ(100u, count);
+
+    const uint32_t depth = 11;
+    std::vector<TreeTask> tree( (2u << depth) - 1);
+    for (uint32_t round = 0; round < 2; ++round) {
+        count = 0;
+        uint32_t next = 1;
+        for (size_t i = 0; i < tree.size(); ++i) {
+            tree[i].reset();
+        }
+        tree[0].pool = &pool;
+        tree[0].tasks = &tree[0];
+        tree[0].next = &next;
+        tree[0].count = &count;
+        tree[0].depth = depth;
+        ASSERT_TRUE(pool.commit(&tree[0]) );
+        if (round == 0) {
+            for (uint32_t ms = 0; ms < 5000 && __sync_fetch_and_add(&count, 0) < tree.size(); ++ms) {
+                zsleep_ms(1);
+            }
+        } else {
+            // stop() drains the tasks committed by running tasks
+            pool.stop();
+        }
+        EXPECT_EQ(tree.size(), count);
+        EXPECT_EQ(tree.size(), next);
+    }
+    EXPECT_EQ(0u, pool.waiting_task() );
+    CountTask late;
+    late.count = &count;
+    EXPECT_FALSE(pool.commit(&late) );
+
+    // with the only worker busy, another thread runs the waiting task
+    ZThreadPool busy(16);
+    EXPECT_FALSE(busy.run_one() );
+    ASSERT_TRUE(busy.start(1, ZThreadPool::WORK_STEALING) );
+    BlockTask block;
+    ASSERT_TRUE(busy.commit(&block) );
+    while (block.status() != ZThreadTask::RUNNING) {
+        zsleep_us(100);
+    }
+    count = 0;
+    ASSERT_TRUE(busy.commit(&late) );
+    EXPECT_EQ(1u, busy.waiting_task() );
+    EXPECT_TRUE(busy.run_one() );
+    EXPECT_EQ(1u, count);
+    EXPECT_EQ(ZThreadTask::DONE, late.status() );
+    EXPECT_FALSE(busy.run_one() );
+    __sync_fetch_and_add(&block.release, 1);
+    busy.stop();
+    EXPECT_EQ(ZThreadTask::DONE, block.status() );
+}
+
+/// counts its live copies; too big for the inline buffer when BYTES is
+template <uint32_t BYTES>
+struct LiveCall {
+    LiveCall(uint32_t *count, uint32_t *live) : count(count), live(live) {__sync_fetch_and_add(live, 1); }
+    LiveCall(const LiveCall &o) : count(o.count), live(o.live) {__sync_fetch_and_add(live, 1); }
+    ~LiveCall() {__sync_fetch_and_sub(live, 1); }
+    void operator() () {__sync_fetch_and_add(count, 1); }
+
+    uint32_t    *count;
+    uint32_t    *live;
+    char        pad[BYTES];
+};
+
+/// move-only
+struct OwnCall {
+    explicit OwnCall(uint32_t *count) : count(new uint32_t*(count) ) {}
+    OwnCall(OwnCall &&o) : count(std::move(o.count) ) {}
+    void operator() () {__sync_fetch_and_add(*count, 1); }
+
+    std::unique_ptr<uint32_t*>  count;
+};
+
+TEST(ut_low_thread, thread_pool_callable) {
+    using namespace z;
+
+    for (int mode = ZThreadPool::SHARED_QUEUE; mode <= ZThreadPool::WORK_STEALING; ++mode) {
+        ZThreadPool pool(64);
+        uint32_t count = 0;
+        EXPECT_FALSE(pool.commit([&count] () {++count; }) );
+        ASSERT_TRUE(pool.start(2, ZThreadPool::ScheduleMode(mode) ) );
+
+        // inline, on the heap, move-only, each waited for by its event
+        uint32_t live = 0;
+        ZTaskEvent events[3];
+        ASSERT_TRUE(pool.commit(LiveCall<8>(&count, &live), &events[0]) );
+        ASSERT_TRUE(pool.commit(LiveCall<128>(&count, &live), &events[1]) );
+        ASSERT_TRUE(pool.commit(OwnCall(&count), &events[2]) );
+        for (uint32_t i = 0; i < 3; ++i) {
+            EXPECT_TRUE(events[i].wait(5000) );
+            EXPECT_TRUE(events[i].is_set() );
+        }
+        EXPECT_EQ(3u, count);
+        EXPECT_EQ(0u, live);
+
+        // a group of callables, in WORK_STEALING joining groups of their own
+        ZTaskGroup group(&pool);
+        bool nested = (mode == ZThreadPool::WORK_STEALING);
+        for (uint32_t i = 0; i < 20; ++i) {
+            ASSERT_TRUE(group.commit([&pool, &count, nested] () {
+                if (!nested) {
+                    __sync_fetch_and_add(&count, 10);
+                    return;
+                }
+                ZTaskGroup inner(&pool);
+                for (uint32_t j = 0; j < 10; ++j) {
+                    EXPECT_TRUE(inner.commit([&count] () {__sync_fetch_and_add(&count, 1); }) );
+                }
+            }) );
+        }
+        EXPECT_TRUE(group.wait(5000) );
+        EXPECT_EQ(203u, count);
+
+        pool.stop();
+
+        // with the slots exhausted behind a busy worker, refused
+        ZThreadPool small(8);
+        ASSERT_TRUE(small.start(1, ZThreadPool::ScheduleMode(mode) ) );
+        ZTaskEvent block;
+        ZTaskEvent blocked;
+        ASSERT_TRUE(small.commit([&block, &blocked] () {blocked.set(); block.wait(); }) );
+        blocked.wait();
+        count = 0;
+        uint32_t committed = 0;
+        while (small.commit(LiveCall<8>(&count, &live) ) ) {
+            ++committed;
+        }
+        EXPECT_EQ(7u, committed);
+        EXPECT_EQ(committed, live);
+        block.set();
+        small.stop();
+        EXPECT_EQ(committed, count);
+        EXPECT_EQ(0u, live);
+        EXPECT_FALSE(small.commit(LiveCall<8>(&count, &live) ) );
+        EXPECT_FALSE(pool.commit(LiveCall<8>(&count, &live) ) );
+        EXPECT_EQ(0u, live);
+    }
+
+    ZTaskEvent e;
+    EXPECT_FALSE(e.wait(10) );
+    e.set();
+    EXPECT_TRUE(e.wait(0) );
+    e.reset();
+    EXPECT_FALSE(e.is_set() );
+}
+
+#endif // Z_COMPILE_FLAG_ENABLE_UT
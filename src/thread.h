@@ -4,6 +4,11 @@
 #include "tm.h"
 #include "algo_ds.h"
 #include <pthread.h>
+#include <atomic>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
 #include <vector>
 #include <unistd.h>
 #include <sys/epoll.h>
@@ -11,6 +16,17 @@
 namespace z {
 ;
 
+/**
+ * @brief futex(2) on a 32-bit word, private to the process.
+ *
+ * zfutex_wait() sleeps while *addr == val, up to timeout_ms (-1: no limit),
+ * and may return early for no reason; callers recheck their condition.
+ * @return false on timeout
+ */
+bool zfutex_wait(std::atomic<uint32_t> *addr, uint32_t val, int timeout_ms = -1);
+/// @return the number of waiters woken, at most n
+int zfutex_wake(std::atomic<uint32_t> *addr, int n = 1);
+
 class ZNoLock {
 public:
     bool try_lock() {return true; }
@@ -43,6 +59,169 @@ private:
     pthread_spinlock_t  _spinlock;
 };
 
+/**
+ * @brief A futex lock between ZSpinLock and ZMutexLock: lock() spins a
+ *        bounded number of rounds, with pause and exponential backoff, then
+ *        parks on the lock word. A parking thread marks the word CONTENDED,
+ *        so unlock() only makes a syscall when one may be sleeping; parked
+ *        threads are counted, and stop the others from spinning in vain.
+ *        Single CPU hosts skip the spinning, the holder cannot run meanwhile.
+ *
+ * timed_lock() takes an absolute ztime_now() deadline, nullptr for none,
+ * and returns 0 or ETIMEDOUT, like pthread_mutex_timedlock().
+ */
+class ZAdaptiveLock {
+    Z_DECLARE_COPY_FUNCTIONS(ZAdaptiveLock)
+public:
+    ZAdaptiveLock();
+
+    bool try_lock();
+    void lock() {if (!try_lock() ) {lock_slow(nullptr); } }
+    int timed_lock(const ztime_t *t);
+    void unlock();
+private:
+    enum {
+        UNLOCKED    = 0,
+        LOCKED,
+        CONTENDED,          ///< locked, and threads may sleep on it
+    };
+    enum {
+        SPIN_ROUNDS     = 8,    ///< the backoff doubles from 1 pause each round
+    };
+
+    /// @return true if it took the lock
+    bool spin();
+    int lock_slow(const ztime_t *t);
+private:
+    std::atomic<uint32_t>   _state;     ///< the futex word
+    std::atomic<uint32_t>   _waiters;   ///< parked or about to park
+};
+
+/**
+ * @brief A reader-writer lock for read-mostly data, whose readers do not
+ *        bounce a shared cache line: each CPU has its own reader count.
+ *
+ * read_lock() adds one to the count of the CPU it runs on, then looks for a
+ * writer; read_unlock() takes one from the CPU it runs on by then, maybe
+ * another, so a count may go negative and only the sum means anything. A
+ * writer excludes the other writers, raises a flag and waits for the sum to
+ * drop to zero. Readers coming meanwhile back out and sleep until it is
+ * done: writers are never starved by a stream of readers.
+ *
+ * lock(), try_lock(), timed_lock() and unlock() are the writer side, so it
+ * fits any LOCK policy; the read-only paths of the templates take the
+ * reader side through ZSharedLock, see HashTable64::find().
+ */
+class ZRWLock {
+    Z_DECLARE_COPY_FUNCTIONS(ZRWLock)
+public:
+    ZRWLock();
+    ~ZRWLock();
+
+    void read_lock();
+    bool try_read_lock();
+    void read_unlock();
+
+    bool try_lock();
+    void lock() {timed_lock(nullptr); }
+    int timed_lock(const ztime_t *t);
+    void unlock();
+private:
+    enum {
+        NO_WRITER       = 0,
+        WRITING,
+        WRITING_WAITED,         ///< and readers sleep until it is done
+    };
+    enum {
+        SPIN_BEFORE_YIELD   = 64,
+    };
+
+    struct __attribute__((aligned(DEF_SIZE_CACHE_LINE))) Slot {
+        std::atomic<int32_t>    readers;
+    };
+
+    Slot* slot() const;
+    /// @return false on timeout, the writer flag still raised
+    bool wait_readers(const ztime_t *t) const;
+    void wait_writer();
+    void end_write();
+private:
+    Slot                    *_slots;
+    uint32_t                _slot_mask;
+    ZAdaptiveLock           _writers;
+    std::atomic<uint32_t>   _writer;    ///< the futex word of the readers waiting
+};
+
+/**
+ * @brief A sequence lock: writers exclude each other with lock() and keep
+ *        the sequence odd while they write; readers never write anything,
+ *        they read, then retry if the sequence moved meanwhile.
+ *
+ *     uint32_t seq;
+ *     do {
+ *         seq = s.read_begin();
+ *         copy = data;
+ *     } while (s.read_retry(seq) );
+ *
+ * The data read may be torn until read_retry() says it is not: readers must
+ * only copy it, not follow pointers in it. ZSeqSnapshot wraps a value. As a
+ * LOCK policy it is just a writer lock.
+ */
+class ZSeqLock {
+    Z_DECLARE_COPY_FUNCTIONS(ZSeqLock)
+public:
+    ZSeqLock() {_seq.store(0, std::memory_order_relaxed); }
+
+    bool try_lock();
+    void lock() {timed_lock(nullptr); }
+    int timed_lock(const ztime_t *t);
+    void unlock();
+
+    /// waits out a writer
+    uint32_t read_begin() const {
+        uint32_t seq = _seq.load(std::memory_order_acquire);
+        return (seq & 1) ? wait_writer() : seq;
+    }
+    /// @return true if a writer ran since read_begin(): read again
+    bool read_retry(uint32_t seq) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return _seq.load(std::memory_order_relaxed) != seq;
+    }
+private:
+    enum {
+        SPIN_BEFORE_YIELD   = 64,
+    };
+
+    uint32_t wait_writer() const;
+private:
+    ZAdaptiveLock           _writers;
+    std::atomic<uint32_t>   _seq;       ///< odd while a writer runs
+};
+
+/**
+ * @brief A small trivially copyable value behind a ZSeqLock: load() copies
+ *        a consistent snapshot without writing shared memory, store() and
+ *        update() replace it. For stats and config snapshots of a few cache
+ *        lines at most, every load() copies all of it.
+ */
+template <typename T>
+    class ZSeqSnapshot {
+    private:
+        Z_DECLARE_COPY_FUNCTIONS(ZSeqSnapshot);
+        static_assert(std::is_trivially_copyable<T>::value, "load() copies T while it may be written");
+    public:
+        explicit ZSeqSnapshot(const T &v = T() ) : _value(v) {}
+
+        T load() const;
+        void store(const T &v);
+        /// f(T*) changes the value in place, under the writer lock
+        template <typename F>
+            void update(F f);
+    private:
+        ZSeqLock    _lock;
+        T           _value;
+    };
+
 template <typename LOCK>
 class ZAutoLocker {
 public:
@@ -59,8 +238,13 @@ private:
 
 // ------------------------------------------------------------------------ //
 
+class ZThreadPool;
+class ZTaskGroup;
+
 class ZThreadTask {
     Z_DECLARE_COPY_FUNCTIONS(ZThreadTask)
+    friend class ZThreadPool;
+    friend class ZTaskGroup;
 public:
     enum TaskStatus {
         INIT        = 0,
@@ -79,21 +263,142 @@ public:
     void signal_done();
 
     virtual int exec(void*);
+    /**
+     * Called by the pool after exec(), the last touch of the task by the
+     * pool: signals the waiters unless exec() did. A task that owns itself
+     * may delete itself here instead.
+     */
+    virtual void finish();
 protected:
     int                 _status;
     pthread_mutex_t     _mutex;
     pthread_cond_t      _cond;
+    ZTaskGroup          *_group;    ///< counts the task in, until it finished
 };
 
+/**
+ * @brief A one-shot event on a futex word: set() once, wait() for it. The
+ *        setter only makes a syscall when a waiter went to sleep.
+ */
+class ZTaskEvent {
+    Z_DECLARE_COPY_FUNCTIONS(ZTaskEvent)
+public:
+    ZTaskEvent() {_state.store(PENDING, std::memory_order_relaxed); }
+
+    void reset() {_state.store(PENDING, std::memory_order_relaxed); }
+    void set();
+    bool is_set() const {return SET == _state.load(std::memory_order_acquire); }
+    /// @return false on timeout
+    bool wait(int timeout_ms = -1);
+private:
+    enum {
+        PENDING     = 0,
+        WAITING,            ///< pending, and a thread sleeps on it
+        SET,
+    };
+
+    std::atomic<uint32_t>   _state;
+};
+
+/**
+ * @brief The task slot of ZThreadPool::commit(F&&): a callable stored in
+ *        place when it fits in INLINE_BYTES, on the heap otherwise. Slots
+ *        are pooled and reused, so the mutex and condition of ZThreadTask
+ *        are set up once per slot and never used.
+ */
+class ZCallTask : public ZThreadTask {
+    Z_DECLARE_COPY_FUNCTIONS(ZCallTask)
+    friend class ZThreadPool;
+    friend class ZTaskGroup;
+public:
+    enum {
+        INLINE_BYTES    = 48,
+    };
+
+    ZCallTask() : _fn(nullptr), _op(nullptr), _event(nullptr), _pool(nullptr) {}
+
+    virtual int exec(void*);
+    /// frees the slot, then sets the event
+    virtual void finish();
+private:
+    /// run (or not) then destroy the callable
+    typedef void (*Op)(void *fn, bool run);
+    typedef std::aligned_storage<INLINE_BYTES, alignof(std::max_align_t)>::type Buffer;
+
+    template <typename F>
+        void bind(F &&f, ZTaskEvent *event);
+    template <typename F>
+        void place(F &&f, std::true_type);
+    template <typename F>
+        void place(F &&f, std::false_type);
+    template <typename Fn>
+        static void inline_op(void *fn, bool run);
+    template <typename Fn>
+        static void heap_op(void *fn, bool run);
+    /// destroys the callable unrun, for a commit that failed
+    void cancel();
+private:
+    Buffer          _buf;
+    void            *_fn;       ///< in _buf, or on the heap
+    Op              _op;
+    ZTaskEvent      *_event;
+    ZThreadPool     *_pool;
+};
+
+/**
+ * @brief A pool of worker threads running ZThreadTasks.
+ *
+ * SHARED_QUEUE: every task goes through one queue whose eventfd the workers
+ * poll through a shared epoll fd.
+ *
+ * WORK_STEALING: every worker owns a WorkStealingDeque. A task committed
+ * from a worker goes to the bottom of its own deque and is likely run next
+ * by the same thread, with its data still in cache; a task committed from
+ * any other thread goes to a shared injection queue. An idle worker takes
+ * from its own deque, then the injection queue, then steals the oldest task
+ * of a random victim, and parks on a futex after a fruitless round: a
+ * committer only makes a syscall when some worker is parked. stop() lets the
+ * workers drain everything, including tasks committed by running tasks.
+ */
 class ZThreadPool {
     Z_DECLARE_COPY_FUNCTIONS(ZThreadPool)
+    friend class ZCallTask;
+    friend class ZTaskGroup;
 public:
+    enum ScheduleMode {
+        SHARED_QUEUE    = 0,
+        WORK_STEALING,
+    };
+
+    /// task_queue_size bounds the shared queue and, in WORK_STEALING, each deque
     ZThreadPool(uint32_t task_queue_size = 1024);
     ~ZThreadPool();
 public:
-    bool     start(uint32_t thread_num = 2);
+    bool     start(uint32_t thread_num = 2, ScheduleMode mode = SHARED_QUEUE);
     void     stop();
+    /**
+     * In WORK_STEALING a worker whose deque is full runs the task in
+     * place before returning.
+     */
     bool     commit(ZThreadTask *task);
+    /**
+     * Commit any callable f(), in one of task_queue_size pooled slots: no
+     * allocation unless its captures exceed ZCallTask::INLINE_BYTES. With
+     * an event, it is set once f() has returned. A WORK_STEALING worker
+     * finding no free slot runs f() in place, like for a full deque.
+     * @return false, f() not run, if the pool is not running or is full
+     */
+    template <typename F>
+        typename std::enable_if<!std::is_convertible<F, ZThreadTask*>::value, bool>::type
+        commit(F &&f, ZTaskEvent *event = nullptr);
+    /**
+     * Run one waiting task on the calling thread, if any: a task waiting
+     * for the tasks it committed helps instead of blocking a worker. Only
+     * in WORK_STEALING: a SHARED_QUEUE worker holds a batch of dequeued
+     * tasks, possibly the one its task waits for.
+     * @return false if no task was found
+     */
+    bool     run_one();
     uint32_t thread_count() const;
     uint32_t waiting_task() const;
 private:
@@ -102,6 +407,20 @@ private:
         uint32_t        info_offset;
     };
     static void* ThreadMain(void *arg);
+    static void run_task(ZThreadTask *task);
+    uint32_t batch_size() const;
+
+    void steal_loop(uint32_t self);
+    /// self is the worker index, or -1 from another thread
+    ZThreadTask* find_task(uint32_t self);
+    void wake_one();
+
+    /// the calling thread is a WORK_STEALING worker of this pool
+    bool on_worker() const;
+    ZCallTask* alloc_call();
+    void release_call(ZCallTask *task);
+    /// frees the slot if the commit fails
+    bool commit_call(ZCallTask *task);
 private:
     struct ThreadInfo {
         pthread_t       id;
@@ -110,8 +429,21 @@ private:
     };
     typedef ZThreadTask*                                    TaskPtr;
     typedef std::vector<ThreadInfo>                         ThreadInfoList;
-    typedef z::FixedLengthQueueWithFd<TaskPtr, 
-                    z::ZSpinLock>                           TaskQueue;
+    typedef z::FixedLengthQueueWithFd<TaskPtr, z::ZNoLock, 1024,
+                    z::MPMCQueue<TaskPtr> >                 TaskQueue;
+    struct Worker {
+        Worker(uint32_t n) : deque(n), rand(0) {}
+
+        z::WorkStealingDeque<TaskPtr>   deque;
+        uint64_t                        rand;       ///< picks the victims
+    };
+    typedef std::vector<Worker*>                            WorkerList;
+    enum {
+        BATCH_SIZE      = 16,
+        STEAL_ROUNDS    = 2,    ///< sweeps over the victims before parking
+        PARK_MS         = 100,
+        CALL_MAGAZINE   = 16,   ///< slots of commit(F&&) cached per thread
+    };
     enum ThreadPoolStatus {
         INIT        = 0,
         RUNNING,
@@ -120,12 +452,160 @@ private:
     };
 
     int             _status;
+    int             _mode;
     int             _sched_epoll;
     ::epoll_event   _ev;
     ThreadInfoList  _threads;
     TaskQueue       _task_queue;
+
+    uint32_t                _deque_size;
+    WorkerList              _workers;
+    z::MPMCQueue<TaskPtr>   _inject;        ///< committed from outside the workers
+    std::atomic<uint32_t>   _sleepers;      ///< workers about to park or parked
+    std::atomic<uint32_t>   _searching;     ///< woken workers without a task yet
+    std::atomic<uint32_t>   _wake_seq;      ///< the futex word they park on
+
+    z::StaticLinkedList<ZCallTask, z::ZLockFree>   *_calls;    ///< the slots of commit(F&&)
 };
 
+/**
+ * @brief Tasks committed to a pool and waited for together, with a single
+ *        counter of unfinished tasks as the futex word: no task needs its
+ *        own mutex and condition to be joined.
+ *
+ * wait() from a worker of the pool runs tasks of the pool while the group
+ * is not done, rather than blocking the thread; see ZThreadPool::run_one().
+ * Joining from the workers hence takes a WORK_STEALING pool. The destructor
+ * waits.
+ */
+class ZTaskGroup {
+    Z_DECLARE_COPY_FUNCTIONS(ZTaskGroup)
+    friend class ZThreadPool;
+public:
+    explicit ZTaskGroup(ZThreadPool *pool);
+    ~ZTaskGroup();
+
+    bool     commit(ZThreadTask *task);
+    /// a callable in a slot of the pool, see ZThreadPool::commit(F&&)
+    template <typename F>
+        typename std::enable_if<!std::is_convertible<F, ZThreadTask*>::value, bool>::type
+        commit(F &&f);
+    /// @return false on timeout
+    bool     wait(int timeout_ms = -1);
+    uint32_t pending() const {return _pending.load(std::memory_order_acquire) & ~uint32_t(WAITING); }
+private:
+    enum {
+        WAIT_SLICE_MS   = 1,            ///< a waiting worker looks for tasks this often
+        WAITING         = 0x80000000U,  ///< of _pending: a thread sleeps on it
+    };
+
+    void done();
+private:
+    ZThreadPool             *_pool;
+    std::atomic<uint32_t>   _pending;   ///< the futex word: the count, and WAITING
+};
+
+// ------------------------------------------------------------------------ //
+
+template <typename F>
+    void ZCallTask::bind(F &&f, ZTaskEvent *event) {
+        typedef typename std::decay<F>::type Fn;
+        place(std::forward<F>(f), std::integral_constant<bool,
+            sizeof(Fn) <= sizeof(Buffer) && alignof(Fn) <= alignof(Buffer)>() );
+        _event = event;
+    }
+
+template <typename F>
+    void ZCallTask::place(F &&f, std::true_type) {
+        typedef typename std::decay<F>::type Fn;
+        _fn = new (&_buf) Fn(std::forward<F>(f) );
+        _op = &ZCallTask::inline_op<Fn>;
+    }
+
+template <typename F>
+    void ZCallTask::place(F &&f, std::false_type) {
+        typedef typename std::decay<F>::type Fn;
+        _fn = new Fn(std::forward<F>(f) );
+        _op = &ZCallTask::heap_op<Fn>;
+    }
+
+template <typename Fn>
+    void ZCallTask::inline_op(void *fn, bool run) {
+        Fn *f = static_cast<Fn*>(fn);
+        if (run) {
+            (*f)();
+        }
+        f->~Fn();
+    }
+
+template <typename Fn>
+    void ZCallTask::heap_op(void *fn, bool run) {
+        Fn *f = static_cast<Fn*>(fn);
+        if (run) {
+            (*f)();
+        }
+        delete f;
+    }
+
+template <typename F>
+    typename std::enable_if<!std::is_convertible<F, ZThreadTask*>::value, bool>::type
+    ZThreadPool::commit(F &&f, ZTaskEvent *event) {
+        ZCallTask *task = alloc_call();
+        if (nullptr == task) {
+            Z_RET_IF(!on_worker(), false);
+            f();
+            if (event) {
+                event->set();
+            }
+            return true;
+        }
+        task->bind(std::forward<F>(f), event);
+        return commit_call(task);
+    }
+
+template <typename F>
+    typename std::enable_if<!std::is_convertible<F, ZThreadTask*>::value, bool>::type
+    ZTaskGroup::commit(F &&f) {
+        ZCallTask *task = _pool ? _pool->alloc_call() : nullptr;
+        if (nullptr == task) {
+            Z_RET_IF(nullptr == _pool || !_pool->on_worker(), false);
+            f();
+            return true;
+        }
+        task->bind(std::forward<F>(f), nullptr);
+        _pending.fetch_add(1, std::memory_order_relaxed);
+        task->_group = this;
+        Z_RET_IF(_pool->commit_call(task), true);
+        done();
+        return false;
+    }
+
+template <typename T>
+    T ZSeqSnapshot<T>::load() const {
+        T v;
+        uint32_t seq;
+        do {
+            seq = _lock.read_begin();
+            v = _value;
+        } while (_lock.read_retry(seq) );
+        return v;
+    }
+
+template <typename T>
+    void ZSeqSnapshot<T>::store(const T &v) {
+        _lock.lock();
+        _value = v;
+        _lock.unlock();
+    }
+
+template <typename T>
+template <typename F>
+    void ZSeqSnapshot<T>::update(F f) {
+        _lock.lock();
+        f(&_value);
+        _lock.unlock();
+    }
+
 } // namespace z
 
 #endif
@@ -0,0 +1,229 @@
+#include "thread_future.h"
+
+#if Z_COMPILE_FLAG_ENABLE_UT
+#include <gtest/gtest.h>
+
+namespace {
+;
+
+/// sets a promise from a pool thread
+class SetTask : public z::ZThreadTask {
+public:
+    SetTask() : value(0), delay_us(0) {}
+    virtual int exec(void*) {
+        if (delay_us) {
+            z::zsleep_us(delay_us);
+        }
+        promise.set_value(value);
+        return 0;
+    }
+
+    z::ZPromise<int>    promise;
+    int                 value;
+    uint32_t            delay_us;
+};
+
+class AddTask : public z::ZThreadTask {
+public:
+    AddTask() : sum(nullptr) {}
+    virtual int exec(void*) {
+        __sync_fetch_and_add(sum, 1);
+        return 0;
+    }
+
+    uint32_t    *sum;
+};
+
+/// a node of a tree: commits its children to a group and joins them
+class JoinTask : public z::ZThreadTask {
+public:
+    JoinTask() : pool(nullptr), depth(0), leaves(nullptr) {}
+    virtual int exec(void*) {
+        if (0 == depth) {
+            __sync_fetch_and_add(leaves, 1);
+            return 0;
+        }
+        z::ZTaskGroup group(pool);
+        JoinTask children[2];
+        for (uint32_t i = 0; i < 2; ++i) {
+            children[i].pool = pool;
+            children[i].depth = depth - 1;
+            children[i].leaves = leaves;
+            EXPECT_TRUE(group.commit(&children[i]) );
+        }
+        EXPECT_TRUE(group.wait() );
+        return 0;
+    }
+    /// the children live on the stack of the parent: only the group tells
+    /// they finished, and the pool touches nothing after finish()
+    virtual void finish() {}
+
+    z::ZThreadPool  *pool;
+    uint32_t        depth;
+    uint32_t        *leaves;
+};
+
+int add_one(const int &v) {return v + 1; }
+
+} // namespace
+
+TEST(ut_low_thread_future, promise) {
+    using namespace z;
+
+    ZPromise<int> p;
+    ZFuture<int> f = p.future();
+    ZFuture<int> copy;
+    EXPECT_FALSE(copy.valid() );
+    EXPECT_FALSE(copy.wait(0) );
+    EXPECT_EQ(0, copy.get() );
+    copy = f;
+    EXPECT_TRUE(copy.valid() );
+    EXPECT_FALSE(f.is_ready() );
+    EXPECT_FALSE(f.wait(10) );
+
+    EXPECT_TRUE(p.set_value(7) );
+    EXPECT_FALSE(p.set_value(8) );
+    EXPECT_TRUE(f.is_ready() );
+    EXPECT_TRUE(f.wait(0) );
+    EXPECT_EQ(7, f.get() );
+    EXPECT_EQ(7, copy.get() );
+
+    // then() with no pool runs on the setting thread, or at once if set
+    ZFuture<int> now = f.then(nullptr, add_one);
+    EXPECT_TRUE(now.is_ready() );
+    EXPECT_EQ(8, now.get() );
+    ZPromise<int> later;
+    ZFuture<std::string> s = later.future().then(nullptr, [](const int &v) {return std::string(v, 'x'); });
+    EXPECT_FALSE(s.is_ready() );
+    later.set_value(3);
+    EXPECT_EQ(std::string("xxx"), s.get() );
+}
+
+TEST(ut_low_thread_future, then_on_pool) {
+    using namespace z;
+
+    ZThreadPool pool(64);
+    ASSERT_TRUE(pool.start(2, ZThreadPool::WORK_STEALING) );
+
+    // a chain, set from a pool thread while this one sleeps on the futex
+    SetTask set;
+    set.value = 10;
+    set.delay_us = 20000;
+    ZFuture<int> f = set.promise.future()
+        .then(&pool, add_one)
+        .then(&pool, [](const int &v) {return v * 2; });
+    ASSERT_TRUE(pool.commit(&set) );
+    EXPECT_EQ(22, f.get() );
+
+    // many continuations of one value, added before and after it is set
+    ZPromise<int> p;
+    std::vector<ZFuture<int> > outs;
+    for (int i = 0; i < 50; ++i) {
+        outs.push_back(p.future().then(&pool, [i](const int &v) {return v + i; }) );
+    }
+    p.set_value(100);
+    for (int i = 50; i < 100; ++i) {
+        outs.push_back(p.future().then(&pool, [i](const int &v) {return v + i; }) );
+    }
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(100 + i, outs[i].get() );
+    }
+    pool.stop();
+}
+
+TEST(ut_low_thread_future, when_all_any) {
+    using namespace z;
+
+    ZThreadPool pool(64);
+    ASSERT_TRUE(pool.start(3, ZThreadPool::WORK_STEALING) );
+
+    // set out of order, some already set
+    SetTask tasks[8];
+    std::vector<ZFuture<int> > futures;
+    for (int i = 0; i < 8; ++i) {
+        tasks[i].value = i * i;
+        tasks[i].delay_us = (8 - i) * 2000;
+        futures.push_back(tasks[i].promise.future() );
+    }
+    tasks[5].promise.set_value(25);
+    ZFuture<std::vector<int> > all = when_all(futures);
+    ZFuture<std::pair<uint32_t, int> > any = when_any(futures);
+    EXPECT_TRUE(any.is_ready() );
+    EXPECT_EQ(5u, any.get().first);
+    EXPECT_EQ(25, any.get().second);
+    EXPECT_FALSE(all.is_ready() );
+    for (int i = 0; i < 8; ++i) {
+        ASSERT_TRUE(pool.commit(&tasks[i]) );
+    }
+    ASSERT_EQ(8u, all.get().size() );
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_EQ(i * i, all.get()[i]);
+    }
+
+    // the first of unset futures
+    ZPromise<int> a;
+    ZPromise<int> b;
+    std::vector<ZFuture<int> > ab;
+    ab.push_back(a.future() );
+    ab.push_back(b.future() );
+    ZFuture<std::pair<uint32_t, int> > first = when_any(ab);
+    EXPECT_FALSE(first.is_ready() );
+    b.set_value(2);
+    a.set_value(1);
+    EXPECT_EQ(1u, first.get().first);
+    EXPECT_EQ(2, first.get().second);
+
+    EXPECT_TRUE(when_all(std::vector<ZFuture<int> >() ).get().empty() );
+    EXPECT_FALSE(when_any(std::vector<ZFuture<int> >() ).wait(0) );
+    for (int i = 0; i < 8; ++i) {
+        tasks[i].wait(1000);
+    }
+    pool.stop();
+}
+
+TEST(ut_low_thread_future, task_group) {
+    using namespace z;
+
+    // from outside the pool, in both modes
+    for (int mode = ZThreadPool::SHARED_QUEUE; mode <= ZThreadPool::WORK_STEALING; ++mode) {
+        ZThreadPool pool(256);
+        ASSERT_TRUE(pool.start(2, ZThreadPool::ScheduleMode(mode) ) );
+        uint32_t sum = 0;
+        AddTask tasks[200];
+        ZTaskGroup group(&pool);
+        EXPECT_TRUE(group.wait(0) );
+        for (uint32_t i = 0; i < 200; ++i) {
+            tasks[i].sum = &sum;
+            ASSERT_TRUE(group.commit(&tasks[i]) );
+        }
+        ASSERT_FALSE(group.commit(&tasks[0]) );
+        EXPECT_TRUE(group.wait(5000) );
+        EXPECT_EQ(0u, group.pending() );
+        EXPECT_EQ(200u, sum);
+        pool.stop();
+    }
+
+    // nested groups joined on the workers: with 2 threads and 2^10 leaves,
+    // blocking joins would deadlock, helping ones do not
+    ZThreadPool pool(64);
+    ASSERT_TRUE(pool.start(2, ZThreadPool::WORK_STEALING) );
+    uint32_t leaves = 0;
+    JoinTask root;
+    root.pool = &pool;
+    root.depth = 10;
+    root.leaves = &leaves;
+    ZTaskGroup group(&pool);
+    ASSERT_TRUE(group.commit(&root) );
+    EXPECT_TRUE(group.wait(10000) );
+    EXPECT_EQ(1024u, leaves);
+
+    // freed as soon as wait() returns: the last done() must not touch it then
+    for (int i = 0; i < 1000; ++i) {
+        ZTaskGroup *g = new ZTaskGroup(&pool);
+        ASSERT_TRUE(g->commit([] () {}) );
+        EXPECT_TRUE(g->wait() );
+        delete g;
+    }
+    pool.stop();
+}
+#endif
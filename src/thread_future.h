@@ -0,0 +1,375 @@
+#ifndef Z_THREAD_FUTURE_H__
+#define Z_THREAD_FUTURE_H__
+
+/**
+ * @brief Futures and promises over ZThreadPool.
+ *
+ * A ZPromise sets a value once; the ZFutures of it read the value, wait for
+ * it on a futex, or chain work with then(), which runs on a pool once the
+ * value is set instead of blocking a thread until then. when_all() and
+ * when_any() combine futures into one. Promises and futures are handles to
+ * a shared reference counted state and are cheap to copy.
+ *
+ * A promise dropped without a value leaves its futures waiting forever.
+ */
+
+#include "thread.h"
+#include <limits.h>
+#include <stdint.h>
+#include <atomic>
+#include <utility>
+#include <vector>
+#include <type_traits>
+
+namespace z {
+;
+
+/**
+ * @brief Run once the value of a future is set, on the thread setting it,
+ *        or at once if it is already set. The callback owns itself.
+ */
+class ZFutureCallback {
+public:
+    ZFutureCallback() : next(nullptr) {}
+    virtual ~ZFutureCallback() {}
+
+    virtual void ready() = 0;
+
+    ZFutureCallback     *next;
+};
+
+template <typename T>
+    class ZFutureState {
+    private:
+        Z_DECLARE_COPY_FUNCTIONS(ZFutureState);
+    public:
+        ZFutureState();
+
+        void ref() {_refs.fetch_add(1, std::memory_order_relaxed); }
+        void unref();
+
+        /// @return false if a value was set before
+        bool set(const T &v);
+        bool is_ready() const {return READY == _ready.load(std::memory_order_acquire); }
+        /// @return false on timeout
+        bool wait(int timeout_ms);
+        const T& value() const {return _value; }
+        void add_callback(ZFutureCallback *cb);
+    private:
+        enum {
+            PENDING     = 0,
+            WAITING,            ///< pending, and a thread sleeps on it
+            READY,
+        };
+
+        /// the callback list once the value is set
+        static ZFutureCallback* closed() {return reinterpret_cast<ZFutureCallback*>(uintptr_t(1) ); }
+    private:
+        std::atomic<uint32_t>           _refs;
+        std::atomic<uint32_t>           _ready;     ///< the futex word
+        std::atomic<bool>               _claimed;   ///< by the first set()
+        std::atomic<ZFutureCallback*>   _callbacks;
+        T                               _value;
+    };
+
+template <typename T>
+    class ZFuture {
+    public:
+        ZFuture() : _s(nullptr) {}
+        explicit ZFuture(ZFutureState<T> *s) : _s(s) {if (_s) {_s->ref(); } }
+        ZFuture(const ZFuture &o) : _s(o._s) {if (_s) {_s->ref(); } }
+        ~ZFuture() {if (_s) {_s->unref(); } }
+        ZFuture& operator= (const ZFuture &o);
+
+        bool valid() const {return nullptr != _s; }
+        bool is_ready() const {return _s && _s->is_ready(); }
+        /// @return false on timeout
+        bool wait(int timeout_ms = -1) const {return _s && _s->wait(timeout_ms); }
+        /// waits for the value; T() for a future with no state
+        const T& get() const;
+
+        /**
+         * A future of f(value), f run in a slot of pool once the value is
+         * set, see ZThreadPool::commit(F&&); with no pool, or if the pool
+         * refuses it, f runs on the thread that sets the value.
+         */
+        template <typename F>
+            ZFuture<typename std::result_of<F(const T&)>::type> then(ZThreadPool *pool, F f) const;
+
+        /// for the combinators: cb runs once the value is set
+        void on_ready(ZFutureCallback *cb) const {_s->add_callback(cb); }
+    private:
+        ZFutureState<T>     *_s;
+    };
+
+template <typename T>
+    class ZPromise {
+    public:
+        ZPromise() : _s(new ZFutureState<T>) {}
+        ZPromise(const ZPromise &o) : _s(o._s) {_s->ref(); }
+        ~ZPromise() {_s->unref(); }
+        ZPromise& operator= (const ZPromise &o);
+
+        ZFuture<T> future() const {return ZFuture<T>(_s); }
+        /// @return false if a value was set before
+        bool set_value(const T &v) {return _s->set(v); }
+    private:
+        ZFutureState<T>     *_s;
+    };
+
+/// the values of all the futures, in order, once all are set
+template <typename T>
+    ZFuture<std::vector<T> > when_all(const std::vector<ZFuture<T> > &futures);
+
+/// the index and the value of the first future set; none: never set
+template <typename T>
+    ZFuture<std::pair<uint32_t, T> > when_any(const std::vector<ZFuture<T> > &futures);
+
+// ------------------------------------------------------------------------ //
+
+template <typename T>
+    ZFutureState<T>::ZFutureState() : _value() {
+        _refs.store(1, std::memory_order_relaxed);
+        _ready.store(PENDING, std::memory_order_relaxed);
+        _claimed.store(false, std::memory_order_relaxed);
+        _callbacks.store(nullptr, std::memory_order_relaxed);
+    }
+
+template <typename T>
+    void ZFutureState<T>::unref() {
+        if (1 == _refs.fetch_sub(1, std::memory_order_acq_rel) ) {
+            delete this;
+        }
+    }
+
+template <typename T>
+    bool ZFutureState<T>::set(const T &v) {
+        Z_RET_IF(_claimed.exchange(true, std::memory_order_acq_rel), false);
+        _value = v;
+        if (WAITING == _ready.exchange(READY, std::memory_order_acq_rel) ) {
+            zfutex_wake(&_ready, INT_MAX);
+        }
+
+        // pushed last first: run them in the order they were added
+        ZFutureCallback *cb = _callbacks.exchange(closed(), std::memory_order_acq_rel);
+        ZFutureCallback *ordered = nullptr;
+        while (cb) {
+            ZFutureCallback *next = cb->next;
+            cb->next = ordered;
+            ordered = cb;
+            cb = next;
+        }
+        while (ordered) {
+            ZFutureCallback *next = ordered->next;
+            ordered->ready();
+            ordered = next;
+        }
+        return true;
+    }
+
+template <typename T>
+    bool ZFutureState<T>::wait(int timeout_ms) {
+        uint64_t deadline = (timeout_ms < 0) ? 0 : zmonotonic_ms() + timeout_ms;
+        for (;;) {
+            uint32_t s = _ready.load(std::memory_order_acquire);
+            Z_RET_IF(READY == s, true);
+            if (PENDING == s && !_ready.compare_exchange_weak(s, WAITING, std::memory_order_acq_rel) ) {
+                continue;
+            }
+
+            int left = -1;
+            if (timeout_ms >= 0) {
+                uint64_t now = zmonotonic_ms();
+                Z_RET_IF(now >= deadline, is_ready() );
+                left = int(deadline - now);
+            }
+            zfutex_wait(&_ready, WAITING, left);
+        }
+    }
+
+template <typename T>
+    void ZFutureState<T>::add_callback(ZFutureCallback *cb) {
+        ZFutureCallback *head = _callbacks.load(std::memory_order_acquire);
+        do {
+            if (closed() == head) {
+                cb->ready();
+                return;
+            }
+            cb->next = head;
+        } while (!_callbacks.compare_exchange_weak(head, cb, std::memory_order_acq_rel) );
+    }
+
+template <typename T>
+    ZFuture<T>& ZFuture<T>::operator= (const ZFuture &o) {
+        if (o._s) {
+            o._s->ref();
+        }
+        if (_s) {
+            _s->unref();
+        }
+        _s = o._s;
+        return *this;
+    }
+
+template <typename T>
+    const T& ZFuture<T>::get() const {
+        static const T none = T();
+        Z_RET_IF(nullptr == _s, none);
+        _s->wait(-1);
+        return _s->value();
+    }
+
+template <typename T>
+    ZPromise<T>& ZPromise<T>::operator= (const ZPromise &o) {
+        o._s->ref();
+        _s->unref();
+        _s = o._s;
+        return *this;
+    }
+
+/**
+ * The continuation of then(): a pointer to it is committed to the pool when
+ * the value is set, a pooled slot with no mutex or condition of its own, and
+ * it frees itself once it ran.
+ */
+template <typename T, typename U, typename F>
+    class ZFutureThen : public ZFutureCallback {
+    public:
+        ZFutureThen(ZThreadPool *pool, const ZFuture<T> &src, const ZPromise<U> &dst, const F &f)
+        : _pool(pool), _src(src), _dst(dst), _f(f) {}
+
+        virtual void ready() {
+            ZFutureThen *self = this;
+            if (nullptr == _pool || !_pool->commit([self] () {self->run(); }) ) {
+                run();
+            }
+        }
+    private:
+        void run() {
+            _dst.set_value(_f(_src.get() ) );
+            delete this;
+        }
+    private:
+        ZThreadPool     *_pool;
+        ZFuture<T>      _src;
+        ZPromise<U>     _dst;
+        F               _f;
+    };
+
+template <typename T>
+template <typename F>
+    ZFuture<typename std::result_of<F(const T&)>::type> ZFuture<T>::then(ZThreadPool *pool, F f) const {
+        typedef typename std::result_of<F(const T&)>::type U;
+        ZPromise<U> p;
+        ZFuture<U> r = p.future();
+        Z_RET_IF(nullptr == _s, r);
+        _s->add_callback(new ZFutureThen<T, U, F>(pool, *this, p, f) );
+        return r;
+    }
+
+/**
+ * The combinators: a slot per input future, called back with its value,
+ * and the join freed by the last slot to run.
+ */
+template <typename T>
+    class ZFutureJoin {
+    private:
+        Z_DECLARE_COPY_FUNCTIONS(ZFutureJoin);
+    public:
+        explicit ZFutureJoin(const std::vector<ZFuture<T> > &futures) : _slots(futures.size() ) {
+            _left.store(uint32_t(futures.size() ), std::memory_order_relaxed);
+            for (uint32_t i = 0; i < futures.size(); ++i) {
+                _slots[i].join = this;
+                _slots[i].src = futures[i];
+                _slots[i].index = i;
+            }
+        }
+        virtual ~ZFutureJoin() {}
+
+        /// this may be freed before it returns, if all the values are set
+        void start() {
+            uint32_t n = uint32_t(_slots.size() );
+            for (uint32_t i = 0; i < n; ++i) {
+                _slots[i].src.on_ready(&_slots[i]);
+            }
+        }
+    protected:
+        virtual void value(uint32_t index, const T &v) = 0;
+        /// after the value of the last slot
+        virtual void last() = 0;
+    private:
+        struct Slot : public ZFutureCallback {
+            virtual void ready() {join->arrive(index, src.get() ); }
+
+            ZFutureJoin     *join;
+            ZFuture<T>      src;
+            uint32_t        index;
+        };
+
+        void arrive(uint32_t index, const T &v) {
+            value(index, v);
+            if (1 == _left.fetch_sub(1, std::memory_order_acq_rel) ) {
+                last();
+                delete this;
+            }
+        }
+    private:
+        std::vector<Slot>       _slots;
+        std::atomic<uint32_t>   _left;
+    };
+
+template <typename T>
+    class ZFutureAll : public ZFutureJoin<T> {
+    public:
+        explicit ZFutureAll(const std::vector<ZFuture<T> > &futures)
+        : ZFutureJoin<T>(futures), _values(futures.size() ) {}
+
+        ZFuture<std::vector<T> > future() const {return _promise.future(); }
+    protected:
+        virtual void value(uint32_t index, const T &v) {_values[index] = v; }
+        virtual void last() {_promise.set_value(_values); }
+    private:
+        std::vector<T>              _values;
+        ZPromise<std::vector<T> >   _promise;
+    };
+
+template <typename T>
+    class ZFutureAny : public ZFutureJoin<T> {
+    public:
+        explicit ZFutureAny(const std::vector<ZFuture<T> > &futures) : ZFutureJoin<T>(futures) {}
+
+        ZFuture<std::pair<uint32_t, T> > future() const {return _promise.future(); }
+    protected:
+        virtual void value(uint32_t index, const T &v) {_promise.set_value(std::make_pair(index, v) ); }
+        virtual void last() {}
+    private:
+        ZPromise<std::pair<uint32_t, T> >   _promise;   ///< the first set() wins
+    };
+
+template <typename T>
+    ZFuture<std::vector<T> > when_all(const std::vector<ZFuture<T> > &futures) {
+        if (futures.empty() ) {
+            ZPromise<std::vector<T> > p;
+            p.set_value(std::vector<T>() );
+            return p.future();
+        }
+        ZFutureAll<T> *j = new ZFutureAll<T>(futures);
+        ZFuture<std::vector<T> > r = j->future();
+        j->start();
+        return r;
+    }
+
+template <typename T>
+    ZFuture<std::pair<uint32_t, T> > when_any(const std::vector<ZFuture<T> > &futures) {
+        if (futures.empty() ) {
+            return ZPromise<std::pair<uint32_t, T> >().future();
+        }
+        ZFutureAny<T> *j = new ZFutureAny<T>(futures);
+        ZFuture<std::pair<uint32_t, T> > r = j->future();
+        j->start();
+        return r;
+    }
+
+} // namespace z
+
+#endif
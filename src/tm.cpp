@@ -61,6 +61,13 @@ long ztime_length_us(const ztime_t & begin, const ztime_t & end)
          + (end.tv_nsec - begin.tv_nsec) / 1000L;
 }
 
+uint64_t zmonotonic_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000 + ts.tv_nsec / (1000 * 1000);
+}
+
 void zsleep_sec(uint32_t seconds) {
     timeval tm = {seconds, 0};
     select(0, NULL, NULL, NULL, &tm);
@@ -14,6 +14,8 @@ const char * now_utc(char * buf, uint32_t bufsize);
 ztime_t     ztime_now();
 void        ztime_now(ztime_t * t);
 long        ztime_length_us(const ztime_t & begin, const ztime_t & end);
+/// CLOCK_MONOTONIC in ms, for timers and timeouts
+uint64_t    zmonotonic_ms();
 
 void        zsleep_sec(uint32_t seconds);
 void        zsleep_ms(uint32_t  milliseconds);